@@ -458,6 +458,27 @@ public:
 		return m_SubtreeHeaders;
 	}
 
+	///STK: read-only access to the nodes, used to traverse the tree with a batch of rays
+	SIMD_FORCE_INLINE const NodeArray&	getContiguousNodes() const
+	{
+		return m_contiguousNodes;
+	}
+
+	SIMD_FORCE_INLINE const QuantizedNodeArray&	getQuantizedContiguousNodes() const
+	{
+		return m_quantizedContiguousNodes;
+	}
+
+	SIMD_FORCE_INLINE int	getNumNodes() const
+	{
+		return m_curNodeIndex;
+	}
+
+	SIMD_FORCE_INLINE bool	isQuantized() const
+	{
+		return m_useQuantization;
+	}
+
 ////////////////////////////////////////////////////////////////////
 
 	/////Calculate space needed to store BVH for serialization
@@ -485,10 +506,6 @@ public:
 
 ////////////////////////////////////////////////////////////////////
 
-	SIMD_FORCE_INLINE bool isQuantized()
-	{
-		return m_useQuantization;
-	}
 
 private:
 	// Special "copy" constructor that allows for in-place deserialization
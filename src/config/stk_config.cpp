@@ -217,6 +217,7 @@ void STKConfig::init_defaults()
     m_title_music                = NULL;
     m_default_music              = NULL;
     m_solver_split_impulse       = false;
+    m_quantized_bvh              = false;
     m_smooth_normals             = false;
     m_same_powerup_mode          = POWERUP_MODE_ONLY_IF_SAME;
     m_ai_acceleration            = 1.0f;
@@ -323,6 +324,7 @@ void STKConfig::getAllData(const XMLNode * root)
         physics_node->get("fps",                    &m_physics_fps           );
         physics_node->get("solver-iterations",      &m_solver_iterations     );
         physics_node->get("solver-split-impulse",   &m_solver_split_impulse  );
+        physics_node->get("quantized-bvh",          &m_quantized_bvh         );
         physics_node->get("solver-split-impulse-threshold",
                                                &m_solver_split_impulse_thresh);
         std::vector<std::string> solver_modes;
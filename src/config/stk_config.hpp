@@ -115,6 +115,10 @@ public:
     /** If position and velocity constraints are solved separately. */
     bool m_solver_split_impulse;
 
+    /** If the BVH of triangle meshes uses quantized AABB compression, which
+     *  needs about a quarter of the memory. */
+    bool m_quantized_bvh;
+
     /** Threshold when to use the split impulse approach. */
     float m_solver_split_impulse_thresh;
 
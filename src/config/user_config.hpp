@@ -683,6 +683,9 @@ namespace UserConfigParams
     /** If gamepad debugging is enabled. */
     PARAM_PREFIX bool m_unit_testing PARAM_DEFAULT(false);
 
+    /** If the timing of the unit tests is run instead of the unit tests. */
+    PARAM_PREFIX bool m_unit_benchmarks PARAM_DEFAULT(false);
+
     /** If gamepad debugging is enabled. */
     PARAM_PREFIX bool m_gamepad_debug PARAM_DEFAULT( false );
 
@@ -708,6 +711,10 @@ namespace UserConfigParams
     /** True if physics debugging should be enabled. */
     PARAM_PREFIX bool m_physics_debug PARAM_DEFAULT( false );
 
+    /** True if the wheel rays of all karts are cast together against the
+     *  track in each physics step, which gives the same results faster. */
+    PARAM_PREFIX bool m_batched_raycasts PARAM_DEFAULT( true );
+
     /** True if fps should be printed each frame. */
     PARAM_PREFIX bool m_fps_debug PARAM_DEFAULT(false);
 
@@ -742,6 +749,10 @@ namespace UserConfigParams
     /** True if graphical profiler should be displayed */
     PARAM_PREFIX bool m_profiler_enabled  PARAM_DEFAULT( false );
 
+    /** Number of threads to update the AI karts of offline races with,
+     *  -1 to use one per CPU core, 0 to update each kart after the other. */
+    PARAM_PREFIX int m_ai_threads         PARAM_DEFAULT( 0 );
+
     // ---- Networking
     PARAM_PREFIX StringToUIntUserConfigParam m_stun_servers
         PARAM_DEFAULT(StringToUIntUserConfigParam("stun-servers",
@@ -872,6 +883,12 @@ namespace UserConfigParams
     PARAM_PREFIX BoolUserConfigParam        m_cache_overworld
             PARAM_DEFAULT(  BoolUserConfigParam(true, "cache-overworld") );
 
+    PARAM_PREFIX BoolUserConfigParam        m_cache_track_bvh
+            PARAM_DEFAULT(  BoolUserConfigParam(true, "cache-track-bvh",
+            "Save the collision BVH of tracks in the cache directory, so it "
+            "does not need to be built again the next time a track is "
+            "loaded.") );
+
     // TODO : is this used with new code? does it still work?
     PARAM_PREFIX BoolUserConfigParam        m_crashed
             PARAM_DEFAULT(  BoolUserConfigParam(false, "crashed") );
@@ -32,6 +32,7 @@
 #include "graphics/rtts.hpp"
 #include "graphics/shaders.hpp"
 #include "graphics/sp/sp_dynamic_draw_call.hpp"
+#include "graphics/sp/sp_frustum_culling.hpp"
 #include "graphics/sp/sp_instanced_data.hpp"
 #include "graphics/sp/sp_per_object_uniform.hpp"
 #include "graphics/sp/sp_mesh.hpp"
@@ -103,7 +104,7 @@ std::vector<float> g_bounding_boxes;
 // ----------------------------------------------------------------------------
 std::vector<std::shared_ptr<SPDynamicDrawCall> > g_dy_dc;
 // ----------------------------------------------------------------------------
-float g_frustums[5][24] = { { } };
+SPFrustumCulling g_frustum_culling;
 // ----------------------------------------------------------------------------
 unsigned sp_solid_poly_count = 0;
 // ----------------------------------------------------------------------------
@@ -635,65 +636,6 @@ SPShader* getNormalVisualizer()
     return g_normal_visualizer;
 }   // getNormalVisualizer
 
-// ----------------------------------------------------------------------------
-inline void mathPlaneNormf(float *p)
-{
-    float f = 1.0f / sqrtf(p[0] * p[0] + p[1] * p[1] + p[2] * p[2]);
-    p[0] *= f;
-    p[1] *= f;
-    p[2] *= f;
-    p[3] *= f;
-}   // mathPlaneNormf
-
-// ----------------------------------------------------------------------------
-inline void mathPlaneFrustumf(float* out, const core::matrix4& pvm)
-{
-    // return 6 planes, 24 floats
-    const float* m = pvm.pointer();
-
-    // near
-    out[0] = m[3] + m[2];
-    out[1] = m[7] + m[6];
-    out[2] = m[11] + m[10];
-    out[3] = m[15] + m[14];
-    mathPlaneNormf(&out[0]);
-
-    // right
-    out[4] = m[3] - m[0];
-    out[4 + 1] = m[7] - m[4];
-    out[4 + 2] = m[11] - m[8];
-    out[4 + 3] = m[15] - m[12];
-    mathPlaneNormf(&out[4]);
-
-    // left
-    out[2 * 4] = m[3] + m[0];
-    out[2 * 4 + 1] = m[7] + m[4];
-    out[2 * 4 + 2] = m[11] + m[8];
-    out[2 * 4 + 3] = m[15] + m[12];
-    mathPlaneNormf(&out[2 * 4]);
-
-    // bottom
-    out[3 * 4] = m[3] + m[1];
-    out[3 * 4 + 1] = m[7] + m[5];
-    out[3 * 4 + 2] = m[11] + m[9];
-    out[3 * 4 + 3] = m[15] + m[13];
-    mathPlaneNormf(&out[3 * 4]);
-
-    // top
-    out[4 * 4] = m[3] - m[1];
-    out[4 * 4 + 1] = m[7] - m[5];
-    out[4 * 4 + 2] = m[11] - m[9];
-    out[4 * 4 + 3] = m[15] - m[13];
-    mathPlaneNormf(&out[4 * 4]);
-
-    // far
-    out[5 * 4] = m[3] - m[2];
-    out[5 * 4 + 1] = m[7] - m[6];
-    out[5 * 4 + 2] = m[11] - m[10];
-    out[5 * 4 + 3] = m[15] - m[14];
-    mathPlaneNormf(&out[5 * 4]);
-}   // mathPlaneFrustumf
-
 // ----------------------------------------------------------------------------
 inline core::vector3df getCorner(const core::aabbox3df& bbox, unsigned n)
 {
@@ -754,20 +696,20 @@ void prepareDrawCalls()
     // 1st one is identity
     g_skinning_offset = 1;
     g_skinning_mesh.clear();
-    mathPlaneFrustumf(g_frustums[0], irr_driver->getProjViewMatrix());
+    g_frustum_culling.setFrustum(0, irr_driver->getProjViewMatrix());
     g_handle_shadow = Track::getCurrentTrack() &&
         Track::getCurrentTrack()->hasShadows() && CVS->isDeferredEnabled() &&
         CVS->isShadowEnabled();
 
     if (g_handle_shadow)
     {
-        mathPlaneFrustumf(g_frustums[1],
+        g_frustum_culling.setFrustum(1,
             g_stk_sbr->getShadowMatrices()->getSunOrthoMatrices()[0]);
-        mathPlaneFrustumf(g_frustums[2],
+        g_frustum_culling.setFrustum(2,
             g_stk_sbr->getShadowMatrices()->getSunOrthoMatrices()[1]);
-        mathPlaneFrustumf(g_frustums[3],
+        g_frustum_culling.setFrustum(3,
             g_stk_sbr->getShadowMatrices()->getSunOrthoMatrices()[2]);
-        mathPlaneFrustumf(g_frustums[4],
+        g_frustum_culling.setFrustum(4,
             g_stk_sbr->getShadowMatrices()->getSunOrthoMatrices()[3]);
     }
 
@@ -808,39 +750,11 @@ void addObject(SPMeshNode* node)
         }
         core::aabbox3df bb = mb->getBoundingBox();
         model_matrix.transformBoxEx(bb);
-        std::vector<bool> discard;
         const bool handle_shadow = node->isInShadowPass() &&
             g_handle_shadow && shader->hasShader(RP_SHADOW);
-        discard.resize((handle_shadow ? 5 : 1), false);
-
-        for (int dc_type = 0; dc_type < (handle_shadow ? 5 : 1); dc_type++)
-        {
-            for (int i = 0; i < 24; i += 4)
-            {
-                bool outside = true;
-                for (int j = 0; j < 8; j++)
-                {
-                    const float dist =
-                        getCorner(bb, j).X * g_frustums[dc_type][i] +
-                        getCorner(bb, j).Y * g_frustums[dc_type][i + 1] +
-                        getCorner(bb, j).Z * g_frustums[dc_type][i + 2] +
-                        g_frustums[dc_type][i + 3];
-                    outside = outside && dist < 0.0f;
-                    if (!outside)
-                    {
-                        break;
-                    }
-                }
-                if (outside)
-                {
-                    discard[dc_type] = true;
-                    break;
-                }
-            }
-        }
-        if (handle_shadow ?
-            (discard[0] && discard[1] && discard[2] && discard[3] &&
-            discard[4]) : discard[0])
+        const unsigned num_frustums = handle_shadow ? 5 : 1;
+        const uint8_t discard = g_frustum_culling.cull(bb, num_frustums);
+        if (discard == (1 << num_frustums) - 1)
         {
             continue;
         }
@@ -886,9 +800,9 @@ void addObject(SPMeshNode* node)
             node->getTextureMatrix(m)[1], hue,
             (short)node->getSkinningOffset());
 
-        for (int dc_type = 0; dc_type < (handle_shadow ? 5 : 1); dc_type++)
+        for (int dc_type = 0; dc_type < (int)num_frustums; dc_type++)
         {
-            if (discard[dc_type])
+            if ((discard & (1 << dc_type)) != 0)
             {
                 continue;
             }
@@ -978,38 +892,11 @@ void handleDynamicDrawCall()
         SPShader* shader = dydc->getShader();
         core::aabbox3df bb = dydc->getBoundingBox();
         dydc->getAbsoluteTransformation().transformBoxEx(bb);
-        std::vector<bool> discard;
         const bool handle_shadow =
             g_handle_shadow && shader->hasShader(RP_SHADOW);
-        discard.resize((handle_shadow ? 5 : 1), false);
-        for (int dc_type = 0; dc_type < (handle_shadow ? 5 : 1); dc_type++)
-        {
-            for (int i = 0; i < 24; i += 4)
-            {
-                bool outside = true;
-                for (int j = 0; j < 8; j++)
-                {
-                    const float dist =
-                        getCorner(bb, j).X * g_frustums[dc_type][i] +
-                        getCorner(bb, j).Y * g_frustums[dc_type][i + 1] +
-                        getCorner(bb, j).Z * g_frustums[dc_type][i + 2] +
-                        g_frustums[dc_type][i + 3];
-                    outside = outside && dist < 0.0f;
-                    if (!outside)
-                    {
-                        break;
-                    }
-                }
-                if (outside)
-                {
-                    discard[dc_type] = true;
-                    break;
-                }
-            }
-        }
-        if (handle_shadow ?
-            (discard[0] && discard[1] && discard[2] && discard[3] &&
-            discard[4]) : discard[0])
+        const unsigned num_frustums = handle_shadow ? 5 : 1;
+        const uint8_t discard = g_frustum_culling.cull(bb, num_frustums);
+        if (discard == (1 << num_frustums) - 1)
         {
             continue;
         }
@@ -1030,9 +917,9 @@ void handleDynamicDrawCall()
             addEdgeForViz(getCorner(bb, 4), getCorner(bb, 6));
         }
 
-        for (int dc_type = 0; dc_type < (handle_shadow ? 5 : 1); dc_type++)
+        for (int dc_type = 0; dc_type < (int)num_frustums; dc_type++)
         {
-            if (discard[dc_type])
+            if ((discard & (1 << dc_type)) != 0)
             {
                 continue;
             }
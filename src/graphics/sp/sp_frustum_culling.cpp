@@ -0,0 +1,240 @@
+//  SuperTuxKart - a fun racing game with go-kart
+//  Copyright (C) 2020 SuperTuxKart-Team
+//
+//  This program is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU General Public License
+//  as published by the Free Software Foundation; either version 3
+//  of the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+#include "graphics/sp/sp_frustum_culling.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstdlib>
+
+#if __SSE__ || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+ #include <xmmintrin.h>
+ #define SIMD_SSE_SUPPORT (1)
+#endif
+
+namespace SP
+{
+
+// ----------------------------------------------------------------------------
+SPFrustumCulling::SPFrustumCulling()
+{
+    // A plane with normal 0 and positive distance never culls a box
+    for (unsigned i = 0; i < MAX_FRUSTUMS * PLANES_PER_FRUSTUM; i++)
+    {
+        m_normal_x[i] = m_normal_y[i] = m_normal_z[i] = 0.0f;
+        m_distance[i] = 1.0f;
+    }
+}   // SPFrustumCulling
+
+// ----------------------------------------------------------------------------
+/** Sets the 6 planes of a frustum.
+ *  \param n Index of the frustum, 0 is the camera, 1-4 the shadow cascades.
+ *  \param pvm The projection view matrix of the frustum.
+ */
+void SPFrustumCulling::setFrustum(unsigned n, const core::matrix4& pvm)
+{
+    assert(n < MAX_FRUSTUMS);
+    const float* m = pvm.pointer();
+    // near, right, left, bottom, top, far
+    const int column[6] = { 2, 0, 0, 1, 1, 2 };
+    const float sign[6] = { 1.0f, -1.0f, 1.0f, 1.0f, -1.0f, -1.0f };
+    for (unsigned i = 0; i < 6; i++)
+    {
+        float p[4];
+        for (unsigned j = 0; j < 4; j++)
+        {
+            const float a = m[j * 4 + 3];
+            const float b = m[j * 4 + column[i]];
+            p[j] = sign[i] > 0.0f ? a + b : a - b;
+        }
+        const float f = 1.0f / sqrtf(p[0] * p[0] + p[1] * p[1] + p[2] * p[2]);
+        const unsigned index = n * PLANES_PER_FRUSTUM + i;
+        m_normal_x[index] = p[0] * f;
+        m_normal_y[index] = p[1] * f;
+        m_normal_z[index] = p[2] * f;
+        m_distance[index] = p[3] * f;
+    }
+}   // setFrustum
+
+// ----------------------------------------------------------------------------
+/** Tests a box against the first frustums.
+ *  \param bb The box in world space.
+ *  \param num_frustums Number of frustums to test.
+ *  \return A mask with bit n set if the box is outside of frustum n.
+ */
+uint8_t SPFrustumCulling::cull(const core::aabbox3df& bb,
+                               unsigned num_frustums) const
+{
+    assert(num_frustums <= MAX_FRUSTUMS);
+    uint8_t culled = 0;
+#ifdef SIMD_SSE_SUPPORT
+    const __m128 min_x = _mm_set1_ps(bb.MinEdge.X);
+    const __m128 min_y = _mm_set1_ps(bb.MinEdge.Y);
+    const __m128 min_z = _mm_set1_ps(bb.MinEdge.Z);
+    const __m128 max_x = _mm_set1_ps(bb.MaxEdge.X);
+    const __m128 max_y = _mm_set1_ps(bb.MaxEdge.Y);
+    const __m128 max_z = _mm_set1_ps(bb.MaxEdge.Z);
+    const __m128 zero = _mm_setzero_ps();
+    for (unsigned n = 0; n < num_frustums; n++)
+    {
+        int outside = 0;
+        for (unsigned i = n * PLANES_PER_FRUSTUM;
+             i < (n + 1) * PLANES_PER_FRUSTUM; i += 4)
+        {
+            // The product with the furthest corner is the larger one of
+            // the products with the min and max edge (also after rounding)
+            const __m128 nx = _mm_load_ps(m_normal_x + i);
+            const __m128 ny = _mm_load_ps(m_normal_y + i);
+            const __m128 nz = _mm_load_ps(m_normal_z + i);
+            const __m128 dx = _mm_max_ps(_mm_mul_ps(min_x, nx),
+                                         _mm_mul_ps(max_x, nx));
+            const __m128 dy = _mm_max_ps(_mm_mul_ps(min_y, ny),
+                                         _mm_mul_ps(max_y, ny));
+            const __m128 dz = _mm_max_ps(_mm_mul_ps(min_z, nz),
+                                         _mm_mul_ps(max_z, nz));
+            const __m128 dist = _mm_add_ps(_mm_add_ps(_mm_add_ps(dx, dy), dz),
+                                           _mm_load_ps(m_distance + i));
+            outside |= _mm_movemask_ps(_mm_cmplt_ps(dist, zero));
+        }
+        if (outside != 0)
+            culled |= 1 << n;
+    }
+#else
+    for (unsigned n = 0; n < num_frustums; n++)
+    {
+        for (unsigned i = n * PLANES_PER_FRUSTUM;
+             i < n * PLANES_PER_FRUSTUM + 6; i++)
+        {
+            const float dist =
+                std::max(bb.MinEdge.X * m_normal_x[i],
+                         bb.MaxEdge.X * m_normal_x[i]) +
+                std::max(bb.MinEdge.Y * m_normal_y[i],
+                         bb.MaxEdge.Y * m_normal_y[i]) +
+                std::max(bb.MinEdge.Z * m_normal_z[i],
+                         bb.MaxEdge.Z * m_normal_z[i]) +
+                m_distance[i];
+            if (dist < 0.0f)
+            {
+                culled |= 1 << n;
+                break;
+            }
+        }
+    }
+#endif
+    return culled;
+}   // cull
+
+// ----------------------------------------------------------------------------
+/** Tests a box against the first frustums by testing each corner against
+ *  each plane. Slower than cull, used to test it.
+ */
+uint8_t SPFrustumCulling::cullCorners(const core::aabbox3df& bb,
+                                      unsigned num_frustums) const
+{
+    // Not aabbox3df::getEdges, which rounds the corners differently
+    core::vector3df corners[8];
+    for (unsigned j = 0; j < 8; j++)
+    {
+        corners[j].X = j & 1 ? bb.MaxEdge.X : bb.MinEdge.X;
+        corners[j].Y = j & 2 ? bb.MaxEdge.Y : bb.MinEdge.Y;
+        corners[j].Z = j & 4 ? bb.MaxEdge.Z : bb.MinEdge.Z;
+    }
+    uint8_t culled = 0;
+    for (unsigned n = 0; n < num_frustums; n++)
+    {
+        for (unsigned i = n * PLANES_PER_FRUSTUM;
+             i < n * PLANES_PER_FRUSTUM + 6; i++)
+        {
+            bool outside = true;
+            for (unsigned j = 0; j < 8 && outside; j++)
+            {
+                const float dist = corners[j].X * m_normal_x[i] +
+                    corners[j].Y * m_normal_y[i] +
+                    corners[j].Z * m_normal_z[i] + m_distance[i];
+                outside = dist < 0.0f;
+            }
+            if (outside)
+            {
+                culled |= 1 << n;
+                break;
+            }
+        }
+    }
+    return culled;
+}   // cullCorners
+
+// ----------------------------------------------------------------------------
+void SPFrustumCulling::unitTesting()
+{
+    SPFrustumCulling fc;
+    core::matrix4 projection, view;
+    projection.buildProjectionMatrixPerspectiveFovLH(1.0f, 1.5f, 1.0f,
+                                                     100.0f);
+    view.buildCameraLookAtMatrixLH(core::vector3df(0, 0, 0),
+                                   core::vector3df(0, 0, 1),
+                                   core::vector3df(0, 1, 0));
+    fc.setFrustum(0, projection * view);
+
+    // Boxes in front of, behind and beside the camera
+    core::aabbox3df front(-1, -1, 10, 1, 1, 12);
+    core::aabbox3df behind(-1, -1, -12, 1, 1, -10);
+    core::aabbox3df beside(100, -1, 10, 102, 1, 12);
+    core::aabbox3df far_away(-1, -1, 200, 1, 1, 202);
+    core::aabbox3df around(-1000, -1000, -1000, 1000, 1000, 1000);
+    assert(fc.cull(front, 1) == 0);
+    assert(fc.cull(behind, 1) == 1);
+    assert(fc.cull(beside, 1) == 1);
+    assert(fc.cull(far_away, 1) == 1);
+    assert(fc.cull(around, 1) == 0);
+
+    // Orthographic shadow cascades along the y axis
+    for (unsigned n = 1; n < MAX_FRUSTUMS; n++)
+    {
+        core::matrix4 ortho, sun;
+        ortho.buildProjectionMatrixOrthoLH(20.0f * n, 20.0f * n, 1.0f,
+                                           500.0f);
+        sun.buildCameraLookAtMatrixLH(core::vector3df(0, 100, 0),
+                                      core::vector3df(0, 0, 0),
+                                      core::vector3df(0, 0, 1));
+        fc.setFrustum(n, ortho * sun);
+    }
+    // Only the larger cascades contain a box far from the sun
+    core::aabbox3df outer(25, -1, 25, 27, 1, 27);
+    assert(fc.cull(front, MAX_FRUSTUMS) == 0);
+    assert(fc.cull(outer, MAX_FRUSTUMS) == 0x07);
+    assert(fc.cull(around, MAX_FRUSTUMS) == 0);
+    assert(fc.cull(far_away, MAX_FRUSTUMS) == 0x1f);
+
+    // The results must be identical to testing all corners
+    srand(42);
+    for (unsigned i = 0; i < 100000; i++)
+    {
+        core::vector3df center((rand() % 4001 - 2000) / 10.0f,
+                               (rand() % 4001 - 2000) / 10.0f,
+                               (rand() % 4001 - 2000) / 10.0f);
+        core::vector3df extent((rand() % 501) / 10.0f,
+                               (rand() % 501) / 10.0f,
+                               (rand() % 501) / 10.0f);
+        core::aabbox3df bb(center - extent, center + extent);
+        assert(fc.cull(bb, MAX_FRUSTUMS) ==
+               fc.cullCorners(bb, MAX_FRUSTUMS));
+        assert(fc.cull(bb, 1) == fc.cullCorners(bb, 1));
+    }
+}   // unitTesting
+
+}
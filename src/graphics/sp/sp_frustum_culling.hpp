@@ -0,0 +1,66 @@
+//  SuperTuxKart - a fun racing game with go-kart
+//  Copyright (C) 2020 SuperTuxKart-Team
+//
+//  This program is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU General Public License
+//  as published by the Free Software Foundation; either version 3
+//  of the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+#ifndef HEADER_SP_FRUSTUM_CULLING_HPP
+#define HEADER_SP_FRUSTUM_CULLING_HPP
+
+#include "aabbox3d.h"
+#include "matrix4.h"
+
+#include <cstdint>
+
+using namespace irr;
+
+namespace SP
+{
+
+/** Culls bounding boxes against the frustums of the camera and the shadow
+ *  cascades. The planes of all frustums are stored as structure of arrays,
+ *  so that a box is tested against 4 planes at once (with SSE if
+ *  available). A box is outside of a plane if the corner furthest along the
+ *  plane normal is behind it, which gives the same results as testing all
+ *  8 corners of the box one at a time.
+ */
+class SPFrustumCulling
+{
+public:
+    /** The camera frustum and the 4 shadow cascades. */
+    static const unsigned MAX_FRUSTUMS = 5;
+
+private:
+    /** Planes stored for each frustum: the 6 planes of it followed by 2
+     *  planes which never cull a box, so that each frustum uses 2 SIMD
+     *  registers. */
+    static const unsigned PLANES_PER_FRUSTUM = 8;
+
+    alignas(16) float m_normal_x[MAX_FRUSTUMS * PLANES_PER_FRUSTUM];
+    alignas(16) float m_normal_y[MAX_FRUSTUMS * PLANES_PER_FRUSTUM];
+    alignas(16) float m_normal_z[MAX_FRUSTUMS * PLANES_PER_FRUSTUM];
+    alignas(16) float m_distance[MAX_FRUSTUMS * PLANES_PER_FRUSTUM];
+
+public:
+    SPFrustumCulling();
+    void setFrustum(unsigned n, const core::matrix4& pvm);
+    uint8_t cull(const core::aabbox3df& bb, unsigned num_frustums) const;
+    uint8_t cullCorners(const core::aabbox3df& bb,
+                        unsigned num_frustums) const;
+    static void unitTesting();
+};   // SPFrustumCulling
+
+}
+
+#endif
@@ -172,6 +172,13 @@ public:
         return false;
     }   // hitKart
 
+    // -----------------------------------------------------------------------
+    virtual float getMaxHitDistance() const
+    {
+        Log::fatal("ItemState", "getMaxHitDistance() called for ItemState.");
+        return 0;
+    }   // getMaxHitDistance
+
     // -----------------------------------------------------------------------
     virtual int getGraphNode() const 
     {
@@ -407,6 +414,14 @@ public:
     /** Returns the index of the graph node this item is on. */
     virtual int getGraphNode() const OVERRIDE { return m_graph_node; }
     // ------------------------------------------------------------------------
+    /** Returns the largest distance from the item at which hitKart can return
+     *  true. Since the height is halved in hitKart, this is twice the
+     *  collection distance. */
+    virtual float getMaxHitDistance() const OVERRIDE
+    {
+        return 2.0f * sqrtf(m_distance_2);
+    }   // getMaxHitDistance
+    // ------------------------------------------------------------------------
     /** Returns the distance from center: negative means left of center,
      *  positive means right of center. */
     virtual float getDistanceFromCenter() const OVERRIDE
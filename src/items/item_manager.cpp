@@ -38,6 +38,7 @@
 #include <IMesh.h>
 #include <IAnimatedMesh.h>
 
+#include <algorithm>
 #include <assert.h>
 #include <stdexcept>
 #include <sstream>
@@ -165,6 +166,7 @@ void ItemManager::removeTextures()
 ItemManager::ItemManager()
 {
     m_switch_ticks = -1;
+    m_item_hash_dirty = true;
     // The actual loading is done in loadDefaultItems
 
     // Prepare the switch to array, which stores which item should be
@@ -251,6 +253,7 @@ unsigned int ItemManager::insertItem(Item *item)
  */
 void ItemManager::insertItemInQuad(Item *item)
 {
+    m_item_hash_dirty = true;
     if(m_items_in_quads)
     {
         int graph_node = item->getGraphNode();
@@ -380,14 +383,11 @@ void ItemManager::collectedItem(ItemState *item, AbstractKart *kart)
  */
 void  ItemManager::checkItemHit(AbstractKart* kart)
 {
-    // We could use m_items_in_quads to to check for item hits: take the quad
-    // of the graph node of the kart, and only check items in that quad. But
-    // then we also need to check for any adjacent quads (since an item just
-    // on the order of one quad might get hit from an adjacent quad). Then
-    // it is possible that a quad is that short that we need to test adjacent
-    // of adjacent quads. And check for items outside of the track.
-    // Since at this stace item detection is by far not a bottle neck,
-    // the original, simple and stable algorithm is left in place.
+    // Using m_items_in_quads would require to also check adjacent quads
+    // (and adjacent of adjacent quads for short quads), and items outside
+    // of the track. So a separate grid is used to find the items close to
+    // the kart. They are tested in the order of m_all_items, so the result
+    // is the same as when testing all items.
 
     /** Disable item collection detection for debug purposes. */
     if(m_disable_item_collection) return;
@@ -395,9 +395,13 @@ void  ItemManager::checkItemHit(AbstractKart* kart)
     // Spare tire karts don't collect items
     if ( dynamic_cast<SpareTireAI*>(kart->getController()) ) return;
 
-    for(AllItemTypes::iterator i =m_all_items.begin();
-                               i!=m_all_items.end();  i++)
+    if (m_item_hash_dirty)
+        updateItemHash();
+    m_item_hash.getCandidates(kart->getXYZ(), &m_hit_candidates);
+
+    for (unsigned int index : m_hit_candidates)
     {
+        AllItemTypes::iterator i = m_all_items.begin() + index;
         // Ignore items that have been collected or are not available atm
         if ((!*i) || !(*i)->isAvailable() || (*i)->isUsedUp()) continue;
 
@@ -416,9 +420,34 @@ void  ItemManager::checkItemHit(AbstractKart* kart)
         {
             collectedItem(*i, kart);
         }   // if hit
-    }   // for m_all_items
+    }   // for m_hit_candidates
 }   // checkItemHit
 
+//-----------------------------------------------------------------------------
+/** Rebuilds the grid used in checkItemHit from all items.
+ */
+void ItemManager::updateItemHash()
+{
+    float max_hit_distance = 1.0f;
+    for (ItemState* item : m_all_items)
+    {
+        if (item)
+        {
+            max_hit_distance = std::max(max_hit_distance,
+                                        item->getMaxHitDistance());
+        }
+    }
+    // Make the cells a bit larger to be safe against rounding errors
+    m_item_hash.clear(max_hit_distance * 1.01f);
+    for (unsigned int i = 0; i < m_all_items.size(); i++)
+    {
+        if (m_all_items[i])
+            m_item_hash.addItem(m_all_items[i]->getXYZ(), i);
+    }
+    m_item_hash.finishAdding();
+    m_item_hash_dirty = false;
+}   // updateItemHash
+
 //-----------------------------------------------------------------------------
 /** Resets all items and removes bubble gum that is stuck on the track.
  *  This is done when a race is (re)started.
@@ -532,6 +561,7 @@ void ItemManager::deleteItem(ItemState *item)
  */
 void ItemManager::deleteItemInQuad(ItemState* item)
 {
+    m_item_hash_dirty = true;
     if(m_items_in_quads)
     {
         int sector = item->getGraphNode();
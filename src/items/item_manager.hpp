@@ -22,6 +22,7 @@
 #include "LinearMath/btTransform.h"
 
 #include "items/item.hpp"
+#include "items/item_spatial_hash.hpp"
 #include "utils/aligned_array.hpp"
 #include "utils/no_copy.hpp"
 #include "utils/vec3.hpp"
@@ -110,6 +111,14 @@ private:
      *  field is undefined if no Graph exist, e.g. arena without navmesh. */
     std::vector< AllItemTypes > *m_items_in_quads;
 
+    /** Grid of all items, used to only test items close to a kart in
+     *  checkItemHit. */
+    ItemSpatialHash m_item_hash;
+
+    /** Used in checkItemHit to store the items close to a kart, to avoid
+     *  allocating memory for each kart. */
+    std::vector<unsigned int> m_hit_candidates;
+
     /** Stores all item models. */
     static std::vector<scene::IMesh *> m_item_mesh;
 
@@ -121,12 +130,17 @@ protected:
      *  value is <0, it indicates that the items are not switched atm. */
     int m_switch_ticks;
 
+    /** Set when items are added or removed (or might have been moved, e.g.
+     *  by a rewind), so that m_item_hash needs to be rebuilt. */
+    bool m_item_hash_dirty;
+
     void deleteItem(ItemState *item);
     virtual unsigned int insertItem(Item *item);
     void switchItemsInternal(std::vector < ItemState*> &all_items);
     void setSwitchItems(const std::vector<int> &switch_items);
     void insertItemInQuad(Item *item);
     void deleteItemInQuad(ItemState *item);
+    void updateItemHash();
              ItemManager();
 public:
     virtual ~ItemManager();
@@ -0,0 +1,204 @@
+//
+//  SuperTuxKart - a fun racing game with go-kart
+//  Copyright (C) 2020 SuperTuxKart-Team
+//
+//  This program is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU General Public License
+//  as published by the Free Software Foundation; either version 3
+//  of the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+#include "items/item_spatial_hash.hpp"
+
+#include "utils/log.hpp"
+#include "utils/vec3.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <random>
+
+// ----------------------------------------------------------------------------
+ItemSpatialHash::ItemSpatialHash()
+{
+    m_cell_size = 1.0f;
+}   // ItemSpatialHash
+
+// ----------------------------------------------------------------------------
+/** Removes all items.
+ *  \param cell_size Size of a cell, must be at least the largest distance
+ *         at which any of the items added afterwards can be hit.
+ */
+void ItemSpatialHash::clear(float cell_size)
+{
+    m_cell_size = cell_size;
+    m_entries.clear();
+    m_other_items.clear();
+}   // clear
+
+// ----------------------------------------------------------------------------
+/** Computes the cell of a position. Coordinates are clamped, so that the
+ *  conversion to int is always defined.
+ *  \return False if the position has no cell (NAN).
+ */
+bool ItemSpatialHash::getCell(const Vec3 &xyz, int *x, int *z) const
+{
+    float fx = xyz.getX() / m_cell_size;
+    float fz = xyz.getZ() / m_cell_size;
+    if (std::isnan(fx) || std::isnan(fz))
+        return false;
+    *x = (int)floorf(std::max(-1.0e9f, std::min(1.0e9f, fx)));
+    *z = (int)floorf(std::max(-1.0e9f, std::min(1.0e9f, fz)));
+    return true;
+}   // getCell
+
+// ----------------------------------------------------------------------------
+/** Adds an item. finishAdding must be called after all items are added. */
+void ItemSpatialHash::addItem(const Vec3 &xyz, unsigned int index)
+{
+    int x, z;
+    if (getCell(xyz, &x, &z))
+        m_entries.emplace_back(getKey(x, z), index);
+    else
+        m_other_items.push_back(index);
+}   // addItem
+
+// ----------------------------------------------------------------------------
+void ItemSpatialHash::finishAdding()
+{
+    std::sort(m_entries.begin(), m_entries.end());
+}   // finishAdding
+
+// ----------------------------------------------------------------------------
+/** Returns the indices of all items which might be hit by a kart at the
+ *  given position, sorted in increasing order.
+ *  \param xyz Position of the kart.
+ *  \param candidates Vector the indices are stored in (it is cleared).
+ */
+void ItemSpatialHash::getCandidates(const Vec3 &xyz,
+                                    std::vector<unsigned int> *candidates) const
+{
+    candidates->clear();
+    int x, z;
+    if (getCell(xyz, &x, &z))
+    {
+        for (int dx = -1; dx <= 1; dx++)
+        {
+            for (int dz = -1; dz <= 1; dz++)
+            {
+                const uint64_t key = getKey(x + dx, z + dz);
+                auto it = std::lower_bound(m_entries.begin(), m_entries.end(),
+                    std::make_pair(key, 0u));
+                for (; it != m_entries.end() && it->first == key; it++)
+                    candidates->push_back(it->second);
+            }
+        }
+    }
+    else
+    {
+        // Without a cell the kart can't hit any item anyway, but test all
+        // to be on the safe side
+        for (auto &entry : m_entries)
+            candidates->push_back(entry.second);
+    }
+    candidates->insert(candidates->end(), m_other_items.begin(),
+                       m_other_items.end());
+    std::sort(candidates->begin(), candidates->end());
+}   // getCandidates
+
+// ----------------------------------------------------------------------------
+/** Replays karts driving through a field of randomly placed and rotated
+ *  items, and checks that for every position the items hit (using the same
+ *  test as Item::hitKart) are the same as when testing all items.
+ */
+void ItemSpatialHash::unitTesting()
+{
+    std::mt19937 random(42);
+    auto uniform = [&random](float min, float max)
+    {
+        return std::uniform_real_distribution<float>(min, max)(random);
+    };
+
+    const float distance_2 = 1.2f;
+    const float max_hit_distance = 2.0f * sqrtf(distance_2);
+    std::vector<Vec3> xyz;
+    std::vector<btQuaternion> rotation;
+    for (unsigned int i = 0; i < 500; i++)
+    {
+        // Place groups of items like on a track, some of them close to or
+        // on cell borders and some of them tilted.
+        Vec3 center(uniform(-200.0f, 200.0f), uniform(-5.0f, 5.0f),
+                    uniform(-200.0f, 200.0f));
+        if (i % 10 == 0)
+            center.setX(floorf(center.getX() / max_hit_distance) *
+                        max_hit_distance);
+        for (unsigned int j = 0; j < 4; j++)
+        {
+            xyz.push_back(center + Vec3(j * 1.5f, 0, 0));
+            rotation.push_back(btQuaternion(Vec3(uniform(-1, 1), 1,
+                uniform(-1, 1)).normalize(), uniform(0, 6.28f)));
+        }
+    }
+
+    ItemSpatialHash hash;
+    hash.clear(max_hit_distance);
+    for (unsigned int i = 0; i < xyz.size(); i++)
+        hash.addItem(xyz[i], i);
+    hash.finishAdding();
+
+    auto hit = [&](const Vec3 &kart_xyz, unsigned int i)
+    {
+        Vec3 lc = quatRotate(rotation[i], kart_xyz - xyz[i]);
+        lc.setY(lc.getY() / 2.0f);
+        return lc.length2() < distance_2;
+    };
+
+    std::vector<unsigned int> candidates;
+    unsigned int num_hits = 0;
+    for (unsigned int kart = 0; kart < 20; kart++)
+    {
+        // Each kart drives towards a random item, and then on to the next
+        Vec3 kart_xyz(uniform(-200.0f, 200.0f), 0, uniform(-200.0f, 200.0f));
+        for (unsigned int target = 0; target < 20; target++)
+        {
+            Vec3 goal = xyz[random() % xyz.size()] +
+                Vec3(uniform(-1, 1), uniform(-2, 2), uniform(-1, 1));
+            Vec3 step = (goal - kart_xyz) / 300.0f;
+            for (unsigned int tick = 0; tick < 300; tick++)
+            {
+                kart_xyz += step;
+                std::vector<unsigned int> expected;
+                for (unsigned int i = 0; i < xyz.size(); i++)
+                {
+                    if (hit(kart_xyz, i))
+                        expected.push_back(i);
+                }
+                hash.getCandidates(kart_xyz, &candidates);
+                std::vector<unsigned int> found;
+                for (unsigned int i : candidates)
+                {
+                    if (hit(kart_xyz, i))
+                        found.push_back(i);
+                }
+                if (found != expected)
+                {
+                    Log::fatal("ItemSpatialHash", "Different items hit at "
+                        "%f %f %f: %d instead of %d.", kart_xyz.getX(),
+                        kart_xyz.getY(), kart_xyz.getZ(), (int)found.size(),
+                        (int)expected.size());
+                }
+                num_hits += (unsigned int)found.size();
+            }
+        }
+    }
+    // Make sure that the test actually tests something
+    if (num_hits == 0)
+        Log::fatal("ItemSpatialHash", "No items were hit.");
+}   // unitTesting
@@ -0,0 +1,68 @@
+//
+//  SuperTuxKart - a fun racing game with go-kart
+//  Copyright (C) 2020 SuperTuxKart-Team
+//
+//  This program is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU General Public License
+//  as published by the Free Software Foundation; either version 3
+//  of the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+#ifndef HEADER_ITEM_SPATIAL_HASH_HPP
+#define HEADER_ITEM_SPATIAL_HASH_HPP
+
+#include <stdint.h>
+#include <utility>
+#include <vector>
+
+class Vec3;
+
+/** A uniform grid over the x/z plane, used by the ItemManager to only test
+ *  the items close to a kart for a hit. Each item is stored in the cell of
+ *  its position, and the cell size is at least the largest distance at
+ *  which an item can be hit, so that all items a kart can hit are in the
+ *  3x3 cells around the kart. The (sparse) cells are stored as a sorted
+ *  array of (cell, item index) pairs, which is rebuilt when items change.
+ *  \ingroup items
+ */
+class ItemSpatialHash
+{
+private:
+    /** Size of a cell. */
+    float m_cell_size;
+
+    /** All (cell key, item index) pairs, sorted. */
+    std::vector<std::pair<uint64_t, unsigned int> > m_entries;
+
+    /** Items at a position which can not be mapped to a cell (NAN),
+     *  they are returned for every position. */
+    std::vector<unsigned int> m_other_items;
+
+    // ------------------------------------------------------------------------
+    bool getCell(const Vec3 &xyz, int *x, int *z) const;
+    // ------------------------------------------------------------------------
+    /** Returns the key used to sort the entries of a cell. */
+    static uint64_t getKey(int x, int z)
+    {
+        return ((uint64_t)(uint32_t)x << 32) | (uint64_t)(uint32_t)z;
+    }   // getKey
+
+public:
+    ItemSpatialHash();
+    void clear(float cell_size);
+    void addItem(const Vec3 &xyz, unsigned int index);
+    void finishAdding();
+    void getCandidates(const Vec3 &xyz,
+                       std::vector<unsigned int> *candidates) const;
+    static void unitTesting();
+};   // ItemSpatialHash
+
+#endif
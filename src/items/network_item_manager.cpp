@@ -223,29 +223,19 @@ void NetworkItemManager::setItemConfirmationTime(std::weak_ptr<STKPeer> peer,
  *  to save the initial state, which is the first confirmed state by all
  *  clients.
  */
-BareNetworkString* NetworkItemManager::saveState(std::vector<std::string>* ru)
+bool NetworkItemManager::saveState(BareNetworkString* buffer,
+                                   std::vector<std::string>* ru)
 {
     ru->push_back(getUniqueIdentity());
     // On the server:
     // ==============
     m_item_events.lock();
-    uint16_t n = (uint16_t)m_item_events.getData().size();
-    if(n==0)
+    for (auto& p : m_item_events.getData())
     {
-        BareNetworkString *s = new BareNetworkString();
-        m_item_events.unlock();
-        return s;
-    }
-
-    BareNetworkString *s =
-        new BareNetworkString(n * (  sizeof(int) + sizeof(uint16_t)
-                                   + sizeof(uint8_t)              ) );
-    for (auto p : m_item_events.getData())
-    {
-        p.saveState(s);
+        p.saveState(buffer);
     }
     m_item_events.unlock();
-    return s;
+    return true;
 }   // saveState
 
 //-----------------------------------------------------------------------------
@@ -511,6 +501,8 @@ void NetworkItemManager::restoreState(BareNetworkString *buffer, int count)
     }   // for i < max_index
     // Clean up the rest
     m_all_items.resize(m_confirmed_state.size());
+    // Copying the confirmed states can change the position of items
+    m_item_hash_dirty = true;
 
     // Now set the clock back to the 'rewindto' time:
     world->setTicksForRewind(rewind_to_time);
@@ -526,6 +518,9 @@ void NetworkItemManager::restoreState(BareNetworkString *buffer, int count)
 void NetworkItemManager::saveCompleteState(BareNetworkString* buffer) const
 {
     const uint32_t all_items = (uint32_t)m_all_items.size();
+    // 12 bytes header and at most 48 bytes for each item (see
+    // ItemState::saveCompleteState), to avoid growing the buffer many times
+    buffer->getBuffer().reserve(buffer->getTotalSize() + 12 + all_items * 48);
     buffer->addUInt32(World::getWorld()->getTicksSinceStart())
         .addUInt32(m_switch_ticks).addUInt32(all_items);
     for (unsigned i = 0; i < all_items; i++)
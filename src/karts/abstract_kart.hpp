@@ -273,6 +273,12 @@ public:
     // ------------------------------------------------------------------------
     virtual void finishedRace(float time, bool from_server=false) = 0;
     // ------------------------------------------------------------------------
+    /** Does the part of update() before the controller is updated, so that
+     *  World can update the controllers of all karts together afterwards.
+     *  Returns false if the kart does not support this, then update() must
+     *  do all of it. */
+    virtual bool updateBeforeController(int ticks) { return false; }
+    // ------------------------------------------------------------------------
     /** Returns the finished time for a kart. */
     virtual float getFinishTime() const = 0;
     // ------------------------------------------------------------------------
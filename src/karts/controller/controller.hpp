@@ -115,6 +115,19 @@ public:
     // ------------------------------------------------------------------------
     /** Returns the kart controlled by this controller. */
     AbstractKart *getKart() const { return m_kart; }
+    // ------------------------------------------------------------------------
+    /** Returns true if updateInParallel() only reads the world and modifies
+     *  this controller, its kart and its kart controls, so that it can be
+     *  called for several karts at the same time. */
+    virtual bool  canUpdateInParallel() const { return false; }
+    // ------------------------------------------------------------------------
+    /** Updates the controller on a thread of the kart update pool. Anything
+     *  that changes other objects must be done in finishParallelUpdate(). */
+    virtual void  updateInParallel(int ticks) { update(ticks); }
+    // ------------------------------------------------------------------------
+    /** Called on the main thread after updateInParallel() was called for
+     *  all karts, in the order of the karts in the world. */
+    virtual void  finishParallelUpdate() {}
 };   // Controller
 
 #endif
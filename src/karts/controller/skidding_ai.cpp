@@ -176,6 +176,12 @@ void SkiddingAI::reset()
     m_skid_probability_state     = SKID_PROBAB_NOT_YET;
     m_last_item_random           = NULL;
     m_burster                    = false;
+    m_defer_rescue               = false;
+    m_rescue_pending             = false;
+    m_own_random = World::getWorld() &&
+                   World::getWorld()->updatesKartsInParallel();
+    if (m_own_random)
+        m_random.seed(rand());
 
     AIBaseLapController::reset();
     m_track_node               = Graph::UNKNOWN_SECTOR;
@@ -238,7 +244,7 @@ void SkiddingAI::update(int ticks)
         {
             if (m_kart->getPosition() > 1)
             {
-                int r = rand() % 5;
+                int r = getRandom(5);
                 if (r == 0 || r == 1)
                     m_kart->setPowerup(PowerupManager::POWERUP_ZIPPER, 1);
                 else if (r == 2 || r == 3)
@@ -248,7 +254,7 @@ void SkiddingAI::update(int ticks)
             }
             else if (m_kart->getAttachment()->getType() == Attachment::ATTACH_SWATTER)
             {
-                int r = rand() % 4;
+                int r = getRandom(4);
                 if (r < 3)
                     m_kart->setPowerup(PowerupManager::POWERUP_BUBBLEGUM, 1);
                 else
@@ -256,7 +262,7 @@ void SkiddingAI::update(int ticks)
             }
             else
             {
-                int r = rand() % 5;
+                int r = getRandom(5);
                 if (r == 0 || r == 1)
                     m_kart->setPowerup(PowerupManager::POWERUP_BUBBLEGUM, 1);
                 else if (r == 2 || r == 3)
@@ -296,11 +302,7 @@ void SkiddingAI::update(int ticks)
     // If the kart needs to be rescued, do it now (and nothing else)
     if(isStuck() && !m_kart->getKartAnimation())
     {
-        // For network AI controller
-        if (m_enabled_network_ai)
-            m_controls->setRescue(true);
-        else
-            RescueAnimation::create(m_kart);
+        rescueKart();
         AIBaseLapController::update(ticks);
         return;
     }
@@ -660,7 +662,7 @@ void SkiddingAI::handleItemCollectionAndAvoidance(Vec3 *aim_point,
         {
             int p = (int)(100.0f*m_ai_properties->
                           getItemCollectProbability(m_distance_to_player));
-            m_really_collect_item = m_random_collect_item.get(100)<p;
+            m_really_collect_item = getRandom(100, &m_random_collect_item)<p;
             m_last_item_random = items_to_collect[0];
         }
         if(!m_really_collect_item)
@@ -1099,7 +1101,7 @@ void SkiddingAI::handleItems(const float dt, const Vec3 *aim_point, int last_nod
             else
             {
                 // to make things less predictable :)
-                m_time_since_last_shot = (rand() % 1000) / 1000.0f * 3.0f - 2.0f;
+                m_time_since_last_shot = getRandom(1000) / 1000.0f * 3.0f - 2.0f;
             }
         }
         else
@@ -1121,7 +1123,7 @@ void SkiddingAI::handleItems(const float dt, const Vec3 *aim_point, int last_nod
     if(item_skill == 1)
     {
         int random_t = 0;
-        random_t = m_random_skid.get(6); //Reuse the random skid generator
+        random_t = getRandom(6, &m_random_skid); //Reuse the random skid generator
         random_t = random_t + 5;
           
         if( m_time_since_last_shot > random_t )
@@ -2120,18 +2122,22 @@ void SkiddingAI::handleRaceStart()
         }
         // Each kart starts at a different, random time, and the time is
         // smaller depending on the difficulty.
+        float r = m_own_random ? (float) m_random() / m_random.max()
+                               : (float) rand() / RAND_MAX;
         m_start_delay = stk_config->time2Ticks(
                         m_ai_properties->m_min_start_delay
-                      + (float) rand() / RAND_MAX
-                      * (m_ai_properties->m_max_start_delay -
-                         m_ai_properties->m_min_start_delay)   );
+                      + r * (m_ai_properties->m_max_start_delay -
+                             m_ai_properties->m_min_start_delay)   );
 
         float false_start_probability =
                m_superpower == RaceManager::SUPERPOWER_NOLOK_BOSS
                ? 0.0f  : m_ai_properties->m_false_start_probability;
 
         // Now check for a false start. If so, add 1 second penalty time.
-        if (rand() < RAND_MAX * false_start_probability)
+        bool false_start = m_own_random
+                         ? m_random() < m_random.max() * false_start_probability
+                         : rand() < RAND_MAX * false_start_probability;
+        if (false_start)
         {
             m_start_delay+=stk_config->m_penalty_ticks;
             return;
@@ -2155,11 +2161,7 @@ void SkiddingAI::handleRescue(const float dt)
         m_time_since_stuck += dt;
         if(m_time_since_stuck > 2.0f)
         {
-            // For network AI controller
-            if (m_enabled_network_ai)
-                m_controls->setRescue(true);
-            else
-                RescueAnimation::create(m_kart);
+            rescueKart();
             m_time_since_stuck=0.0f;
         }   // m_time_since_stuck > 2.0f
     }
@@ -2169,6 +2171,51 @@ void SkiddingAI::handleRescue(const float dt)
     }
 }   // handleRescue
 
+//-----------------------------------------------------------------------------
+/** Rescues the kart, or requests a rescue for network AI. If the AI is
+ *  updated in parallel to other karts, the rescue animation is only created
+ *  in finishParallelUpdate().
+ */
+void SkiddingAI::rescueKart()
+{
+    // For network AI controller
+    if (m_enabled_network_ai)
+        m_controls->setRescue(true);
+    else if (m_defer_rescue)
+        m_rescue_pending = true;
+    else
+        RescueAnimation::create(m_kart);
+}   // rescueKart
+
+//-----------------------------------------------------------------------------
+/** The AI only reads the world and sets the controls of its kart, except
+ *  for the Nolok boss AI which also gives its kart powerups and nitro.
+ */
+bool SkiddingAI::canUpdateInParallel() const
+{
+    return !m_enabled_network_ai &&
+           m_superpower != RaceManager::SUPERPOWER_NOLOK_BOSS;
+}   // canUpdateInParallel
+
+//-----------------------------------------------------------------------------
+void SkiddingAI::updateInParallel(int ticks)
+{
+    m_defer_rescue = true;
+    update(ticks);
+    m_defer_rescue = false;
+}   // updateInParallel
+
+//-----------------------------------------------------------------------------
+/** Creates a rescue animation which was requested in updateInParallel(). */
+void SkiddingAI::finishParallelUpdate()
+{
+    if (!m_rescue_pending)
+        return;
+    m_rescue_pending = false;
+    if (!m_kart->getKartAnimation())
+        RescueAnimation::create(m_kart);
+}   // finishParallelUpdate
+
 //-----------------------------------------------------------------------------
 /** Decides wether to use nitro and zipper or not.
  */
@@ -3027,7 +3074,7 @@ void SkiddingAI::setSteering(float angle, float dt)
         {
             int prob = (int)(100.0f*m_ai_properties
                                ->getSkiddingProbability(m_distance_to_player));
-            int r = m_random_skid.get(100);
+            int r = getRandom(100, &m_random_skid);
             m_skid_probability_state = (r<prob)
                                      ? SKID_PROBAB_SKID
                                      : SKID_PROBAB_NO_SKID;
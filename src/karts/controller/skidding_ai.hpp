@@ -49,6 +49,7 @@
 #include "utils/random_generator.hpp"
 
 #include <line3d.h>
+#include <random>
 
 class ItemState;
 class LinearWorld;
@@ -196,6 +197,24 @@ private:
     /** A random number generator to decide if the AI should skid or not. */
     RandomGenerator m_random_skid;
 
+    /** True if the AIs are updated in parallel (see
+     *  World::updateKartsInParallel). All random numbers are then taken
+     *  from m_random instead of rand(), m_random_skid and
+     *  m_random_collect_item, so they do not depend on the order in which
+     *  the AIs are updated. */
+    bool m_own_random;
+
+    /** The random number generator of this AI if m_own_random is set,
+     *  seeded from rand() in reset(). */
+    std::minstd_rand m_random;
+
+    /** True while updateInParallel() runs, so a rescue must be postponed
+     *  to finishParallelUpdate(). */
+    bool m_defer_rescue;
+
+    /** True if a rescue was requested during updateInParallel(). */
+    bool m_rescue_pending;
+
     /** This implements a simple finite state machine: it starts in
      *  NOT_YET. The first time the AI decides to skid, the state is changed
      *  randomly (depending on skid probability) to NO_SKID or SKID.
@@ -269,6 +288,7 @@ private:
                        const std::vector<const ItemState *> &items_to_collect,
                        const std::vector<const ItemState *> &items_to_avoid);
     void  handleRescue(const float dt);
+    void  rescueKart();
     void  handleBraking(float max_turn_speed, float min_speed);
     void  handleNitroAndZipper(float max_safe_speed);
     void  computeNearestKarts();
@@ -292,6 +312,16 @@ private:
     virtual bool canSkid(float steer_fraction);
     virtual void setSteering(float angle, float dt);
     void handleCurve();
+    // ------------------------------------------------------------------------
+    /** Returns a random number between 0 and n-1 inclusive, from the given
+     *  generator, or from rand() if it is NULL. If the AIs are updated in
+     *  parallel, the own generator of this AI is used instead. */
+    int getRandom(int n, RandomGenerator* generator = NULL)
+    {
+        if (m_own_random)
+            return (int)(m_random() % n);
+        return generator ? generator->get(n) : rand() % n;
+    }   // getRandom
 
 protected:
     virtual unsigned int getNextSector(unsigned int index);
@@ -302,6 +332,9 @@ public:
     virtual void update      (int ticks);
     virtual void reset       ();
     virtual const irr::core::stringw& getNamePostfix() const;
+    virtual bool canUpdateInParallel() const OVERRIDE;
+    virtual void updateInParallel(int ticks) OVERRIDE;
+    virtual void finishParallelUpdate() OVERRIDE;
 };
 
 #endif
@@ -125,6 +125,8 @@ Kart::Kart (const std::string& ident, unsigned int world_kart_id,
     m_powerup              = new Powerup(this);
     m_initial_position     = position;
     m_race_result          = false;
+    m_updated_before_controller = false;
+    m_has_animation_before_update = false;
     m_wheel_box            = NULL;
     m_collision_particles  = NULL;
     m_controller           = NULL;
@@ -395,6 +397,8 @@ void Kart::reset()
     m_is_jumping           = false;
     m_flying               = false;
     m_startup_boost        = 0.0f;
+    m_updated_before_controller = false;
+    m_has_animation_before_update = false;
 
     m_node->setScale(core::vector3df(1.0f, 1.0f, 1.0f));
 
@@ -1351,11 +1355,13 @@ void Kart::eliminate()
 }   // eliminate
 
 //-----------------------------------------------------------------------------
-/** Updates the kart in each time step. It updates the physics setting,
- *  particle effects, camera position, etc.
- *  \param dt Time step size.
+/** Does the part of the update of the kart which must happen before its
+ *  controller is updated. World can call this for all karts and then update
+ *  their controllers together, in which case update() skips this part and
+ *  the controller update.
+ *  \param ticks Number of physics time steps.
  */
-void Kart::update(int ticks)
+bool Kart::updateBeforeController(int ticks)
 {
     if (m_network_finish_check_ticks > 0 &&
         World::getWorld()->getTicksSinceStart() >
@@ -1416,12 +1422,12 @@ void Kart::update(int ticks)
     }
 
     // This is to avoid a rescue immediately after an explosion
-    const bool has_animation_before = m_kart_animation != NULL;
+    m_has_animation_before_update = m_kart_animation != NULL;
     // A kart animation can change the xyz position. This needs to be done
     // before updating the graphical position (which is done in
     // Moveable::update() ), otherwise 'stuttering' can happen (caused by
     // graphical and physical position not being the same).
-    if (has_animation_before)
+    if (m_has_animation_before_update)
     {
         m_kart_animation->update(ticks);
     }
@@ -1482,8 +1488,25 @@ void Kart::update(int ticks)
     // reduce the restitution, meaning the karts will get less of a push
     // based on the collision speed.
     m_body->setRestitution(m_kart_properties->getRestitution(fabsf(m_speed)));
+    m_updated_before_controller = true;
+    return true;
+}   // updateBeforeController
 
-    m_controller->update(ticks);
+//-----------------------------------------------------------------------------
+/** Updates the kart in each time step. It updates the physics setting,
+ *  particle effects, camera position, etc.
+ *  \param ticks Number of physics time steps.
+ */
+void Kart::update(int ticks)
+{
+    // Unless World has done this already for all karts
+    if (!m_updated_before_controller)
+    {
+        updateBeforeController(ticks);
+        m_controller->update(ticks);
+    }
+    m_updated_before_controller = false;
+    const bool has_animation_before = m_has_animation_before_update;
 
 #ifndef SERVER_ONLY
 #undef DEBUG_CAMERA_SHAKE
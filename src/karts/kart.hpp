@@ -204,6 +204,14 @@ protected:
     /** If > 0 then bubble gum effect is on. This is the sliding when hitting a gum on the floor, not the shield. */
     int16_t      m_bubblegum_ticks;
 
+    /** True if updateBeforeController() was called (and the controller
+     *  updated by World) for the current update(). */
+    bool         m_updated_before_controller;
+
+    /** True if the kart had an animation at the start of the update, used
+     *  to avoid a rescue immediately after an explosion. */
+    bool         m_has_animation_before_update;
+
     /** When a kart has its view blocked by the plunger, this variable will be
      *  > 0 the number it contains is the time left before removing plunger. */
     int16_t       m_view_blocked_by_plunger;
@@ -342,6 +350,7 @@ public:
     virtual void   crashed          (const Material *m, const Vec3 &normal) OVERRIDE;
     virtual float  getHoT           () const OVERRIDE;
     virtual void   update           (int ticks) OVERRIDE;
+    virtual bool   updateBeforeController(int ticks) OVERRIDE;
     virtual void   finishedRace     (float time, bool from_server=false) OVERRIDE;
     virtual void   setPosition      (int p) OVERRIDE;
     virtual void   beep             () OVERRIDE;
@@ -149,21 +149,19 @@ void KartRewinder::computeError()
 }   // computeError
 
 // ----------------------------------------------------------------------------
-/** Saves all state information for a kart in a memory buffer. The memory
- *  is allocated here and the address returned. It will then be managed
- *  by the RewindManager.
+/** Saves all state information for a kart by appending it to the given
+ *  buffer.
+ *  \param buffer The state buffer to write to.
  *  \param[out] ru The unique identity of rewinder writing to.
- *  \return The address of the memory buffer with the state.
+ *  \return False if the kart is eliminated and has no state.
  */
-BareNetworkString* KartRewinder::saveState(std::vector<std::string>* ru)
+bool KartRewinder::saveState(BareNetworkString* buffer,
+                             std::vector<std::string>* ru)
 {
     if (m_eliminated)
-        return nullptr;
+        return false;
 
     ru->push_back(getUniqueIdentity());
-    const int MEMSIZE = 17*sizeof(float) + 9+3;
-
-    BareNetworkString *buffer = new BareNetworkString(MEMSIZE);
 
     // 1) Steering and other player controls
     // -------------------------------------
@@ -256,7 +254,7 @@ BareNetworkString* KartRewinder::saveState(std::vector<std::string>* ru)
     // -----------
     m_skidding->saveState(buffer);
 
-    return buffer;
+    return true;
 }   // saveState
 
 // ----------------------------------------------------------------------------
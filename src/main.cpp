@@ -157,7 +157,9 @@
 #    include <direct.h>
 #  endif
 #else
+#  include <errno.h>
 #  include <signal.h>
+#  include <sys/wait.h>
 #  include <unistd.h>
 #endif
 #include <stdexcept>
@@ -192,6 +194,7 @@
 #include "graphics/particle_kind_manager.hpp"
 #include "graphics/referee.hpp"
 #include "graphics/sp/sp_base.hpp"
+#include "graphics/sp/sp_frustum_culling.hpp"
 #include "graphics/sp/sp_shader.hpp"
 #include "guiengine/engine.hpp"
 #include "guiengine/event_handler.hpp"
@@ -203,6 +206,7 @@
 #include "io/file_manager.hpp"
 #include "items/attachment_manager.hpp"
 #include "items/item_manager.hpp"
+#include "items/item_spatial_hash.hpp"
 #include "items/network_item_manager.hpp"
 #include "items/powerup_manager.hpp"
 #include "items/projectile_manager.hpp"
@@ -214,26 +218,37 @@
 #include "modes/cutscene_world.hpp"
 #include "modes/demo_world.hpp"
 #include "modes/profile_world.hpp"
+#include "network/database_cache.hpp"
+#include "network/database_writer.hpp"
+#include "network/link_emulator.hpp"
+#include "network/message_coalescer.hpp"
 #include "network/protocols/connect_to_server.hpp"
 #include "network/protocols/client_lobby.hpp"
+#include "network/protocols/game_protocol.hpp"
 #include "network/protocols/server_lobby.hpp"
 #include "network/network_config.hpp"
 #include "network/network_string.hpp"
+#include "network/protocol_manager.hpp"
 #include "network/rewind_manager.hpp"
 #include "network/rewind_queue.hpp"
 #include "network/server.hpp"
+#include "network/server_benchmark.hpp"
+#include "network/server_metrics.hpp"
 #include "network/server_config.hpp"
 #include "network/servers_manager.hpp"
+#include "network/state_delta.hpp"
 #include "network/stk_host.hpp"
 #include "network/stk_peer.hpp"
 #include "online/profile_manager.hpp"
 #include "online/request_manager.hpp"
+#include "physics/triangle_mesh.hpp"
 #include "race/grand_prix_manager.hpp"
 #include "race/highscore_manager.hpp"
 #include "race/history.hpp"
 #include "race/race_manager.hpp"
 #include "replay/replay_play.hpp"
 #include "replay/replay_recorder.hpp"
+#include "scriptengine/script_engine.hpp"
 #include "states_screens/download_assets.hpp"
 #include "states_screens/main_menu_screen.hpp"
 #include "states_screens/online/networking_lobby.hpp"
@@ -258,6 +273,7 @@
 static void cleanSuperTuxKart();
 static void cleanUserConfig();
 void runUnitTests();
+void runUnitBenchmarks();
 
 // ============================================================================
 //                        gamepad visualisation screen
@@ -586,6 +602,12 @@ void cmdLineHelp()
                               "laps.\n"
     "       --profile-time=n   Enable automatic driven profile mode for n "
                               "seconds.\n"
+    "       --ai-threads=n     Update the AI karts of offline races together "
+                              "with n threads,\n"
+    "                          -1 for one per CPU core (default: update "
+                              "each kart after the other).\n"
+    "       --no-batched-raycasts Cast the wheel rays of each kart on its own\n"
+    "                          (to compare the physics performance).\n"
     "       --unlock-all       Permanently unlock all karts and tracks for testing.\n"
     "       --no-unlock-all    Disable unlock-all (i.e. base unlocking on player achievement).\n"
     "       --no-graphics      Do not display the actual race.\n"
@@ -614,6 +636,9 @@ void cmdLineHelp()
     "                          (in format x.x.x.x:xxx(port)), the port should be its\n"
     "                          public port.\n"
     "       --server-id=n      Server id in stk addons for --connect-now.\n"
+    "       --link-emulator=s  Connect with --connect-now through a link emulator with\n"
+    "                          the given conditions, e.g. latency=100,jitter=20,\n"
+    "                          loss=0.05,reorder=0.01,bandwidth=64000 (ms, bytes/s).\n"
     "       --network-ai=n     Numbers of AI for connecting to linear race server, used\n"
     "                          together with --connect-now.\n"
     "       --login=s          Automatically log in (set the login).\n"
@@ -621,6 +646,17 @@ void cmdLineHelp()
     "       --init-user        Save the above login and password (if set) in config.\n"
     "       --disable-polling  Don't poll for logged in user.\n"
     "       --port=n           Port number to use.\n"
+    "       --server-benchmark=n Run a race with network AI clients over loopback on\n"
+    "                          this server, and write the server cost of n ticks to\n"
+    "                          a JSON file. Use with --network-ai, --track and --seed.\n"
+    "       --server-benchmark-output=file Name of the JSON file of --server-benchmark.\n"
+    "       --server-benchmark-link=s Connect the clients of --server-benchmark through\n"
+    "                          link emulators, settings as in --link-emulator\n"
+    "                          separated by ';' are used for the clients in turn.\n"
+    "                          Settings separated by '>' change the link during\n"
+    "                          the benchmark.\n"
+    "       --server-instances=n Host n independent servers on consecutive ports,\n"
+    "                          sharing loaded karts and tracks (server only).\n"
     "       --auto-connect     Automatically connect to fist server and start race\n"
     "       --max-players=n    Maximum number of clients (server only).\n"
     "       --min-players=n    Minimum number of clients for owner less server(server only).\n"
@@ -933,6 +969,9 @@ int handleCmdLinePreliminary()
     if (CommandLine::has("--no-sound"))
         UserConfigParams::m_enable_sound = false;
 
+    if (CommandLine::has("--ai-threads", &n))
+        UserConfigParams::m_ai_threads = std::max(n, -1);
+
     if (CommandLine::has("--seed", &n))
     {
         srand(n);
@@ -942,6 +981,83 @@ int handleCmdLinePreliminary()
     return 0;
 }   // handleCmdLinePreliminary
 
+#if !defined(WIN32) && !defined(MOBILE_STK)
+// ============================================================================
+/** The process ids of the forked server instances, only set in the original
+ *  process. */
+std::vector<pid_t> g_server_instance_pids;
+
+// ----------------------------------------------------------------------------
+/** SIGCHLD handler of the original server process, which reaps the server
+ *  instances that exited. Only the pids of the instances are waited for, so
+ *  that other child processes (e.g. the clients of --server-benchmark) are
+ *  still waited for by SeparateProcess.
+ */
+void reapServerInstances(int sig)
+{
+    const int saved_errno = errno;
+    for (pid_t pid : g_server_instance_pids)
+        waitpid(pid, NULL, WNOHANG);
+    errno = saved_errno;
+}   // reapServerInstances
+
+// ----------------------------------------------------------------------------
+/** Forks n-1 additional server processes after the karts, models and the
+ *  track list are loaded at startup, so that this data is shared
+ *  copy-on-write instead of being loaded by each server. The track of each
+ *  race is still loaded by each server. Each process then creates its own
+ *  independent lobby, using the port after the one of the previous instance.
+ *  A child stops when the original process is terminated (see MainLoop).
+ *  Only the calling thread survives a fork, so this must be called before
+ *  any other thread is started (which is why sound and graphics must be
+ *  disabled).
+ *  \param n Total number of server instances.
+ *  \return Index of the instance in this process, 0 for the original one.
+ */
+int forkServerInstances(int n)
+{
+    const unsigned parent_pid = (unsigned)getpid();
+    const std::string server_name = ServerConfig::m_server_name;
+    // Don't let children inherit unwritten output
+    Log::flushBuffers();
+    fflush(NULL);
+    for (int i = 1; i < n; i++)
+    {
+        pid_t pid = fork();
+        if (pid == 0)
+        {
+            g_server_instance_pids.clear();
+            ServerMetrics::setInstance(i + 1);
+            main_loop->setParentPid(parent_pid);
+            srand((unsigned)time(0) + i);
+            ServerConfig::m_server_name =
+                server_name + " " + StringUtils::toString(i + 1);
+            Log::info("main", "Server instance %d started.", i + 1);
+            return i;
+        }
+        else if (pid < 0)
+        {
+            Log::error("main", "Cannot fork server instance %d.", i + 1);
+            break;
+        }
+        g_server_instance_pids.push_back(pid);
+    }
+    if (!g_server_instance_pids.empty())
+        ServerMetrics::setInstance(1);
+    // Installed after all forks, so that the list of pids doesn't change
+    // while the handler runs. An instance exiting before is reaped with the
+    // next signal.
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = reapServerInstances;
+    sigemptyset(&sa.sa_mask);
+    sa.sa_flags = SA_RESTART | SA_NOCLDSTOP;
+    sigaction(SIGCHLD, &sa, NULL);
+    reapServerInstances(SIGCHLD);
+    return 0;
+}   // forkServerInstances
+#endif
+
 // ============================================================================
 /** Handles command line options.
  *  \param argc Number of command line options
@@ -956,6 +1072,8 @@ int handleCmdLine(bool has_server_config, bool has_parent_process)
 
     if (CommandLine::has("--unit-testing"))
         UserConfigParams::m_unit_testing = true;
+    if (CommandLine::has("--unit-benchmarks"))
+        UserConfigParams::m_unit_benchmarks = true;
     if (CommandLine::has("--gamepad-debug"))
         UserConfigParams::m_gamepad_debug=true;
     if (CommandLine::has("--keyboard-debug"))
@@ -1044,6 +1162,29 @@ int handleCmdLine(bool has_server_config, bool has_parent_process)
             UserConfigParams::m_check_debug=true;
     }
 
+    int server_instance = 0;
+    if (CommandLine::has("--server-instances", &n))
+    {
+#if !defined(WIN32) && !defined(MOBILE_STK)
+        // The sound and graphics threads would not exist in the forked
+        // instances
+        if (CommandLine::has("--graphical-server") ||
+            UserConfigParams::m_enable_sound)
+        {
+            Log::warn("main", "--server-instances can't be used with "
+                "--graphical-server or sound enabled, starting one server.");
+        }
+        else if (has_server_config || NetworkConfig::get()->isServer())
+            server_instance = forkServerInstances(n);
+        else
+#endif
+        {
+            Log::warn("main", "--server-instances is only supported for "
+                "servers on linux and macOS.");
+        }
+        Online::RequestManager::get()->startNetworkThread();
+    }
+
     bool init_user = CommandLine::has("--init-user");
     if (init_user)
     {
@@ -1295,6 +1436,11 @@ int handleCmdLine(bool has_server_config, bool has_parent_process)
         NetworkConfig::get()->setClientPort(n);
         ServerConfig::m_server_port = n;
     }
+    if (server_instance > 0 && ServerConfig::m_server_port != 0)
+    {
+        ServerConfig::m_server_port =
+            ServerConfig::m_server_port + server_instance;
+    }
     if (CommandLine::has("--public-server"))
     {
         NetworkConfig::get()->setIsPublicServer();
@@ -1345,6 +1491,24 @@ int handleCmdLine(bool has_server_config, bool has_parent_process)
                 PlayerManager::getCurrentPlayer(), PLAYER_DIFFICULTY_NORMAL);
         }
         TransportAddress server_addr(s);
+        std::string link;
+        if (CommandLine::has("--link-emulator", &link))
+        {
+            LinkEmulator::Settings settings;
+            if (!settings.parse(link))
+            {
+                cleanSuperTuxKart();
+                return false;
+            }
+            int seed = 1;
+            CommandLine::has("--seed", &seed);
+            LinkEmulator::create(server_addr, settings, seed);
+            if (LinkEmulator::get()->getPort() != 0)
+            {
+                server_addr = TransportAddress(127, 0, 0, 1,
+                    LinkEmulator::get()->getPort());
+            }
+        }
         auto server = std::make_shared<Server>(0,
             StringUtils::utf8ToWide(server_addr.toString()), 0, 0, 0, 0,
             server_addr, !server_password.empty(), false);
@@ -1361,6 +1525,34 @@ int handleCmdLine(bool has_server_config, bool has_parent_process)
         NetworkingLobby::getInstance()->setJoinedServer(server);
     }
 
+    if (CommandLine::has("--server-benchmark", &n))
+    {
+        if (!NetworkConfig::get()->isServer())
+        {
+            Log::error("main", "--server-benchmark needs --lan-server or "
+                "--server-config.");
+            cleanSuperTuxKart();
+            return false;
+        }
+        int num_clients = 4;
+        CommandLine::has("--network-ai", &num_clients);
+        int seed = 1;
+        CommandLine::has("--seed", &seed);
+        std::string track, output;
+        CommandLine::has("--track", &track);
+        if (!CommandLine::has("--server-benchmark-output", &output))
+            output = file_manager->getUserConfigFile("server_benchmark.json");
+        ServerBenchmark::enable(n, std::max(num_clients, 1), seed, track,
+            output);
+        std::string links;
+        if (CommandLine::has("--server-benchmark-link", &links) &&
+            !ServerBenchmark::setLinks(links))
+        {
+            cleanSuperTuxKart();
+            return false;
+        }
+    }
+
     if (NetworkConfig::get()->isServer())
     {
         const std::string& server_name = ServerConfig::m_server_name;
@@ -1385,6 +1577,8 @@ int handleCmdLine(bool has_server_config, bool has_parent_process)
             Log::info("main", "Creating a LAN server '%s'.",
                 server_name.c_str());
         }
+        if (ServerBenchmark::isEnabled() && STKHost::existHost())
+            ServerBenchmark::startClients();
     }
 
     if (CommandLine::has("--auto-connect"))
@@ -1579,6 +1773,9 @@ int handleCmdLine(bool has_server_config, bool has_parent_process)
         race_manager->setNumLaps(999999); // profile end depends on time
     }   // --profile-time
 
+    if(CommandLine::has("--no-batched-raycasts"))
+        UserConfigParams::m_batched_raycasts = false;
+
     if(CommandLine::has("--history"))
     {
         history->setReplayHistory(true);
@@ -1761,7 +1958,10 @@ void initRest()
     // The rest will be read later (since the rest needs the unlock- and
     // achievement managers to be created, which can only be created later).
     PlayerManager::create();
-    Online::RequestManager::get()->startNetworkThread();
+    // Server instances are forked in handleCmdLine after all data is loaded,
+    // which must be done before any other thread is started
+    if (!CommandLine::has("--server-instances"))
+        Online::RequestManager::get()->startNetworkThread();
 #ifndef SERVER_ONLY
     if (!ProfileWorld::isNoGraphics())
         NewsManager::get();   // this will create the news manager
@@ -2120,6 +2320,11 @@ int main(int argc, char *argv[])
             runUnitTests();
             exit(0);
         }
+        if(UserConfigParams::m_unit_benchmarks)
+        {
+            runUnitBenchmarks();
+            exit(0);
+        }
 
 #ifndef SERVER_ONLY
         if (!ProfileWorld::isNoGraphics())
@@ -2356,7 +2561,8 @@ int main(int argc, char *argv[])
 
     delete file_manager;
 
-    return 0 ;
+    // Lets scripts running --server-benchmark with changing links fail
+    return ServerBenchmark::hasFailed() ? 1 : 0;
 }   // main
 
 // ============================================================================
@@ -2411,6 +2617,7 @@ static void cleanSuperTuxKart()
     GUIEngine::cleanUp();
     GUIEngine::clearScreenCache();
     if(font_manager)            delete font_manager;
+    LinkEmulator::destroy();
 
     // Now finish shutting down objects which a separate thread. The
     // RequestManager has been signaled to shut down as early as possible,
@@ -2498,6 +2705,8 @@ void runUnitTests()
     MiniGLM::unitTesting();
     Log::info("UnitTest", "GraphicsRestrictions");
     GraphicsRestrictions::unitTesting();
+    Log::info("UnitTest", "SPFrustumCulling");
+    SP::SPFrustumCulling::unitTesting();
     Log::info("UnitTest", "NetworkString");
     NetworkString::unitTesting();
     Log::info("UnitTest", "TransportAddress");
@@ -2539,19 +2748,87 @@ void runUnitTests()
     Log::info("UnitTest", "PowerupManager");
     PowerupManager::unitTesting();
 
+    Log::info("UnitTest", "ItemSpatialHash");
+    ItemSpatialHash::unitTesting();
+
     Log::info("UnitTest", "Kart characteristics");
     CombinedCharacteristic::unitTesting();
 
     Log::info("UnitTest", "Arena Graph");
     ArenaGraph::unitTesting();
 
+    Log::info("UnitTest", "Graph spatial index");
+    Graph::unitTesting();
+
+    Log::info("UnitTest", "TriangleMesh BVH cache");
+    TriangleMesh::unitTesting();
+
+    Log::info("UnitTest", "ScriptEngine collision callbacks");
+    Scripting::ScriptEngine::unitTesting();
+
     Log::info("UnitTest", "Fonts for translation");
     font_manager->unitTesting();
 
+    Log::info("UnitTest", "StateDelta");
+    StateDelta::unitTesting();
+
+    Log::info("UnitTest", "GameProtocol");
+    GameProtocol::unitTesting();
+
     Log::info("UnitTest", "RewindQueue");
     RewindQueue::unitTesting();
 
+    Log::info("UnitTest", "DatabaseCache");
+    DatabaseCache::unitTesting();
+
+#ifdef ENABLE_SQLITE3
+    Log::info("UnitTest", "DatabaseWriter");
+    DatabaseWriter::unitTesting();
+#endif
+
+    Log::info("UnitTest", "ProtocolManager");
+    ProtocolManager::unitTesting();
+
+    Log::info("UnitTest", "ServerMetrics");
+    ServerMetrics::unitTesting();
+
+    Log::info("UnitTest", "LinkEmulator");
+    LinkEmulator::unitTesting();
+
+    Log::info("UnitTest", "MessageCoalescer");
+    MessageCoalescer::unitTesting();
+
+    Log::info("UnitTest", "STKHost send threads");
+    STKHost::unitTesting();
+
+    Log::info("UnitTest", "Parallel AI update");
+    ProfileWorld::unitTesting();
+
     Log::info("UnitTest", "=====================");
     Log::info("UnitTest", "Testing successful   ");
     Log::info("UnitTest", "=====================");
 }   // runUnitTests
+
+//=============================================================================
+/** Times the code paths some unit tests check, which takes too long to be
+ *  done in each unit test run.
+ */
+void runUnitBenchmarks()
+{
+    Log::info("UnitBenchmark", "Starting unit benchmarks");
+    Log::info("UnitBenchmark", "=====================");
+
+    Log::info("UnitBenchmark", "TriangleMesh BVH cache");
+    TriangleMesh::benchmark();
+
+    Log::info("UnitBenchmark", "ScriptEngine collision callbacks");
+    Scripting::ScriptEngine::benchmark();
+
+    Log::info("UnitBenchmark", "GameProtocol saveState");
+    GameProtocol::benchmark();
+
+    Log::info("UnitBenchmark", "STKHost send threads");
+    STKHost::benchmark();
+
+    Log::info("UnitBenchmark", "=====================");
+}   // runUnitBenchmarks
@@ -38,6 +38,8 @@
 #include "network/protocol_manager.hpp"
 #include "network/race_event_manager.hpp"
 #include "network/rewind_manager.hpp"
+#include "network/server_benchmark.hpp"
+#include "network/server_metrics.hpp"
 #include "network/stk_host.hpp"
 #include "online/request_manager.hpp"
 #include "race/history.hpp"
@@ -511,6 +513,7 @@ void MainLoop::run()
                                          0x7F, 0x00, 0x7F);
                 if (auto pm = ProtocolManager::lock())
                 {
+                    ServerBenchmark::Timer t(ServerBenchmark::SB_PROTOCOL_MANAGER);
                     pm->update(1);
                 }
                 PROFILER_POP_CPU_MARKER();
@@ -518,9 +521,14 @@ void MainLoop::run()
                 PROFILER_PUSH_CPU_MARKER("Update race", 0, 255, 255);
                 if (World::getWorld())
                 {
+                    ServerBenchmark::Timer t(ServerBenchmark::SB_UPDATE_WORLD);
                     updateRace(1, fast_forward);
                 }
                 PROFILER_POP_CPU_MARKER();
+                if (ServerBenchmark::isEnabled())
+                    ServerBenchmark::update();
+                if (ServerMetrics::isEnabled())
+                    ServerMetrics::endTick();
 
                 // We need to check again because update_race may have requested
                 // the main loop to abort; and it's not a good idea to continue
@@ -60,6 +60,8 @@ public:
     void requestAbort() { m_request_abort = true; }
     void setThrottleFPS(bool throttle) { m_throttle_fps = throttle; }
     void setAllowLargeDt(bool enable) { m_allow_large_dt = enable; }
+    /** Abort the main loop once the process with this pid terminates. */
+    void setParentPid(unsigned pid) { m_parent_pid = pid; }
     void renderGUI(int phase, int loop_index=-1, int loop_size=-1);
     // ------------------------------------------------------------------------
     /** Returns true if STK is to be stoppe. */
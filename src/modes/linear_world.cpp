@@ -49,6 +49,7 @@
 #include "utils/translation.hpp"
 
 #include <climits>
+#include <cmath>
 #include <iostream>
 
 //-----------------------------------------------------------------------------
@@ -819,9 +820,13 @@ btTransform LinearWorld::getRescueTransform(unsigned int index) const
 }   // getRescueTransform
 
 //-----------------------------------------------------------------------------
-/** Find the position (rank) of every kart. ATM it uses a stable O(n^2)
- *  algorithm by counting for each kart how many other karts are ahead of
- *  it.
+/** Find the position (rank) of every kart. The karts are sorted by
+ *  sortRaceOrder (finished karts first, then racing karts by decreasing
+ *  overall distance, with ties broken by the initial position, and
+ *  eliminated karts last), and a racing kart gets the number of karts
+ *  before it plus one. Finished and eliminated karts keep their position.
+ *  If any overall distance is NAN, there is no strict order, and the old
+ *  O(n^2) counting of the karts ahead of each kart is used instead.
  */
 void LinearWorld::updateRacePosition()
 {
@@ -833,6 +838,32 @@ void LinearWorld::updateRacePosition()
     bool rank_changed = false;
 #endif
 
+    // Sorting needs a strict ordering, which is not the case with NAN
+    // distances. Count the karts ahead of each kart in this case.
+    bool sorted = true;
+    for (unsigned int i = 0; i < kart_amount; i++)
+    {
+        if (std::isnan(m_kart_info[i].m_overall_distance))
+            sorted = false;
+    }
+    if (sorted)
+    {
+        sortRaceOrder();
+        // The position of a racing kart is the number of finished karts
+        // and racing karts in front of it plus one.
+        m_race_positions.resize(kart_amount);
+        int p = 1;
+        for (unsigned int kart_id : m_race_order)
+        {
+            const int group = getRaceGroup(kart_id);
+            if (group == 2)
+                break;
+            if (group == 1)
+                m_race_positions[kart_id] = p;
+            p++;
+        }
+    }
+
     // NOTE: if you do any changes to this loop, the next loop (see
     // DEBUG_KART_RANK below) needs to have the same changes applied
     // so that debug output is still correct!!!!!!!!!!!
@@ -853,37 +884,18 @@ void LinearWorld::updateRacePosition()
         }
         KartInfo& kart_info = m_kart_info[i];
 
-        int p = 1 ;
-
-        const unsigned int my_id = kart->getWorldKartId();
-        const float my_distance  = m_kart_info[my_id].m_overall_distance;
-
-        // Count karts ahead of the current kart, i.e. kart that are
-        // already finished or have covered a larger overall distance.
-        for (unsigned int j = 0 ; j < kart_amount ; j++)
-        {
-            // don't compare a kart with itself and ignore eliminated karts
-            if(j == my_id || m_karts[j]->isEliminated())
-                continue;
-
-            // If the other kart has:
-            // - finished the race (but this kart hasn't)
-            // - or is ahead
-            // - or has the same distance (very unlikely) but started earlier
-            // it is ahead --> increase position
-            if((!kart->hasFinishedRace() && m_karts[j]->hasFinishedRace()) ||
-                m_kart_info[j].m_overall_distance > my_distance            ||
-               (m_kart_info[j].m_overall_distance == my_distance &&
-                m_karts[j]->getInitialPosition()<kart->getInitialPosition() ) )
-            {
-                p++;
-            }
-
-        } //next kart
+        int p = sorted ? m_race_positions[i] : countRacePosition(i);
 
 #ifndef DEBUG
         setKartPosition(i, p);
 #else
+        if (sorted && p != countRacePosition(i))
+        {
+            Log::error("[LinearWorld]", "Kart %s has position %d after "
+                       "sorting, but %d after counting karts ahead.",
+                       kart->getIdent().c_str(), p, countRacePosition(i));
+            assert(false);
+        }
         rank_changed |= kart->getPosition()!=p;
         if (!setKartPosition(i,p))
         {
@@ -999,6 +1011,101 @@ void LinearWorld::updateRacePosition()
     endSetKartPositions();
 }   // updateRacePosition
 
+//-----------------------------------------------------------------------------
+/** Returns in which part of the race order a kart is: 0 for karts that have
+ *  finished the race, 1 for karts still racing and 2 for eliminated karts.
+ *  \param kart_id World id of the kart.
+ */
+int LinearWorld::getRaceGroup(unsigned int kart_id) const
+{
+    if (m_karts[kart_id]->isEliminated())
+        return 2;
+    return m_karts[kart_id]->hasFinishedRace() ? 0 : 1;
+}   // getRaceGroup
+
+//-----------------------------------------------------------------------------
+/** Defines the order used in sortRaceOrder: karts that have finished the
+ *  race come first, then the racing karts by decreasing overall distance
+ *  (or by initial position if they have the same distance), and eliminated
+ *  karts last.
+ *  \return True if kart a is before kart b in the race order.
+ */
+bool LinearWorld::isAheadInRace(unsigned int a, unsigned int b) const
+{
+    const int group_a = getRaceGroup(a);
+    const int group_b = getRaceGroup(b);
+    if (group_a != group_b)
+        return group_a < group_b;
+    if (group_a != 1)
+        return a < b;
+    const float distance_a = m_kart_info[a].m_overall_distance;
+    const float distance_b = m_kart_info[b].m_overall_distance;
+    if (distance_a != distance_b)
+        return distance_a > distance_b;
+    return m_karts[a]->getInitialPosition() < m_karts[b]->getInitialPosition();
+}   // isAheadInRace
+
+//-----------------------------------------------------------------------------
+/** Sorts m_race_order using insertion sort, which only needs linear time if
+ *  no or only a few karts changed their order since the last call.
+ */
+void LinearWorld::sortRaceOrder()
+{
+    const unsigned int kart_amount = (unsigned int)m_karts.size();
+    if (m_race_order.size() != kart_amount)
+    {
+        m_race_order.resize(kart_amount);
+        for (unsigned int i = 0; i < kart_amount; i++)
+            m_race_order[i] = i;
+    }
+    for (unsigned int i = 1; i < kart_amount; i++)
+    {
+        const unsigned int kart_id = m_race_order[i];
+        unsigned int j = i;
+        while (j > 0 && isAheadInRace(kart_id, m_race_order[j - 1]))
+        {
+            m_race_order[j] = m_race_order[j - 1];
+            j--;
+        }
+        m_race_order[j] = kart_id;
+    }
+}   // sortRaceOrder
+
+//-----------------------------------------------------------------------------
+/** Computes the position of a racing kart by counting the karts ahead of it,
+ *  i.e. karts that have already finished or have covered a larger overall
+ *  distance. This is used if the karts can not be sorted, and in debug mode
+ *  to check the position computed from the sorted karts.
+ *  \param kart_id World id of the kart.
+ */
+int LinearWorld::countRacePosition(unsigned int kart_id) const
+{
+    const AbstractKart* kart = m_karts[kart_id].get();
+    const float my_distance  = m_kart_info[kart_id].m_overall_distance;
+    const unsigned int kart_amount = (unsigned int)m_karts.size();
+    int p = 1;
+    for (unsigned int j = 0 ; j < kart_amount ; j++)
+    {
+        // don't compare a kart with itself and ignore eliminated karts
+        if(j == kart_id || m_karts[j]->isEliminated())
+            continue;
+
+        // If the other kart has:
+        // - finished the race (but this kart hasn't)
+        // - or is ahead
+        // - or has the same distance (very unlikely) but started earlier
+        // it is ahead --> increase position
+        if((!kart->hasFinishedRace() && m_karts[j]->hasFinishedRace()) ||
+            m_kart_info[j].m_overall_distance > my_distance            ||
+           (m_kart_info[j].m_overall_distance == my_distance &&
+            m_karts[j]->getInitialPosition()<kart->getInitialPosition() ) )
+        {
+            p++;
+        }
+    }   // next kart
+    return p;
+}   // countRacePosition
+
 //-----------------------------------------------------------------------------
 /** Checks if a kart is going in the wrong direction. This is done only for
  *  player karts to display a message to the player.
@@ -71,11 +71,27 @@ private:
     /* if set then the game will auto end after this time for networking */
     float       m_finish_timeout;
 
+    /** The world ids of all karts, sorted by race progress in the last
+     *  call of updateRacePosition. Since the order rarely changes between
+     *  two calls, sorting it again is usually linear. */
+    std::vector<unsigned int> m_race_order;
+
+    /** Temporarily stores the positions computed in updateRacePosition. */
+    std::vector<int> m_race_positions;
+
     /** This calculate the time difference between the second kart in the race
      *  (there must be at least two) and the first kart in the race
      *  (who must be a ghost).
      */
     void  updateLiveDifference();
+    // ------------------------------------------------------------------------
+    void  sortRaceOrder();
+    // ------------------------------------------------------------------------
+    bool  isAheadInRace(unsigned int a, unsigned int b) const;
+    // ------------------------------------------------------------------------
+    int   countRacePosition(unsigned int kart_id) const;
+    // ------------------------------------------------------------------------
+    int   getRaceGroup(unsigned int kart_id) const;
 
     // ------------------------------------------------------------------------
     /** Some additional info that needs to be kept for each kart
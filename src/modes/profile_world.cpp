@@ -19,14 +19,24 @@
 #include "modes/profile_world.hpp"
 
 #include "main_loop.hpp"
+#include "config/player_manager.hpp"
+#include "config/user_config.hpp"
 #include "graphics/camera.hpp"
 #include "graphics/irr_driver.hpp"
+#include "input/device_manager.hpp"
+#include "input/keyboard_device.hpp"
+#include "input/input_manager.hpp"
 #include "karts/kart_with_stats.hpp"
 #include "karts/controller/controller.hpp"
+#include "physics/physics.hpp"
+#include "states_screens/state_manager.hpp"
 #include "tracks/track.hpp"
+#include "tracks/track_manager.hpp"
 
 #include <ISceneManager.h>
 
+#include <algorithm>
+#include <cstring>
 #include <iomanip>
 #include <iostream>
 #include <sstream>
@@ -205,6 +215,18 @@ void ProfileWorld::enterRaceOverState()
     Log::verbose("profile", "Number of frames: %d time %f, Average FPS: %f",
                  m_frame_count, runtime, (float)m_frame_count/runtime);
 
+    // Print physics statistics, to compare e.g. batched raycasts
+    Physics *physics = Physics::getInstance();
+    if (physics->getNumSteps() > 0)
+    {
+        Log::verbose("profile", "Physics steps: %d with %d karts, average "
+                     "%.1f us (%s raycasts)", physics->getNumSteps(),
+                     race_manager->getNumberOfKarts(),
+                     (float)physics->getStepTimeUs()/physics->getNumSteps(),
+                     UserConfigParams::m_batched_raycasts ? "batched"
+                                                          : "single");
+    }
+
     // Print geometry statistics if we're not in no-graphics mode
     if(!m_no_graphics)
     {
@@ -349,3 +371,91 @@ void ProfileWorld::enterRaceOverState()
     delete this;
     main_loop->abort();
 }   // enterRaceOverState
+
+//-----------------------------------------------------------------------------
+/** Drives the start of the same seeded AI race with one thread and with
+ *  four threads for the AI controllers (see World::updateKartsInParallel),
+ *  and checks that all karts end up with exactly the same transforms. Uses
+ *  the first installed race track, and fails if there is none.
+ */
+void ProfileWorld::unitTesting()
+{
+    std::vector<std::string> tracks = track_manager->getAllTrackIdentifiers();
+    std::sort(tracks.begin(), tracks.end());
+    std::string track_name;
+    for (const std::string& ident : tracks)
+    {
+        if (track_manager->getTrack(ident)->isRaceTrack())
+        {
+            track_name = ident;
+            break;
+        }
+    }
+    if (track_name.empty())
+    {
+        Log::fatal("ProfileWorld", "No race track found, parallel AI updates "
+            "can't be tested.");
+    }
+
+    const ProfileType saved_mode = m_profile_mode;
+    const int saved_laps = m_num_laps;
+    const float saved_time = m_time;
+    const int saved_threads = UserConfigParams::m_ai_threads;
+    if (StateManager::get()->activePlayerCount() == 0)
+    {
+        PlayerManager::get()->enforceCurrentPlayer();
+        StateManager::get()->createActivePlayer(
+            PlayerManager::getCurrentPlayer(),
+            input_manager->getDeviceManager()->getKeyboard(0));
+    }
+
+    auto run = [&track_name](int num_threads)
+    {
+        UserConfigParams::m_ai_threads = num_threads;
+        setProfileModeTime(1000.0f);
+        srand(1234);
+        race_manager->setNumPlayers(1);
+        race_manager->setPlayerKart(0, "tux");
+        race_manager->setNumKarts(8);
+        race_manager->setMinorMode(RaceManager::MINOR_MODE_NORMAL_RACE);
+        race_manager->setDifficulty(RaceManager::DIFFICULTY_HARD);
+        race_manager->startSingleRace(track_name, m_num_laps, false);
+
+        World* world = World::getWorld();
+        for (int i = 0; i < 1200; i++)
+        {
+            world->updateWorld(1);
+            world->updateTime(1);
+        }
+        std::vector<btTransform> transforms;
+        for (unsigned i = 0; i < world->getNumKarts(); i++)
+            transforms.push_back(world->getKart(i)->getTrans());
+        race_manager->exitRace();
+        return transforms;
+    };   // run
+
+    std::vector<btTransform> one = run(1);
+    std::vector<btTransform> four = run(4);
+    if (one.size() != four.size() || one.empty())
+    {
+        Log::fatal("ProfileWorld", "Different number of karts with 1 and "
+            "4 AI threads.");
+    }
+    for (unsigned i = 0; i < one.size(); i++)
+    {
+        // Bitwise comparison, the results must be identical
+        if (memcmp(&one[i], &four[i], sizeof(btTransform)) != 0)
+        {
+            Log::fatal("ProfileWorld", "Kart %d on '%s' ends at a different "
+                "transform with 4 AI threads than with 1.", i,
+                track_name.c_str());
+        }
+    }
+    Log::info("ProfileWorld", "Parallel AI updates on '%s' give the same "
+        "result with 1 and 4 threads.", track_name.c_str());
+
+    m_profile_mode = saved_mode;
+    m_num_laps = saved_laps;
+    m_time = saved_time;
+    UserConfigParams::m_ai_threads = saved_threads;
+}   // unitTesting
@@ -56,6 +56,7 @@
 #include "network/protocols/client_lobby.hpp"
 #include "network/network_config.hpp"
 #include "network/rewind_manager.hpp"
+#include "network/server_benchmark.hpp"
 #include "physics/btKart.hpp"
 #include "physics/physics.hpp"
 #include "physics/triangle_mesh.hpp"
@@ -80,6 +81,7 @@
 #include "utils/profiler.hpp"
 #include "utils/translation.hpp"
 #include "utils/string_utils.hpp"
+#include "utils/thread_pool.hpp"
 
 #include <algorithm>
 #include <assert.h>
@@ -139,6 +141,7 @@ World::World() : WorldStatus()
     m_schedule_exit_race = false;
     m_schedule_tutorial  = false;
     m_is_network_world   = false;
+    m_kart_update_pool   = NULL;
 
     m_stop_music_when_dialog_open = true;
 
@@ -238,6 +241,22 @@ void World::init()
         m_karts.push_back(new_kart);
     }  // for i
 
+    // With --ai-threads the AI controllers of offline races are updated
+    // together on a thread pool. This changes the order of the kart updates
+    // (see updateKartsInParallel), so by default the karts are updated one
+    // after another as before. Networked games always update the karts one
+    // after another: there the AI karts are driven by client processes with
+    // one kart each, and a client must update its karts in the same order
+    // as the server to predict the server states.
+    if (!NetworkConfig::get()->isNetworking() &&
+        UserConfigParams::m_ai_threads != 0)
+    {
+        unsigned num_threads = UserConfigParams::m_ai_threads > 0
+                             ? (unsigned)UserConfigParams::m_ai_threads
+                             : ThreadPool::getDefaultNumThreads();
+        m_kart_update_pool = new ThreadPool(num_threads);
+    }
+
     main_loop->renderGUI(7050);
     // Load other custom models if needed
     loadCustomModels();
@@ -558,6 +577,7 @@ Controller* World::loadAIController(AbstractKart* kart)
 //-----------------------------------------------------------------------------
 World::~World()
 {
+    delete m_kart_update_pool;
     material_manager->unloadAllTextures();
     RewindManager::destroy();
 
@@ -1102,16 +1122,12 @@ void World::update(int ticks)
     // Update all the karts. This in turn will also update the controller,
     // which causes all AI steering commands set. So in the following 
     // physics update the new steering is taken into account.
-    const int kart_amount = (int)m_karts.size();
-    for (int i = 0 ; i < kart_amount; ++i)
     {
-        SpareTireAI* sta =
-            dynamic_cast<SpareTireAI*>(m_karts[i]->getController());
-        // Update all karts that are not eliminated
-        if(!m_karts[i]->isEliminated() || (sta && sta->isMoving()))
-            m_karts[i]->update(ticks);
-        if (isStartPhase())
-            m_karts[i]->makeKartRest();
+        ServerBenchmark::Timer t(ServerBenchmark::SB_KARTS);
+        if (m_kart_update_pool)
+            updateKartsInParallel(ticks);
+        else
+            updateKarts(ticks);
     }
     PROFILER_POP_CPU_MARKER();
     if(race_manager->isRecordingRace()) ReplayRecorder::get()->update(ticks);
@@ -1121,7 +1137,10 @@ void World::update(int ticks)
     PROFILER_POP_CPU_MARKER();
 
     PROFILER_PUSH_CPU_MARKER("World::update (physics)", 0xa0, 0x7F, 0x00);
-    Physics::getInstance()->update(ticks);
+    {
+        ServerBenchmark::Timer t(ServerBenchmark::SB_PHYSICS);
+        Physics::getInstance()->update(ticks);
+    }
     PROFILER_POP_CPU_MARKER();
 
     PROFILER_POP_CPU_MARKER();
@@ -1131,6 +1150,75 @@ void World::update(int ticks)
 #endif
 }   // update
 
+// ----------------------------------------------------------------------------
+/** Updates all karts that are not eliminated one after another.
+ *  \param ticks Number of physics time steps.
+ */
+void World::updateKarts(int ticks)
+{
+    const int kart_amount = (int)m_karts.size();
+    for (int i = 0 ; i < kart_amount; ++i)
+    {
+        SpareTireAI* sta =
+            dynamic_cast<SpareTireAI*>(m_karts[i]->getController());
+        // Update all karts that are not eliminated
+        if(!m_karts[i]->isEliminated() || (sta && sta->isMoving()))
+            m_karts[i]->update(ticks);
+        if (isStartPhase())
+            m_karts[i]->makeKartRest();
+    }
+}   // updateKarts
+
+// ----------------------------------------------------------------------------
+/** Updates all karts that are not eliminated, with the AI controllers being
+ *  updated in parallel. First the part of the kart update before the
+ *  controller is done for all karts. Then the controllers which support it
+ *  are updated using the thread pool, and the others one after another.
+ *  Finally the controllers apply their deferred changes and the rest of
+ *  each kart update is done. Everything except the parallel controller
+ *  update happens in the order of the karts, so the result does not depend
+ *  on the number of threads (but differs from updateKarts, which updates
+ *  each kart completely before the next one).
+ *  \param ticks Number of physics time steps.
+ */
+void World::updateKartsInParallel(int ticks)
+{
+    const int kart_amount = (int)m_karts.size();
+    std::vector<bool> needs_update(kart_amount);
+    m_parallel_controllers.clear();
+    for (int i = 0 ; i < kart_amount; ++i)
+    {
+        SpareTireAI* sta =
+            dynamic_cast<SpareTireAI*>(m_karts[i]->getController());
+        // Update all karts that are not eliminated
+        needs_update[i] =
+            !m_karts[i]->isEliminated() || (sta && sta->isMoving());
+        if (!needs_update[i] || !m_karts[i]->updateBeforeController(ticks))
+            continue;
+        Controller* controller = m_karts[i]->getController();
+        if (controller->canUpdateInParallel())
+            m_parallel_controllers.push_back(controller);
+        else
+            controller->update(ticks);
+    }
+
+    m_kart_update_pool->parallelFor((unsigned)m_parallel_controllers.size(),
+        [this, ticks](unsigned i)
+        {
+            m_parallel_controllers[i]->updateInParallel(ticks);
+        });
+    for (Controller* controller : m_parallel_controllers)
+        controller->finishParallelUpdate();
+
+    for (int i = 0 ; i < kart_amount; ++i)
+    {
+        if (needs_update[i])
+            m_karts[i]->update(ticks);
+        if (isStartPhase())
+            m_karts[i]->makeKartRest();
+    }
+}   // updateKartsInParallel
+
 // ----------------------------------------------------------------------------
 /** Only updates the track. The order in which the various parts of STK are
  *  updated is quite important (i.e. the track can't be updated as part of
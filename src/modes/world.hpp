@@ -47,6 +47,7 @@ class Controller;
 class ItemState;
 class PhysicalObject;
 class STKPeer;
+class ThreadPool;
 
 namespace Scripting
 {
@@ -179,6 +180,14 @@ protected:
 
     /** Set when the world is online and counts network players. */
     bool m_is_network_world;
+
+    /** Threads to update the AI controllers of all karts in parallel, NULL
+     *  in networked games and if --ai-threads was not used, in which case
+     *  the karts are updated one after another. */
+    ThreadPool* m_kart_update_pool;
+
+    /** The controllers updated in parallel in the current update. */
+    std::vector<Controller*> m_parallel_controllers;
     
     virtual void  onGo() OVERRIDE;
     /** Returns true if the race is over. Must be defined by all modes. */
@@ -186,6 +195,8 @@ protected:
     virtual void  update(int ticks) OVERRIDE;
     virtual void  createRaceGUI();
             void  updateTrack(int ticks);
+            void  updateKarts(int ticks);
+            void  updateKartsInParallel(int ticks);
     // ------------------------------------------------------------------------
     /** Used for AI karts that are still racing when all player kart finished.
      *  Generally it should estimate the arrival time for those karts, but as
@@ -379,6 +390,10 @@ public:
     // ------------------------------------------------------------------------
     bool isNetworkWorld() const { return m_is_network_world; }
     // ------------------------------------------------------------------------
+    /** Returns true if the AI controllers are updated together, see
+     *  updateKartsInParallel(). */
+    bool updatesKartsInParallel() const { return m_kart_update_pool != NULL; }
+    // ------------------------------------------------------------------------
     /** Set the team arrow on karts if necessary*/
     void initTeamArrows(AbstractKart* k);
     // ------------------------------------------------------------------------
@@ -29,6 +29,15 @@ namespace CompressNetworkBody
 {
     using namespace MiniGLM;
     // ------------------------------------------------------------------------
+    /** Offset in the network string of the last body written by compress(),
+     *  or -1. GameProtocol uses this to find the body in the state of a
+     *  rewinder, to send it with reduced precision to far away clients. */
+    inline int& lastBodyOffset()
+    {
+        static int offset = -1;
+        return offset;
+    }   // lastBodyOffset
+    // ------------------------------------------------------------------------
     /** Set body and motion state of bullet object with compressed values. */
     inline void setCompressedValues(float x, float y, float z,
                                     uint32_t compressed_q,
@@ -79,6 +88,7 @@ namespace CompressNetworkBody
         if (!bns)
             return;
 
+        lastBodyOffset() = (int)bns->getTotalSize();
         bns->addFloat(x).addFloat(y).addFloat(z).addUInt32(compressed_q);
         bns->addUInt16(lvx).addUInt16(lvy).addUInt16(lvz)
             .addUInt16(avx).addUInt16(avy).addUInt16(avz);
@@ -0,0 +1,393 @@
+//
+//  SuperTuxKart - a fun racing game with go-kart
+//  Copyright (C) 2020 SuperTuxKart-Team
+//
+//  This program is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU General Public License
+//  as published by the Free Software Foundation; either version 3
+//  of the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+#include "network/database_cache.hpp"
+
+#include "network/server_config.hpp"
+#include "utils/log.hpp"
+#include "utils/time.hpp"
+#include "utils/vs.hpp"
+
+#include <chrono>
+#include <random>
+
+// ----------------------------------------------------------------------------
+/** Loads the tables and starts the background thread.
+ *  \param database_file The database to load from.
+ *  \param ip_ban_table Name of the ip ban table, empty if it doesn't exist.
+ *  \param online_id_ban_table Name of the online id ban table, empty if it
+ *         doesn't exist.
+ *  \param ip_geolocation_table Name of the ip geolocation table, empty if it
+ *         doesn't exist.
+ */
+DatabaseCache::DatabaseCache(const std::string& database_file,
+                             const std::string& ip_ban_table,
+                             const std::string& online_id_ban_table,
+                             const std::string& ip_geolocation_table)
+             : m_ip_ban_table(ip_ban_table),
+               m_online_id_ban_table(online_id_ban_table),
+               m_ip_geolocation_table(ip_geolocation_table)
+{
+    m_tables.reset(new Tables());
+    m_new_tables.store(NULL);
+    m_exit = false;
+#ifdef ENABLE_SQLITE3
+    m_data_version = -1;
+    m_ip_geolocation_rows = -1;
+    m_ip_geolocation_sum = -1;
+    // A private cache, otherwise PRAGMA data_version doesn't see the changes
+    // done by the connection of the server lobby
+    int ret = sqlite3_open_v2(database_file.c_str(), &m_db,
+        SQLITE_OPEN_PRIVATECACHE | SQLITE_OPEN_READONLY, NULL);
+    if (ret != SQLITE_OK)
+    {
+        Log::error("DatabaseCache", "Cannot open database: %s.",
+            sqlite3_errmsg(m_db));
+        sqlite3_close(m_db);
+        m_db = NULL;
+        return;
+    }
+    sqlite3_busy_timeout(m_db, ServerConfig::m_database_timeout);
+
+    // Load the tables now, so that no player can connect before the bans
+    // are known
+    Tables* tables = loadTables();
+    if (tables)
+        m_tables.reset(tables);
+    m_thread = std::thread(&DatabaseCache::refreshLoop, this,
+        std::max((int)ServerConfig::m_database_refresh_interval, 1));
+#endif
+}   // DatabaseCache
+
+// ----------------------------------------------------------------------------
+DatabaseCache::~DatabaseCache()
+{
+    std::unique_lock<std::mutex> ul(m_exit_mutex);
+    m_exit = true;
+    m_exit_cv.notify_all();
+    ul.unlock();
+    if (m_thread.joinable())
+        m_thread.join();
+    delete m_new_tables.load();
+#ifdef ENABLE_SQLITE3
+    if (m_db)
+        sqlite3_close(m_db);
+#endif
+}   // ~DatabaseCache
+
+// ----------------------------------------------------------------------------
+/** Checks every interval seconds if the database changed, and if so loads
+ *  the tables again. Runs in a separate thread.
+ */
+void DatabaseCache::refreshLoop(int interval)
+{
+    VS::setThreadName("DatabaseCache");
+    std::unique_lock<std::mutex> ul(m_exit_mutex);
+    while (true)
+    {
+        m_exit_cv.wait_for(ul, std::chrono::seconds(interval),
+            [this]() { return m_exit; });
+        if (m_exit)
+            return;
+        ul.unlock();
+#ifdef ENABLE_SQLITE3
+        Tables* tables = loadTables();
+        if (tables)
+        {
+            // Discard tables not taken over yet, these are newer
+            delete m_new_tables.exchange(tables);
+        }
+#endif
+        ul.lock();
+    }
+}   // refreshLoop
+
+// ----------------------------------------------------------------------------
+/** Uses the tables loaded by the background thread (if any) from now on. */
+void DatabaseCache::update()
+{
+    Tables* tables = m_new_tables.exchange(NULL);
+    if (tables)
+        m_tables.reset(tables);
+}   // update
+
+// ----------------------------------------------------------------------------
+/** Returns the active ban of an ip, or NULL if it is not banned. */
+const DatabaseCache::Ban* DatabaseCache::findIPBan(uint32_t ip) const
+{
+    const int64_t now = (int64_t)StkTime::getTimeSinceEpoch();
+    return m_tables->m_ip_ban.find(ip,
+        [now](const Ban& ban) { return ban.isActive(now); });
+}   // findIPBan
+
+// ----------------------------------------------------------------------------
+/** Returns the active ban of an online id, or NULL if it is not banned. */
+const DatabaseCache::Ban* DatabaseCache::findOnlineIdBan(uint32_t online_id)
+                                                                          const
+{
+    const int64_t now = (int64_t)StkTime::getTimeSinceEpoch();
+    return m_tables->m_online_id_ban.find(online_id,
+        [now](const Ban& ban) { return ban.isActive(now); });
+}   // findOnlineIdBan
+
+// ----------------------------------------------------------------------------
+/** Returns the country code of an ip, or "" if it is unknown. If several
+ *  ranges contain the ip, the one with the largest start is used.
+ */
+std::string DatabaseCache::findCountryCode(uint32_t ip) const
+{
+    if (!m_tables->m_ip_geolocation)
+        return "";
+    const std::string* country_code = m_tables->m_ip_geolocation->find(ip);
+    return country_code ? *country_code : "";
+}   // findCountryCode
+
+#ifdef ENABLE_SQLITE3
+// ----------------------------------------------------------------------------
+/** Runs a query returning a single integer.
+ *  \return The integer, 0 if the result is NULL, or -1 on error.
+ */
+int64_t DatabaseCache::queryInt(const std::string& query) const
+{
+    sqlite3_stmt* stmt = NULL;
+    int64_t result = -1;
+    if (sqlite3_prepare_v2(m_db, query.c_str(), -1, &stmt, 0) != SQLITE_OK)
+    {
+        Log::error("DatabaseCache", "Error preparing database for query "
+            "%s: %s", query.c_str(), sqlite3_errmsg(m_db));
+        return result;
+    }
+    if (sqlite3_step(stmt) == SQLITE_ROW)
+        result = sqlite3_column_int64(stmt, 0);
+    sqlite3_finalize(stmt);
+    return result;
+}   // queryInt
+
+// ----------------------------------------------------------------------------
+/** Loads all bans which are or can still become active from a ban table.
+ *  \param table Name of the table.
+ *  \param ip True for an ip ban table, false for an online id ban table.
+ *  \param result The table to add the bans to.
+ *  \return False if an error occurred.
+ */
+bool DatabaseCache::loadBanTable(const std::string& table, bool ip,
+                                 RangeTable<Ban>* result) const
+{
+    // Times are converted to seconds since 1970, the expiry time is NULL
+    // if expired_days is NULL
+    std::string query = std::string("SELECT rowid, ") +
+        (ip ? "ip_start, ip_end" : "online_id, online_id") +
+        ", reason, description, "
+        "CAST(strftime('%s', starting_time) AS INTEGER), "
+        "CAST(strftime('%s', starting_time, '+'||expired_days||' days') "
+        "AS INTEGER) FROM " + table + ";";
+    sqlite3_stmt* stmt = NULL;
+    if (sqlite3_prepare_v2(m_db, query.c_str(), -1, &stmt, 0) != SQLITE_OK)
+    {
+        Log::error("DatabaseCache", "Error preparing database for query "
+            "%s: %s", query.c_str(), sqlite3_errmsg(m_db));
+        return false;
+    }
+
+    const int64_t now = (int64_t)StkTime::getTimeSinceEpoch();
+    int ret;
+    while ((ret = sqlite3_step(stmt)) == SQLITE_ROW)
+    {
+        // Without a valid starting time a ban is never active
+        if (sqlite3_column_type(stmt, 5) == SQLITE_NULL)
+            continue;
+        Ban ban;
+        ban.m_row_id = sqlite3_column_int(stmt, 0);
+        ban.m_start = (uint32_t)sqlite3_column_int64(stmt, 1);
+        ban.m_end = (uint32_t)sqlite3_column_int64(stmt, 2);
+        const char* reason = (const char*)sqlite3_column_text(stmt, 3);
+        ban.m_reason = reason ? reason : "";
+        const char* desc = (const char*)sqlite3_column_text(stmt, 4);
+        ban.m_description = desc ? desc : "";
+        ban.m_starting_time = sqlite3_column_int64(stmt, 5);
+        ban.m_expired_time = sqlite3_column_type(stmt, 6) == SQLITE_NULL ?
+            -1 : sqlite3_column_int64(stmt, 6);
+        // Expired bans can't become active again
+        if (ban.m_expired_time != -1 && ban.m_expired_time <= now)
+            continue;
+        result->add(ban.m_start, ban.m_end, ban);
+    }
+    sqlite3_finalize(stmt);
+    if (ret != SQLITE_DONE)
+    {
+        Log::error("DatabaseCache", "Error loading table %s: %s",
+            table.c_str(), sqlite3_errmsg(m_db));
+        return false;
+    }
+    result->finish();
+    return true;
+}   // loadBanTable
+
+// ----------------------------------------------------------------------------
+/** Loads the ip geolocation table if it changed since it was loaded last.
+ *  \return False if an error occurred.
+ */
+bool DatabaseCache::loadIPGeolocationTable()
+{
+    const int64_t rows =
+        queryInt("SELECT count(*) FROM " + m_ip_geolocation_table + ";");
+    // The table is usually created WITHOUT ROWID, so the sum of all ranges
+    // is used to detect changed rows
+    const int64_t sum = queryInt("SELECT sum(ip_start + ip_end) FROM " +
+        m_ip_geolocation_table + ";");
+    if (rows == -1 || sum == -1)
+        return false;
+    if (m_loaded_ip_geolocation && rows == m_ip_geolocation_rows &&
+        sum == m_ip_geolocation_sum)
+        return true;
+
+    std::string query = "SELECT ip_start, ip_end, country_code FROM " +
+        m_ip_geolocation_table + ";";
+    sqlite3_stmt* stmt = NULL;
+    if (sqlite3_prepare_v2(m_db, query.c_str(), -1, &stmt, 0) != SQLITE_OK)
+    {
+        Log::error("DatabaseCache", "Error preparing database for query "
+            "%s: %s", query.c_str(), sqlite3_errmsg(m_db));
+        return false;
+    }
+    auto geolocation = std::make_shared<RangeTable<std::string> >();
+    int ret;
+    while ((ret = sqlite3_step(stmt)) == SQLITE_ROW)
+    {
+        const char* country_code = (const char*)sqlite3_column_text(stmt, 2);
+        geolocation->add((uint32_t)sqlite3_column_int64(stmt, 0),
+            (uint32_t)sqlite3_column_int64(stmt, 1),
+            country_code ? country_code : "");
+    }
+    sqlite3_finalize(stmt);
+    if (ret != SQLITE_DONE)
+    {
+        Log::error("DatabaseCache", "Error loading table %s: %s",
+            m_ip_geolocation_table.c_str(), sqlite3_errmsg(m_db));
+        return false;
+    }
+    geolocation->finish();
+    m_loaded_ip_geolocation = geolocation;
+    m_ip_geolocation_rows = rows;
+    m_ip_geolocation_sum = sum;
+    Log::info("DatabaseCache", "Loaded %d ip geolocation ranges.",
+        (int)geolocation->size());
+    return true;
+}   // loadIPGeolocationTable
+
+// ----------------------------------------------------------------------------
+/** Loads all tables if the database was changed since they were loaded
+ *  last, or if loading failed last time.
+ *  \return The new tables, or NULL if the database didn't change or they
+ *          could not be loaded.
+ */
+DatabaseCache::Tables* DatabaseCache::loadTables()
+{
+    const int64_t data_version = queryInt("PRAGMA data_version;");
+    if (data_version != -1 && data_version == m_data_version)
+        return NULL;
+
+    bool ok = true;
+    Tables* tables = new Tables();
+    if (!m_ip_ban_table.empty())
+        ok &= loadBanTable(m_ip_ban_table, /*ip*/true, &tables->m_ip_ban);
+    if (!m_online_id_ban_table.empty())
+    {
+        ok &= loadBanTable(m_online_id_ban_table, /*ip*/false,
+                           &tables->m_online_id_ban);
+    }
+    if (!m_ip_geolocation_table.empty())
+    {
+        ok &= loadIPGeolocationTable();
+        tables->m_ip_geolocation = m_loaded_ip_geolocation;
+    }
+    if (!ok)
+    {
+        // Keep the previous tables and try again next time
+        delete tables;
+        m_data_version = -1;
+        return NULL;
+    }
+    m_data_version = data_version;
+    return tables;
+}   // loadTables
+
+#endif
+
+// ----------------------------------------------------------------------------
+/** Compares lookups in random, overlapping ranges with a linear search, and
+ *  tests when bans are active.
+ */
+void DatabaseCache::unitTesting()
+{
+    std::mt19937 random(42);
+    RangeTable<int> table;
+    std::vector<std::pair<uint32_t, uint32_t> > ranges;
+    for (int i = 0; i < 2000; i++)
+    {
+        uint32_t start = random();
+        // Mostly short ranges, some long ones and some single values
+        uint32_t length = i % 50 == 0 ? random() % 0x40000000 :
+                          i % 3 == 0 ? 0 : random() % 0x100000;
+        uint32_t end = start + length < start ? 0xffffffff : start + length;
+        table.add(start, end, i);
+        ranges.emplace_back(start, end);
+    }
+    table.add(0, 0, 2000);
+    ranges.emplace_back(0, 0);
+    table.add(0xffffffff, 0xffffffff, 2001);
+    ranges.emplace_back(0xffffffff, 0xffffffff);
+    table.finish();
+
+    for (int i = 0; i < 20000; i++)
+    {
+        uint32_t value = i % 2 == 0 ? (uint32_t)random() :
+            ranges[random() % ranges.size()].first + random() % 3;
+        if (i < 4)
+            value = i < 2 ? 0 : 0xffffffff;
+        // Only accept even data in half the tests
+        const bool even = i % 4 < 2;
+        int expected = -1;
+        for (unsigned j = 0; j < ranges.size(); j++)
+        {
+            if (ranges[j].first <= value && ranges[j].second >= value &&
+                (!even || j % 2 == 0) &&
+                (expected == -1 || ranges[j].first > ranges[expected].first))
+                expected = j;
+        }
+        const int* found = even ?
+            table.find(value, [](int data) { return data % 2 == 0; }) :
+            table.find(value);
+        // Ranges with the same start can be found in any order
+        if ((found == NULL) != (expected == -1) || (found &&
+            (ranges[*found].first != ranges[expected].first ||
+             ranges[*found].second < value || (even && *found % 2 != 0))))
+        {
+            Log::fatal("DatabaseCache", "Wrong range found for %u.", value);
+        }
+    }
+
+    Ban ban;
+    ban.m_starting_time = 1000;
+    ban.m_expired_time = -1;
+    if (ban.isActive(1000) || !ban.isActive(1001) || !ban.isActive(1000000))
+        Log::fatal("DatabaseCache", "Wrong ban without expiry.");
+    ban.m_expired_time = 2000;
+    if (!ban.isActive(1999) || ban.isActive(2000))
+        Log::fatal("DatabaseCache", "Wrong ban with expiry.");
+}   // unitTesting
@@ -0,0 +1,212 @@
+//
+//  SuperTuxKart - a fun racing game with go-kart
+//  Copyright (C) 2020 SuperTuxKart-Team
+//
+//  This program is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU General Public License
+//  as published by the Free Software Foundation; either version 3
+//  of the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+#ifndef HEADER_DATABASE_CACHE_HPP
+#define HEADER_DATABASE_CACHE_HPP
+
+#include "utils/types.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifdef ENABLE_SQLITE3
+#include <sqlite3.h>
+#endif
+
+/** \ingroup network
+ *  A set of (possibly overlapping) ranges of unsigned values, each with some
+ *  data. The ranges are sorted by their start, and each one stores the
+ *  largest end of all ranges up to it. So all ranges containing a value are
+ *  found by a binary search for the last range starting before the value,
+ *  followed by a walk backwards which stops as soon as no earlier range
+ *  can reach the value anymore (which is immediately for disjoint ranges).
+ */
+template<typename T>
+class RangeTable
+{
+private:
+    struct Entry
+    {
+        uint32_t m_start;
+        uint32_t m_end;
+        /** Largest m_end of this and all previous entries. */
+        uint32_t m_max_end;
+        T m_data;
+    };
+    std::vector<Entry> m_entries;
+
+public:
+    // ------------------------------------------------------------------------
+    /** Adds a range, finish() must be called after all ranges are added. */
+    void add(uint32_t start, uint32_t end, const T& data)
+    {
+        m_entries.push_back({ start, end, end, data });
+    }   // add
+    // ------------------------------------------------------------------------
+    void finish()
+    {
+        std::stable_sort(m_entries.begin(), m_entries.end(),
+            [](const Entry& a, const Entry& b)
+            {
+                return a.m_start < b.m_start;
+            });
+        for (unsigned i = 1; i < m_entries.size(); i++)
+        {
+            m_entries[i].m_max_end = std::max(m_entries[i].m_end,
+                                              m_entries[i - 1].m_max_end);
+        }
+    }   // finish
+    // ------------------------------------------------------------------------
+    /** Returns the data of the range containing value with the largest start
+     *  for which accept(data) is true, or NULL if there is none. */
+    template<typename Accept>
+    const T* find(uint32_t value, Accept accept) const
+    {
+        auto it = std::upper_bound(m_entries.begin(), m_entries.end(), value,
+            [](uint32_t v, const Entry& e) { return v < e.m_start; });
+        while (it != m_entries.begin())
+        {
+            it--;
+            if (it->m_max_end < value)
+                break;
+            if (it->m_end >= value && accept(it->m_data))
+                return &it->m_data;
+        }
+        return NULL;
+    }   // find
+    // ------------------------------------------------------------------------
+    const T* find(uint32_t value) const
+    {
+        return find(value, [](const T&) { return true; });
+    }   // find
+    // ------------------------------------------------------------------------
+    size_t size() const                            { return m_entries.size(); }
+};   // RangeTable
+
+// ============================================================================
+/** \ingroup network
+ *  Keeps the ip ban, online id ban and ip geolocation tables of the server
+ *  database in memory, so that connecting players can be checked without
+ *  running a query. The tables are loaded when this object is created, and
+ *  then a background thread (with its own database connection) checks every
+ *  database-refresh-interval seconds if the database was changed, and if so
+ *  loads them again. The geolocation table is usually large and rarely
+ *  changed, so it is only loaded again if its number of rows or the sum of
+ *  its ranges changed.
+ *  The tables loaded by the background thread are taken over in update(),
+ *  so update() and the find functions must be called from the same thread,
+ *  and don't need any locking.
+ */
+class DatabaseCache
+{
+public:
+    /** An entry of a ban table. */
+    struct Ban
+    {
+        int m_row_id;
+        /** The banned ip range or online id (in both). */
+        uint32_t m_start;
+        uint32_t m_end;
+        /** Time the ban starts, in seconds since 1.1.1970. */
+        int64_t m_starting_time;
+        /** Time the ban ends, -1 if it doesn't expire. */
+        int64_t m_expired_time;
+        std::string m_reason;
+        std::string m_description;
+        // --------------------------------------------------------------------
+        bool isActive(int64_t now) const
+        {
+            return now > m_starting_time &&
+                (m_expired_time == -1 || m_expired_time > now);
+        }   // isActive
+    };   // Ban
+
+private:
+    struct Tables
+    {
+        RangeTable<Ban> m_ip_ban;
+        RangeTable<Ban> m_online_id_ban;
+        /** Shared by all tables loaded while it doesn't change. */
+        std::shared_ptr<const RangeTable<std::string> > m_ip_geolocation;
+    };
+
+    /** The tables used by the find functions. */
+    std::unique_ptr<Tables> m_tables;
+
+    /** Tables loaded by the background thread which were not yet taken
+     *  over by update(). */
+    std::atomic<Tables*> m_new_tables;
+
+    std::string m_ip_ban_table;
+
+    std::string m_online_id_ban_table;
+
+    std::string m_ip_geolocation_table;
+
+    /** Background thread loading changed tables. */
+    std::thread m_thread;
+
+    std::mutex m_exit_mutex;
+
+    std::condition_variable m_exit_cv;
+
+    bool m_exit;
+
+#ifdef ENABLE_SQLITE3
+    /** The database connection of the background thread. */
+    sqlite3* m_db;
+
+    /** PRAGMA data_version when the tables were loaded. */
+    int64_t m_data_version;
+
+    /** The latest geolocation table loaded by the background thread. */
+    std::shared_ptr<const RangeTable<std::string> > m_loaded_ip_geolocation;
+
+    /** Number of rows and sum of all ip starts and ends of
+     *  m_loaded_ip_geolocation. */
+    int64_t m_ip_geolocation_rows;
+    int64_t m_ip_geolocation_sum;
+
+    int64_t queryInt(const std::string& query) const;
+    bool loadBanTable(const std::string& table, bool ip,
+                      RangeTable<Ban>* result) const;
+    bool loadIPGeolocationTable();
+    Tables* loadTables();
+#endif
+    void refreshLoop(int interval);
+
+public:
+    DatabaseCache(const std::string& database_file,
+                  const std::string& ip_ban_table,
+                  const std::string& online_id_ban_table,
+                  const std::string& ip_geolocation_table);
+    ~DatabaseCache();
+    void update();
+    const Ban* findIPBan(uint32_t ip) const;
+    const Ban* findOnlineIdBan(uint32_t online_id) const;
+    std::string findCountryCode(uint32_t ip) const;
+    static void unitTesting();
+};   // DatabaseCache
+
+#endif
@@ -0,0 +1,354 @@
+//
+//  SuperTuxKart - a fun racing game with go-kart
+//  Copyright (C) 2020 SuperTuxKart-Team
+//
+//  This program is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU General Public License
+//  as published by the Free Software Foundation; either version 3
+//  of the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+#ifdef ENABLE_SQLITE3
+
+#include "network/database_writer.hpp"
+
+#include "io/file_manager.hpp"
+#include "network/server_config.hpp"
+#include "utils/file_utils.hpp"
+#include "utils/log.hpp"
+#include "utils/string_utils.hpp"
+#include "utils/vs.hpp"
+
+#include <atomic>
+#include <chrono>
+
+// ----------------------------------------------------------------------------
+/** Opens the database and starts the writer thread.
+ *  \param database_file The database to write to.
+ *  \param flush_interval Time in ms queries are collected before they are
+ *         written in one transaction.
+ *  \param flush_queries Number of queued queries after which they are
+ *         written without waiting any longer.
+ *  \param max_queries Maximum number of queued queries, further queries are
+ *         dropped.
+ */
+DatabaseWriter::DatabaseWriter(const std::string& database_file,
+                               unsigned flush_interval,
+                               unsigned flush_queries, unsigned max_queries)
+              : m_flush_interval(flush_interval),
+                m_flush_queries(std::max(flush_queries, 1u)),
+                m_max_queries(max_queries)
+{
+    m_exit = false;
+    m_num_dropped = 0;
+    // A private cache, otherwise sqlite reports a locked table to the other
+    // connections immediately instead of calling their busy handler
+    int ret = sqlite3_open_v2(database_file.c_str(), &m_db,
+        SQLITE_OPEN_PRIVATECACHE | SQLITE_OPEN_READWRITE, NULL);
+    if (ret != SQLITE_OK)
+    {
+        Log::error("DatabaseWriter", "Cannot open database: %s.",
+            sqlite3_errmsg(m_db));
+        sqlite3_close(m_db);
+        m_db = NULL;
+        return;
+    }
+    sqlite3_busy_timeout(m_db, ServerConfig::m_database_timeout);
+    m_thread = std::thread(&DatabaseWriter::writerLoop, this);
+}   // DatabaseWriter
+
+// ----------------------------------------------------------------------------
+/** Writes all queued queries, and closes the database. */
+DatabaseWriter::~DatabaseWriter()
+{
+    std::unique_lock<std::mutex> ul(m_queue_mutex);
+    m_exit = true;
+    m_queue_cv.notify_all();
+    ul.unlock();
+    if (m_thread.joinable())
+        m_thread.join();
+    for (auto& statement : m_statements)
+        sqlite3_finalize(statement.second);
+    if (m_db)
+        sqlite3_close(m_db);
+}   // ~DatabaseWriter
+
+// ----------------------------------------------------------------------------
+/** Queues a query to be written. Can be called from any thread.
+ *  \param query The query, with a ? for each value.
+ *  \param values The values bound to the parameters of the query.
+ *  \param callback Called with true if the query was written successfully,
+ *         or false otherwise. It is called by the writer thread, or
+ *         immediately if the query is dropped.
+ *  \return False if the query was dropped.
+ */
+bool DatabaseWriter::write(const std::string& query,
+                           const std::vector<Value>& values,
+                           const std::function<void(bool)>& callback)
+{
+    std::unique_lock<std::mutex> ul(m_queue_mutex);
+    if (!m_db || m_exit || m_queue.size() >= m_max_queries)
+    {
+        // Only warn once for each time the queue is full
+        if (m_db && m_num_dropped++ == 0)
+        {
+            Log::warn("DatabaseWriter", "Too many queued queries, "
+                "dropping %s", query.c_str());
+        }
+        ul.unlock();
+        if (callback)
+            callback(false);
+        return false;
+    }
+    if (m_num_dropped > 0)
+    {
+        Log::warn("DatabaseWriter", "%u queries were dropped.",
+            m_num_dropped);
+        m_num_dropped = 0;
+    }
+    m_queue.push_back({ query, values, callback });
+    if (m_queue.size() == 1 || m_queue.size() >= m_flush_queries)
+        m_queue_cv.notify_one();
+    return true;
+}   // write
+
+// ----------------------------------------------------------------------------
+/** Waits for queued queries and writes them. Runs in a separate thread. */
+void DatabaseWriter::writerLoop()
+{
+    VS::setThreadName("DatabaseWriter");
+    std::vector<Query> queries;
+    std::unique_lock<std::mutex> ul(m_queue_mutex);
+    while (true)
+    {
+        m_queue_cv.wait(ul, [this]() { return m_exit || !m_queue.empty(); });
+        // Collect more queries to write them in the same transaction
+        m_queue_cv.wait_for(ul, std::chrono::milliseconds(m_flush_interval),
+            [this]() { return m_exit || m_queue.size() >= m_flush_queries; });
+        // Only empty when exiting
+        if (m_queue.empty())
+            return;
+        std::swap(queries, m_queue);
+        ul.unlock();
+        writeQueries(&queries);
+        queries.clear();
+        ul.lock();
+    }
+}   // writerLoop
+
+// ----------------------------------------------------------------------------
+/** Writes queries in one transaction, and calls their callbacks. */
+void DatabaseWriter::writeQueries(std::vector<Query>* queries)
+{
+    // Without a transaction each query is written on its own, which is
+    // slower but still correct
+    const bool transaction = execute("BEGIN IMMEDIATE;");
+    std::vector<bool> written(queries->size());
+    for (unsigned i = 0; i < queries->size(); i++)
+        written[i] = execute((*queries)[i]);
+    if (transaction && !execute("COMMIT;"))
+    {
+        execute("ROLLBACK;");
+        written.assign(queries->size(), false);
+    }
+    for (unsigned i = 0; i < queries->size(); i++)
+    {
+        if ((*queries)[i].m_callback)
+            (*queries)[i].m_callback(written[i]);
+    }
+}   // writeQueries
+
+// ----------------------------------------------------------------------------
+/** Returns the prepared statement for a query, or NULL on error. */
+sqlite3_stmt* DatabaseWriter::getStatement(const std::string& query)
+{
+    auto it = m_statements.find(query);
+    if (it != m_statements.end())
+        return it->second;
+
+    // Queries which are formatted with changing values are not reused, so
+    // don't let them pile up
+    if (m_statements.size() >= 64)
+    {
+        for (auto& statement : m_statements)
+            sqlite3_finalize(statement.second);
+        m_statements.clear();
+    }
+    sqlite3_stmt* stmt = NULL;
+    if (sqlite3_prepare_v2(m_db, query.c_str(), -1, &stmt, 0) != SQLITE_OK)
+    {
+        Log::error("DatabaseWriter", "Error preparing database for query "
+            "%s: %s", query.c_str(), sqlite3_errmsg(m_db));
+        sqlite3_finalize(stmt);
+        return NULL;
+    }
+    m_statements[query] = stmt;
+    return stmt;
+}   // getStatement
+
+// ----------------------------------------------------------------------------
+/** Binds the values of a query and executes it.
+ *  \return True if no error occurred.
+ */
+bool DatabaseWriter::execute(const Query& query)
+{
+    sqlite3_stmt* stmt = getStatement(query.m_query);
+    if (!stmt)
+        return false;
+    bool ok = true;
+    for (unsigned i = 0; i < query.m_values.size(); i++)
+    {
+        // The values stay alive until the statement is reset
+        const Value& value = query.m_values[i];
+        int ret;
+        if (value.m_type == Value::VT_INTEGER)
+            ret = sqlite3_bind_int64(stmt, i + 1, value.m_integer);
+        else if (value.m_type == Value::VT_TEXT)
+        {
+            ret = sqlite3_bind_text(stmt, i + 1, value.m_text.c_str(), -1,
+                SQLITE_STATIC);
+        }
+        else
+            ret = sqlite3_bind_null(stmt, i + 1);
+        if (ret != SQLITE_OK)
+        {
+            Log::error("DatabaseWriter", "Failed to bind value %d of query "
+                "%s: %s", i + 1, query.m_query.c_str(), sqlite3_errmsg(m_db));
+            ok = false;
+        }
+    }
+    if (ok)
+    {
+        int ret = sqlite3_step(stmt);
+        if (ret != SQLITE_DONE && ret != SQLITE_ROW)
+        {
+            Log::error("DatabaseWriter", "Error executing query %s: %s",
+                query.m_query.c_str(), sqlite3_errmsg(m_db));
+            ok = false;
+        }
+    }
+    sqlite3_reset(stmt);
+    sqlite3_clear_bindings(stmt);
+    return ok;
+}   // execute
+
+// ----------------------------------------------------------------------------
+bool DatabaseWriter::execute(const std::string& query)
+{
+    return execute(Query{ query, std::vector<Value>(), nullptr });
+}   // execute
+
+// ----------------------------------------------------------------------------
+/** Writes several thousand queries from two threads into a temporary
+ *  database, and checks the result and the callbacks.
+ */
+void DatabaseWriter::unitTesting()
+{
+    const std::string file = FileUtils::getTemporaryPath(
+        file_manager->getCachedDataDir() + "database_writer_test.sqlite");
+    file_manager->removeFile(file);
+    sqlite3* db = NULL;
+    if (sqlite3_open_v2(file.c_str(), &db,
+        SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE, NULL) != SQLITE_OK ||
+        sqlite3_exec(db, "CREATE TABLE events (id INTEGER PRIMARY KEY, "
+        "name TEXT NOT NULL, value INTEGER NOT NULL, note TEXT NULL);",
+        NULL, NULL, NULL) != SQLITE_OK)
+    {
+        Log::fatal("DatabaseWriter", "Cannot create %s: %s", file.c_str(),
+            sqlite3_errmsg(db));
+    }
+    sqlite3_close(db);
+
+    const int num_events = 5000;
+    std::atomic<int> num_written(0), num_failed(0);
+    auto callback = [&num_written, &num_failed](bool written)
+        {
+            if (written)
+                num_written++;
+            else
+                num_failed++;
+        };
+    {
+        DatabaseWriter writer(file, 10, 64);
+        // Like connecting and disconnecting players from the lobby thread
+        // and the main thread at the same time
+        auto feed = [&writer, &callback](int first, int last)
+            {
+                for (int i = first; i < last; i++)
+                {
+                    writer.write("INSERT INTO events (id, name, value, note) "
+                        "VALUES (?, ?, ?, ?);", { i, StringUtils::insertValues(
+                        "player '%d'", i), i * 3, i % 2 == 0 ?
+                        Value() : Value("note") }, callback);
+                    if (i % 10 == 0)
+                    {
+                        writer.write("UPDATE events SET value = value + 1 "
+                            "WHERE id = ?;", { i }, callback);
+                    }
+                    // A failing query must not affect the others
+                    if (i % 1000 == 0)
+                    {
+                        writer.write("UPDATE no_such_table SET value = 1;",
+                            std::vector<Value>(), callback);
+                    }
+                }
+            };
+        std::thread other(feed, num_events / 2, num_events);
+        feed(0, num_events / 2);
+        other.join();
+    }
+    if (num_written != num_events + num_events / 10 || num_failed != 5)
+    {
+        Log::fatal("DatabaseWriter", "Wrong callbacks: %d written, %d "
+            "failed.", num_written.load(), num_failed.load());
+    }
+
+    // Nothing is taken from the queue before the interval of 10 minutes,
+    // so the queries after the first 100 are dropped
+    num_written = num_failed = 0;
+    {
+        DatabaseWriter writer(file, 600000, 1000, 100);
+        for (int i = 0; i < 150; i++)
+        {
+            writer.write("UPDATE events SET value = value + 1 WHERE id = ?;",
+                { i % 2 }, callback);
+        }
+        if (num_written != 0 || num_failed != 50)
+            Log::fatal("DatabaseWriter", "Queries were not dropped.");
+    }
+    if (num_written != 100)
+        Log::fatal("DatabaseWriter", "Queued queries were not written.");
+
+    db = NULL;
+    sqlite3_open_v2(file.c_str(), &db, SQLITE_OPEN_READONLY, NULL);
+    sqlite3_stmt* stmt = NULL;
+    int ret = sqlite3_prepare_v2(db, "SELECT count(*), sum(value), "
+        "count(note), sum(name = 'player ''' || id || '''') FROM events;",
+        -1, &stmt, 0);
+    if (ret != SQLITE_OK || sqlite3_step(stmt) != SQLITE_ROW ||
+        sqlite3_column_int64(stmt, 0) != num_events ||
+        sqlite3_column_int64(stmt, 1) !=
+        3 * (int64_t)num_events * (num_events - 1) / 2 + num_events / 10 +
+        100 ||
+        sqlite3_column_int64(stmt, 2) != num_events / 2 ||
+        sqlite3_column_int64(stmt, 3) != num_events)
+    {
+        sqlite3_finalize(stmt);
+        sqlite3_close(db);
+        file_manager->removeFile(file);
+        Log::fatal("DatabaseWriter", "Wrong database content.");
+    }
+    sqlite3_finalize(stmt);
+    sqlite3_close(db);
+    file_manager->removeFile(file);
+}   // unitTesting
+
+#endif
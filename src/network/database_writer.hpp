@@ -0,0 +1,124 @@
+//
+//  SuperTuxKart - a fun racing game with go-kart
+//  Copyright (C) 2020 SuperTuxKart-Team
+//
+//  This program is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU General Public License
+//  as published by the Free Software Foundation; either version 3
+//  of the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+#ifndef HEADER_DATABASE_WRITER_HPP
+#define HEADER_DATABASE_WRITER_HPP
+
+#ifdef ENABLE_SQLITE3
+
+#include "utils/types.hpp"
+
+#include <condition_variable>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <sqlite3.h>
+
+/** \ingroup network
+ *  Writes to the server database in a separate thread (with its own
+ *  database connection), so that a slow or locked database never blocks the
+ *  server lobby. Queries are queued by write(), and written together in one
+ *  transaction when enough of them are queued, or some time after the first
+ *  of them was queued. Each query is prepared only once and then reused, so
+ *  values which change should be bound as parameters instead of formatted
+ *  into the query. If too many queries are queued (because the database is
+ *  locked for a long time), new queries are dropped.
+ */
+class DatabaseWriter
+{
+public:
+    /** A value bound to a parameter of a query. */
+    struct Value
+    {
+        enum ValueType { VT_NULL, VT_INTEGER, VT_TEXT };
+        ValueType m_type;
+        int64_t m_integer;
+        std::string m_text;
+        // --------------------------------------------------------------------
+        Value() : m_type(VT_NULL), m_integer(0) {}
+        // --------------------------------------------------------------------
+        Value(int64_t integer) : m_type(VT_INTEGER), m_integer(integer) {}
+        // --------------------------------------------------------------------
+        Value(const std::string& text)
+            : m_type(VT_TEXT), m_integer(0), m_text(text) {}
+        // --------------------------------------------------------------------
+        Value(const char* text) : m_type(VT_TEXT), m_integer(0), m_text(text)
+        {}
+    };   // Value
+
+private:
+    struct Query
+    {
+        std::string m_query;
+        std::vector<Value> m_values;
+        std::function<void(bool)> m_callback;
+    };
+
+    /** The database connection of the writer thread. */
+    sqlite3* m_db;
+
+    /** Prepared statements, indexed by their query. */
+    std::map<std::string, sqlite3_stmt*> m_statements;
+
+    /** Queries not yet taken by the writer thread. */
+    std::vector<Query> m_queue;
+
+    /** Protects m_queue, m_exit and m_num_dropped. */
+    std::mutex m_queue_mutex;
+
+    std::condition_variable m_queue_cv;
+
+    std::thread m_thread;
+
+    bool m_exit;
+
+    /** Time in ms queries are collected before they are written. */
+    unsigned m_flush_interval;
+
+    /** Number of queued queries after which they are written immediately. */
+    unsigned m_flush_queries;
+
+    /** Maximum number of queued queries. */
+    unsigned m_max_queries;
+
+    /** Number of queries dropped since the last warning. */
+    unsigned m_num_dropped;
+
+    void writerLoop();
+    void writeQueries(std::vector<Query>* queries);
+    bool execute(const Query& query);
+    bool execute(const std::string& query);
+    sqlite3_stmt* getStatement(const std::string& query);
+
+public:
+    DatabaseWriter(const std::string& database_file, unsigned flush_interval,
+                   unsigned flush_queries = 256, unsigned max_queries = 65536);
+    ~DatabaseWriter();
+    bool write(const std::string& query,
+               const std::vector<Value>& values = std::vector<Value>(),
+               const std::function<void(bool)>& callback = nullptr);
+    static void unitTesting();
+};   // DatabaseWriter
+
+#endif
+
+#endif
@@ -22,6 +22,7 @@
 #include "network/protocols/client_lobby.hpp"
 #include "network/stk_peer.hpp"
 #include "utils/log.hpp"
+#include "utils/memory_pool.hpp"
 #include "utils/time.hpp"
 
 #include <string.h>
@@ -44,6 +45,7 @@ Event::Event(ENetEvent* event, std::shared_ptr<STKPeer> peer)
     m_arrival_time = StkTime::getMonoTimeMs();
     m_pdi = PDI_TIMEOUT;
     m_peer = peer;
+    m_next = NULL;
 
     switch (event->type)
     {
@@ -97,6 +99,21 @@ Event::Event(ENetEvent* event, std::shared_ptr<STKPeer> peer)
 
 }   // Event(ENetEvent)
 
+// ----------------------------------------------------------------------------
+/** Creates the event of one message of a packet with coalesced messages.
+ *  \param coalesced The event of the packet.
+ *  \param data The message, which is then owned by this event.
+ */
+Event::Event(const Event& coalesced, NetworkString* data)
+{
+    m_arrival_time = coalesced.m_arrival_time;
+    m_pdi = PDI_TIMEOUT;
+    m_peer = coalesced.m_peer;
+    m_next = NULL;
+    m_type = EVENT_TYPE_MESSAGE;
+    m_data = data;
+}   // Event(Event, NetworkString)
+
 // ----------------------------------------------------------------------------
 /** \brief Destructor that frees the memory of the package.
  */
@@ -105,3 +122,24 @@ Event::~Event()
     delete m_data;
 }   // ~Event
 
+// ----------------------------------------------------------------------------
+/** Events are created for each packet received, so their memory is kept in
+ *  a pool instead of being allocated each time.
+ */
+static MemoryPool& getEventPool()
+{
+    static MemoryPool pool(sizeof(Event), 4096);
+    return pool;
+}   // getEventPool
+
+// ----------------------------------------------------------------------------
+void* Event::operator new(size_t size)
+{
+    return getEventPool().allocate(size);
+}   // operator new
+
+// ----------------------------------------------------------------------------
+void Event::operator delete(void* p, size_t size)
+{
+    getEventPool().deallocate(p, size);
+}   // operator delete
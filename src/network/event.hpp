@@ -32,6 +32,7 @@
 
 #include <memory>
 
+class ProtocolManager;
 class STKPeer;
 
 /*!
@@ -72,6 +73,8 @@ enum PeerDisconnectInfo : unsigned int;
 class Event
 {
 private:
+    friend class ProtocolManager;
+
     LEAK_CHECK()
 
     /** Copy of the data passed by the event. */
@@ -89,9 +92,15 @@ private:
     /** For disconnection event, a bit more info is provided. */
     PeerDisconnectInfo m_pdi;
 
+    /** Next event in the event queues of the ProtocolManager. */
+    Event* m_next;
+
 public:
          Event(ENetEvent* event, std::shared_ptr<STKPeer> peer);
+         Event(const Event& coalesced, NetworkString* data);
         ~Event();
+    static void* operator new(size_t size);
+    static void  operator delete(void* p, size_t size);
 
     // ------------------------------------------------------------------------
     /** Returns the type of this event. */
@@ -0,0 +1,480 @@
+//
+//  SuperTuxKart - a fun racing game with go-kart
+//  Copyright (C) 2020 SuperTuxKart-Team
+//
+//  This program is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU General Public License
+//  as published by the Free Software Foundation; either version 3
+//  of the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+#include "network/link_emulator.hpp"
+
+#include "utils/log.hpp"
+#include "utils/string_utils.hpp"
+#include "utils/vs.hpp"
+
+#include <string.h>
+#if defined(WIN32)
+#  include "ws2tcpip.h"
+#else
+#  include <arpa/inet.h>
+#  include <sys/socket.h>
+#endif
+
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <functional>
+#include <sstream>
+
+LinkEmulator* LinkEmulator::m_link_emulator = NULL;
+
+// ============================================================================
+/** Parses the settings from a string like "latency=100,jitter=20,loss=0.05,
+ *  reorder=0.01,bandwidth=64000". Keys which are not given keep their value.
+ *  \return False if the string is not valid.
+ */
+bool LinkEmulator::Settings::parse(const std::string& settings)
+{
+    for (const std::string& pair : StringUtils::split(settings, ','))
+    {
+        std::vector<std::string> key_value = StringUtils::split(pair, '=');
+        if (key_value.size() != 2)
+        {
+            Log::error("LinkEmulator", "Invalid setting '%s'.", pair.c_str());
+            return false;
+        }
+        const std::string& key = key_value[0];
+        const std::string& value = key_value[1];
+        bool valid = false;
+        if (key == "latency")
+            valid = StringUtils::fromString(value, m_latency);
+        else if (key == "jitter")
+            valid = StringUtils::fromString(value, m_jitter);
+        else if (key == "loss")
+        {
+            valid = StringUtils::fromString(value, m_loss) &&
+                m_loss >= 0.0f && m_loss <= 1.0f;
+        }
+        else if (key == "reorder")
+        {
+            valid = StringUtils::fromString(value, m_reorder) &&
+                m_reorder >= 0.0f && m_reorder <= 1.0f;
+        }
+        else if (key == "bandwidth")
+            valid = StringUtils::fromString(value, m_bandwidth);
+        if (!valid)
+        {
+            Log::error("LinkEmulator", "Invalid setting '%s'.", pair.c_str());
+            return false;
+        }
+    }
+    return true;
+}   // parse
+
+// ----------------------------------------------------------------------------
+/** Returns the settings in the format read by parse(). */
+std::string LinkEmulator::Settings::toString() const
+{
+    std::ostringstream out;
+    out << "latency=" << m_latency << ",jitter=" << m_jitter << ",loss="
+        << m_loss << ",reorder=" << m_reorder << ",bandwidth="
+        << m_bandwidth;
+    return out.str();
+}   // toString
+
+// ----------------------------------------------------------------------------
+/** Compares how bad the link is for the network code, which reacts to the
+ *  latency and the packet loss.
+ *  \return 1 if this link is worse than other, -1 if it is better and 0 if
+ *          it is the same or one is worse and the other better.
+ */
+int LinkEmulator::Settings::compare(const Settings& other) const
+{
+    if (m_latency >= other.m_latency && m_loss >= other.m_loss &&
+        (m_latency > other.m_latency || m_loss > other.m_loss))
+        return 1;
+    if (m_latency <= other.m_latency && m_loss <= other.m_loss &&
+        (m_latency < other.m_latency || m_loss < other.m_loss))
+        return -1;
+    return 0;
+}   // compare
+
+// ============================================================================
+LinkEmulator::Link::Link(const Settings& settings, uint32_t seed)
+              : m_settings(settings), m_random(seed)
+{
+    m_sequence = 0;
+    m_last_time = 0;
+    m_link_free_time = 0;
+    m_num_dropped = 0;
+}   // Link
+
+// ----------------------------------------------------------------------------
+/** Sends a packet over the link.
+ *  \param now Current time in microseconds.
+ *  \param data The packet.
+ *  \param size Size of the packet in bytes.
+ */
+void LinkEmulator::Link::add(uint64_t now, const uint8_t* data, size_t size)
+{
+    std::uniform_real_distribution<float> chance(0.0f, 1.0f);
+    if (m_settings.m_loss > 0.0f && chance(m_random) < m_settings.m_loss)
+    {
+        m_num_dropped++;
+        return;
+    }
+
+    // Packets wait until the previous ones are sent with the bandwidth
+    // limit, like in the queue of a router, which drops packets once more
+    // than one second of data is waiting
+    uint64_t start = now;
+    if (m_settings.m_bandwidth > 0)
+    {
+        start = std::max(now, m_link_free_time);
+        if (start - now > 1000000)
+        {
+            m_num_dropped++;
+            return;
+        }
+        m_link_free_time = start +
+            (uint64_t)size * 1000000 / m_settings.m_bandwidth;
+        start = m_link_free_time;
+    }
+
+    int64_t delay = (int64_t)m_settings.m_latency * 1000;
+    const int64_t jitter = (int64_t)m_settings.m_jitter * 1000;
+    if (jitter > 0)
+    {
+        std::uniform_int_distribution<int64_t> offset(-jitter, jitter);
+        delay = std::max(delay + offset(m_random), (int64_t)0);
+    }
+
+    Packet packet;
+    packet.m_time = start + delay;
+    packet.m_sequence = m_sequence++;
+    packet.m_data.assign(data, data + size);
+    if (m_settings.m_reorder > 0.0f && chance(m_random) < m_settings.m_reorder)
+    {
+        // Arrives after the packets sent later, which keep the order
+        packet.m_time = std::max(packet.m_time, m_last_time) +
+            std::max(jitter, (int64_t)10000);
+    }
+    else
+    {
+        // The jitter alone doesn't reorder packets
+        packet.m_time = std::max(packet.m_time, m_last_time);
+        m_last_time = packet.m_time;
+    }
+    m_packets.push_back(std::move(packet));
+    std::push_heap(m_packets.begin(), m_packets.end(), std::greater<Packet>());
+}   // add
+
+// ----------------------------------------------------------------------------
+/** Takes the next packet from the link if it has arrived.
+ *  \param now Current time in microseconds.
+ *  \param data Set to the packet.
+ *  \return True if a packet was returned.
+ */
+bool LinkEmulator::Link::get(uint64_t now, std::vector<uint8_t>* data)
+{
+    if (m_packets.empty() || m_packets.front().m_time > now)
+        return false;
+    std::pop_heap(m_packets.begin(), m_packets.end(), std::greater<Packet>());
+    *data = std::move(m_packets.back().m_data);
+    m_packets.pop_back();
+    return true;
+}   // get
+
+// ============================================================================
+/** Creates the socket on a free port of 127.0.0.1 and starts relaying.
+ *  \param target Address packets from the client are sent to.
+ *  \param settings Conditions of the link.
+ *  \param seed Seed of the random decisions.
+ */
+LinkEmulator::LinkEmulator(const TransportAddress& target,
+                           const Settings& settings, uint32_t seed)
+            : m_target(target), m_up(settings, seed),
+              m_down(settings, seed + 1)
+{
+    m_has_client = false;
+    m_settings_changed = false;
+    m_port = 0;
+    m_exit.store(false);
+    m_socket = enet_socket_create(ENET_SOCKET_TYPE_DATAGRAM);
+    if (m_socket == ENET_SOCKET_NULL)
+    {
+        Log::error("LinkEmulator", "Failed to create socket.");
+        return;
+    }
+    ENetAddress address = TransportAddress(127, 0, 0, 1, 0).toEnetAddress();
+    struct sockaddr_in sin;
+    socklen_t len = sizeof(sin);
+    if (enet_socket_bind(m_socket, &address) < 0 ||
+        getsockname(m_socket, (struct sockaddr *)&sin, &len) == -1)
+    {
+        Log::error("LinkEmulator", "Failed to bind socket.");
+        enet_socket_destroy(m_socket);
+        m_socket = ENET_SOCKET_NULL;
+        return;
+    }
+    m_port = ntohs(sin.sin_port);
+    enet_socket_set_option(m_socket, ENET_SOCKOPT_NONBLOCK, 1);
+    m_thread = std::thread(std::bind(&LinkEmulator::mainLoop, this));
+    Log::info("LinkEmulator", "Relaying 127.0.0.1:%d to %s with %s.", m_port,
+        m_target.toString().c_str(), settings.toString().c_str());
+}   // LinkEmulator
+
+// ----------------------------------------------------------------------------
+LinkEmulator::~LinkEmulator()
+{
+    m_exit.store(true);
+    if (m_thread.joinable())
+        m_thread.join();
+    if (m_socket != ENET_SOCKET_NULL)
+    {
+        enet_socket_destroy(m_socket);
+        Log::info("LinkEmulator", "Dropped %d packets to and %d from %s.",
+            m_up.getNumDropped(), m_down.getNumDropped(),
+            m_target.toString().c_str());
+    }
+}   // ~LinkEmulator
+
+// ----------------------------------------------------------------------------
+/** Changes the conditions of the link in both directions, can be called from
+ *  any thread. Packets already on the way keep their arrival time.
+ */
+void LinkEmulator::setSettings(const Settings& settings)
+{
+    std::lock_guard<std::mutex> lock(m_settings_mutex);
+    m_new_settings = settings;
+    m_settings_changed = true;
+    Log::info("LinkEmulator", "Changed 127.0.0.1:%d to %s.", m_port,
+        settings.toString().c_str());
+}   // setSettings
+
+// ----------------------------------------------------------------------------
+void LinkEmulator::sendPacket(const std::vector<uint8_t>& data,
+                              const TransportAddress& dst)
+{
+    struct sockaddr_in to;
+    int to_len = sizeof(to);
+    memset(&to, 0, to_len);
+    to.sin_family = AF_INET;
+    to.sin_port = htons(dst.getPort());
+    to.sin_addr.s_addr = htonl(dst.getIP());
+    sendto(m_socket, (const char*)data.data(), (int)data.size(), 0,
+           (sockaddr*)&to, to_len);
+}   // sendPacket
+
+// ----------------------------------------------------------------------------
+/** Thread which receives the packets, keeps them in the links until they
+ *  arrive and sends them on.
+ */
+void LinkEmulator::mainLoop()
+{
+    VS::setThreadName("LinkEmulator");
+    std::vector<uint8_t> data;
+    uint8_t buffer[2048];
+    while (!m_exit.load())
+    {
+        const uint64_t now = std::chrono::duration_cast
+            <std::chrono::microseconds>(std::chrono::steady_clock::now()
+            .time_since_epoch()).count();
+        {
+            std::lock_guard<std::mutex> lock(m_settings_mutex);
+            if (m_settings_changed)
+            {
+                m_up.setSettings(m_new_settings);
+                m_down.setSettings(m_new_settings);
+                m_settings_changed = false;
+            }
+        }
+        while (m_up.get(now, &data))
+            sendPacket(data, m_target);
+        while (m_down.get(now, &data))
+            sendPacket(data, m_client);
+
+        enet_uint32 wait = ENET_SOCKET_WAIT_RECEIVE;
+        if (enet_socket_wait(m_socket, &wait, 1) < 0 ||
+            (wait & ENET_SOCKET_WAIT_RECEIVE) == 0)
+            continue;
+        while (true)
+        {
+            struct sockaddr_in addr;
+            socklen_t from_len = sizeof(addr);
+            int len = recvfrom(m_socket, (char*)buffer, sizeof(buffer), 0,
+                               (struct sockaddr*)(&addr), &from_len);
+            if (len <= 0)
+                break;
+            TransportAddress sender(ntohl((uint32_t)(addr.sin_addr.s_addr)),
+                                    ntohs(addr.sin_port));
+            if (sender == m_target)
+            {
+                m_down.add(now, buffer, len);
+                continue;
+            }
+            if (!m_has_client)
+            {
+                m_client = sender;
+                m_has_client = true;
+            }
+            if (sender == m_client)
+                m_up.add(now, buffer, len);
+        }
+    }
+}   // mainLoop
+
+// ----------------------------------------------------------------------------
+void LinkEmulator::unitTesting()
+{
+    // All calls are made outside of assert, which is empty with NDEBUG
+    Settings settings;
+    bool valid = settings.parse("latency=100,jitter=20,loss=0.5,"
+                                "reorder=0.25,bandwidth=1000");
+    assert(valid);
+    assert(settings.m_latency == 100);
+    assert(settings.m_jitter == 20);
+    assert(settings.m_loss == 0.5f);
+    assert(settings.m_reorder == 0.25f);
+    assert(settings.m_bandwidth == 1000);
+    const std::string text = settings.toString();
+    assert(text ==
+        "latency=100,jitter=20,loss=0.5,reorder=0.25,bandwidth=1000");
+    Settings invalid;
+    valid = invalid.parse("loss=2");
+    assert(!valid);
+    valid = invalid.parse("latency");
+    assert(!valid);
+    valid = invalid.parse("delay=10");
+    assert(!valid);
+
+    const uint8_t data[100] = {};
+    std::vector<uint8_t> packet;
+    bool got = false;
+
+    // Latency only: packets arrive in order after the latency
+    Settings latency;
+    latency.m_latency = 50;
+    Link link(latency, 0);
+    link.add(0, data, 10);
+    link.add(1000, data, 20);
+    got = link.get(49999, &packet);
+    assert(!got);
+    got = link.get(50000, &packet);
+    assert(got && packet.size() == 10);
+    got = link.get(50999, &packet);
+    assert(!got);
+    got = link.get(51000, &packet);
+    assert(got && packet.size() == 20);
+    got = link.get(1000000, &packet);
+    assert(!got);
+
+    // Jitter doesn't reorder packets
+    Settings jitter;
+    jitter.m_latency = 50;
+    jitter.m_jitter = 40;
+    Link jitter_link(jitter, 1);
+    for (unsigned i = 0; i < 100; i++)
+        jitter_link.add(i * 1000, data, i % 100 + 1);
+    for (unsigned i = 0; i < 100; i++)
+    {
+        got = jitter_link.get(1000000, &packet);
+        assert(got);
+        assert(packet.size() == i % 100 + 1);
+    }
+
+    // Loss drops about the given share of packets
+    Settings loss;
+    loss.m_loss = 0.25f;
+    Link loss_link(loss, 2);
+    unsigned received = 0;
+    for (unsigned i = 0; i < 1000; i++)
+    {
+        loss_link.add(i, data, 10);
+        while (loss_link.get(i, &packet))
+            received++;
+    }
+    assert(received + loss_link.getNumDropped() == 1000);
+    assert(received > 700 && received < 800);
+
+    // Reordered packets arrive after later ones
+    Settings reorder;
+    reorder.m_latency = 10;
+    reorder.m_reorder = 0.5f;
+    Link reorder_link(reorder, 3);
+    for (unsigned i = 0; i < 50; i++)
+        reorder_link.add(i * 100, data, i + 1);
+    bool reordered = false;
+    size_t last = 0;
+    for (unsigned i = 0; i < 50; i++)
+    {
+        got = reorder_link.get(1000000, &packet);
+        assert(got);
+        reordered |= packet.size() < last;
+        last = packet.size();
+    }
+    assert(reordered);
+    got = reorder_link.get(1000000, &packet);
+    assert(!got);
+
+    // 1000 bytes per second: each 100 byte packet takes 0.1 seconds, and
+    // packets are dropped once more than a second is queued
+    Settings bandwidth;
+    bandwidth.m_bandwidth = 1000;
+    Link bandwidth_link(bandwidth, 4);
+    for (unsigned i = 0; i < 15; i++)
+        bandwidth_link.add(0, data, 100);
+    assert(bandwidth_link.getNumDropped() == 4);
+    got = bandwidth_link.get(99999, &packet);
+    assert(!got);
+    got = bandwidth_link.get(100000, &packet);
+    assert(got);
+    got = bandwidth_link.get(199999, &packet);
+    assert(!got);
+    got = bandwidth_link.get(200000, &packet);
+    assert(got);
+    for (unsigned i = 2; i < 11; i++)
+    {
+        got = bandwidth_link.get(1100000, &packet);
+        assert(got);
+    }
+    got = bandwidth_link.get(10000000, &packet);
+    assert(!got);
+
+    // Changed settings are used for the packets sent afterwards
+    Link changed_link(latency, 5);
+    changed_link.add(0, data, 10);
+    Settings lost;
+    lost.m_loss = 1.0f;
+    changed_link.setSettings(lost);
+    changed_link.add(0, data, 20);
+    got = changed_link.get(50000, &packet);
+    assert(got && packet.size() == 10);
+    got = changed_link.get(1000000, &packet);
+    assert(!got && changed_link.getNumDropped() == 1);
+
+    // The latency and the loss decide which link is worse
+    Settings worse = latency;
+    worse.m_loss = 0.1f;
+    int order = worse.compare(latency);
+    assert(order == 1);
+    order = latency.compare(worse);
+    assert(order == -1);
+    order = latency.compare(latency);
+    assert(order == 0);
+    order = worse.compare(jitter);
+    assert(order == 1);
+    order = loss.compare(latency);
+    assert(order == 0);
+    (void)order; (void)valid; (void)got; (void)reordered;
+}   // unitTesting
@@ -0,0 +1,182 @@
+//
+//  SuperTuxKart - a fun racing game with go-kart
+//  Copyright (C) 2020 SuperTuxKart-Team
+//
+//  This program is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU General Public License
+//  as published by the Free Software Foundation; either version 3
+//  of the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+#ifndef HEADER_LINK_EMULATOR_HPP
+#define HEADER_LINK_EMULATOR_HPP
+
+#include "network/transport_address.hpp"
+#include "utils/no_copy.hpp"
+#include "utils/types.hpp"
+
+#include <atomic>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+/** \ingroup network
+ *  Emulates a bad network connection on loopback: it relays UDP packets
+ *  between one client and a target address (the server), and delays, drops
+ *  or reorders them and limits the bandwidth in each direction. The client
+ *  connects to getPort() on 127.0.0.1 instead of the server. All random
+ *  decisions use a fixed seed, so that tests are reproducible (as far as
+ *  the timing of the operating system allows).
+ */
+class LinkEmulator : public NoCopy
+{
+public:
+    /** Conditions of the link, the same in both directions. */
+    struct Settings
+    {
+        /** Delay of each packet in ms in one direction. */
+        unsigned m_latency;
+        /** Maximum random change of the delay in ms. */
+        unsigned m_jitter;
+        /** Probability that a packet is lost. */
+        float m_loss;
+        /** Probability that a packet is delayed further, so that packets
+         *  sent after it arrive before it. */
+        float m_reorder;
+        /** Bytes per second, 0 for unlimited. */
+        unsigned m_bandwidth;
+        // --------------------------------------------------------------------
+        Settings() : m_latency(0), m_jitter(0), m_loss(0.0f),
+                     m_reorder(0.0f), m_bandwidth(0) {}
+        // --------------------------------------------------------------------
+        bool parse(const std::string& settings);
+        std::string toString() const;
+        int compare(const Settings& other) const;
+    };   // Settings
+
+    /** One direction of the link, which doesn't use sockets. */
+    class Link
+    {
+    private:
+        struct Packet
+        {
+            /** Time in microseconds when the packet arrives. */
+            uint64_t m_time;
+            /** Keeps packets with the same time in order. */
+            uint64_t m_sequence;
+            std::vector<uint8_t> m_data;
+            // ----------------------------------------------------------------
+            bool operator>(const Packet& other) const
+            {
+                return m_time > other.m_time ||
+                    (m_time == other.m_time && m_sequence > other.m_sequence);
+            }
+        };
+
+        Settings m_settings;
+
+        std::mt19937 m_random;
+
+        /** Heap of the packets on the way, the next one to arrive first. */
+        std::vector<Packet> m_packets;
+
+        uint64_t m_sequence;
+
+        /** Arrival time of the latest packet which was not reordered. */
+        uint64_t m_last_time;
+
+        /** Time when the link has sent all packets with the bandwidth
+         *  limit. */
+        uint64_t m_link_free_time;
+
+        unsigned m_num_dropped;
+
+    public:
+        Link(const Settings& settings, uint32_t seed);
+        void add(uint64_t now, const uint8_t* data, size_t size);
+        bool get(uint64_t now, std::vector<uint8_t>* data);
+        // --------------------------------------------------------------------
+        /** Changes the conditions for the packets sent from now on. */
+        void setSettings(const Settings& settings) { m_settings = settings; }
+        // --------------------------------------------------------------------
+        /** Returns the number of packets lost or dropped because the
+         *  bandwidth was exceeded. */
+        unsigned getNumDropped() const                { return m_num_dropped; }
+    };   // Link
+
+private:
+    ENetSocket m_socket;
+
+    /** The address packets from the client are sent to. */
+    TransportAddress m_target;
+
+    /** The address of the client, set by its first packet. */
+    TransportAddress m_client;
+
+    bool m_has_client;
+
+    /** Packets from the client to the target and back. */
+    Link m_up, m_down;
+
+    uint16_t m_port;
+
+    std::atomic_bool m_exit;
+
+    /** Protects the new settings, which are set by another thread. */
+    std::mutex m_settings_mutex;
+
+    /** Settings to use from the next update of the links on. */
+    Settings m_new_settings;
+
+    bool m_settings_changed;
+
+    std::thread m_thread;
+
+    static LinkEmulator* m_link_emulator;
+
+    void mainLoop();
+    void sendPacket(const std::vector<uint8_t>& data,
+                    const TransportAddress& dst);
+
+public:
+    LinkEmulator(const TransportAddress& target, const Settings& settings,
+                 uint32_t seed);
+    ~LinkEmulator();
+    // ------------------------------------------------------------------------
+    /** Returns the port on 127.0.0.1 clients connect to, 0 if the socket
+     *  couldn't be created. */
+    uint16_t getPort() const                                 { return m_port; }
+    // ------------------------------------------------------------------------
+    void setSettings(const Settings& settings);
+    // ------------------------------------------------------------------------
+    /** Creates the link emulator used by this client to connect to the
+     *  server. */
+    static void create(const TransportAddress& target,
+                       const Settings& settings, uint32_t seed)
+    {
+        delete m_link_emulator;
+        m_link_emulator = new LinkEmulator(target, settings, seed);
+    }   // create
+    // ------------------------------------------------------------------------
+    static LinkEmulator* get()                      { return m_link_emulator; }
+    // ------------------------------------------------------------------------
+    static void destroy()
+    {
+        delete m_link_emulator;
+        m_link_emulator = NULL;
+    }   // destroy
+    // ------------------------------------------------------------------------
+    static void unitTesting();
+};   // LinkEmulator
+
+#endif
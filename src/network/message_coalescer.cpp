@@ -0,0 +1,297 @@
+//
+//  SuperTuxKart - a fun racing game with go-kart
+//  Copyright (C) 2020 SuperTuxKart-Team
+//
+//  This program is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU General Public License
+//  as published by the Free Software Foundation; either version 3
+//  of the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+#include "network/message_coalescer.hpp"
+
+#include <cassert>
+#include <chrono>
+#include <thread>
+
+// ----------------------------------------------------------------------------
+MessageCoalescer::MessageCoalescer()
+                : m_messages(PROTOCOL_COALESCED, MAX_PACKET_SIZE)
+{
+}   // MessageCoalescer
+
+// ----------------------------------------------------------------------------
+/** Appends a message with its size to a coalesced packet. */
+void MessageCoalescer::addMessage(const NetworkString& data,
+                                  NetworkString* out)
+{
+    const unsigned size = data.getTotalSize();
+    if (size <= MAX_MESSAGE_SIZE)
+        out->addUInt8((uint8_t)size);
+    else
+        out->addUInt8(255).addUInt32(size);
+    std::vector<uint8_t>& buffer = out->getBuffer();
+    buffer.insert(buffer.end(), (const uint8_t*)data.getData(),
+                  (const uint8_t*)data.getData() + size);
+}   // addMessage
+
+// ----------------------------------------------------------------------------
+/** Collects a reliable message, or sends it at once if it is too large.
+ *  Can be called from any thread.
+ *  \param data The message.
+ *  \param send Function which sends a packet. If the message is not
+ *         collected, it is called with a packet with the collected messages
+ *         followed by this message, or with the message itself if there are
+ *         no collected messages. It is called while the lock is kept, so
+ *         that messages collected later by another thread can't be flushed
+ *         before this packet is sent.
+ *  \return True if the message was collected and is sent with the next
+ *          flush.
+ */
+bool MessageCoalescer::add(NetworkString* data,
+                           const std::function<void(NetworkString*)>& send)
+{
+    const unsigned size = data->getTotalSize();
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (size <= MAX_MESSAGE_SIZE &&
+        m_messages.getTotalSize() + size + 1 <= MAX_PACKET_SIZE)
+    {
+        addMessage(*data, &m_messages);
+        return true;
+    }
+    // Too large: the collected messages must be sent before it
+    if (m_messages.getTotalSize() == 1)
+    {
+        send(data);
+        return false;
+    }
+    addMessage(*data, &m_messages);
+    send(&m_messages);
+    m_messages.clear();
+    return false;
+}   // add
+
+// ----------------------------------------------------------------------------
+/** Sends the collected messages as one packet. The lock is kept while they
+ *  are sent, so that a large message sent at the same time by another
+ *  thread can't overtake them, see add().
+ *  \param send Function which sends the packet.
+ *  \return False if there were no messages to send.
+ */
+bool MessageCoalescer::flush(const std::function<void(NetworkString*)>& send)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_messages.getTotalSize() == 1)
+        return false;
+    send(&m_messages);
+    m_messages.clear();
+    return true;
+}   // flush
+
+// ----------------------------------------------------------------------------
+/** Returns if a received message contains coalesced messages. */
+bool MessageCoalescer::isCoalesced(const NetworkString& data)
+{
+    return data.getTotalSize() > 0 &&
+        (uint8_t)data.getData()[0] == PROTOCOL_COALESCED;
+}   // isCoalesced
+
+// ----------------------------------------------------------------------------
+/** Splits a received coalesced packet into the messages.
+ *  \param data The received packet.
+ *  \param messages The messages are appended to it, the caller must delete
+ *         them.
+ *  \return False if the packet is not valid, in which case no messages are
+ *          returned.
+ */
+bool MessageCoalescer::split(const NetworkString& data,
+                             std::vector<NetworkString*>* messages)
+{
+    const uint8_t* buffer = (const uint8_t*)data.getData();
+    const size_t total = data.getTotalSize();
+    const size_t first = messages->size();
+    size_t offset = 1;
+    while (offset < total)
+    {
+        size_t size = buffer[offset++];
+        if (size == 255)
+        {
+            if (offset + 4 > total)
+                break;
+            size = ((size_t)buffer[offset] << 24) |
+                ((size_t)buffer[offset + 1] << 16) |
+                ((size_t)buffer[offset + 2] << 8) | buffer[offset + 3];
+            offset += 4;
+        }
+        // Each message has at least its protocol type, and a coalesced
+        // packet never contains another one
+        if (size == 0 || size > total - offset ||
+            buffer[offset] == PROTOCOL_COALESCED)
+            break;
+        messages->push_back(new NetworkString(buffer + offset, (int)size));
+        offset += size;
+    }
+    if (offset == total && messages->size() > first)
+        return true;
+    for (size_t i = first; i < messages->size(); i++)
+        delete (*messages)[i];
+    messages->resize(first);
+    return false;
+}   // split
+
+// ----------------------------------------------------------------------------
+void MessageCoalescer::unitTesting()
+{
+    // All calls are made outside of assert, which is empty with NDEBUG
+    MessageCoalescer mc;
+    std::mutex packets_mutex;
+    std::vector<std::vector<uint8_t> > packets;
+    std::function<void(NetworkString*)> send =
+        [&packets, &packets_mutex](NetworkString* ns)
+    {
+        std::lock_guard<std::mutex> lock(packets_mutex);
+        packets.emplace_back((const uint8_t*)ns->getData(),
+            (const uint8_t*)ns->getData() + ns->getTotalSize());
+    };
+    bool sent = mc.flush(send);
+    assert(!sent && packets.empty());
+
+    // Small messages are collected in order and split again
+    NetworkString chat(PROTOCOL_LOBBY_ROOM);
+    chat.setSynchronous(true);
+    chat.addUInt8(1).addUInt32(12345);
+    NetworkString vote(PROTOCOL_LOBBY_ROOM);
+    vote.addUInt8(2).encodeString(std::string("track"));
+    bool added = mc.add(&chat, send);
+    assert(added);
+    added = mc.add(&vote, send);
+    assert(added && packets.empty());
+    sent = mc.flush(send);
+    assert(sent && packets.size() == 1);
+    assert(packets[0].size() ==
+        1 + 1 + chat.getTotalSize() + 1 + vote.getTotalSize());
+    sent = mc.flush(send);
+    assert(!sent);
+
+    NetworkString received(packets[0].data(), (int)packets[0].size());
+    assert(isCoalesced(received));
+    assert(!isCoalesced(chat));
+    std::vector<NetworkString*> messages;
+    bool valid = split(received, &messages);
+    assert(valid && messages.size() == 2);
+    assert(messages[0]->isSynchronous());
+    assert(messages[0]->getProtocolType() == PROTOCOL_LOBBY_ROOM);
+    const uint8_t chat_type = messages[0]->getUInt8();
+    const uint32_t chat_value = messages[0]->getUInt32();
+    assert(chat_type == 1 && chat_value == 12345);
+    assert(!messages[1]->isSynchronous());
+    const uint8_t vote_type = messages[1]->getUInt8();
+    std::string track;
+    messages[1]->decodeString(&track);
+    assert(vote_type == 2 && track == "track");
+    for (NetworkString* ns : messages)
+        delete ns;
+    messages.clear();
+
+    // A large message is sent at once on its own, or after the collected
+    // ones
+    NetworkString large(PROTOCOL_LOBBY_ROOM, 2000);
+    for (unsigned i = 0; i < 500; i++)
+        large.addUInt32(i);
+    packets.clear();
+    added = mc.add(&large, send);
+    assert(!added && packets.size() == 1);
+    assert(packets[0].size() == large.getTotalSize());
+    added = mc.add(&chat, send);
+    assert(added);
+    added = mc.add(&large, send);
+    assert(!added && packets.size() == 2);
+    sent = mc.flush(send);
+    assert(!sent);
+    NetworkString received_large(packets[1].data(), (int)packets[1].size());
+    valid = split(received_large, &messages);
+    assert(valid && messages.size() == 2);
+    assert(messages[0]->getTotalSize() == chat.getTotalSize());
+    assert(messages[1]->getTotalSize() == large.getTotalSize());
+    for (unsigned i = 0; i < 500; i++)
+    {
+        const uint32_t value = messages[1]->getUInt32();
+        assert(value == i);
+        (void)value;
+    }
+    for (NetworkString* ns : messages)
+        delete ns;
+    messages.clear();
+
+    // A small message collected by another thread while the large message
+    // is being sent is flushed after it
+    packets.clear();
+    added = mc.add(&chat, send);
+    assert(added);
+    std::thread other;
+    std::function<void(NetworkString*)> send_slowly =
+        [&](NetworkString* ns)
+    {
+        other = std::thread([&mc, &vote, &send]()
+            {
+                mc.add(&vote, send);
+                mc.flush(send);
+            });
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        send(ns);
+    };
+    added = mc.add(&large, send_slowly);
+    other.join();
+    assert(!added && packets.size() == 2);
+    NetworkString first(packets[0].data(), (int)packets[0].size());
+    valid = split(first, &messages);
+    assert(valid && messages.size() == 2);
+    assert(messages[0]->getTotalSize() == chat.getTotalSize());
+    assert(messages[1]->getTotalSize() == large.getTotalSize());
+    NetworkString second(packets[1].data(), (int)packets[1].size());
+    valid = split(second, &messages);
+    assert(valid && messages.size() == 3);
+    assert(messages[2]->getTotalSize() == vote.getTotalSize());
+    for (NetworkString* ns : messages)
+        delete ns;
+    messages.clear();
+
+    // Collected messages are sent once they don't fit in one datagram
+    packets.clear();
+    unsigned collected = 0;
+    while (mc.add(&chat, send))
+        collected++;
+    assert(packets.size() == 1);
+    assert(collected == (MAX_PACKET_SIZE - 1) / (chat.getTotalSize() + 1));
+    NetworkString received_full(packets[0].data(), (int)packets[0].size());
+    valid = split(received_full, &messages);
+    assert(valid && messages.size() == collected + 1);
+    for (NetworkString* ns : messages)
+        delete ns;
+    messages.clear();
+    sent = mc.flush(send);
+    assert(!sent);
+
+    // Invalid packets are rejected without messages
+    const uint8_t truncated[] = { PROTOCOL_COALESCED, 3, PROTOCOL_LOBBY_ROOM,
+                                  1 };
+    valid = split(NetworkString(truncated, sizeof(truncated)), &messages);
+    assert(!valid);
+    const uint8_t nested[] = { PROTOCOL_COALESCED, 2, PROTOCOL_LOBBY_ROOM, 1,
+                               1, PROTOCOL_COALESCED };
+    valid = split(NetworkString(nested, sizeof(nested)), &messages);
+    assert(!valid);
+    const uint8_t empty[] = { PROTOCOL_COALESCED };
+    valid = split(NetworkString(empty, sizeof(empty)), &messages);
+    assert(!valid && messages.empty());
+    (void)sent; (void)added; (void)valid; (void)chat_type; (void)chat_value;
+    (void)vote_type;
+}   // unitTesting
@@ -0,0 +1,71 @@
+//
+//  SuperTuxKart - a fun racing game with go-kart
+//  Copyright (C) 2020 SuperTuxKart-Team
+//
+//  This program is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU General Public License
+//  as published by the Free Software Foundation; either version 3
+//  of the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+#ifndef HEADER_MESSAGE_COALESCER_HPP
+#define HEADER_MESSAGE_COALESCER_HPP
+
+#include "network/network_string.hpp"
+#include "utils/no_copy.hpp"
+
+#include <functional>
+#include <mutex>
+#include <vector>
+
+/** \ingroup network
+ *  Collects the small reliable messages sent to one peer, so that they are
+ *  sent together in one packet when the STKHost thread flushes them, instead
+ *  of one enet packet (with its own acknowledgement and encryption) for each
+ *  message. The packet starts with PROTOCOL_COALESCED, followed by each
+ *  message with its size in one byte (or 255 and the size in 4 bytes for
+ *  large messages). The ProtocolManager of the receiver splits it into one
+ *  event for each message again, so the protocols don't notice it.
+ *  Messages are only added while the order to other reliable messages is
+ *  kept: a message which is too large is sent at once together with the
+ *  collected messages, before any message can be collected again.
+ */
+class MessageCoalescer : public NoCopy
+{
+public:
+    /** Largest message which is collected. */
+    static const unsigned MAX_MESSAGE_SIZE = 254;
+
+    /** The collected messages are sent at once when they would become
+     *  larger than this, so that they fit in one datagram. */
+    static const unsigned MAX_PACKET_SIZE = 1000;
+
+private:
+    std::mutex m_mutex;
+
+    /** The collected messages, only containing PROTOCOL_COALESCED if there
+     *  are none. */
+    NetworkString m_messages;
+
+    static void addMessage(const NetworkString& data, NetworkString* out);
+
+public:
+    MessageCoalescer();
+    bool add(NetworkString* data,
+             const std::function<void(NetworkString*)>& send);
+    bool flush(const std::function<void(NetworkString*)>& send);
+    static bool isCoalesced(const NetworkString& data);
+    static bool split(const NetworkString& data,
+                      std::vector<NetworkString*>* messages);
+    static void unitTesting();
+};   // MessageCoalescer
+
+#endif
@@ -62,7 +62,7 @@ public:
 
     // ------------------------------------------------------
     /** Encodes this vote object into a network string. */
-    void encode(NetworkString *ns)
+    void encode(BareNetworkString *ns)
     {
         ns->encodeString(m_player_name)
             .encodeString(m_track_name)
@@ -19,10 +19,12 @@
 #include "network/protocol_manager.hpp"
 
 #include "network/event.hpp"
+#include "network/message_coalescer.hpp"
 #include "network/network_config.hpp"
 #include "network/protocols/game_protocol.hpp"
 #include "network/protocols/server_lobby.hpp"
 #include "network/stk_peer.hpp"
+#include "utils/cpp2011.hpp"
 #include "utils/log.hpp"
 #include "utils/profiler.hpp"
 #include "utils/time.hpp"
@@ -33,6 +35,7 @@
 #include <cstdlib>
 #include <errno.h>
 #include <functional>
+#include <thread>
 #include <typeinfo>
 
 // ============================================================================
@@ -101,6 +104,8 @@ std::shared_ptr<ProtocolManager> ProtocolManager::createInstance()
 ProtocolManager::ProtocolManager()
 {
     m_exit.store(false);
+    m_num_sync_events.store(0);
+    m_num_async_events.store(0);
 }   // ProtocolManager
 
 // ----------------------------------------------------------------------------
@@ -112,19 +117,23 @@ ProtocolManager::~ProtocolManager()
         m_all_protocols[i].abort();
     }
 
-    m_sync_events_to_process.lock();
-    for (EventList::iterator i =m_sync_events_to_process.getData().begin();
-                             i!=m_sync_events_to_process.getData().end(); ++i)
-        delete *i;
-    m_sync_events_to_process.getData().clear();
-    m_sync_events_to_process.unlock();
-
-    m_async_events_to_process.lock();
-    for (EventList::iterator i = m_async_events_to_process.getData().begin();
-                             i!= m_async_events_to_process.getData().end(); ++i)
-        delete *i;
-    m_async_events_to_process.getData().clear();
-    m_async_events_to_process.unlock();
+    for (EventQueue* queue : { &m_sync_events_to_process,
+                               &m_async_events_to_process })
+    {
+        Event* event = queue->popAll();
+        while (event)
+        {
+            Event* next = event->m_next;
+            delete event;
+            event = next;
+        }
+    }
+    for (Event* event : m_sync_events_pending)
+        delete event;
+    m_sync_events_pending.clear();
+    for (Event* event : m_async_events_pending)
+        delete event;
+    m_async_events_pending.clear();
 
     for (EventList::iterator i = m_controller_events_list.begin();
                              i!= m_controller_events_list.end(); ++i)
@@ -166,10 +175,25 @@ void ProtocolManager::abort()
 // ----------------------------------------------------------------------------
 /** \brief Function that processes incoming events.
  *  This function is called by the network manager each time there is an
- *  incoming packet.
+ *  incoming packet. Packets with several coalesced messages are split into
+ *  one event for each message.
  */
 void ProtocolManager::propagateEvent(Event* event)
 {
+    if (event->getType() == EVENT_TYPE_MESSAGE &&
+        MessageCoalescer::isCoalesced(event->data()))
+    {
+        std::vector<NetworkString*> messages;
+        if (!MessageCoalescer::split(event->data(), &messages))
+        {
+            Log::warn("ProtocolManager", "Invalid coalesced messages of "
+                "size %d.", event->data().getTotalSize());
+        }
+        for (NetworkString* data : messages)
+            propagateEvent(new Event(*event, data));
+        delete event;
+        return;
+    }
     // Special handling for contoller events in server
     if (NetworkConfig::get()->isServer() &&
         event->getType() == EVENT_TYPE_MESSAGE &&
@@ -182,15 +206,13 @@ void ProtocolManager::propagateEvent(Event* event)
     }
     if (event->isSynchronous())
     {
-        m_sync_events_to_process.lock();
-        m_sync_events_to_process.getData().push_back(event);
-        m_sync_events_to_process.unlock();
+        m_num_sync_events.fetch_add(1, std::memory_order_relaxed);
+        m_sync_events_to_process.push(event);
     }
     else
     {
-        m_async_events_to_process.lock();
-        m_async_events_to_process.getData().push_back(event);
-        m_async_events_to_process.unlock();
+        m_num_async_events.fetch_add(1, std::memory_order_relaxed);
+        m_async_events_to_process.push(event);
     }
 }   // propagateEvent
 
@@ -331,6 +353,63 @@ bool ProtocolManager::sendEvent(Event* event,
                               >= TIME_TO_KEEP_EVENTS;
 }   // sendEvent
 
+// ----------------------------------------------------------------------------
+/** Takes all events from a queue, and sends them and the events which could
+ *  not be delivered before to the protocols, in the order they arrived.
+ *  \param queue The queue to take the new events from.
+ *  \param pending The events which were not delivered yet. It must only be
+ *         used by the thread calling this function.
+ *  \param protocols The protocols to deliver the events to.
+ *  \param async True if the events are delivered asynchronously.
+ */
+void ProtocolManager::deliverEvents(EventQueue* queue,
+                         std::vector<Event*>* pending,
+                         std::array<OneProtocolType, PROTOCOL_MAX>& protocols,
+                         bool async)
+{
+    Event* event = queue->popAll();
+    while (event)
+    {
+        Event* next = event->m_next;
+        pending->push_back(event);
+        event = next;
+    }
+
+    unsigned num_kept = 0;
+    for (unsigned i = 0; i < pending->size(); i++)
+    {
+        event = (*pending)[i];
+        bool can_be_deleted = true;
+        try
+        {
+            can_be_deleted = sendEvent(event, protocols);
+        }
+        catch (std::exception& e)
+        {
+            const std::string& name =
+                event->getPeer()->getAddress().toString();
+            Log::error("ProtocolManager", "%s event error from %s: %s",
+                async ? "Asynchronous" : "Synchronous", name.c_str(),
+                e.what());
+            Log::error("ProtocolManager",
+                event->data().getLogMessage().c_str());
+        }
+        if (can_be_deleted)
+        {
+            delete event;
+            (async ? m_num_async_events : m_num_sync_events)
+                .fetch_sub(1, std::memory_order_relaxed);
+        }
+        else
+        {
+            // This should only happen if the protocol has not been started
+            // or already terminated (e.g. late ping answer)
+            (*pending)[num_kept++] = event;
+        }
+    }
+    pending->resize(num_kept);
+}   // deliverEvents
+
 // ----------------------------------------------------------------------------
 /** Calls either the synchronous update or asynchronous update function in all
  *  protocols of this type.
@@ -369,37 +448,8 @@ void ProtocolManager::update(int ticks)
     ul.unlock();
 
     // before updating, notify protocols that they have received events
-    m_sync_events_to_process.lock();
-    EventList::iterator i = m_sync_events_to_process.getData().begin();
-
-    while (i != m_sync_events_to_process.getData().end())
-    {
-        m_sync_events_to_process.unlock();
-        bool can_be_deleted = true;
-        try
-        {
-            can_be_deleted = sendEvent(*i, all_protocols);
-        }
-        catch (std::exception& e)
-        {
-            const std::string& name = (*i)->getPeer()->getAddress().toString();
-            Log::error("ProtocolManager",
-                "Synchronous event error from %s: %s", name.c_str(), e.what());
-            Log::error("ProtocolManager", (*i)->data().getLogMessage().c_str());
-        }
-        m_sync_events_to_process.lock();
-        if (can_be_deleted)
-        {
-            delete *i;
-            i = m_sync_events_to_process.getData().erase(i);
-        }
-        else
-        {
-            // This should only happen if the protocol has not been started
-            ++i;
-        }
-    }
-    m_sync_events_to_process.unlock();
+    deliverEvents(&m_sync_events_to_process, &m_sync_events_pending,
+                  all_protocols, /*async*/false);
 
     // Now update all protocols.
     for (unsigned int i = 0; i < all_protocols.size(); i++)
@@ -428,40 +478,8 @@ void ProtocolManager::asynchronousUpdate()
     auto all_protocols = m_all_protocols;
     ul.unlock();
 
-    m_async_events_to_process.lock();
-    EventList::iterator i = m_async_events_to_process.getData().begin();
-    while (i != m_async_events_to_process.getData().end())
-    {
-        m_async_events_to_process.unlock();
-
-        bool result = true;
-        try
-        {
-            result = sendEvent(*i, all_protocols);
-        }
-        catch (std::exception& e)
-        {
-            const std::string& name = (*i)->getPeer()->getAddress().toString();
-            Log::error("ProtocolManager", "Asynchronous event "
-                "error from %s: %s", name.c_str(), e.what());
-            Log::error("ProtocolManager",
-                (*i)->data().getLogMessage().c_str());
-        }
-
-        m_async_events_to_process.lock();
-        if (result)
-        {
-            delete *i;
-            i = m_async_events_to_process.getData().erase(i);
-        }
-        else
-        {
-            // This should only happen if the protocol has not been started
-            // or already terminated (e.g. late ping answer)
-            ++i;
-        }
-    }   // while i != m_events_to_process.end()
-    m_async_events_to_process.unlock();
+    deliverEvents(&m_async_events_to_process, &m_async_events_pending,
+                  all_protocols, /*async*/true);
 
     PROFILER_POP_CPU_MARKER();
     PROFILER_PUSH_CPU_MARKER("Message delivery", 255, 0, 0);
@@ -492,3 +510,85 @@ std::shared_ptr<Protocol> ProtocolManager::getProtocol(ProtocolType type)
 
     return opt.getFirstProtocol();
 }   // getProtocol
+
+// ----------------------------------------------------------------------------
+/** Adds events from several threads while they are delivered, and checks
+ *  that all events of each thread arrive in the order they were added.
+ */
+void ProtocolManager::unitTesting()
+{
+    class TestProtocol : public Protocol
+    {
+    public:
+        std::vector<unsigned> m_next_event;
+        std::atomic<unsigned> m_num_events;
+        // --------------------------------------------------------------------
+        TestProtocol(unsigned num_threads)
+            : Protocol(PROTOCOL_LOBBY_ROOM), m_next_event(num_threads, 0)
+        {
+            m_num_events.store(0);
+            setHandleDisconnections(true);
+        }
+        // --------------------------------------------------------------------
+        virtual void setup() OVERRIDE {}
+        virtual void update(int ticks) OVERRIDE {}
+        virtual void asynchronousUpdate() OVERRIDE {}
+        // --------------------------------------------------------------------
+        virtual bool notifyEventAsynchronous(Event* event) OVERRIDE
+        {
+            // The disconnect info is used to store the thread and number
+            const unsigned thread = event->getPeerDisconnectInfo() >> 24;
+            const unsigned number = event->getPeerDisconnectInfo() & 0xffffff;
+            if (thread >= m_next_event.size() ||
+                number != m_next_event[thread])
+            {
+                Log::fatal("ProtocolManager", "Event %u of thread %u arrived "
+                    "out of order.", number, thread);
+            }
+            m_next_event[thread]++;
+            m_num_events++;
+            return true;
+        }   // notifyEventAsynchronous
+    };   // TestProtocol
+
+    // Create the config now, it is used by all threads
+    NetworkConfig::get();
+    const unsigned num_threads = 4;
+    const unsigned num_events = 50000;
+    ProtocolManager pm;
+    auto protocol = std::make_shared<TestProtocol>(num_threads);
+    pm.requestStart(protocol);
+
+    std::atomic<unsigned> num_finished(0);
+    std::vector<std::thread> threads;
+    for (unsigned t = 0; t < num_threads; t++)
+    {
+        threads.emplace_back([&pm, &num_finished, t, num_events]()
+            {
+                for (unsigned i = 0; i < num_events; i++)
+                {
+                    ENetEvent event = {};
+                    event.type = ENET_EVENT_TYPE_DISCONNECT;
+                    event.data = (t << 24) | i;
+                    pm.propagateEvent(new Event(&event, nullptr));
+                }
+                num_finished++;
+            });
+    }
+    // Deliver the events while they are added, the last update after all
+    // threads finished delivers the remaining events
+    bool finished = false;
+    while (!finished)
+    {
+        finished = num_finished.load() == num_threads;
+        pm.asynchronousUpdate();
+    }
+    for (std::thread& thread : threads)
+        thread.join();
+    if (protocol->m_num_events != num_threads * num_events ||
+        !pm.m_async_events_pending.empty())
+    {
+        Log::fatal("ProtocolManager", "%u of %u events were delivered.",
+            protocol->m_num_events.load(), num_threads * num_events);
+    }
+}   // unitTesting
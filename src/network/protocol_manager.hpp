@@ -23,11 +23,12 @@
 #ifndef PROTOCOL_MANAGER_HPP
 #define PROTOCOL_MANAGER_HPP
 
+#include "network/event.hpp"
 #include "network/network_string.hpp"
 #include "network/protocol.hpp"
+#include "utils/lock_free_queue.hpp"
 #include "utils/no_copy.hpp"
 #include "utils/singleton.hpp"
-#include "utils/synchronised.hpp"
 #include "utils/types.hpp"
 
 #include <array>
@@ -39,7 +40,6 @@
 #include <vector>
 #include <thread>
 
-class Event;
 class STKPeer;
 
 // ============================================================================
@@ -149,13 +149,28 @@ private:
     /** A list of network events - messages, disconnect and disconnects. */
     typedef std::list<Event*> EventList;
 
+    /** A queue the network thread adds events to without locking. */
+    typedef LockFreeQueue<Event, &Event::m_next> EventQueue;
+
     /** Contains the network events to pass synchronously to protocols
      *  (i.e. from the main thread). */
-    Synchronised<EventList> m_sync_events_to_process;
+    EventQueue m_sync_events_to_process;
 
     /** Contains the network events to pass asynchronously to protocols
     *  (i.e. from the separate ProtocolManager thread). */
-    Synchronised<EventList> m_async_events_to_process;
+    EventQueue m_async_events_to_process;
+
+    /** Synchronous events taken from the queue which were not delivered
+     *  yet, only used by the main thread. */
+    std::vector<Event*> m_sync_events_pending;
+
+    /** Asynchronous events taken from the queue which were not delivered
+     *  yet, only used by the ProtocolManager thread. */
+    std::vector<Event*> m_async_events_pending;
+
+    /** Number of synchronous and asynchronous events received but not yet
+     *  delivered, for ServerMetrics. */
+    std::atomic<unsigned> m_num_sync_events, m_num_async_events;
 
     /** When set to true, the main thread will exit. */
     std::atomic_bool m_exit;
@@ -179,6 +194,10 @@ private:
     bool sendEvent(Event* event,
                    std::array<OneProtocolType, PROTOCOL_MAX>& protocols);
 
+    void deliverEvents(EventQueue* queue, std::vector<Event*>* pending,
+                       std::array<OneProtocolType, PROTOCOL_MAX>& protocols,
+                       bool async);
+
     void asynchronousUpdate();
 
 public:
@@ -196,6 +215,20 @@ public:
     // ------------------------------------------------------------------------
     bool isExiting() const                            { return m_exit.load(); }
     // ------------------------------------------------------------------------
+    /** Returns the number of events which were received from the network
+     *  thread, but not yet delivered to the protocols. */
+    unsigned getNumPendingEvents(bool async) const
+    {
+        return async ? m_num_async_events.load(std::memory_order_relaxed)
+                     : m_num_sync_events.load(std::memory_order_relaxed);
+    }   // getNumPendingEvents
+    // ------------------------------------------------------------------------
+    size_t getNumControllerEvents()
+    {
+        std::lock_guard<std::mutex> lock(m_game_protocol_mutex);
+        return m_controller_events_list.size();
+    }   // getNumControllerEvents
+    // ------------------------------------------------------------------------
     const std::thread& getThread() const
     {
         return m_asynchronous_update_thread; 
@@ -212,6 +245,8 @@ public:
     {
         return m_protocol_manager.lock();
     }   // lock
+    // ------------------------------------------------------------------------
+    static void unitTesting();
 
 };   // class ProtocolManager
 
@@ -623,6 +623,12 @@ void ClientLobby::connectionAccepted(Event* event)
         caps.insert(cap);
     }
     NetworkConfig::get()->setServerCapabilities(caps);
+    if (caps.find("coalesced_messages") != caps.end())
+    {
+        auto server_peer = STKHost::get()->getServerPeerForClient();
+        if (server_peer)
+            server_peer->setCoalesceMessages(true);
+    }
 
     float auto_start_timer = data.getFloat();
     int state_frequency_in_server = data.getUInt32();
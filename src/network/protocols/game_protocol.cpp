@@ -21,7 +21,9 @@
 #include "items/network_item_manager.hpp"
 #include "karts/abstract_kart.hpp"
 #include "karts/controller/player_controller.hpp"
+#include "karts/moveable.hpp"
 #include "modes/world.hpp"
+#include "network/compress_network_body.hpp"
 #include "network/event.hpp"
 #include "network/network_config.hpp"
 #include "network/game_setup.hpp"
@@ -30,12 +32,19 @@
 #include "network/protocol_manager.hpp"
 #include "network/rewind_info.hpp"
 #include "network/rewind_manager.hpp"
+#include "network/rewinder.hpp"
+#include "network/server_benchmark.hpp"
+#include "network/server_config.hpp"
+#include "network/smooth_network_body.hpp"
 #include "network/stk_host.hpp"
 #include "network/stk_peer.hpp"
+#include "physics/physical_object.hpp"
 #include "utils/log.hpp"
 #include "utils/time.hpp"
 #include "main_loop.hpp"
 
+#include <cstring>
+
 // ============================================================================
 std::weak_ptr<GameProtocol> GameProtocol::m_game_protocol;
 // ============================================================================
@@ -57,12 +66,23 @@ GameProtocol::GameProtocol()
             : Protocol(PROTOCOL_CONTROLLER_EVENTS)
 {
     m_data_to_send = getNetworkString();
+    m_state_history.resize(STATE_HISTORY_SIZE);
+    m_state_history_index = 0;
+    m_last_rewind_report = StkTime::getMonoTimeMs();
+    if (NetworkConfig::get()->isServer())
+    {
+        // Acknowledged states from a previous race can't be used as base
+        for (auto& peer : STKHost::get()->getPeers())
+            peer->setAckedStateTicks(-1);
+    }
 }   // GameProtocol
 
 //-----------------------------------------------------------------------------
 GameProtocol::~GameProtocol()
 {
     delete m_data_to_send;
+    for (NetworkString* ns : m_peer_states)
+        delete ns;
 }   // ~GameProtocol
 
 //-----------------------------------------------------------------------------
@@ -125,6 +145,9 @@ bool GameProtocol::notifyEventAsynchronous(Event* event)
     {
     case GP_CONTROLLER_ACTION: handleControllerAction(event); break;
     case GP_STATE:             handleState(event);            break;
+    case GP_STATE_DELTA:       handleStateDelta(event);       break;
+    case GP_STATE_ACK:         handleStateAck(event);         break;
+    case GP_REWIND_REPORT:     handleRewindReport(event);     break;
     case GP_ITEM_CONFIRMATION: handleItemEventConfirmation(event); break;
     case GP_ADJUST_TIME:
     case GP_ITEM_UPDATE:
@@ -283,18 +306,43 @@ void GameProtocol::startNewState()
     m_data_to_send->clear();
     m_data_to_send->addUInt8(GP_STATE)
         .addUInt32(World::getWorld()->getTicksSinceStart());
+    m_body_offsets.clear();
 }   // startNewState
 
 // ----------------------------------------------------------------------------
-/** Called by a server to add data to the current state. The data in buffer
- *  is copied, so the data can be freed after this call/.
- *  \param buffer Adds the data in the buffer to the current state.
+/** Called by a server to add the state of a rewinder to the current state.
+ *  The rewinder writes directly into the state buffer after a 16 bit size
+ *  placeholder, which is patched afterwards. Since the buffer keeps its
+ *  capacity between states, no memory is allocated in steady state. The
+ *  offset of the body in the state of the rewinder is remembered, so that
+ *  it can be sent with reduced precision.
+ *  \param rewinder The rewinder whose state is to be saved.
+ *  \param[out] ru The unique identity of rewinder using, which is appended
+ *         to if the rewinder saved a state.
+ *  \return Number of bytes of state data added.
  */
-void GameProtocol::addState(BareNetworkString *buffer)
+unsigned GameProtocol::addState(Rewinder* rewinder,
+                                std::vector<std::string>* ru)
 {
     assert(NetworkConfig::get()->isServer());
-    m_data_to_send->addUInt16(buffer->size());
-    (*m_data_to_send) += *buffer;
+    std::vector<uint8_t>& buffer = m_data_to_send->getBuffer();
+    const size_t size_pos = buffer.size();
+    m_data_to_send->addUInt16(0);
+    int& body_offset = CompressNetworkBody::lastBodyOffset();
+    body_offset = -1;
+    if (!rewinder->saveState(m_data_to_send, ru))
+    {
+        // Discard the size placeholder and anything written
+        buffer.resize(size_pos);
+        return 0;
+    }
+    const size_t state_size = buffer.size() - size_pos - 2;
+    assert(state_size <= 65535);
+    buffer[size_pos] = (uint8_t)((state_size >> 8) & 0xff);
+    buffer[size_pos + 1] = (uint8_t)(state_size & 0xff);
+    m_body_offsets.push_back(body_offset == -1 ? -1
+        : body_offset - (int)size_pos - 2);
+    return (unsigned)state_size;
 }   // addState
 
 // ----------------------------------------------------------------------------
@@ -310,15 +358,15 @@ void GameProtocol::finalizeState(std::vector<std::string>& cur_rewinder)
         4/*time*/;
 
     m_data_to_send->reset();
-    std::vector<uint8_t> names;
-    names.push_back((uint8_t)cur_rewinder.size());
+    m_rewinder_names.clear();
+    m_rewinder_names.push_back((uint8_t)cur_rewinder.size());
     for (std::string& name : cur_rewinder)
     {
-        names.push_back((uint8_t)name.size());
-        std::vector<uint8_t> rewinder(name.begin(), name.end());
-        names.insert(names.end(), rewinder.begin(), rewinder.end());
+        m_rewinder_names.push_back((uint8_t)name.size());
+        m_rewinder_names.insert(m_rewinder_names.end(), name.begin(),
+            name.end());
     }
-    buffer.insert(pos, names.begin(), names.end());
+    buffer.insert(pos, m_rewinder_names.begin(), m_rewinder_names.end());
 }   // finalizeState
 
 // ----------------------------------------------------------------------------
@@ -328,9 +376,345 @@ void GameProtocol::finalizeState(std::vector<std::string>& cur_rewinder)
 void GameProtocol::sendState()
 {
     assert(NetworkConfig::get()->isServer());
-    sendMessageToPeers(m_data_to_send, /*reliable*/false);
+    if (ServerConfig::m_delta_state ||
+        ServerConfig::m_relevance_distance > 0.0f ||
+        ServerConfig::m_max_state_interval > 1)
+        sendPeerStates();
+    else
+        sendMessageToPeers(m_data_to_send, /*reliable*/false);
 }   // sendState
 
+// ----------------------------------------------------------------------------
+/** Returns the next entry in the state history to be overwritten. */
+StateDelta::Snapshot* GameProtocol::addStateHistory()
+{
+    StateDelta::Snapshot* s = &m_state_history[m_state_history_index];
+    m_state_history_index = (m_state_history_index + 1) % STATE_HISTORY_SIZE;
+    return s;
+}   // addStateHistory
+
+// ----------------------------------------------------------------------------
+/** Returns the state with the given ticks from the state history, or NULL
+ *  if it's not available (anymore).
+ */
+const StateDelta::Snapshot* GameProtocol::findStateHistory(int ticks) const
+{
+    if (ticks < 0)
+        return NULL;
+    for (const StateDelta::Snapshot& s : m_state_history)
+    {
+        if (s.m_ticks == ticks)
+            return &s;
+    }
+    return NULL;
+}   // findStateHistory
+
+// ----------------------------------------------------------------------------
+/** Returns if the rewinder with the given unique identity can be left out
+ *  of a state. Only physical objects can: a client keeps the local state of
+ *  a physical object which is missing from a state, while a kart missing
+ *  from a state is eliminated (see KartRewinder::computeError), and a
+ *  flyable is removed (see Flyable::computeError).
+ */
+bool GameProtocol::canSkipRewinder(const std::string& name)
+{
+    return !name.empty() && name[0] == RN_PHYSICAL_OBJ;
+}   // canSkipRewinder
+
+// ----------------------------------------------------------------------------
+/** A physical object is only in a state if it moved since the previous
+ *  state (see PhysicalObject::saveState). So a peer which didn't get the
+ *  state in which an object came to rest would never get its final
+ *  position. This adds the latest state of each object which a peer missed
+ *  and which is not in the current state anyway to the current state. It
+ *  is only sent to the peers which missed it (see computeRelevance).
+ *  \param s The current state.
+ *  \param peers All peers.
+ */
+void GameProtocol::addMissedObjects(StateDelta::Snapshot* s,
+                          const std::vector<std::shared_ptr<STKPeer> >& peers)
+{
+    for (const StateDelta::Entry& e : s->m_entries)
+    {
+        if (!canSkipRewinder(e.m_name))
+            continue;
+        const uint8_t* data = s->m_data.data() + e.m_offset;
+        m_object_states[e.m_name].assign(data, data + e.m_size);
+    }
+
+    for (auto& peer : peers)
+    {
+        auto it = m_peer_states_sent.find(peer->getHostId());
+        if (it == m_peer_states_sent.end())
+            continue;
+        for (const std::string& name : it->second.m_missed)
+        {
+            // The number of rewinders in a state is stored in 8 bit
+            if (s->m_entries.size() >= 255)
+                return;
+            if (s->findEntry(name, 0) != -1)
+                continue;
+            auto object = m_object_states.find(name);
+            if (object != m_object_states.end())
+            {
+                s->addEntry(name, object->second.data(),
+                    (uint16_t)object->second.size());
+            }
+        }
+    }
+}   // addMissedObjects
+
+// ----------------------------------------------------------------------------
+/** Collects the position of each physical object, kart and flyable in the
+ *  state, used to decide whether it is relevant for each peer. All other
+ *  rewinders are always sent.
+ *  \param s The current state.
+ *  \param num_saved Number of rewinders which saved their state, the rest
+ *         was added by addMissedObjects.
+ */
+void GameProtocol::updateRelevanceInfo(const StateDelta::Snapshot& s,
+                                       unsigned num_saved)
+{
+    m_relevance_info.resize(s.m_entries.size());
+    for (unsigned i = 0; i < s.m_entries.size(); i++)
+    {
+        RelevanceInfo& info = m_relevance_info[i];
+        info.m_type = RT_ALWAYS;
+        if (i >= num_saved)
+        {
+            info.m_type = RT_MISSED;
+            continue;
+        }
+        std::shared_ptr<Rewinder> r =
+            RewindManager::get()->getRewinder(s.m_entries[i].m_name);
+        if (canSkipRewinder(s.m_entries[i].m_name))
+        {
+            if (PhysicalObject* po = dynamic_cast<PhysicalObject*>(r.get()))
+            {
+                info.m_xyz = po->getBody()->getWorldTransform().getOrigin();
+                info.m_type = RT_SKIP;
+            }
+        }
+        else if (s.m_entries[i].m_body != -1)
+        {
+            if (Moveable* m = dynamic_cast<Moveable*>(r.get()))
+            {
+                info.m_xyz = m->getXYZ();
+                info.m_type = RT_REDUCE;
+            }
+        }
+    }
+}   // updateRelevanceInfo
+
+// ----------------------------------------------------------------------------
+/** Decides how rewinders are sent in a state to a peer with karts at the
+ *  given positions. Everything within max_distance of one of the karts is
+ *  sent in full every time. Further away, physical objects are only sent
+ *  every interval states, and the body of karts and flyables is sent with
+ *  reduced precision (see StateDelta::reduceBody) except every interval
+ *  states. This is staggered, so that not all far rewinders are sent in
+ *  full in the same state. Physical objects at rest (RT_MISSED) are not
+ *  sent, see computeRelevance.
+ *  \param info Position of each rewinder in the state.
+ *  \param own_xyz Position of each kart of the peer.
+ *  \param state_count Number of states sent to the peer before.
+ *  \param max_distance Distance within which everything is sent in full.
+ *  \param interval Far rewinders are sent in full every interval states.
+ *  \param send How each rewinder is sent (StateDelta::SendMode).
+ */
+void GameProtocol::selectRelevant(const std::vector<RelevanceInfo>& info,
+                                  const std::vector<Vec3>& own_xyz,
+                                  unsigned state_count, float max_distance,
+                                  unsigned interval,
+                                  std::vector<uint8_t>* send)
+{
+    send->assign(info.size(), StateDelta::SM_FULL);
+    for (unsigned i = 0; i < info.size(); i++)
+    {
+        if (info[i].m_type == RT_MISSED)
+            (*send)[i] = StateDelta::SM_SKIP;
+    }
+    if (max_distance <= 0.0f || interval <= 1 || own_xyz.empty())
+        return;
+
+    const float max_distance2 = max_distance * max_distance;
+    for (unsigned i = 0; i < info.size(); i++)
+    {
+        if (info[i].m_type == RT_ALWAYS || info[i].m_type == RT_MISSED ||
+            (state_count + i) % interval == 0)
+            continue;
+        bool relevant = false;
+        for (const Vec3& xyz : own_xyz)
+        {
+            if ((xyz - info[i].m_xyz).length2() < max_distance2)
+            {
+                relevant = true;
+                break;
+            }
+        }
+        if (!relevant)
+        {
+            (*send)[i] = info[i].m_type == RT_SKIP ? StateDelta::SM_SKIP
+                                                   : StateDelta::SM_REDUCED;
+        }
+    }
+}   // selectRelevant
+
+// ----------------------------------------------------------------------------
+/** Decides how rewinders are sent to a peer in the current state, see
+ *  selectRelevant. Spectators receive everything in full. Physical objects
+ *  at rest are only sent to the peer if it missed their latest state.
+ *  \param peer The peer to send the state to.
+ *  \param s The current state.
+ *  \param ps The states sent to the peer.
+ *  \param send How each rewinder is sent (StateDelta::SendMode).
+ */
+void GameProtocol::computeRelevance(const STKPeer* peer,
+                                    const StateDelta::Snapshot& s,
+                                    PeerStates* ps,
+                                    std::vector<uint8_t>* send) const
+{
+    World* world = World::getWorld();
+    std::vector<Vec3> own_xyz;
+    for (unsigned id : peer->getAvailableKartIDs())
+    {
+        if (id < world->getNumKarts())
+            own_xyz.push_back(world->getKart(id)->getXYZ());
+    }
+    selectRelevant(m_relevance_info, own_xyz, ps->m_count++,
+        ServerConfig::m_relevance_distance,
+        (unsigned)std::max(1, (int)ServerConfig::m_far_state_interval), send);
+    for (unsigned i = 0; i < s.m_entries.size(); i++)
+    {
+        if (m_relevance_info[i].m_type == RT_MISSED &&
+            ps->m_missed.find(s.m_entries[i].m_name) != ps->m_missed.end())
+            (*send)[i] = StateDelta::SM_FULL;
+    }
+}   // computeRelevance
+
+// ----------------------------------------------------------------------------
+/** Remembers which physical objects in the current state were not sent to
+ *  a peer, so that their latest state is sent later (see
+ *  addMissedObjects).
+ *  \param s The current state.
+ *  \param info Relevance type of each rewinder in the state.
+ *  \param send How each rewinder was sent, empty if the state was not sent
+ *         to the peer at all.
+ *  \param ps The states sent to the peer.
+ */
+void GameProtocol::updateMissedObjects(const StateDelta::Snapshot& s,
+                                       const std::vector<RelevanceInfo>& info,
+                                       const std::vector<uint8_t>& send,
+                                       PeerStates* ps)
+{
+    for (unsigned i = 0; i < s.m_entries.size(); i++)
+    {
+        const RelevanceType type = info[i].m_type;
+        if (type != RT_SKIP && type != RT_MISSED)
+            continue;
+        if (!send.empty() && send[i] != StateDelta::SM_SKIP)
+            ps->m_missed.erase(s.m_entries[i].m_name);
+        else if (type == RT_SKIP)
+            ps->m_missed.insert(s.m_entries[i].m_name);
+    }
+}   // updateMissedObjects
+
+// ----------------------------------------------------------------------------
+/** Sends the current state to each peer, leaving out rewinders which are
+ *  not relevant for it at this time or sending them with reduced precision,
+ *  and relative to the latest state it acknowledged if delta states are
+ *  enabled. Peers which didn't acknowledge a state still in the history
+ *  (e.g. because of packet loss) get a full state, and peers not
+ *  supporting delta states get a GP_STATE. Peers with a bad connection may
+ *  only get every n-th state (see getNewStateInterval).
+ */
+void GameProtocol::sendPeerStates()
+{
+    const unsigned cur_index = m_state_history_index;
+    StateDelta::Snapshot* cur = addStateHistory();
+    // Skip protocol type and GP_STATE
+    m_data_to_send->reset();
+    m_data_to_send->skip(2);
+    StateDelta::parseState(m_data_to_send, cur);
+    const unsigned num_saved = (unsigned)cur->m_entries.size();
+    if (m_body_offsets.size() == num_saved)
+    {
+        for (unsigned i = 0; i < num_saved; i++)
+            cur->m_entries[i].m_body = m_body_offsets[i];
+    }
+    auto all_peers = STKHost::get()->getPeers();
+    addMissedObjects(cur, all_peers);
+    updateRelevanceInfo(*cur, num_saved);
+    const unsigned max_interval =
+        (unsigned)std::max(1, (int)ServerConfig::m_max_state_interval);
+    const uint64_t now = StkTime::getMonoTimeMs();
+
+    // The states are built here, and then encrypted for all peers in
+    // parallel by STKHost
+    std::vector<STKPeer*> peers;
+    std::vector<NetworkString*> states;
+    for (auto& peer : all_peers)
+    {
+        if (!peer->isValidated() || peer->isWaitingForGame())
+            continue;
+        auto it = m_peer_states_sent.find(peer->getHostId());
+        if (it == m_peer_states_sent.end())
+        {
+            it = m_peer_states_sent.emplace(peer->getHostId(),
+                PeerStates()).first;
+            it->second.m_skipped = peer->getHostId();
+        }
+        PeerStates& ps = it->second;
+        std::vector<uint8_t>& cur_send = ps.m_sent[cur_index];
+        if (now >= ps.m_next_interval_update)
+        {
+            ps.m_interval = getNewStateInterval(ps.m_interval, max_interval,
+                peer->getAveragePing(), peer->getPacketLoss(),
+                peer->getRewindLoad());
+            ps.m_next_interval_update = now + 1000;
+        }
+        if (++ps.m_skipped % ps.m_interval != 0)
+        {
+            // Not sent, so it can't be used as base for delta states
+            cur_send.clear();
+            updateMissedObjects(*cur, m_relevance_info, cur_send, &ps);
+            continue;
+        }
+        ps.m_skipped = 0;
+        computeRelevance(peer.get(), *cur, &ps, &cur_send);
+
+        if (m_peer_states.size() <= states.size())
+            m_peer_states.push_back(getNetworkString());
+        NetworkString* ns = m_peer_states[states.size()];
+        ns->clear();
+        if (ServerConfig::m_delta_state &&
+            peer->getClientCapabilities().find("delta_state") !=
+            peer->getClientCapabilities().end())
+        {
+            const StateDelta::Snapshot* base =
+                findStateHistory(peer->getAckedStateTicks());
+            const std::vector<uint8_t>* base_sent = NULL;
+            if (base)
+            {
+                base_sent = &ps.m_sent[base - m_state_history.data()];
+                if (base_sent->size() != base->m_entries.size())
+                    base = NULL;
+            }
+            ns->addUInt8(GP_STATE_DELTA);
+            StateDelta::encode(base, *cur, ns, base_sent, &cur_send);
+        }
+        else
+        {
+            ns->addUInt8(GP_STATE);
+            StateDelta::writeFilteredState(*cur, &cur_send, ns);
+        }
+        updateMissedObjects(*cur, m_relevance_info, cur_send, &ps);
+        peers.push_back(peer.get());
+        states.push_back(ns);
+    }
+    STKHost::get()->sendPacketToPeers(peers, states, /*reliable*/false);
+}   // sendPeerStates
+
 // ----------------------------------------------------------------------------
 /** Called when a new full state is received form the server.
  */
@@ -357,6 +741,203 @@ void GameProtocol::handleState(Event *event)
     RewindManager::get()->addNetworkRewindInfo(ris);
 }   // handleState
 
+// ----------------------------------------------------------------------------
+/** Called when a delta compressed state is received from the server. The
+ *  full state is reconstructed from the base state in the history, and the
+ *  server is informed that this state can be used as base from now on. If
+ *  the base state is not available the state is ignored, the server will
+ *  send a full state once the base state is removed from its history.
+ */
+void GameProtocol::handleStateDelta(Event *event)
+{
+    if (!NetworkConfig::get()->isClient())
+        return;
+    NetworkString &data = event->data();
+    const StateDelta::Snapshot* base =
+        findStateHistory(StateDelta::getBaseTicks(&data));
+    StateDelta::Snapshot* cur = addStateHistory();
+    // Don't overwrite the base state while decoding
+    if (cur == base)
+        cur = addStateHistory();
+    try
+    {
+        StateDelta::decode(base, &data, cur);
+    }
+    catch (std::exception& e)
+    {
+        Log::warn("GameProtocol", "Invalid delta state: %s", e.what());
+        cur->clear();
+        return;
+    }
+
+    NetworkString* ack = getNetworkString(5);
+    ack->addUInt8(GP_STATE_ACK).addUInt32(cur->m_ticks);
+    sendToServer(ack, /*reliable*/false);
+    delete ack;
+
+    std::vector<std::string> rewinder_using;
+    for (const StateDelta::Entry& e : cur->m_entries)
+        rewinder_using.push_back(e.m_name);
+    std::vector<uint8_t> buffer;
+    StateDelta::writeState(*cur, &buffer);
+    RewindInfoState* ris = new RewindInfoState(cur->m_ticks, 0,
+        rewinder_using, buffer);
+    RewindManager::get()->addNetworkRewindInfo(ris);
+}   // handleStateDelta
+
+// ----------------------------------------------------------------------------
+/** Called on the server when a client acknowledged a delta state.
+ */
+void GameProtocol::handleStateAck(Event *event)
+{
+    if (!NetworkConfig::get()->isServer() || !checkDataSize(event, 4))
+        return;
+    int ticks = event->data().getTime();
+    STKPeer* peer = event->getPeer();
+    // Acknowledgements can arrive out of order
+    if (ticks > peer->getAckedStateTicks())
+        peer->setAckedStateTicks(ticks);
+}   // handleStateAck
+
+// ----------------------------------------------------------------------------
+/** Called on the client once per frame, sends the number of rewinds and the
+ *  time spent rewinding every second to the server, which uses it to decide
+ *  how often states are sent to this client. The position corrections
+ *  caused by the rewinds are included for the server benchmark.
+ */
+void GameProtocol::sendRewindReport()
+{
+    const uint64_t now = StkTime::getMonoTimeMs();
+    if (now < m_last_rewind_report + 1000)
+        return;
+    const std::set<std::string>& caps =
+        NetworkConfig::get()->getServerCapabilities();
+    if (caps.find("rewind_report") == caps.end())
+        return;
+
+    RewindManager* rm = RewindManager::get();
+    const uint64_t duration = now - m_last_rewind_report;
+    m_last_rewind_report = now;
+    NetworkString* report = getNetworkString(1 + REWIND_REPORT_SIZE);
+    writeRewindReport(report, rm->getNumRewinds(), rm->getRewindTimeUs(),
+        duration, SmoothNetworkBody::getNumCorrections(),
+        SmoothNetworkBody::getTotalCorrection(),
+        SmoothNetworkBody::getMaxCorrection());
+    sendToServer(report, /*reliable*/false);
+    delete report;
+    rm->resetRewindStats();
+    SmoothNetworkBody::resetCorrectionStats();
+}   // sendRewindReport
+
+// ----------------------------------------------------------------------------
+/** Writes a rewind report message, the values are clamped to 16 bit.
+ *  \param report The message to write to.
+ *  \param rewind_us Time spent rewinding in microseconds.
+ *  \param duration Time in milliseconds covered by the report.
+ */
+void GameProtocol::writeRewindReport(NetworkString* report,
+                                     unsigned num_rewinds, uint64_t rewind_us,
+                                     uint64_t duration,
+                                     unsigned num_corrections,
+                                     float total_correction,
+                                     float max_correction)
+{
+    report->addUInt8(GP_REWIND_REPORT)
+        .addUInt16((uint16_t)std::min(num_rewinds, 65535u))
+        .addUInt16((uint16_t)std::min<uint64_t>(rewind_us / 1000, 65535))
+        .addUInt16((uint16_t)std::min<uint64_t>(duration, 65535))
+        .addUInt16((uint16_t)std::min(num_corrections, 65535u))
+        .addFloat(total_correction)
+        .addFloat(max_correction);
+}   // writeRewindReport
+
+// ----------------------------------------------------------------------------
+/** Called on the server when a client reports how much time it spent
+ *  rewinding, and how far the karts were moved by the rewinds.
+ */
+void GameProtocol::handleRewindReport(Event *event)
+{
+    if (!NetworkConfig::get()->isServer() ||
+        !checkDataSize(event, REWIND_REPORT_SIZE))
+        return;
+    readRewindReport(event->data(), event->getPeer());
+}   // handleRewindReport
+
+// ----------------------------------------------------------------------------
+/** Reads a rewind report after the message type and updates the rewind load
+ *  of the peer, and the server benchmark if it is running.
+ */
+void GameProtocol::readRewindReport(NetworkString& data, STKPeer* peer)
+{
+    const unsigned num_rewinds = data.getUInt16();
+    const unsigned rewind_ms = data.getUInt16();
+    const unsigned duration = data.getUInt16();
+    const unsigned num_corrections = data.getUInt16();
+    const float total_correction = data.getFloat();
+    const float max_correction = data.getFloat();
+    if (duration == 0)
+        return;
+    peer->setRewindLoad((int)std::min(rewind_ms * 1000 / duration, 1000u));
+    if (ServerBenchmark::isEnabled())
+    {
+        ServerBenchmark::addRewindReport(peer->getHostId(), num_rewinds,
+            rewind_ms, num_corrections, total_correction, max_correction);
+    }
+    if (Network::m_connection_debug)
+    {
+        Log::verbose("GameProtocol", "Peer %d: %d rewinds in %dms taking "
+            "%dms, %d corrections of at most %f.", peer->getHostId(),
+            num_rewinds, duration, rewind_ms, num_corrections,
+            max_correction);
+    }
+}   // readRewindReport
+
+// ----------------------------------------------------------------------------
+/** Returns the interval of states sent to a peer, i.e. it gets only every
+ *  n-th state. The interval increases by one if the client spends too much
+ *  time rewinding (each state received causes a rewind) or loses many
+ *  packets, and decreases by one if it can handle more states again. For
+ *  clients which don't report their rewind time a high ping is used
+ *  instead, since it makes each rewind longer.
+ *  \param interval The current interval.
+ *  \param max_interval The maximum interval.
+ *  \param ping Average ping of the client in ms.
+ *  \param packet_loss Packet loss of the client from 0 to 1.
+ *  \param rewind_load Per mille of time the client spends rewinding, or -1
+ *         if it's not reported.
+ */
+unsigned GameProtocol::getNewStateInterval(unsigned interval,
+                                           unsigned max_interval,
+                                           uint32_t ping, float packet_loss,
+                                           int rewind_load)
+{
+    bool increase, decrease;
+    if (rewind_load >= 0)
+    {
+        increase = rewind_load > 300;
+        // The rewind time grows with the number of states, only send more
+        // states if it stays below the limit afterwards to avoid oscillating
+        decrease = interval > 1 &&
+            rewind_load * (int)interval / (int)(interval - 1) < 250;
+    }
+    else
+    {
+        increase = ping > 200;
+        decrease = ping < 100;
+    }
+    // Lost states are only wasted bandwidth
+    if (packet_loss > 0.1f)
+        increase = true;
+    else if (packet_loss > 0.02f)
+        decrease = false;
+
+    if (increase)
+        interval++;
+    else if (decrease && interval > 1)
+        interval--;
+    return std::max(1u, std::min(interval, max_interval));
+}   // getNewStateInterval
+
 // ----------------------------------------------------------------------------
 /** Called from the RewindManager when rolling back.
  *  \param buffer Pointer to the saved state information.
@@ -394,4 +975,294 @@ void GameProtocol::update(int ticks)
 {
     if (!World::getWorld())
         ProtocolManager::lock()->findAndTerminate(PROTOCOL_CONTROLLER_EVENTS);
+    else if (NetworkConfig::get()->isClient())
+        sendRewindReport();
 }   // update
+
+// ----------------------------------------------------------------------------
+void GameProtocol::unitTesting()
+{
+    // No report: the ping decides
+    assert(getNewStateInterval(1, 3, 50, 0.0f, -1) == 1);
+    assert(getNewStateInterval(1, 3, 250, 0.0f, -1) == 2);
+    assert(getNewStateInterval(2, 3, 250, 0.0f, -1) == 3);
+    assert(getNewStateInterval(3, 3, 250, 0.0f, -1) == 3);
+    assert(getNewStateInterval(3, 3, 150, 0.0f, -1) == 3);
+    assert(getNewStateInterval(3, 3, 50, 0.0f, -1) == 2);
+    // Packet loss
+    assert(getNewStateInterval(1, 3, 50, 0.2f, -1) == 2);
+    assert(getNewStateInterval(2, 3, 50, 0.05f, -1) == 2);
+    // Reported rewind load overrides the ping
+    assert(getNewStateInterval(1, 3, 250, 0.0f, 100) == 1);
+    assert(getNewStateInterval(1, 3, 50, 0.0f, 400) == 2);
+    // 200 per mille with every 2nd state would be 400 with all states
+    assert(getNewStateInterval(2, 3, 50, 0.0f, 200) == 2);
+    assert(getNewStateInterval(2, 3, 50, 0.0f, 100) == 1);
+    assert(getNewStateInterval(3, 3, 50, 0.0f, 150) == 2);
+    // Disabled or lowered maximum
+    assert(getNewStateInterval(1, 1, 250, 0.5f, 1000) == 1);
+    assert(getNewStateInterval(3, 2, 150, 0.0f, -1) == 2);
+
+    // Far karts and flyables are in every state, otherwise the client would
+    // eliminate the kart and remove the flyable, but with reduced precision
+    // except in every 3rd state. Far physical objects are left out instead.
+    // The last entry is an object at rest added by addMissedObjects.
+    StateDelta::Snapshot state;
+    state.m_ticks = 100;
+    const std::string names[] =
+    {
+        std::string{ RN_KART, 1 }, std::string{ RN_BOWLING, 0, 7 },
+        std::string{ RN_PHYSICAL_OBJ, 0 }, std::string{ RN_PHYSICAL_OBJ, 1 },
+        std::string{ RN_PHYSICAL_OBJ, 2 }
+    };
+    const Vec3 positions[] =
+    {
+        Vec3(1000, 0, 0), Vec3(0, 0, 1000), Vec3(-1000, 0, 0), Vec3(5, 0, 0),
+        Vec3(-1000, 0, 0)
+    };
+    const RelevanceType types[] =
+        { RT_REDUCE, RT_REDUCE, RT_SKIP, RT_SKIP, RT_MISSED };
+    std::vector<RelevanceInfo> info;
+    for (unsigned i = 0; i < 5; i++)
+    {
+        StateDelta::Entry e;
+        e.m_name = names[i];
+        e.m_offset = (uint32_t)state.m_data.size();
+        e.m_size = 4;
+        e.m_body = -1;
+        e.m_reduced = false;
+        state.m_entries.push_back(e);
+        state.m_data.insert(state.m_data.end(), 4, (uint8_t)i);
+        RelevanceInfo ri;
+        ri.m_xyz = positions[i];
+        ri.m_type = types[i];
+        info.push_back(ri);
+    }
+    assert(canSkipRewinder(names[2]) && canSkipRewinder(names[3]));
+    assert(!canSkipRewinder(names[0]) && !canSkipRewinder(names[1]));
+    const std::vector<Vec3> own_xyz = { Vec3(0, 0, 0) };
+    std::vector<uint8_t> send;
+    for (unsigned count = 0; count < 3; count++)
+    {
+        selectRelevant(info, own_xyz, count, 50.0f, 3, &send);
+        assert(send[0] == (count == 0 ? StateDelta::SM_FULL
+                                      : StateDelta::SM_REDUCED));
+        assert(send[1] == (count == 2 ? StateDelta::SM_FULL
+                                      : StateDelta::SM_REDUCED));
+        assert(send[2] == (count == 1 ? StateDelta::SM_FULL
+                                      : StateDelta::SM_SKIP));
+        assert(send[3] == StateDelta::SM_FULL);
+        assert(send[4] == StateDelta::SM_SKIP);
+    }
+
+    // The far kart is in the state received by a client without delta
+    // states, which is always sent with full precision
+    selectRelevant(info, own_xyz, 1, 50.0f, 3, &send);
+    BareNetworkString filtered;
+    StateDelta::writeFilteredState(state, &send, &filtered);
+    assert(send[0] == StateDelta::SM_FULL);
+    StateDelta::Snapshot received_state;
+    StateDelta::parseState(&filtered, &received_state);
+    assert(received_state.m_ticks == 100);
+    assert(received_state.m_entries.size() == 4);
+    assert(received_state.m_entries[0].m_name == names[0]);
+    assert(received_state.m_entries[1].m_name == names[1]);
+    assert(received_state.m_entries[2].m_name == names[2]);
+    assert(received_state.m_entries[3].m_name == names[3]);
+    assert(received_state.m_data[received_state.m_entries[0].m_offset] == 0);
+
+    // Without relevance-distance everything but the object at rest is sent
+    selectRelevant(info, own_xyz, 0, 0.0f, 3, &send);
+    for (unsigned i = 0; i < 4; i++)
+        assert(send[i] == StateDelta::SM_FULL);
+    assert(send[4] == StateDelta::SM_SKIP);
+
+    // A peer misses the last state of far objects which are left out or
+    // not sent at all, until it gets a state with them
+    PeerStates ps;
+    selectRelevant(info, own_xyz, 0, 50.0f, 3, &send);
+    updateMissedObjects(state, info, send, &ps);
+    assert(ps.m_missed.size() == 1 && ps.m_missed.count(names[2]) == 1);
+    updateMissedObjects(state, info, std::vector<uint8_t>(), &ps);
+    assert(ps.m_missed.size() == 2 && ps.m_missed.count(names[3]) == 1);
+    selectRelevant(info, own_xyz, 1, 50.0f, 3, &send);
+    updateMissedObjects(state, info, send, &ps);
+    assert(ps.m_missed.empty());
+    // An object at rest is only forgotten once it was sent to the peer
+    ps.m_missed.insert(names[4]);
+    selectRelevant(info, own_xyz, 1, 50.0f, 3, &send);
+    updateMissedObjects(state, info, send, &ps);
+    assert(ps.m_missed.size() == 1);
+    send[4] = StateDelta::SM_FULL;
+    updateMissedObjects(state, info, send, &ps);
+    assert(ps.m_missed.empty());
+
+    // A rewind report is read back as written, sets the rewind load and
+    // is added to the benchmark result
+    const int benchmark_ticks = ServerBenchmark::m_ticks;
+    ServerBenchmark::m_ticks = 1;
+    ServerBenchmark::m_rewind_data.clear();
+    NetworkString report(PROTOCOL_CONTROLLER_EVENTS, 1 + REWIND_REPORT_SIZE);
+    writeRewindReport(&report, 12, 250000, 1000, 3, 1.5f, 0.75f);
+    assert(report.getTotalSize() == 2 + REWIND_REPORT_SIZE);
+    NetworkString received((const uint8_t*)report.getData(),
+                           report.getTotalSize());
+    const uint8_t type = received.getUInt8();
+    assert(type == GP_REWIND_REPORT);
+    (void)type;
+    assert(received.size() == REWIND_REPORT_SIZE);
+    ENetPeer enet_peer;
+    memset(&enet_peer, 0, sizeof(enet_peer));
+    STKPeer peer(&enet_peer, NULL, 7);
+    assert(peer.getRewindLoad() == -1);
+    readRewindReport(received, &peer);
+    assert(received.size() == 0);
+    assert(peer.getRewindLoad() == 250);
+
+    // Too much rewinding is capped, a report without duration is ignored
+    report.clear();
+    writeRewindReport(&report, 1, 3000000, 1000, 0, 0.0f, 0.0f);
+    NetworkString capped((const uint8_t*)report.getData(),
+                         report.getTotalSize());
+    capped.getUInt8();
+    readRewindReport(capped, &peer);
+    assert(peer.getRewindLoad() == 1000);
+    report.clear();
+    writeRewindReport(&report, 1, 100000, 0, 0, 0.0f, 0.0f);
+    NetworkString empty((const uint8_t*)report.getData(),
+                        report.getTotalSize());
+    empty.getUInt8();
+    readRewindReport(empty, &peer);
+    assert(peer.getRewindLoad() == 1000);
+
+    assert(ServerBenchmark::m_rewind_data.size() == 1);
+    const ServerBenchmark::RewindData& rd = ServerBenchmark::m_rewind_data[7];
+    assert(rd.m_rewinds == 13);
+    assert(rd.m_rewind_ms == 3250);
+    assert(rd.m_corrections == 3);
+    assert(rd.m_total_correction == 1.5);
+    assert(rd.m_max_correction == 0.75f);
+    (void)rd;
+    ServerBenchmark::m_rewind_data.clear();
+
+    // Without a running benchmark only the rewind load is updated
+    ServerBenchmark::m_ticks = 0;
+    report.clear();
+    writeRewindReport(&report, 2, 100000, 1000, 1, 1.0f, 1.0f);
+    NetworkString ignored((const uint8_t*)report.getData(),
+                          report.getTotalSize());
+    ignored.getUInt8();
+    readRewindReport(ignored, &peer);
+    assert(peer.getRewindLoad() == 100);
+    assert(ServerBenchmark::m_rewind_data.empty());
+    ServerBenchmark::m_ticks = benchmark_ticks;
+
+    testSaveState(2, /*print*/false);
+}   // unitTesting
+
+// ----------------------------------------------------------------------------
+/** The state of each kart is written directly into the state buffer. This
+ *  compares it with the previous way, which wrote it into a new buffer for
+ *  each kart and copied it into the state afterwards: both give the same
+ *  state, and the time of each can be printed.
+ *  \param repeat How often the state of each number of karts is saved.
+ *  \param print If the time of each way is printed.
+ */
+void GameProtocol::testSaveState(int repeat, bool print)
+{
+    class TestRewinder : public Rewinder
+    {
+    public:
+        TestRewinder(const std::string& uid) : Rewinder(uid) {}
+        virtual void saveTransform() {}
+        virtual void computeError() {}
+        virtual bool saveState(BareNetworkString* buffer,
+                               std::vector<std::string>* ru)
+        {
+            // Roughly the size and number of writes of a KartRewinder
+            ru->push_back(getUniqueIdentity());
+            buffer->addUInt32(100).addUInt8(1).addUInt8(2).addUInt16(3);
+            for (unsigned i = 0; i < 17; i++)
+                buffer->addFloat((float)i);
+            buffer->addUInt8(4).addUInt8(5).addUInt16(6);
+            return true;
+        }
+        virtual void undoEvent(BareNetworkString* buffer) {}
+        virtual void rewindToEvent(BareNetworkString* buffer) {}
+        virtual void restoreState(BareNetworkString* buffer, int count) {}
+        virtual void undoState(BareNetworkString* buffer) {}
+    };
+    const bool is_server = NetworkConfig::get()->isServer();
+    GameProtocol gp;
+    NetworkConfig::get()->setIsServer(true);
+    const unsigned KART_STATE_SIZE = 17 * sizeof(float) + 12;
+    for (unsigned num_karts : { 4, 8, 16, 32 })
+    {
+        std::vector<std::shared_ptr<Rewinder> > karts;
+        for (unsigned i = 0; i < num_karts; i++)
+        {
+            karts.push_back(std::make_shared<TestRewinder>(
+                std::string{ RN_KART, (char)i }));
+        }
+        std::vector<std::string> ru;
+        double s = StkTime::getRealTime();
+        for (int r = 0; r < repeat; r++)
+        {
+            ru.clear();
+            gp.m_data_to_send->clear();
+            gp.m_data_to_send->addUInt8(GP_STATE).addUInt32(r);
+            for (auto& kart : karts)
+                gp.addState(kart.get(), &ru);
+            gp.finalizeState(ru);
+        }
+        const double direct = (StkTime::getRealTime() - s) / repeat;
+
+        // The states are the same, so check the last one of the direct way
+        StateDelta::Snapshot direct_state;
+        gp.m_data_to_send->reset();
+        gp.m_data_to_send->skip(2);
+        StateDelta::parseState(gp.m_data_to_send, &direct_state);
+        assert(direct_state.m_entries.size() == num_karts);
+        assert(direct_state.m_entries[num_karts - 1].m_name ==
+            karts[num_karts - 1]->getUniqueIdentity());
+        assert(direct_state.m_entries[0].m_size == KART_STATE_SIZE);
+
+        s = StkTime::getRealTime();
+        for (int r = 0; r < repeat; r++)
+        {
+            ru.clear();
+            gp.m_data_to_send->clear();
+            gp.m_data_to_send->addUInt8(GP_STATE).addUInt32(r);
+            for (auto& kart : karts)
+            {
+                BareNetworkString* buffer =
+                    new BareNetworkString(KART_STATE_SIZE);
+                kart->saveState(buffer, &ru);
+                gp.m_data_to_send->addUInt16(buffer->size());
+                (*gp.m_data_to_send) += *buffer;
+                delete buffer;
+            }
+            gp.finalizeState(ru);
+        }
+        const double copied = (StkTime::getRealTime() - s) / repeat;
+
+        StateDelta::Snapshot copied_state;
+        gp.m_data_to_send->reset();
+        gp.m_data_to_send->skip(2);
+        StateDelta::parseState(gp.m_data_to_send, &copied_state);
+        assert(copied_state.m_data == direct_state.m_data);
+        if (print)
+        {
+            Log::info("GameProtocol", "saveState of %u karts: %lf us direct, "
+                      "%lf us with a buffer for each kart", num_karts,
+                      direct * 1000000.0, copied * 1000000.0);
+        }
+    }
+    NetworkConfig::get()->setIsServer(is_server);
+}   // testSaveState
+
+// ----------------------------------------------------------------------------
+void GameProtocol::benchmark()
+{
+    testSaveState(2000, /*print*/true);
+}   // benchmark
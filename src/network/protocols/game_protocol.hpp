@@ -21,18 +21,25 @@
 
 #include "network/event_rewinder.hpp"
 #include "network/protocol.hpp"
+#include "network/state_delta.hpp"
 
 #include "input/input.hpp"                // for PlayerAction
 #include "utils/cpp2011.hpp"
 #include "utils/singleton.hpp"
+#include "utils/vec3.hpp"
 
+#include <array>
 #include <cstdlib>
+#include <map>
 #include <mutex>
+#include <set>
+#include <string>
 #include <vector>
 #include <tuple>
 
 class BareNetworkString;
 class NetworkString;
+class Rewinder;
 class STKPeer;
 
 class GameProtocol : public Protocol
@@ -48,13 +55,101 @@ private:
            GP_STATE,
            GP_ITEM_UPDATE,
            GP_ITEM_CONFIRMATION,
-           GP_ADJUST_TIME
+           GP_ADJUST_TIME,
+           GP_STATE_DELTA,
+           GP_STATE_ACK,
+           GP_REWIND_REPORT
     };
 
+    /** Number of previous states kept for delta compressed states. */
+    static const unsigned STATE_HISTORY_SIZE = 16;
+
     /** A network string that collects all information from the server to be sent
      *  next. */
     NetworkString *m_data_to_send;
 
+    /** Reused buffer for the names of rewinder used in a state, which is
+     *  inserted in front of the state data in finalizeState. */
+    std::vector<uint8_t> m_rewinder_names;
+
+    /** For each rewinder in the current state the offset of its body (see
+     *  CompressNetworkBody::lastBodyOffset) in its data, or -1. */
+    std::vector<int> m_body_offsets;
+
+    /** The latest data of each physical object sent in a state. Objects
+     *  at rest are not in the state, so this is sent to peers which missed
+     *  the last state of the object. */
+    std::map<std::string, std::vector<uint8_t> > m_object_states;
+
+    /** On the server the latest states sent, on the client the latest
+     *  states received. They are used as base for delta compressed states
+     *  and reused in a round robin fashion. */
+    std::vector<StateDelta::Snapshot> m_state_history;
+
+    /** Index of the next entry in m_state_history to be used. */
+    unsigned m_state_history_index;
+
+    /** Network strings to assemble the state for each peer in, they are
+     *  reused for the following states. */
+    std::vector<NetworkString*> m_peer_states;
+
+    /** Information about the states sent to a peer. */
+    struct PeerStates
+    {
+        /** For each entry in the state history how the rewinders were sent
+         *  to the peer (StateDelta::SendMode), so that only those are used
+         *  as base for delta states. */
+        std::array<std::vector<uint8_t>, STATE_HISTORY_SIZE> m_sent;
+        /** Physical objects whose latest state was not sent to the peer. */
+        std::set<std::string> m_missed;
+        /** Number of states sent, used to spread sending of far objects. */
+        unsigned m_count;
+        /** Only every n-th state is sent to the peer. */
+        unsigned m_interval;
+        /** Number of states since the last one sent, it starts with the
+         *  host id so that different peers skip different states. */
+        unsigned m_skipped;
+        /** Time (StkTime::getMonoTimeMs) when m_interval is next updated. */
+        uint64_t m_next_interval_update;
+        // --------------------------------------------------------------------
+        PeerStates() : m_count(0), m_interval(1), m_skipped(0),
+                       m_next_interval_update(0) {}
+    };   // PeerStates
+
+    /** The states sent to each peer (by host id). */
+    std::map<uint32_t, PeerStates> m_peer_states_sent;
+
+    /** How a rewinder is sent to peers whose karts are far away from it. */
+    enum RelevanceType : uint8_t
+    {
+        /** Always sent with full precision. */
+        RT_ALWAYS,
+        /** A physical object, which is left out of the state. */
+        RT_SKIP,
+        /** A kart or flyable, whose body is sent with reduced precision. */
+        RT_REDUCE,
+        /** A physical object at rest, which is only in the state for peers
+         *  which missed its latest state. */
+        RT_MISSED
+    };
+
+    /** Position of a rewinder in the current state to decide whether it
+     *  is relevant for a peer. */
+    struct RelevanceInfo
+    {
+        Vec3 m_xyz;
+        RelevanceType m_type;
+    };
+    std::vector<RelevanceInfo> m_relevance_info;
+
+    /** On the client the time (StkTime::getMonoTimeMs) the rewind stats
+     *  were last sent to the server. */
+    uint64_t m_last_rewind_report;
+
+    /** Size of a rewind report after the message type: four 16 bit
+     *  counters and two floats. */
+    static const unsigned REWIND_REPORT_SIZE = 16;
+
     /** The server might request that the world clock of a client is adjusted
      *  to reduce number of rollbacks. */
     std::vector<int8_t> m_adjust_time;
@@ -75,6 +170,35 @@ private:
 
     void handleControllerAction(Event *event);
     void handleState(Event *event);
+    void handleStateDelta(Event *event);
+    void handleStateAck(Event *event);
+    void handleRewindReport(Event *event);
+    void sendRewindReport();
+    static void writeRewindReport(NetworkString* report, unsigned num_rewinds,
+                                  uint64_t rewind_us, uint64_t duration,
+                                  unsigned num_corrections,
+                                  float total_correction,
+                                  float max_correction);
+    static void readRewindReport(NetworkString& data, STKPeer* peer);
+    void sendPeerStates();
+    void addMissedObjects(StateDelta::Snapshot* s,
+                          const std::vector<std::shared_ptr<STKPeer> >& peers);
+    void updateRelevanceInfo(const StateDelta::Snapshot& s,
+                             unsigned num_saved);
+    static bool canSkipRewinder(const std::string& name);
+    static void selectRelevant(const std::vector<RelevanceInfo>& info,
+                               const std::vector<Vec3>& own_xyz,
+                               unsigned state_count, float max_distance,
+                               unsigned interval, std::vector<uint8_t>* send);
+    void computeRelevance(const STKPeer* peer, const StateDelta::Snapshot& s,
+                          PeerStates* ps, std::vector<uint8_t>* send) const;
+    static void updateMissedObjects(const StateDelta::Snapshot& s,
+                                    const std::vector<RelevanceInfo>& info,
+                                    const std::vector<uint8_t>& send,
+                                    PeerStates* ps);
+    static void testSaveState(int repeat, bool print);
+    StateDelta::Snapshot* addStateHistory();
+    const StateDelta::Snapshot* findStateHistory(int ticks) const;
     void handleAdjustTime(Event *event);
     void handleItemEventConfirmation(Event *event);
     static std::weak_ptr<GameProtocol> m_game_protocol;
@@ -110,10 +234,15 @@ public:
     void controllerAction(int kart_id, PlayerAction action,
                           int value, int val_l, int val_r);
     void startNewState();
-    void addState(BareNetworkString *buffer);
+    unsigned addState(Rewinder* rewinder, std::vector<std::string>* ru);
     void sendState();
     void finalizeState(std::vector<std::string>& cur_rewinder);
     void sendItemEventConfirmation(int ticks);
+    static unsigned getNewStateInterval(unsigned interval,
+                                        unsigned max_interval, uint32_t ping,
+                                        float packet_loss, int rewind_load);
+    static void unitTesting();
+    static void benchmark();
 
     virtual void undo(BareNetworkString *buffer) OVERRIDE;
     virtual void rewind(BareNetworkString *buffer) OVERRIDE;
@@ -137,6 +266,14 @@ public:
     /** Returns the NetworkString in which a state was saved. */
     NetworkString* getState() const { return m_data_to_send;  }
     // ------------------------------------------------------------------------
+    /** Returns that only every n-th state is sent to a peer, 0 if no state
+     *  was sent to it yet. Must be called from the main thread. */
+    unsigned getStateInterval(uint32_t host_id) const
+    {
+        auto it = m_peer_states_sent.find(host_id);
+        return it == m_peer_states_sent.end() ? 0 : it->second.m_interval;
+    }   // getStateInterval
+    // ------------------------------------------------------------------------
     std::unique_lock<std::mutex> acquireWorldDeletingMutex() const
                { return std::unique_lock<std::mutex>(m_world_deleting_mutex); }
 
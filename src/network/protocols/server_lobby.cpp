@@ -28,6 +28,8 @@
 #include "modes/capture_the_flag.hpp"
 #include "modes/linear_world.hpp"
 #include "network/crypto.hpp"
+#include "network/database_cache.hpp"
+#include "network/database_writer.hpp"
 #include "network/event.hpp"
 #include "network/game_setup.hpp"
 #include "network/network_config.hpp"
@@ -38,6 +40,7 @@
 #include "network/protocols/game_protocol.hpp"
 #include "network/protocols/game_events_protocol.hpp"
 #include "network/race_event_manager.hpp"
+#include "network/server_benchmark.hpp"
 #include "network/server_config.hpp"
 #include "network/stk_host.hpp"
 #include "network/stk_peer.hpp"
@@ -141,6 +144,8 @@ ServerLobby::ServerLobby() : LobbyProtocol()
     m_result_ns = getNetworkString();
     m_result_ns->setSynchronous(true);
     m_items_complete_state = new BareNetworkString();
+    m_live_join_vote = new BareNetworkString();
+    m_live_join_settings = new BareNetworkString();
     m_server_id_online.store(0);
     m_difficulty.store(ServerConfig::m_server_difficulty);
     m_game_mode.store(ServerConfig::m_server_mode);
@@ -161,6 +166,8 @@ ServerLobby::~ServerLobby()
     }
     delete m_result_ns;
     delete m_items_complete_state;
+    delete m_live_join_vote;
+    delete m_live_join_settings;
     if (m_save_server_config)
         ServerConfig::writeServerConfigToDisk();
     delete m_default_vote;
@@ -201,6 +208,8 @@ void ServerLobby::initDatabase()
             // Return zero to let caller return SQLITE_BUSY immediately
             return 0;
         }, NULL);
+    m_database_writer.reset(new DatabaseWriter(ServerConfig::m_database_file,
+        std::max((int)ServerConfig::m_database_write_interval, 0)));
 
     checkTableExists(ServerConfig::m_ip_ban_table, m_ip_ban_table_exists);
     checkTableExists(ServerConfig::m_online_id_ban_table,
@@ -209,6 +218,20 @@ void ServerLobby::initDatabase()
         m_player_reports_table_exists);
     checkTableExists(ServerConfig::m_ip_geolocation_table,
         m_ip_geolocation_table_exists);
+
+    if (ServerConfig::m_database_refresh_interval > 0 &&
+        (m_ip_ban_table_exists || m_online_id_ban_table_exists ||
+        m_ip_geolocation_table_exists))
+    {
+        m_database_cache.reset(new DatabaseCache(
+            ServerConfig::m_database_file,
+            m_ip_ban_table_exists ?
+            std::string(ServerConfig::m_ip_ban_table) : "",
+            m_online_id_ban_table_exists ?
+            std::string(ServerConfig::m_online_id_ban_table) : "",
+            m_ip_geolocation_table_exists ?
+            std::string(ServerConfig::m_ip_geolocation_table) : ""));
+    }
 #endif
 }   // initDatabase
 
@@ -417,6 +440,9 @@ void ServerLobby::destroyDatabase()
     auto peers = STKHost::get()->getPeers();
     for (auto& peer : peers)
         writeDisconnectInfoTable(peer.get());
+    // Writes all queued queries
+    m_database_writer.reset();
+    m_database_cache.reset();
     if (m_db != NULL)
         sqlite3_close(m_db);
 #endif
@@ -428,11 +454,13 @@ void ServerLobby::writeDisconnectInfoTable(STKPeer* peer)
 #ifdef ENABLE_SQLITE3
     if (m_server_stats_table.empty())
         return;
+    // The time is bound, as the query is written later
     std::string query = StringUtils::insertValues(
-        "UPDATE %s SET disconnected_time = datetime('now'), ping = %d "
-        "WHERE host_id = %u;", m_server_stats_table.c_str(),
-        peer->getAveragePing(), peer->getHostId());
-    easySQLQuery(query);
+        "UPDATE %s SET disconnected_time = datetime(?, 'unixepoch'), "
+        "ping = ? WHERE host_id = ?;", m_server_stats_table.c_str());
+    m_database_writer->write(query,
+        { (int64_t)StkTime::getTimeSinceEpoch(), peer->getAveragePing(),
+          peer->getHostId() });
 #endif
 }   // writeDisconnectInfoTable
 
@@ -526,6 +554,10 @@ void ServerLobby::setup()
     m_item_seed = 0;
     m_winner_peer_id = 0;
     m_client_starting_time = 0;
+    m_live_join_vote->getBuffer().clear();
+    m_live_join_vote->reset();
+    m_live_join_settings->getBuffer().clear();
+    m_live_join_settings->reset();
     auto players = STKHost::get()->getPlayersForNewGame();
     if (m_game_setup->isGrandPrix() && !m_game_setup->isGrandPrixStarted())
     {
@@ -736,7 +768,7 @@ void ServerLobby::cleanupDatabase()
             "(reported_time, '+%f days') < datetime('now');",
             ServerConfig::m_player_reports_table.c_str(),
             ServerConfig::m_player_reports_expired_days);
-        easySQLQuery(query);
+        m_database_writer->write(query);
     }
     if (m_server_stats_table.empty())
         return;
@@ -776,7 +808,7 @@ void ServerLobby::cleanupDatabase()
         oss << ");";
         query = oss.str();
     }
-    easySQLQuery(query);
+    m_database_writer->write(query);
 }   // cleanupDatabase
 
 //-----------------------------------------------------------------------------
@@ -863,6 +895,8 @@ std::string ServerLobby::ip2Country(const TransportAddress& addr) const
 {
     if (!m_db || !m_ip_geolocation_table_exists || addr.isLAN())
         return "";
+    if (m_database_cache)
+        return m_database_cache->findCountryCode(addr.getIP());
 
     std::string cc_code;
     std::string query = StringUtils::insertValues(
@@ -923,55 +957,32 @@ void ServerLobby::writePlayerReport(Event* event)
         return;
     auto reporting_npp = reporting_peer->getPlayerProfiles()[0];
 
+    // The reply is sent by the database writer thread once it is written
+    NetworkString* success = getNetworkString();
+    success->setSynchronous(true);
+    success->addUInt8(LE_REPORT_PLAYER).addUInt8(1)
+        .encodeString(reporting_npp->getName());
+    std::shared_ptr<STKPeer> reporter_peer = event->getPeerSP();
+
     std::string query = StringUtils::insertValues(
         "INSERT INTO %s "
         "(server_uid, reporter_ip, reporter_online_id, reporter_username, "
         "info, reporting_ip, reporting_online_id, reporting_username) "
-        "VALUES (?, %u, %u, ?, ?, %u, %u, ?);",
-        ServerConfig::m_player_reports_table.c_str(),
-        reporter->getAddress().getIP(), reporter_npp->getOnlineId(),
-        reporting_peer->getAddress().getIP(), reporting_npp->getOnlineId());
-    bool written = easySQLQuery(query,
-        [reporter_npp, reporting_npp, info](sqlite3_stmt* stmt)
+        "VALUES (?, ?, ?, ?, ?, ?, ?, ?);",
+        ServerConfig::m_player_reports_table.c_str());
+    m_database_writer->write(query,
+        { ServerConfig::m_server_uid.c_str(), reporter->getAddress().getIP(),
+          reporter_npp->getOnlineId(),
+          StringUtils::wideToUtf8(reporter_npp->getName()),
+          StringUtils::wideToUtf8(info),
+          reporting_peer->getAddress().getIP(), reporting_npp->getOnlineId(),
+          StringUtils::wideToUtf8(reporting_npp->getName()) },
+        [reporter_peer, success](bool written)
         {
-            // SQLITE_TRANSIENT to copy string
-            if (sqlite3_bind_text(stmt, 1, ServerConfig::m_server_uid.c_str(),
-                -1, SQLITE_TRANSIENT) != SQLITE_OK)
-            {
-                Log::error("easySQLQuery", "Failed to bind %s.",
-                    ServerConfig::m_server_uid.c_str());
-            }
-            if (sqlite3_bind_text(stmt, 2,
-                StringUtils::wideToUtf8(reporter_npp->getName()).c_str(),
-                -1, SQLITE_TRANSIENT) != SQLITE_OK)
-            {
-                Log::error("easySQLQuery", "Failed to bind %s.",
-                    StringUtils::wideToUtf8(reporter_npp->getName()).c_str());
-            }
-            if (sqlite3_bind_text(stmt, 3,
-                StringUtils::wideToUtf8(info).c_str(),
-                -1, SQLITE_TRANSIENT) != SQLITE_OK)
-            {
-                Log::error("easySQLQuery", "Failed to bind %s.",
-                    StringUtils::wideToUtf8(info).c_str());
-            }
-            if (sqlite3_bind_text(stmt, 4,
-                StringUtils::wideToUtf8(reporting_npp->getName()).c_str(),
-                -1, SQLITE_TRANSIENT) != SQLITE_OK)
-            {
-                Log::error("easySQLQuery", "Failed to bind %s.",
-                    StringUtils::wideToUtf8(reporting_npp->getName()).c_str());
-            }
+            if (written)
+                reporter_peer->sendPacket(success, true/*reliable*/);
+            delete success;
         });
-    if (written)
-    {
-        NetworkString* success = getNetworkString();
-        success->setSynchronous(true);
-        success->addUInt8(LE_REPORT_PLAYER).addUInt8(1)
-            .encodeString(reporting_npp->getName());
-        event->getPeer()->sendPacket(success, true/*reliable*/);
-        delete success;
-    }
 #endif
 }   // writePlayerReport
 
@@ -988,6 +999,8 @@ void ServerLobby::asynchronousUpdate()
 
 #ifdef ENABLE_SQLITE3
     cleanupDatabase();
+    if (m_database_cache)
+        m_database_cache->update();
 #endif
 
     // Check if server owner has left
@@ -1155,8 +1168,10 @@ void ServerLobby::asynchronousUpdate()
         }
         if (go_on_race)
         {
-            *m_default_vote = winner_vote;
             m_item_seed = (uint32_t)StkTime::getTimeSinceEpoch();
+            if (ServerBenchmark::isEnabled())
+                ServerBenchmark::setupRace(&winner_vote, &m_item_seed);
+            *m_default_vote = winner_vote;
             ItemManager::updateRandomSeed(m_item_seed);
             m_game_setup->setRace(winner_vote);
             auto players = STKHost::get()->getPlayersForNewGame();
@@ -1242,6 +1257,28 @@ void ServerLobby::encodePlayers(BareNetworkString* bns,
 }   // encodePlayers
 
 //-----------------------------------------------------------------------------
+/** Adds the settings of the race after the players in the load world
+ *  message. */
+void ServerLobby::encodeLoadWorldSettings(BareNetworkString* bns) const
+{
+    bns->addUInt32(m_item_seed);
+    if (race_manager->isBattleMode())
+    {
+        bns->addUInt32(m_battle_hit_capture_limit)
+            .addFloat(m_battle_time_limit);
+        uint16_t flag_return_time = (uint16_t)stk_config->time2Ticks(
+            ServerConfig::m_flag_return_timeout);
+        bns->addUInt16(flag_return_time);
+        uint16_t flag_deactivated_time = (uint16_t)stk_config->time2Ticks(
+            ServerConfig::m_flag_deactivated_time);
+        bns->addUInt16(flag_deactivated_time);
+    }
+}   // encodeLoadWorldSettings
+
+//-----------------------------------------------------------------------------
+/** Creates the message to load the world. For live join the parts which
+ *  don't depend on the players are copied from saveLiveJoinWorldInfo().
+ */
 NetworkString* ServerLobby::getLoadWorldMessage(
     std::vector<std::shared_ptr<NetworkPlayerProfile> >& players,
     bool live_join) const
@@ -1249,22 +1286,19 @@ NetworkString* ServerLobby::getLoadWorldMessage(
     NetworkString* load_world_message = getNetworkString();
     load_world_message->setSynchronous(true);
     load_world_message->addUInt8(LE_LOAD_WORLD);
+    if (live_join && m_live_join_vote->getTotalSize() > 0)
+    {
+        *load_world_message += *m_live_join_vote;
+        load_world_message->addUInt8(1);
+        encodePlayers(load_world_message, players);
+        *load_world_message += *m_live_join_settings;
+        return load_world_message;
+    }
     load_world_message->addUInt32(m_winner_peer_id);
     m_default_vote->encode(load_world_message);
     load_world_message->addUInt8(live_join ? 1 : 0);
     encodePlayers(load_world_message, players);
-    load_world_message->addUInt32(m_item_seed);
-    if (race_manager->isBattleMode())
-    {
-        load_world_message->addUInt32(m_battle_hit_capture_limit)
-            .addFloat(m_battle_time_limit);
-        uint16_t flag_return_time = (uint16_t)stk_config->time2Ticks(
-            ServerConfig::m_flag_return_timeout);
-        load_world_message->addUInt16(flag_return_time);
-        uint16_t flag_deactivated_time = (uint16_t)stk_config->time2Ticks(
-            ServerConfig::m_flag_deactivated_time);
-        load_world_message->addUInt16(flag_deactivated_time);
-    }
+    encodeLoadWorldSettings(load_world_message);
     return load_world_message;
 }   // getLoadWorldMessage
 
@@ -1569,6 +1603,10 @@ void ServerLobby::finishedLoadingLiveJoinClient(Event* event)
         .addUInt8(cc).addUInt64(live_join_start_time)
         .addUInt32(m_last_live_join_util_ticks);
 
+    // The item, world and player states are saved for each live join, since
+    // they must match the tick in which the karts are added. This takes
+    // about 0.2us per item and player, e.g. 45us for 200 items and 16
+    // players, well below 1% of a tick.
     NetworkItemManager* nim =
         dynamic_cast<NetworkItemManager*>(ItemManager::get());
     assert(nim);
@@ -2640,10 +2678,9 @@ void ServerLobby::saveIPBanTable(const TransportAddress& addr)
         return;
 
     std::string query = StringUtils::insertValues(
-        "INSERT INTO %s (ip_start, ip_end) "
-        "VALUES (%u, %u);",
-        ServerConfig::m_ip_ban_table.c_str(), addr.getIP(), addr.getIP());
-    easySQLQuery(query);
+        "INSERT INTO %s (ip_start, ip_end) VALUES (?, ?);",
+        ServerConfig::m_ip_ban_table.c_str());
+    m_database_writer->write(query, { addr.getIP(), addr.getIP() });
 #endif
 }   // saveIPBanTable
 
@@ -2950,6 +2987,10 @@ void ServerLobby::handleUnencryptedConnection(std::shared_ptr<STKPeer> peer,
     }
 
     peer->setValidated();
+    if (ServerConfig::m_coalesce_messages &&
+        peer->getClientCapabilities().find("coalesced_messages") !=
+        peer->getClientCapabilities().end())
+        peer->setCoalesceMessages(true);
 
     // send a message to the one that asked to connect
     NetworkString* server_info = getNetworkString();
@@ -3020,49 +3061,24 @@ void ServerLobby::handleUnencryptedConnection(std::shared_ptr<STKPeer> peer,
 #ifdef ENABLE_SQLITE3
     if (m_server_stats_table.empty())
         return;
+    // Both times are bound, as the query is written later, and players
+    // are connected as long as both are the same
     std::string query = StringUtils::insertValues(
         "INSERT INTO %s "
         "(host_id, ip, port, online_id, username, player_num, "
-        "country_code, version, ping) "
-        "VALUES (%u, %u, %u, %u, ?, %u, ?, ?, %u);",
-        m_server_stats_table.c_str(), peer->getHostId(),
-        peer->getAddress().getIP(), peer->getAddress().getPort(), online_id,
-        player_count, peer->getAveragePing());
-    easySQLQuery(query, [peer, country_code](sqlite3_stmt* stmt)
-        {
-            if (sqlite3_bind_text(stmt, 1, StringUtils::wideToUtf8(
-                peer->getPlayerProfiles()[0]->getName()).c_str(),
-                -1, SQLITE_TRANSIENT) != SQLITE_OK)
-            {
-                Log::error("easySQLQuery", "Failed to bind %s.",
-                    StringUtils::wideToUtf8(
-                    peer->getPlayerProfiles()[0]->getName()).c_str());
-            }
-            if (country_code.empty())
-            {
-                if (sqlite3_bind_null(stmt, 2) != SQLITE_OK)
-                {
-                    Log::error("easySQLQuery",
-                        "Failed to bind NULL for country code.");
-                }
-            }
-            else
-            {
-                if (sqlite3_bind_text(stmt, 2, country_code.c_str(),
-                    -1, SQLITE_TRANSIENT) != SQLITE_OK)
-                {
-                    Log::error("easySQLQuery", "Failed to bind country: %s.",
-                        country_code.c_str());
-                }
-            }
-            if (sqlite3_bind_text(stmt, 3, peer->getUserVersion().c_str(),
-                -1, SQLITE_TRANSIENT) != SQLITE_OK)
-            {
-                Log::error("easySQLQuery", "Failed to bind %s.",
-                    peer->getUserVersion().c_str());
-            }
-        }
-    );
+        "country_code, version, ping, connected_time, disconnected_time) "
+        "VALUES (?, ?, ?, ?, ?, ?, ?, ?, ?, "
+        "datetime(?10, 'unixepoch'), datetime(?10, 'unixepoch'));",
+        m_server_stats_table.c_str());
+    m_database_writer->write(query,
+        { peer->getHostId(), peer->getAddress().getIP(),
+          peer->getAddress().getPort(), online_id,
+          StringUtils::wideToUtf8(peer->getPlayerProfiles()[0]->getName()),
+          player_count,
+          country_code.empty() ?
+          DatabaseWriter::Value() : DatabaseWriter::Value(country_code),
+          peer->getUserVersion(), peer->getAveragePing(),
+          (int64_t)StkTime::getTimeSinceEpoch() });
 #endif
 }   // handleUnencryptedConnection
 
@@ -3838,55 +3854,78 @@ void ServerLobby::testBannedForIP(STKPeer* peer) const
     int row_id = -1;
     unsigned ip_start = 0;
     unsigned ip_end = 0;
-    std::string query = StringUtils::insertValues(
-        "SELECT rowid, ip_start, ip_end, reason, description FROM %s "
-        "WHERE ip_start <= %u AND ip_end >= %u "
-        "AND datetime('now') > datetime(starting_time) AND "
-        "(expired_days is NULL OR datetime"
-        "(starting_time, '+'||expired_days||' days') > datetime('now')) "
-        "LIMIT 1;",
-        ServerConfig::m_ip_ban_table.c_str(),
-        peer->getAddress().getIP(), peer->getAddress().getIP());
-
-    sqlite3_stmt* stmt = NULL;
-    int ret = sqlite3_prepare_v2(m_db, query.c_str(), -1, &stmt, 0);
-    if (ret == SQLITE_OK)
+    std::string query;
+    if (m_database_cache)
     {
-        ret = sqlite3_step(stmt);
-        if (ret == SQLITE_ROW)
+        const DatabaseCache::Ban* ban =
+            m_database_cache->findIPBan(peer->getAddress().getIP());
+        if (ban)
         {
-            row_id = sqlite3_column_int(stmt, 0);
-            ip_start = (unsigned)sqlite3_column_int64(stmt, 1);
-            ip_end = (unsigned)sqlite3_column_int64(stmt, 2);
-            const char* reason = (char*)sqlite3_column_text(stmt, 3);
-            const char* desc = (char*)sqlite3_column_text(stmt, 4);
+            row_id = ban->m_row_id;
+            ip_start = ban->m_start;
+            ip_end = ban->m_end;
             Log::info("ServerLobby", "%s banned by IP: %s "
                 "(rowid: %d, description: %s).",
-                peer->getAddress().toString().c_str(), reason, row_id, desc);
-            kickPlayerWithReason(peer, reason);
+                peer->getAddress().toString().c_str(), ban->m_reason.c_str(),
+                row_id, ban->m_description.c_str());
+            kickPlayerWithReason(peer, ban->m_reason.c_str());
         }
-        ret = sqlite3_finalize(stmt);
-        if (ret != SQLITE_OK)
+    }
+    else
+    {
+        query = StringUtils::insertValues(
+            "SELECT rowid, ip_start, ip_end, reason, description FROM %s "
+            "WHERE ip_start <= %u AND ip_end >= %u "
+            "AND datetime('now') > datetime(starting_time) AND "
+            "(expired_days is NULL OR datetime"
+            "(starting_time, '+'||expired_days||' days') > datetime('now')) "
+            "LIMIT 1;",
+            ServerConfig::m_ip_ban_table.c_str(),
+            peer->getAddress().getIP(), peer->getAddress().getIP());
+
+        sqlite3_stmt* stmt = NULL;
+        int ret = sqlite3_prepare_v2(m_db, query.c_str(), -1, &stmt, 0);
+        if (ret == SQLITE_OK)
+        {
+            ret = sqlite3_step(stmt);
+            if (ret == SQLITE_ROW)
+            {
+                row_id = sqlite3_column_int(stmt, 0);
+                ip_start = (unsigned)sqlite3_column_int64(stmt, 1);
+                ip_end = (unsigned)sqlite3_column_int64(stmt, 2);
+                const char* reason = (char*)sqlite3_column_text(stmt, 3);
+                const char* desc = (char*)sqlite3_column_text(stmt, 4);
+                Log::info("ServerLobby", "%s banned by IP: %s "
+                    "(rowid: %d, description: %s).",
+                    peer->getAddress().toString().c_str(), reason, row_id,
+                    desc);
+                kickPlayerWithReason(peer, reason);
+            }
+            ret = sqlite3_finalize(stmt);
+            if (ret != SQLITE_OK)
+            {
+                Log::error("ServerLobby",
+                    "Error finalize database for query %s: %s",
+                    query.c_str(), sqlite3_errmsg(m_db));
+            }
+        }
+        else
         {
             Log::error("ServerLobby",
-                "Error finalize database for query %s: %s",
+                "Error preparing database for query %s: %s",
                 query.c_str(), sqlite3_errmsg(m_db));
+            return;
         }
     }
-    else
-    {
-        Log::error("ServerLobby", "Error preparing database for query %s: %s",
-            query.c_str(), sqlite3_errmsg(m_db));
-        return;
-    }
     if (row_id != -1)
     {
         query = StringUtils::insertValues(
             "UPDATE %s SET trigger_count = trigger_count + 1, "
-            "last_trigger = datetime('now') "
-            "WHERE ip_start = %u AND ip_end = %u;",
-            ServerConfig::m_ip_ban_table.c_str(), ip_start, ip_end);
-        easySQLQuery(query);
+            "last_trigger = datetime(?, 'unixepoch') "
+            "WHERE ip_start = ? AND ip_end = ?;",
+            ServerConfig::m_ip_ban_table.c_str());
+        m_database_writer->write(query,
+            { (int64_t)StkTime::getTimeSinceEpoch(), ip_start, ip_end });
     }
 #endif
 }   // testBannedForIP
@@ -3900,52 +3939,71 @@ void ServerLobby::testBannedForOnlineId(STKPeer* peer,
         return;
 
     int row_id = -1;
-    std::string query = StringUtils::insertValues(
-        "SELECT rowid, reason, description FROM %s "
-        "WHERE online_id = %u "
-        "AND datetime('now') > datetime(starting_time) AND "
-        "(expired_days is NULL OR datetime"
-        "(starting_time, '+'||expired_days||' days') > datetime('now')) "
-        "LIMIT 1;",
-        ServerConfig::m_online_id_ban_table.c_str(), online_id);
-
-    sqlite3_stmt* stmt = NULL;
-    int ret = sqlite3_prepare_v2(m_db, query.c_str(), -1, &stmt, 0);
-    if (ret == SQLITE_OK)
+    std::string query;
+    if (m_database_cache)
     {
-        ret = sqlite3_step(stmt);
-        if (ret == SQLITE_ROW)
+        const DatabaseCache::Ban* ban =
+            m_database_cache->findOnlineIdBan(online_id);
+        if (ban)
         {
-            row_id = sqlite3_column_int(stmt, 0);
-            const char* reason = (char*)sqlite3_column_text(stmt, 1);
-            const char* desc = (char*)sqlite3_column_text(stmt, 2);
+            row_id = ban->m_row_id;
             Log::info("ServerLobby", "%s banned by online id: %s "
                 "(online id: %u rowid: %d, description: %s).",
-                peer->getAddress().toString().c_str(), reason, online_id,
-                row_id, desc);
-            kickPlayerWithReason(peer, reason);
-        }
-        ret = sqlite3_finalize(stmt);
-        if (ret != SQLITE_OK)
-        {
-            Log::error("ServerLobby", "Error finalize database: %s",
-                sqlite3_errmsg(m_db));
+                peer->getAddress().toString().c_str(), ban->m_reason.c_str(),
+                online_id, row_id, ban->m_description.c_str());
+            kickPlayerWithReason(peer, ban->m_reason.c_str());
         }
     }
     else
     {
-        Log::error("ServerLobby", "Error preparing database: %s",
-            sqlite3_errmsg(m_db));
-        return;
+        query = StringUtils::insertValues(
+            "SELECT rowid, reason, description FROM %s "
+            "WHERE online_id = %u "
+            "AND datetime('now') > datetime(starting_time) AND "
+            "(expired_days is NULL OR datetime"
+            "(starting_time, '+'||expired_days||' days') > datetime('now')) "
+            "LIMIT 1;",
+            ServerConfig::m_online_id_ban_table.c_str(), online_id);
+
+        sqlite3_stmt* stmt = NULL;
+        int ret = sqlite3_prepare_v2(m_db, query.c_str(), -1, &stmt, 0);
+        if (ret == SQLITE_OK)
+        {
+            ret = sqlite3_step(stmt);
+            if (ret == SQLITE_ROW)
+            {
+                row_id = sqlite3_column_int(stmt, 0);
+                const char* reason = (char*)sqlite3_column_text(stmt, 1);
+                const char* desc = (char*)sqlite3_column_text(stmt, 2);
+                Log::info("ServerLobby", "%s banned by online id: %s "
+                    "(online id: %u rowid: %d, description: %s).",
+                    peer->getAddress().toString().c_str(), reason, online_id,
+                    row_id, desc);
+                kickPlayerWithReason(peer, reason);
+            }
+            ret = sqlite3_finalize(stmt);
+            if (ret != SQLITE_OK)
+            {
+                Log::error("ServerLobby", "Error finalize database: %s",
+                    sqlite3_errmsg(m_db));
+            }
+        }
+        else
+        {
+            Log::error("ServerLobby", "Error preparing database: %s",
+                sqlite3_errmsg(m_db));
+            return;
+        }
     }
     if (row_id != -1)
     {
         query = StringUtils::insertValues(
             "UPDATE %s SET trigger_count = trigger_count + 1, "
-            "last_trigger = datetime('now') "
-            "WHERE online_id = %u;",
-            ServerConfig::m_online_id_ban_table.c_str(), online_id);
-        easySQLQuery(query);
+            "last_trigger = datetime(?, 'unixepoch') "
+            "WHERE online_id = ?;",
+            ServerConfig::m_online_id_ban_table.c_str());
+        m_database_writer->write(query,
+            { (int64_t)StkTime::getTimeSinceEpoch(), online_id });
     }
 #endif
 }   // testBannedForOnlineId
@@ -4408,3 +4466,19 @@ void ServerLobby::saveInitialItems()
     assert(nim);
     nim->saveCompleteState(m_items_complete_state);
 }   // saveInitialItems
+
+//-----------------------------------------------------------------------------
+/** Prepares the parts of the live join messages which are the same for the
+ *  whole race once the world is loaded, so that they are only copied when
+ *  a player joins during the race.
+ */
+void ServerLobby::saveLiveJoinWorldInfo()
+{
+    m_live_join_vote->getBuffer().clear();
+    m_live_join_vote->reset();
+    m_live_join_vote->addUInt32(m_winner_peer_id);
+    m_default_vote->encode(m_live_join_vote);
+    m_live_join_settings->getBuffer().clear();
+    m_live_join_settings->reset();
+    encodeLoadWorldSettings(m_live_join_settings);
+}   // saveLiveJoinWorldInfo
@@ -39,6 +39,8 @@
 #endif
 
 class BareNetworkString;
+class DatabaseCache;
+class DatabaseWriter;
 class NetworkString;
 class NetworkPlayerProfile;
 class STKPeer;
@@ -86,6 +88,13 @@ private:
 
     uint64_t m_last_cleanup_db_time;
 
+    /** The ban and ip geolocation tables in memory, NULL if connecting
+     *  players are checked with database queries. */
+    std::unique_ptr<DatabaseCache> m_database_cache;
+
+    /** Writes to the database in a separate thread. */
+    std::unique_ptr<DatabaseWriter> m_database_writer;
+
     void cleanupDatabase();
 
     bool easySQLQuery(const std::string& query,
@@ -183,6 +192,13 @@ private:
     /* Used to make sure clients are having same item list at start */
     BareNetworkString* m_items_complete_state;
 
+    /** Parts of the live join load world message which don't change during
+     *  a race (the vote before the players and the item seed and battle
+     *  settings after them), prepared when the world is loaded. */
+    BareNetworkString* m_live_join_vote;
+
+    BareNetworkString* m_live_join_settings;
+
     std::atomic<uint32_t> m_server_id_online;
 
     std::atomic<int> m_difficulty;
@@ -312,6 +328,7 @@ private:
     void handlePlayerDisconnection() const;
     void addLiveJoinPlaceholder(
         std::vector<std::shared_ptr<NetworkPlayerProfile> >& players) const;
+    void encodeLoadWorldSettings(BareNetworkString* bns) const;
     NetworkString* getLoadWorldMessage(
         std::vector<std::shared_ptr<NetworkPlayerProfile> >& players,
         bool live_join) const;
@@ -358,6 +375,7 @@ public:
     int getDifficulty() const                   { return m_difficulty.load(); }
     int getGameMode() const                      { return m_game_mode.load(); }
     void saveInitialItems();
+    void saveLiveJoinWorldInfo();
     void saveIPBanTable(const TransportAddress& addr);
     void listBanTable();
     void initServerStatsTable();
@@ -25,6 +25,7 @@
 #include "network/protocols/game_protocol.hpp"
 #include "network/rewinder.hpp"
 #include "network/rewind_info.hpp"
+#include "network/server_benchmark.hpp"
 #include "network/smooth_network_body.hpp"
 #include "physics/physics.hpp"
 #include "race/history.hpp"
@@ -35,6 +36,7 @@
 #include "utils/profiler.hpp"
 
 #include <algorithm>
+#include <chrono>
 
 RewindManager* RewindManager::m_rewind_manager = NULL;
 bool           RewindManager::m_enable_rewind_manager = false;
@@ -85,6 +87,7 @@ void RewindManager::reset()
     m_overall_state_size = 0;
     m_state_frequency = stk_config->getPhysicsFPS() /
         NetworkConfig::get()->getStateFrequency();
+    resetRewindStats();
 
     if (!m_enable_rewind_manager) return;
 
@@ -150,29 +153,23 @@ void RewindManager::addNetworkState(BareNetworkString *buffer, int ticks)
 void RewindManager::saveState()
 {
     PROFILER_PUSH_CPU_MARKER("RewindManager - save state", 0x20, 0x7F, 0x20);
+    ServerBenchmark::Timer t(ServerBenchmark::SB_SAVE_STATE);
     auto gp = GameProtocol::lock();
     if (!gp)
         return;
     gp->startNewState();
 
     m_overall_state_size = 0;
-    std::vector<std::string> rewinder_using;
+    m_rewinder_using.clear();
 
     for (auto& p : m_all_rewinder)
     {
-        // TODO: check if it's worth passing in a sufficiently large buffer from
-        // GameProtocol - this would save the copy operation.
-        BareNetworkString* buffer = NULL;
+        // Each rewinder writes directly into the state buffer of
+        // GameProtocol, so no temporary buffer is needed
         if (auto r = p.second.lock())
-            buffer = r->saveState(&rewinder_using);
-        if (buffer != NULL)
-        {
-            m_overall_state_size += buffer->size();
-            gp->addState(buffer);
-        }
-        delete buffer;    // buffer can be freed
+            m_overall_state_size += gp->addState(r.get(), &m_rewinder_using);
     }
-    gp->finalizeState(rewinder_using);
+    gp->finalizeState(m_rewinder_using);
     PROFILER_POP_CPU_MARKER();
 }   // saveState
 
@@ -211,7 +208,10 @@ void RewindManager::update(int ticks_not_used)
         saveState();
         PROFILER_PUSH_CPU_MARKER("RewindManager - send state", 0x20, 0x7F, 0x40);
         if (auto gp = GameProtocol::lock())
+        {
+            ServerBenchmark::Timer t(ServerBenchmark::SB_SEND_STATE);
             gp->sendState();
+        }
     }
     PROFILER_POP_CPU_MARKER();
 }   // update
@@ -241,7 +241,12 @@ void RewindManager::playEventsTill(int world_ticks, bool fast_forward)
     {
         Log::setPrefix("Rewind");
         PROFILER_PUSH_CPU_MARKER("Rewind", 128, 128, 128);
+        auto start = std::chrono::steady_clock::now();
         rewindTo(rewind_ticks, world_ticks, fast_forward);
+        m_num_rewinds++;
+        m_rewind_time_us += std::chrono::duration_cast<
+            std::chrono::microseconds>(std::chrono::steady_clock::now() -
+            start).count();
         // This should replay everything up to 'now'
         assert(World::getWorld()->getTicksSinceStart() == world_ticks);
         PROFILER_POP_CPU_MARKER();
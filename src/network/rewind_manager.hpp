@@ -22,6 +22,7 @@
 #include "network/rewind_queue.hpp"
 #include "utils/ptr_vector.hpp"
 #include "utils/synchronised.hpp"
+#include "utils/types.hpp"
 
 #include <assert.h>
 #include <atomic>
@@ -116,6 +117,15 @@ private:
 
     std::vector<RewindInfoEventFunction*> m_pending_rief;
 
+    /** Number of rewinds and time spent rewinding (in microseconds) since
+     *  resetRewindStats() was called, which clients report to the server. */
+    unsigned m_num_rewinds;
+    uint64_t m_rewind_time_us;
+
+    /** Reused in saveState to collect the rewinder saving a state, to avoid
+     *  allocating a new list for each state. */
+    std::vector<std::string> m_rewinder_using;
+
     RewindManager();
    ~RewindManager();
     // ------------------------------------------------------------------------
@@ -210,6 +220,16 @@ public:
     }
     // ------------------------------------------------------------------------
     void resetSmoothNetworkBody();
+    // ------------------------------------------------------------------------
+    unsigned getNumRewinds() const                    { return m_num_rewinds; }
+    // ------------------------------------------------------------------------
+    uint64_t getRewindTimeUs() const               { return m_rewind_time_us; }
+    // ------------------------------------------------------------------------
+    void resetRewindStats()
+    {
+        m_num_rewinds = 0;
+        m_rewind_time_us = 0;
+    }   // resetRewindStats
 };   // RewindManager
 
 
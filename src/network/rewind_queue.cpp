@@ -74,43 +74,93 @@ void RewindQueue::reset()
     m_network_events.getData().clear();
     m_network_events.unlock();
 
-    AllRewindInfo::const_iterator i;
-    for (i = m_all_rewind_info.begin(); i != m_all_rewind_info.end(); ++i)
-        delete *i;
+    for (TickRewindInfo &tick_info : m_all_rewind_info)
+    {
+        for (RewindInfo *ri : tick_info)
+            delete ri;
+        tick_info.clear();
+    }
+    if (m_all_rewind_info.empty())
+        m_all_rewind_info.resize(64);
 
-    m_all_rewind_info.clear();
-    m_current = m_all_rewind_info.end();
+    m_first_ticks     = 0;
+    m_last_ticks      = -1;
+    m_num_rewind_info = 0;
+    m_current_ticks   = END_TICKS;
+    m_current_index   = 0;
     m_latest_confirmed_state_time = -1;
 }   // reset
 
+// ----------------------------------------------------------------------------
+/** Makes sure that m_all_rewind_info can store all time steps from
+ *  first_ticks to last_ticks, growing (and re-arranging) the circular
+ *  buffer if necessary.
+ */
+void RewindQueue::reserveTicks(int first_ticks, int last_ticks)
+{
+    const size_t needed = (size_t)((int64_t)last_ticks - first_ticks + 1);
+    size_t size = m_all_rewind_info.size();
+    if (needed <= size)
+        return;
+    while (size < needed)
+        size *= 2;
+
+    std::vector<TickRewindInfo> all_rewind_info(size);
+    for (int t = m_first_ticks; t <= m_last_ticks; t++)
+        all_rewind_info[(unsigned int)t & (size - 1)].swap(getTickRewindInfo(t));
+    m_all_rewind_info.swap(all_rewind_info);
+}   // reserveTicks
+
 // ----------------------------------------------------------------------------
 /** Inserts a RewindInfo object in the list of all events at the correct time.
  *  If there are several RewindInfo at the exact same time, state RewindInfo
  *  will be insert at the front, and event info at the end of the RewindInfo
  *  with the same time.
  *  \param ri The RewindInfo object to insert.
- *  \param update_current If set, the current pointer will be updated if
- *         necessary to point to the new event
  */
 void RewindQueue::insertRewindInfo(RewindInfo *ri)
 {
-    AllRewindInfo::iterator i = m_all_rewind_info.end();
+    const int ticks = ri->getTicks();
+    if (m_num_rewind_info == 0)
+    {
+        m_first_ticks = ticks;
+        m_last_ticks  = ticks;
+    }
+    else if (ticks < m_first_ticks)
+    {
+        reserveTicks(ticks, m_last_ticks);
+        m_first_ticks = ticks;
+    }
+    else if (ticks > m_last_ticks)
+    {
+        reserveTicks(m_first_ticks, ticks);
+        m_last_ticks = ticks;
+    }
 
-    while (i != m_all_rewind_info.begin())
+    TickRewindInfo &tick_info = getTickRewindInfo(ticks);
+    unsigned int index;
+    if (ri->isEvent())
     {
-        AllRewindInfo::iterator i_prev = i;
-        i_prev--;
-        // Now test if 'ri' needs to be inserted after the
-        // previous element, i.e. before the current element:
-        if ((*i_prev)->getTicks() < ri->getTicks()) break;
-        if ((*i_prev)->getTicks() == ri->getTicks() &&
-            ri->isEvent()                              ) break;
-        i = i_prev;
+        index = (unsigned int)tick_info.size();
+        tick_info.push_back(ri);
     }
-    if(m_current == m_all_rewind_info.end())
-        m_current = m_all_rewind_info.insert(i, ri);
     else
-        m_all_rewind_info.insert(i, ri);  
+    {
+        index = 0;
+        tick_info.insert(tick_info.begin(), ri);
+    }
+    m_num_rewind_info++;
+
+    if (m_current_ticks == END_TICKS)
+    {
+        m_current_ticks = ticks;
+        m_current_index = index;
+    }
+    else if (m_current_ticks == ticks && index <= m_current_index)
+    {
+        // Keep current pointing to the same RewindInfo
+        m_current_index++;
+    }
 }   // insertRewindInfo
 
 // ----------------------------------------------------------------------------
@@ -327,25 +377,107 @@ void RewindQueue::mergeNetworkData(int world_ticks, bool *needs_rewind,
  */
 void RewindQueue::cleanupOldRewindInfo(int ticks)
 {
-    auto i = m_all_rewind_info.begin();
+    if (m_num_rewind_info == 0)
+        return;
 
-    while (!m_all_rewind_info.empty() &&
-        (*i)->getTicks() < ticks)
+    const int end_ticks = std::min(ticks, m_last_ticks + 1);
+    if (end_ticks <= m_first_ticks)
+        return;
+
+    for (int t = m_first_ticks; t < end_ticks; t++)
     {
-        if (m_current == i) next();
-        delete *i;
-        i = m_all_rewind_info.erase(i);
+        TickRewindInfo &tick_info = getTickRewindInfo(t);
+        for (RewindInfo *ri : tick_info)
+            delete ri;
+        m_num_rewind_info -= (unsigned int)tick_info.size();
+        tick_info.clear();
     }
+    m_first_ticks = end_ticks;
 
-    if (m_all_rewind_info.empty())
-        m_current = m_all_rewind_info.end();
-
+    // If current was deleted, it now points to the first remaining info
+    if (m_current_ticks != END_TICKS && m_current_ticks < m_first_ticks)
+    {
+        m_current_ticks = END_TICKS;
+        for (int t = m_first_ticks; t <= m_last_ticks; t++)
+        {
+            if (!getTickRewindInfo(t).empty())
+            {
+                m_current_ticks = t;
+                m_current_index = 0;
+                break;
+            }
+        }
+    }
 }   // cleanupOldRewindInfo
 
+// ----------------------------------------------------------------------------
+/** Sets ticks and index to the RewindInfo following the one they point to.
+ *  \return False if there is no next RewindInfo (ticks and index are then
+ *          not modified).
+ */
+bool RewindQueue::findNext(int *ticks, unsigned int *index) const
+{
+    if (*index + 1 < getTickRewindInfo(*ticks).size())
+    {
+        (*index)++;
+        return true;
+    }
+    for (int t = *ticks + 1; t <= m_last_ticks; t++)
+    {
+        if (!getTickRewindInfo(t).empty())
+        {
+            *ticks = t;
+            *index = 0;
+            return true;
+        }
+    }
+    return false;
+}   // findNext
+
+// ----------------------------------------------------------------------------
+/** Sets ticks and index to the RewindInfo preceding the one they point to.
+ *  \return False if there is no previous RewindInfo (ticks and index are
+ *          then not modified).
+ */
+bool RewindQueue::findPrevious(int *ticks, unsigned int *index) const
+{
+    if (*index > 0)
+    {
+        (*index)--;
+        return true;
+    }
+    for (int t = *ticks - 1; t >= m_first_ticks; t--)
+    {
+        const TickRewindInfo &tick_info = getTickRewindInfo(t);
+        if (!tick_info.empty())
+        {
+            *ticks = t;
+            *index = (unsigned int)tick_info.size() - 1;
+            return true;
+        }
+    }
+    return false;
+}   // findPrevious
+
+// ----------------------------------------------------------------------------
+/** Returns all RewindInfo in the order in which they are handled. Only used
+ *  for unit testing.
+ */
+std::vector<RewindInfo*> RewindQueue::getAllRewindInfo() const
+{
+    std::vector<RewindInfo*> all;
+    for (int t = m_first_ticks; t <= m_last_ticks; t++)
+    {
+        const TickRewindInfo &tick_info = getTickRewindInfo(t);
+        all.insert(all.end(), tick_info.begin(), tick_info.end());
+    }
+    return all;
+}   // getAllRewindInfo
+
 // ----------------------------------------------------------------------------
 bool RewindQueue::isEmpty() const
 {
-    return m_current == m_all_rewind_info.end();
+    return m_current_ticks == END_TICKS;
 }   // isEmpty
 
 // ----------------------------------------------------------------------------
@@ -353,7 +485,7 @@ bool RewindQueue::isEmpty() const
  */
 bool RewindQueue::hasMoreRewindInfo() const
 {
-    return m_current != m_all_rewind_info.end();
+    return m_current_ticks != END_TICKS;
 }   // hasMoreRewindInfo
 
 // ----------------------------------------------------------------------------
@@ -367,27 +499,31 @@ int RewindQueue::undoUntil(int undo_ticks)
 {
     // A rewind is done after a state in the past is inserted. This function
     // makes sure that m_current is not end()
-    //assert(m_current != m_all_rewind_info.end());
-    assert(!m_all_rewind_info.empty());
-    m_current = m_all_rewind_info.end();
-    m_current--;
-    while((*m_current)->getTicks() > undo_ticks ||
-        (*m_current)->isEvent() || !(*m_current)->isConfirmed())
+    assert(m_num_rewind_info > 0);
+    int ticks = m_last_ticks;
+    unsigned int index = (unsigned int)getTickRewindInfo(ticks).size() - 1;
+    while (true)
     {
+        RewindInfo *ri = getTickRewindInfo(ticks)[index];
+        if (ri->getTicks() <= undo_ticks && !ri->isEvent() &&
+            ri->isConfirmed())
+            break;
         // Undo all events and states from the current time
-        (*m_current)->undo();
-        if(m_current == m_all_rewind_info.begin())
+        ri->undo();
+        if (!findPrevious(&ticks, &index))
         {
             // This shouldn't happen, but add some debug info just in case
             Log::error("undoUntil",
                        "At %d rewinding to %d current = %d = begin",
-                       World::getWorld()->getTicksSinceStart(), undo_ticks, 
-                       (*m_current)->getTicks());
+                       World::getWorld()->getTicksSinceStart(), undo_ticks,
+                       ri->getTicks());
+            break;
         }
-        m_current--;
     }
+    m_current_ticks = ticks;
+    m_current_index = index;
 
-    return (*m_current)->getTicks();
+    return ticks;
 }   // undoUntil
 
 // ----------------------------------------------------------------------------
@@ -397,11 +533,12 @@ int RewindQueue::undoUntil(int undo_ticks)
 void RewindQueue::replayAllEvents(int ticks)
 {
     // Replay all events that happened at the current time step
-    while ( hasMoreRewindInfo() && (*m_current)->getTicks() == ticks )
+    while (m_current_ticks == ticks)
     {
-        if ((*m_current)->isEvent())
-            (*m_current)->replay();
-        m_current++;
+        RewindInfo *ri = getCurrent();
+        if (ri->isEvent())
+            ri->replay();
+        next();
     }   // while current->getTIcks == ticks
 
 }   // replayAllEvents
@@ -413,6 +550,8 @@ void RewindQueue::replayAllEvents(int ticks)
  *  - Sorting order of RewindInfos with different timestamps (and a mixture
  *    of types).
  *  - Special cases that triggered incorrect behaviour previously.
+ *  - Growing the circular buffer, cleaning up old RewindInfos, and undoing
+ *    and replaying them.
  */
 void RewindQueue::unitTesting()
 {
@@ -427,57 +566,52 @@ void RewindQueue::unitTesting()
     assert(!q0.hasMoreRewindInfo());
 
     q0.addLocalState(NULL, /*confirmed*/true, 0);
-    assert(q0.m_all_rewind_info.front()->isState());
-    assert(!q0.m_all_rewind_info.front()->isEvent());
+    assert(q0.getAllRewindInfo().front()->isState());
+    assert(!q0.getAllRewindInfo().front()->isEvent());
     assert(q0.hasMoreRewindInfo());
     assert(q0.undoUntil(0) == 0);
 
     q0.addNetworkEvent(dummy_rewinder.get(), NULL, 0);
     // Network events are not immediately merged
-    assert(q0.m_all_rewind_info.size() == 1);
+    assert(q0.getAllRewindInfo().size() == 1);
 
     bool needs_rewind;
     int rewind_ticks;
     int world_ticks = 0;
     q0.mergeNetworkData(world_ticks, &needs_rewind, &rewind_ticks);
     assert(q0.hasMoreRewindInfo());
-    assert(q0.m_all_rewind_info.size() == 2);
-    AllRewindInfo::iterator rii = q0.m_all_rewind_info.begin();
-    assert((*rii)->isState());
-    rii++;
-    assert((*rii)->isEvent());
+    std::vector<RewindInfo*> all = q0.getAllRewindInfo();
+    assert(all.size() == 2);
+    assert(all[0]->isState());
+    assert(all[1]->isEvent());
 
     // Another state must be sorted before the event:
     q0.addNetworkState(NULL, 0);
     assert(q0.hasMoreRewindInfo());
     q0.mergeNetworkData(world_ticks, &needs_rewind, &rewind_ticks);
-    assert(q0.m_all_rewind_info.size() == 3);
-    rii = q0.m_all_rewind_info.begin();
-    assert((*rii)->isState());
-    rii++;
-    assert((*rii)->isState());
-    rii++;
-    assert((*rii)->isEvent());
+    all = q0.getAllRewindInfo();
+    assert(all.size() == 3);
+    assert(all[0]->isState());
+    assert(all[1]->isState());
+    assert(all[2]->isEvent());
 
     // Test time base comparisons: adding an event to the end
     q0.addLocalEvent(dummy_rewinder.get(), NULL, true, 4);
     // Then adding an earlier event
     q0.addLocalEvent(dummy_rewinder.get(), NULL, false, 1);
-    // rii points to the 3rd element, the ones added just now
-    // should be elements4 and 5:
-    rii++;
-    assert((*rii)->getTicks()==1);
-    rii++;
-    assert((*rii)->getTicks()==4);
+    // The ones added just now should be elements 4 and 5:
+    all = q0.getAllRewindInfo();
+    assert(all.size() == 5);
+    assert(all[3]->getTicks()==1);
+    assert(all[4]->getTicks()==4);
 
     // Now test inserting an event first, then the state
     RewindQueue q1;
     q1.addLocalEvent(NULL, NULL, true, 5);
     q1.addLocalState(NULL, true, 5);
-    rii = q1.m_all_rewind_info.begin();
-    assert((*rii)->isState());
-    rii++;
-    assert((*rii)->isEvent());
+    all = q1.getAllRewindInfo();
+    assert(all[0]->isState());
+    assert(all[1]->isEvent());
 
     // Bugs seen before
     // ----------------
@@ -496,11 +630,11 @@ void RewindQueue::unitTesting()
     //    event, that m_current pooints to the first event, otherwise
     //    events with same time stamp will not be handled correctly.
     //    At this stage current points to the event at time 2 from above
-    AllRewindInfo::iterator current_old = b1.m_current;
+    RewindInfo *current_old = b1.getCurrent();
     b1.addLocalEvent(NULL, NULL, true, 2);
     // Make sure that current was not modified, i.e. the new event at time
     // 2 was added at the end of the list:
-    if (current_old != b1.m_current)
+    if (current_old != b1.getCurrent())
         Log::fatal("RewindQueue", "current_old != b1.m_current");
 
     // This should not trigger an exception, now current points to the
@@ -509,7 +643,7 @@ void RewindQueue::unitTesting()
     assert(ri->getTicks() == 2);
     assert(ri->isEvent());
     b1.next();
-    assert(b1.m_current == b1.m_all_rewind_info.end());
+    assert(!b1.hasMoreRewindInfo());
 
     // 3) Test that if cleanupOldRewindInfo is called, it will if necessary
     //    adjust m_current to point to the latest confirmed state.
@@ -518,7 +652,99 @@ void RewindQueue::unitTesting()
     b2.addNetworkState(NULL, 2);
     b2.addNetworkState(NULL, 3);
     b2.mergeNetworkData(4, &needs_rewind, &rewind_ticks);
-    assert((*b2.m_current)->getTicks() == 3);
-
+    assert(b2.getCurrent()->getTicks() == 3);
+
+    // Tests of the circular buffer
+    // ----------------------------
+    // 4) Inserting a state at the time of current must keep current
+    //    pointing to the same RewindInfo.
+    RewindQueue c1;
+    c1.addLocalEvent(NULL, NULL, true, 7);
+    c1.addLocalEvent(NULL, NULL, true, 7);
+    c1.next();
+    current_old = c1.getCurrent();
+    c1.addLocalState(NULL, false, 7);
+    if (c1.getCurrent() != current_old)
+        Log::fatal("RewindQueue", "Current changed when inserting a state.");
+
+    // 5) Time steps spanning more than the initial buffer size, inserted
+    //    out of order and with gaps, must be sorted by time, with states
+    //    before events at the same time.
+    RewindQueue c2;
+    for (int i = 0; i < 1000; i++)
+    {
+        int ticks = (i * 397) % 1000;
+        if (ticks % 3 == 0)
+            continue;
+        if (i % 2 == 0)
+            c2.addLocalEvent(NULL, NULL, true, ticks);
+        else
+            c2.addLocalState(NULL, /*confirmed*/false, ticks);
+        c2.addLocalEvent(NULL, NULL, true, ticks);
+    }
+    all = c2.getAllRewindInfo();
+    if (all.size() != c2.m_num_rewind_info)
+        Log::fatal("RewindQueue", "Wrong number of RewindInfo.");
+    for (unsigned int i = 1; i < all.size(); i++)
+    {
+        if (all[i - 1]->getTicks() > all[i]->getTicks() ||
+            (all[i - 1]->getTicks() == all[i]->getTicks() &&
+             all[i - 1]->isEvent() && all[i]->isState()))
+        {
+            Log::fatal("RewindQueue", "Wrong order at %d and %d.",
+                       all[i - 1]->getTicks(), all[i]->getTicks());
+        }
+    }
+    // Current still points to the first RewindInfo added (at time 397),
+    // and iterating from there with next() must visit the same RewindInfo
+    unsigned int first = 0;
+    while (first < all.size() && all[first] != c2.getCurrent())
+        first++;
+    if (first == all.size() || all[first]->getTicks() != 397)
+        Log::fatal("RewindQueue", "Current was moved by an insertion.");
+    for (unsigned int i = first; i < all.size(); i++)
+    {
+        if (c2.getCurrent() != all[i])
+            Log::fatal("RewindQueue", "next() skipped RewindInfo %d.", i);
+        c2.next();
+    }
+    assert(!c2.hasMoreRewindInfo());
+
+    // 6) Cleaning up removes everything before the given time, and moves
+    //    current to the first remaining RewindInfo. Then undoing must stop
+    //    at the last confirmed state.
+    RewindQueue c3;
+    int num_undone = 0, num_replayed = 0;
+    for (int ticks = 10; ticks < 200; ticks += 10)
+    {
+        // Insert directly, addLocalState would already clean up
+        c3.insertRewindInfo(new RewindInfoState(ticks, NULL,
+                                                /*confirmed*/ticks % 50 == 0));
+        c3.insertRewindInfo(new RewindInfoEventFunction(ticks,
+            [&num_undone]() { num_undone++; },
+            [&num_replayed]() { num_replayed++; }));
+    }
+    c3.cleanupOldRewindInfo(35);
+    assert(c3.getCurrent()->getTicks() == 40);
+    assert(c3.getCurrent()->isState());
+    all = c3.getAllRewindInfo();
+    if (all.size() != 32 || all.front()->getTicks() != 40)
+        Log::fatal("RewindQueue", "Cleanup removed the wrong RewindInfo.");
+    if (c3.undoUntil(120) != 100 || !c3.getCurrent()->isState())
+        Log::fatal("RewindQueue", "undoUntil did not stop at time 100.");
+    // The events from time 100 (which are after the state) to 190 are undone
+    if (num_undone != 10)
+        Log::fatal("RewindQueue", "%d events undone, not 10.", num_undone);
+    // Replaying time 100 must move to the state at time 110
+    c3.replayAllEvents(100);
+    if (num_replayed != 1 || c3.getCurrent()->getTicks() != 110)
+        Log::fatal("RewindQueue", "replayAllEvents did not replay time 100.");
+    // Cleaning up everything leaves an empty queue, which must be
+    // usable again afterwards
+    c3.cleanupOldRewindInfo(1000);
+    assert(!c3.hasMoreRewindInfo());
+    assert(c3.getAllRewindInfo().empty());
+    c3.addLocalEvent(NULL, NULL, true, 5000);
+    assert(c3.getCurrent()->getTicks() == 5000);
 
 }   // unitTesting
@@ -22,7 +22,6 @@
 #include "utils/synchronised.hpp"
 
 #include <assert.h>
-#include <list>
 #include <vector>
 
 class BareNetworkString;
@@ -37,9 +36,24 @@ class RewindQueue
 {
 private:
 
-    typedef std::list<RewindInfo*> AllRewindInfo;
+    /** All RewindInfo of one time step: first the states, then the events.
+     *  The vector is cleared, but not freed, when the time step is removed
+     *  from the queue, so its storage is reused by later time steps. */
+    typedef std::vector<RewindInfo*> TickRewindInfo;
 
-    AllRewindInfo m_all_rewind_info;
+    /** A circular buffer with the RewindInfo of all time steps from
+     *  m_first_ticks to m_last_ticks. The info for time t is stored at
+     *  index t & (size-1), and the size is always a power of 2. */
+    std::vector<TickRewindInfo> m_all_rewind_info;
+
+    /** The first time step stored in m_all_rewind_info. */
+    int m_first_ticks;
+
+    /** The last time step stored in m_all_rewind_info. */
+    int m_last_ticks;
+
+    /** Number of RewindInfo stored in m_all_rewind_info. */
+    unsigned int m_num_rewind_info;
 
     /** The list of all events received from the network. They are stored
      *  in a separate thread (so this data structure is thread-save), and
@@ -49,14 +63,37 @@ private:
     typedef std::vector<RewindInfo*> AllNetworkRewindInfo;
     Synchronised<AllNetworkRewindInfo> m_network_events;
 
-    /** Iterator to the curren time step info to be handled. */
-    AllRewindInfo::iterator m_current;
+    /** Time step and index in that time step of the current RewindInfo to
+     *  be handled. If m_current_ticks is END_TICKS, all RewindInfo have
+     *  been handled. */
+    int m_current_ticks;
+    unsigned int m_current_index;
+
+    /** Value of m_current_ticks if there is no current RewindInfo. */
+    static const int END_TICKS = 0x7fffffff;
 
     /** Time at which the latest confirmed state is at. */
     int m_latest_confirmed_state_time;
 
 
     void cleanupOldRewindInfo(int ticks);
+    void reserveTicks(int first_ticks, int last_ticks);
+    bool findNext(int *ticks, unsigned int *index) const;
+    bool findPrevious(int *ticks, unsigned int *index) const;
+    std::vector<RewindInfo*> getAllRewindInfo() const;
+    // ------------------------------------------------------------------------
+    /** Returns the RewindInfo of the given time step. */
+    TickRewindInfo& getTickRewindInfo(int ticks)
+    {
+        return m_all_rewind_info[(unsigned int)ticks &
+                                 (m_all_rewind_info.size() - 1)];
+    }   // getTickRewindInfo
+    // ------------------------------------------------------------------------
+    const TickRewindInfo& getTickRewindInfo(int ticks) const
+    {
+        return m_all_rewind_info[(unsigned int)ticks &
+                                 (m_all_rewind_info.size() - 1)];
+    }   // getTickRewindInfo
 
 public:
         static void unitTesting();
@@ -95,9 +132,9 @@ public:
      *  RewindInfo element. */
     void next()
     {
-        assert(m_current != m_all_rewind_info.end());
-        m_current++;
-        return;
+        assert(m_current_ticks != END_TICKS);
+        if (!findNext(&m_current_ticks, &m_current_index))
+            m_current_ticks = END_TICKS;
     }   // operator++
 
     // ------------------------------------------------------------------------
@@ -105,7 +142,9 @@ public:
      *  least one more RewindInfo (see hasMoreRewindInfo()). */
     RewindInfo* getCurrent()
     {
-        return (m_current != m_all_rewind_info.end() ) ? *m_current : NULL;
+        if (m_current_ticks == END_TICKS)
+            return NULL;
+        return getTickRewindInfo(m_current_ticks)[m_current_index];
     }   // getNext
 
 };   // RewindQueue
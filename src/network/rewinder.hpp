@@ -70,12 +70,16 @@ public:
      *  caused by the rewind (which is then visually smoothed over time). */
     virtual void computeError() = 0;
 
-    /** Provides a copy of the state of the object in one memory buffer.
-     *  The memory is managed by the RewindManager.
+    /** Appends the state of the object to the given buffer. The buffer is
+     *  owned by GameProtocol and reused for each state, so no memory needs
+     *  to be allocated here.
+     *  \param buffer The buffer to append the state to. If false is
+     *         returned, anything written to it will be discarded.
      *  \param[out] ru The unique identity of rewinder writing to.
-     *  \return The address of the memory buffer with the state.
+     *  \return True if a state was written for this rewinder.
      */
-    virtual BareNetworkString* saveState(std::vector<std::string>* ru) = 0;
+    virtual bool saveState(BareNetworkString* buffer,
+                           std::vector<std::string>* ru) = 0;
 
     /** Called when an event needs to be undone. This is called while going
      *  backwards for rewinding - all stored events will get an 'undo' call.
@@ -0,0 +1,493 @@
+//
+//  SuperTuxKart - a fun racing game with go-kart
+//  Copyright (C) 2020 SuperTuxKart-Team
+//
+//  This program is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU General Public License
+//  as published by the Free Software Foundation; either version 3
+//  of the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+#include "network/server_benchmark.hpp"
+
+#include "main_loop.hpp"
+#include "modes/world.hpp"
+#include "network/link_emulator.hpp"
+#include "network/peer_vote.hpp"
+#include "network/protocols/game_protocol.hpp"
+#include "network/server_config.hpp"
+#include "network/server_metrics.hpp"
+#include "network/stk_host.hpp"
+#include "network/stk_peer.hpp"
+#include "race/race_manager.hpp"
+#include "utils/file_utils.hpp"
+#include "utils/log.hpp"
+#include "utils/separate_process.hpp"
+#include "utils/string_utils.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+
+#ifndef WIN32
+#  include <sys/resource.h>
+#endif
+
+int ServerBenchmark::m_ticks = 0;
+int ServerBenchmark::m_measured_ticks = 0;
+bool ServerBenchmark::m_measuring = false;
+bool ServerBenchmark::m_metrics = false;
+int ServerBenchmark::m_num_clients = 0;
+uint32_t ServerBenchmark::m_seed = 0;
+std::string ServerBenchmark::m_track;
+std::string ServerBenchmark::m_output;
+std::array<ServerBenchmark::SectionData, ServerBenchmark::SB_COUNT>
+    ServerBenchmark::m_sections;
+std::map<uint32_t, uint64_t> ServerBenchmark::m_start_bytes;
+uint64_t ServerBenchmark::m_start_time = 0;
+std::clock_t ServerBenchmark::m_start_cpu = 0;
+std::vector<std::unique_ptr<SeparateProcess> > ServerBenchmark::m_clients;
+std::vector<std::string> ServerBenchmark::m_links;
+std::vector<std::unique_ptr<LinkEmulator> > ServerBenchmark::m_link_emulators;
+std::map<uint16_t, std::string> ServerBenchmark::m_port_links;
+unsigned ServerBenchmark::m_num_link_phases = 1;
+unsigned ServerBenchmark::m_link_phase = 0;
+std::map<uint32_t, std::vector<ServerBenchmark::PhaseData> >
+    ServerBenchmark::m_state_intervals;
+bool ServerBenchmark::m_failed = false;
+uint64_t ServerBenchmark::m_start_sent_bytes = 0;
+uint64_t ServerBenchmark::m_start_received_bytes = 0;
+std::map<uint32_t, ServerBenchmark::RewindData> ServerBenchmark::m_rewind_data;
+std::mutex ServerBenchmark::m_rewind_mutex;
+
+// ----------------------------------------------------------------------------
+/** Enables the benchmark and changes the server configuration, so that the
+ *  race starts as soon as all network AI clients are connected.
+ *  \param ticks Number of ticks of the race to measure.
+ *  \param num_clients Number of network AI clients to start.
+ *  \param seed Random seed used for items and by the clients.
+ *  \param track Track to race on, or empty to use the default vote.
+ *  \param output Name of the JSON file to write the result to.
+ */
+void ServerBenchmark::enable(int ticks, int num_clients, uint32_t seed,
+                             const std::string& track,
+                             const std::string& output)
+{
+    m_ticks = ticks;
+    m_measured_ticks = 0;
+    m_measuring = false;
+    m_num_clients = num_clients;
+    m_seed = seed;
+    m_track = track;
+    m_output = output;
+
+    // Network AI only supports linear races, and clients connect directly
+    ServerConfig::m_server_mode = 3;
+    ServerConfig::m_wan_server = false;
+    ServerConfig::m_validating_player = false;
+    ServerConfig::m_firewalled_server = false;
+    ServerConfig::m_ranked = false;
+    ServerConfig::m_owner_less = true;
+    ServerConfig::m_track_voting = false;
+    ServerConfig::m_voting_timeout = 1.0f;
+    ServerConfig::m_start_game_counter = 1.0f;
+    ServerConfig::m_auto_end = false;
+    if (ServerConfig::m_server_max_players < num_clients)
+        ServerConfig::m_server_max_players = num_clients;
+    ServerConfig::m_min_start_game_players = num_clients;
+}   // enable
+
+// ----------------------------------------------------------------------------
+/** Makes the clients connect through link emulators.
+ *  \param links Settings of the links separated by ';' (see
+ *         LinkEmulator::Settings::parse()), which are used for the clients
+ *         in turn. A link can have several settings separated by '>', which
+ *         are used one after another for equal parts of the measurement.
+ *  \return False if the settings are not valid.
+ */
+bool ServerBenchmark::setLinks(const std::string& links)
+{
+    m_links.clear();
+    m_num_link_phases = 1;
+    for (const std::string& link : StringUtils::split(links, ';'))
+    {
+        std::vector<std::string> phases = StringUtils::split(link, '>');
+        std::string all_settings;
+        for (unsigned i = 0; i < phases.size(); i++)
+        {
+            LinkEmulator::Settings settings;
+            if (!settings.parse(phases[i]))
+                return false;
+            all_settings += (i > 0 ? ">" : "") + settings.toString();
+        }
+        m_links.push_back(all_settings);
+        m_num_link_phases = std::max(m_num_link_phases,
+                                     (unsigned)phases.size());
+    }
+    return true;
+}   // setLinks
+
+// ----------------------------------------------------------------------------
+/** Starts the network AI client processes, which connect to the port of the
+ *  server (or of their link emulator) over loopback. Must be called after
+ *  STKHost is created. They are terminated when this process quits.
+ */
+void ServerBenchmark::startClients()
+{
+    const std::string exe = SeparateProcess::getCurrentExecutableLocation();
+    const uint16_t server_port = STKHost::get()->getPrivatePort();
+    const std::string port = StringUtils::toString(server_port);
+    for (int i = 0; i < m_num_clients; i++)
+    {
+        std::string client_port = port;
+        if (!m_links.empty())
+        {
+            const std::string& link = m_links[i % m_links.size()];
+            LinkEmulator::Settings settings;
+            settings.parse(StringUtils::split(link, '>')[0]);
+            LinkEmulator* emulator = new LinkEmulator(
+                TransportAddress(127, 0, 0, 1, server_port), settings,
+                m_seed + 2 * i);
+            m_link_emulators.emplace_back(emulator);
+            if (emulator->getPort() != 0)
+            {
+                client_port = StringUtils::toString(emulator->getPort());
+                m_port_links[emulator->getPort()] = link;
+            }
+        }
+        std::string args = "--connect-now=127.0.0.1:" + client_port +
+            " --network-ai=1 --auto-connect --no-graphics --no-console-log"
+            " --seed=" + StringUtils::toString(m_seed) +
+            " --stdout=server-benchmark-client" + StringUtils::toString(i) +
+            ".log";
+        m_clients.emplace_back(new SeparateProcess(exe, args));
+    }
+    Log::info("ServerBenchmark", "Started %d network AI clients on port %s.",
+        m_num_clients, port.c_str());
+}   // startClients
+
+// ----------------------------------------------------------------------------
+/** Makes the race reproducible, called by the server lobby once the race
+ *  is decided.
+ *  \param vote The vote to use for the race, will be modified.
+ *  \param item_seed Seed for the item manager, will be modified.
+ */
+void ServerBenchmark::setupRace(PeerVote* vote, uint32_t* item_seed)
+{
+    if (!m_track.empty())
+        vote->m_track_name = m_track;
+    vote->m_reverse = false;
+    // Make sure the race lasts longer than the measurement
+    vote->m_num_laps = 99;
+    *item_seed = m_seed;
+}   // setupRace
+
+// ----------------------------------------------------------------------------
+uint64_t ServerBenchmark::getTimeUs()
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}   // getTimeUs
+
+// ----------------------------------------------------------------------------
+void ServerBenchmark::addTime(Section section, uint64_t us)
+{
+    if (m_metrics)
+        ServerMetrics::addTime(section, us);
+    if (!m_measuring)
+        return;
+    SectionData& sd = m_sections[section];
+    sd.m_calls++;
+    sd.m_total_us += us;
+    if (us > sd.m_max_us)
+        sd.m_max_us = us;
+}   // addTime
+
+// ----------------------------------------------------------------------------
+/** Adds a rewind report of a client, called from the network thread. */
+void ServerBenchmark::addRewindReport(uint32_t host_id, unsigned rewinds,
+                                      unsigned rewind_ms,
+                                      unsigned corrections,
+                                      float total_correction,
+                                      float max_correction)
+{
+    std::lock_guard<std::mutex> lock(m_rewind_mutex);
+    RewindData& rd = m_rewind_data[host_id];
+    rd.m_rewinds += rewinds;
+    rd.m_rewind_ms += rewind_ms;
+    rd.m_corrections += corrections;
+    rd.m_total_correction += total_correction;
+    if (max_correction > rd.m_max_correction)
+        rd.m_max_correction = max_correction;
+}   // addRewindReport
+
+// ----------------------------------------------------------------------------
+void ServerBenchmark::startMeasuring()
+{
+    for (SectionData& sd : m_sections)
+        sd = { 0, 0, 0 };
+    m_start_bytes.clear();
+    for (auto& peer : STKHost::get()->getPeers())
+        m_start_bytes[peer->getHostId()] = peer->getBytesSent();
+    m_start_sent_bytes = STKHost::get()->getTotalSentBytes();
+    m_start_received_bytes = STKHost::get()->getTotalReceivedBytes();
+    {
+        std::lock_guard<std::mutex> lock(m_rewind_mutex);
+        m_rewind_data.clear();
+    }
+    m_link_phase = 0;
+    m_state_intervals.clear();
+    m_start_time = getTimeUs();
+    m_start_cpu = std::clock();
+    m_measuring = true;
+    Log::info("ServerBenchmark", "Race started, measuring %d ticks.",
+        m_ticks);
+}   // startMeasuring
+
+// ----------------------------------------------------------------------------
+/** Called by the main loop after each tick. Starts measuring once the race
+ *  is running and ends the benchmark after the requested number of ticks,
+ *  or if the race ends before.
+ */
+void ServerBenchmark::update()
+{
+    World* w = World::getWorld();
+    if (!m_measuring)
+    {
+        if (w && w->isRacePhase())
+            startMeasuring();
+        return;
+    }
+
+    m_measured_ticks++;
+    updateLinks();
+    if (m_measured_ticks < m_ticks && w && w->isActiveRacePhase())
+        return;
+
+    m_measuring = false;
+    writeResult();
+    m_ticks = 0;
+    m_clients.clear();
+    m_link_emulators.clear();
+    main_loop->requestAbort();
+}   // update
+
+// ----------------------------------------------------------------------------
+/** Records the state interval of each peer and changes the settings of the
+ *  link emulators at the start of each phase, if a link has several
+ *  settings.
+ */
+void ServerBenchmark::updateLinks()
+{
+    if (m_num_link_phases < 2)
+        return;
+    auto gp = GameProtocol::lock();
+    if (gp)
+    {
+        for (auto& peer : STKHost::get()->getPeers())
+        {
+            const unsigned interval =
+                gp->getStateInterval(peer->getHostId());
+            if (interval == 0)
+                continue;
+            std::vector<PhaseData>& phases =
+                m_state_intervals[peer->getHostId()];
+            if (phases.size() <= m_link_phase)
+                phases.resize(m_link_phase + 1, { 0, 0, 0 });
+            PhaseData& pd = phases[m_link_phase];
+            if (pd.m_min_interval == 0 || interval < pd.m_min_interval)
+                pd.m_min_interval = interval;
+            pd.m_max_interval = std::max(pd.m_max_interval, interval);
+            pd.m_end_interval = interval;
+        }
+    }
+
+    const unsigned phase = std::min(
+        (unsigned)m_measured_ticks * m_num_link_phases / (unsigned)m_ticks,
+        m_num_link_phases - 1);
+    if (phase == m_link_phase)
+        return;
+    m_link_phase = phase;
+    for (unsigned i = 0; i < m_link_emulators.size(); i++)
+    {
+        std::vector<std::string> settings =
+            StringUtils::split(m_links[i % m_links.size()], '>');
+        if (phase >= settings.size())
+            continue;
+        LinkEmulator::Settings s;
+        s.parse(settings[phase]);
+        m_link_emulators[i]->setSettings(s);
+    }
+}   // updateLinks
+
+// ----------------------------------------------------------------------------
+/** Checks that the state interval of a peer went up when its link got
+ *  worse, and down again when it got better. The interval is compared at
+ *  the end of each phase, so the phases must be long enough for the
+ *  interval to adapt (it changes at most once per second).
+ *  \param link The settings of the link of the peer.
+ *  \param phases The state intervals of the peer in each phase.
+ *  \return False if the interval didn't follow a change of the link.
+ */
+bool ServerBenchmark::checkStateIntervals(const std::string& link,
+                                          const std::vector<PhaseData>& phases)
+{
+    const unsigned max_interval =
+        (unsigned)std::max(1, (int)ServerConfig::m_max_state_interval);
+    std::vector<std::string> settings = StringUtils::split(link, '>');
+    for (unsigned i = 1; i < phases.size() && i < settings.size(); i++)
+    {
+        const PhaseData& before = phases[i - 1];
+        const PhaseData& after = phases[i];
+        if (before.m_end_interval == 0 || after.m_end_interval == 0)
+            continue;
+        LinkEmulator::Settings old_link, new_link;
+        old_link.parse(settings[i - 1]);
+        new_link.parse(settings[i]);
+        const int order = new_link.compare(old_link);
+        if (order > 0 && before.m_end_interval < max_interval &&
+            after.m_end_interval <= before.m_end_interval)
+            return false;
+        if (order < 0 && before.m_end_interval > 1 &&
+            after.m_end_interval >= before.m_end_interval)
+            return false;
+    }
+    return true;
+}   // checkStateIntervals
+
+// ----------------------------------------------------------------------------
+/** Returns the name of a section used in the output. */
+const char* ServerBenchmark::getSectionName(Section section)
+{
+    static const char* section_names[SB_COUNT] =
+    {
+        "protocol_manager", "update_world", "karts", "physics",
+        "save_state", "send_state"
+    };
+    return section_names[section];
+}   // getSectionName
+
+// ----------------------------------------------------------------------------
+/** Writes all measurements to the output file. */
+void ServerBenchmark::writeResult()
+{
+    const double wall_s = (getTimeUs() - m_start_time) / 1000000.0;
+    const double cpu_s = double(std::clock() - m_start_cpu) / CLOCKS_PER_SEC;
+    // Time the main thread needs for each tick, which limits the tick rate
+    const uint64_t tick_us = m_sections[SB_PROTOCOL_MANAGER].m_total_us +
+                             m_sections[SB_UPDATE_WORLD].m_total_us;
+    World* w = World::getWorld();
+
+    std::ofstream f(FileUtils::getPortableWritingPath(m_output));
+    f << "{\n";
+    f << "  \"track\": \""
+      << StringUtils::jsonEncode(race_manager->getTrackName()) << "\",\n";
+    f << "  \"karts\": " << (w ? w->getNumKarts() : 0) << ",\n";
+    f << "  \"seed\": " << m_seed << ",\n";
+    f << "  \"send_threads\": " << (int)ServerConfig::m_send_threads << ",\n";
+    f << "  \"ticks\": " << m_measured_ticks << ",\n";
+    f << "  \"complete\": " << (m_measured_ticks >= m_ticks ? "true" : "false")
+      << ",\n";
+    f << "  \"ticks_per_second\": "
+      << (tick_us > 0 ? m_measured_ticks * 1000000.0 / tick_us : 0.0)
+      << ",\n";
+    f << "  \"wall_time_s\": " << wall_s << ",\n";
+    f << "  \"process_cpu_time_s\": " << cpu_s << ",\n";
+#ifndef WIN32
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) == 0)
+        f << "  \"max_rss_kb\": " << usage.ru_maxrss << ",\n";
+#endif
+    f << "  \"sent_bytes\": "
+      << STKHost::get()->getTotalSentBytes() - m_start_sent_bytes << ",\n";
+    f << "  \"received_bytes\": "
+      << STKHost::get()->getTotalReceivedBytes() - m_start_received_bytes
+      << ",\n";
+    f << "  \"sections\": {\n";
+    for (unsigned i = 0; i < SB_COUNT; i++)
+    {
+        const SectionData& sd = m_sections[i];
+        f << "    \"" << getSectionName((Section)i) << "\": { \"calls\": "
+          << sd.m_calls
+          << ", \"total_us\": " << sd.m_total_us
+          << ", \"avg_us\": "
+          << (sd.m_calls > 0 ? double(sd.m_total_us) / sd.m_calls : 0.0)
+          << ", \"max_us\": " << sd.m_max_us << " }"
+          << (i + 1 < SB_COUNT ? ",\n" : "\n");
+    }
+    f << "  },\n";
+    f << "  \"peers\": [";
+    bool first = true;
+    std::lock_guard<std::mutex> lock(m_rewind_mutex);
+    for (auto& peer : STKHost::get()->getPeers())
+    {
+        uint64_t bytes = peer->getBytesSent();
+        auto it = m_start_bytes.find(peer->getHostId());
+        if (it != m_start_bytes.end())
+            bytes -= it->second;
+        f << (first ? "\n" : ",\n") << "    { \"host_id\": "
+          << peer->getHostId() << ", \"bytes_sent\": " << bytes
+          << ", \"bytes_per_second\": "
+          << (wall_s > 0.0 ? bytes / wall_s : 0.0);
+        auto link = m_port_links.find(peer->getAddress().getPort());
+        if (link != m_port_links.end())
+        {
+            f << ", \"link\": \"" << StringUtils::jsonEncode(link->second)
+              << "\"";
+            auto intervals = m_state_intervals.find(peer->getHostId());
+            if (intervals != m_state_intervals.end())
+            {
+                f << ", \"state_intervals\": [";
+                for (unsigned i = 0; i < intervals->second.size(); i++)
+                {
+                    const PhaseData& pd = intervals->second[i];
+                    f << (i > 0 ? ", " : "") << "{ \"min\": "
+                      << pd.m_min_interval << ", \"max\": "
+                      << pd.m_max_interval << ", \"end\": "
+                      << pd.m_end_interval << " }";
+                }
+                f << "]";
+                if (ServerConfig::m_max_state_interval > 1 &&
+                    !checkStateIntervals(link->second, intervals->second))
+                {
+                    Log::error("ServerBenchmark", "The state interval of "
+                        "peer %d didn't follow the changes of %s.",
+                        peer->getHostId(), link->second.c_str());
+                    m_failed = true;
+                }
+            }
+        }
+        auto rewind = m_rewind_data.find(peer->getHostId());
+        if (rewind != m_rewind_data.end())
+        {
+            const RewindData& rd = rewind->second;
+            f << ", \"rewinds\": " << rd.m_rewinds
+              << ", \"rewind_ms\": " << rd.m_rewind_ms
+              << ", \"corrections\": " << rd.m_corrections
+              << ", \"avg_correction\": "
+              << (rd.m_corrections > 0 ?
+                  rd.m_total_correction / rd.m_corrections : 0.0)
+              << ", \"max_correction\": " << rd.m_max_correction;
+        }
+        f << " }";
+        first = false;
+    }
+    f << "\n  ]";
+    if (m_num_link_phases > 1 && ServerConfig::m_max_state_interval > 1)
+    {
+        f << ",\n  \"state_intervals_follow_links\": "
+          << (m_failed ? "false" : "true");
+    }
+    f << "\n}\n";
+    f.close();
+    Log::info("ServerBenchmark", "Wrote result of %d ticks to %s.",
+        m_measured_ticks, m_output.c_str());
+}   // writeResult
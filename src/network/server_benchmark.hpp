@@ -0,0 +1,221 @@
+//
+//  SuperTuxKart - a fun racing game with go-kart
+//  Copyright (C) 2020 SuperTuxKart-Team
+//
+//  This program is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU General Public License
+//  as published by the Free Software Foundation; either version 3
+//  of the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+#ifndef HEADER_SERVER_BENCHMARK_HPP
+#define HEADER_SERVER_BENCHMARK_HPP
+
+#include "utils/types.hpp"
+
+#include <array>
+#include <ctime>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+class LinkEmulator;
+class PeerVote;
+class SeparateProcess;
+
+/** \ingroup network
+ *  Measures the cost of a dedicated server (started with
+ *  --server-benchmark). The server is made an owner-less LAN server and
+ *  connects one network AI client process per player over loopback. When
+ *  the race starts, the time spent in the main server subsystems and the
+ *  bytes sent to each peer are recorded for a fixed number of ticks. The
+ *  result is written as a JSON file and the server quits.
+ *  With --server-benchmark-link each client connects through a
+ *  LinkEmulator with the given latency, loss etc., and the rewinds and
+ *  position corrections reported by the clients are written too, so that
+ *  the network code can be tested with reproducible bad connections. A link
+ *  can change its settings during the measurement, in which case the state
+ *  interval of its peer must follow the change (see GameProtocol), or the
+ *  benchmark fails.
+ */
+class ServerBenchmark
+{
+public:
+    /** The subsystems which are timed separately. */
+    enum Section
+    {
+        SB_PROTOCOL_MANAGER = 0,
+        SB_UPDATE_WORLD,
+        SB_KARTS,
+        SB_PHYSICS,
+        SB_SAVE_STATE,
+        SB_SEND_STATE,
+        SB_COUNT
+    };
+
+    // ------------------------------------------------------------------------
+    /** Adds the time from construction to destruction of this object to
+     *  a section, if the benchmark is currently measuring or the server
+     *  metrics are enabled. */
+    class Timer
+    {
+    private:
+        Section m_section;
+        uint64_t m_start;
+    public:
+        Timer(Section section) : m_section(section)
+        {
+            m_start = m_measuring || m_metrics ? getTimeUs() : 0;
+        }
+        // --------------------------------------------------------------------
+        ~Timer()
+        {
+            if (m_start != 0)
+                addTime(m_section, getTimeUs() - m_start);
+        }
+    };   // Timer
+
+private:
+    /** For the unit test of the rewind reports. */
+    friend class GameProtocol;
+
+    struct SectionData
+    {
+        uint64_t m_calls;
+        uint64_t m_total_us;
+        uint64_t m_max_us;
+    };
+
+    /** Sum of the rewind reports of a client. */
+    struct RewindData
+    {
+        uint64_t m_rewinds;
+        uint64_t m_rewind_ms;
+        uint64_t m_corrections;
+        double m_total_correction;
+        float m_max_correction;
+    };
+
+    /** State intervals of a peer while the links used one setting, 0 if
+     *  no state was sent to it. */
+    struct PhaseData
+    {
+        unsigned m_min_interval;
+        unsigned m_max_interval;
+        unsigned m_end_interval;
+    };
+
+    /** Number of ticks to measure, 0 if the benchmark is not enabled. */
+    static int m_ticks;
+
+    /** Number of ticks measured so far. */
+    static int m_measured_ticks;
+
+    /** True between the start of the race and the end of measurement. */
+    static bool m_measuring;
+
+    /** True if the section times are also passed to ServerMetrics. */
+    static bool m_metrics;
+
+    /** Number of network AI client processes to start. */
+    static int m_num_clients;
+
+    /** Seed for the item manager and the clients. */
+    static uint32_t m_seed;
+
+    /** Track to race on, empty for the default one of the server. */
+    static std::string m_track;
+
+    /** Name of the JSON file to write. */
+    static std::string m_output;
+
+    static std::array<SectionData, SB_COUNT> m_sections;
+
+    /** Bytes sent to each peer (by host id) when measurement started. */
+    static std::map<uint32_t, uint64_t> m_start_bytes;
+
+    static uint64_t m_start_time;
+
+    static std::clock_t m_start_cpu;
+
+    static std::vector<std::unique_ptr<SeparateProcess> > m_clients;
+
+    /** Settings of the link emulators, used for the clients in turn. Empty
+     *  if the clients connect directly. */
+    static std::vector<std::string> m_links;
+
+    static std::vector<std::unique_ptr<LinkEmulator> > m_link_emulators;
+
+    /** Settings of the link of each emulator port, which is the port of
+     *  the peer on the server. */
+    static std::map<uint16_t, std::string> m_port_links;
+
+    /** Largest number of settings of a link, the measured ticks are split
+     *  evenly into this number of phases. */
+    static unsigned m_num_link_phases;
+
+    /** Index of the current phase of the links. */
+    static unsigned m_link_phase;
+
+    /** State intervals of each peer by host id in each phase. */
+    static std::map<uint32_t, std::vector<PhaseData> > m_state_intervals;
+
+    /** True if the state intervals didn't follow the changes of the
+     *  links. */
+    static bool m_failed;
+
+    static uint64_t m_start_sent_bytes, m_start_received_bytes;
+
+    /** Rewind reports of each peer by host id, received in the network
+     *  thread. */
+    static std::map<uint32_t, RewindData> m_rewind_data;
+
+    static std::mutex m_rewind_mutex;
+
+    // ------------------------------------------------------------------------
+    static uint64_t getTimeUs();
+    // ------------------------------------------------------------------------
+    static void addTime(Section section, uint64_t us);
+    // ------------------------------------------------------------------------
+    static void startMeasuring();
+    // ------------------------------------------------------------------------
+    static void updateLinks();
+    // ------------------------------------------------------------------------
+    static bool checkStateIntervals(const std::string& link,
+                                    const std::vector<PhaseData>& phases);
+    // ------------------------------------------------------------------------
+    static void writeResult();
+
+public:
+    static void enable(int ticks, int num_clients, uint32_t seed,
+                       const std::string& track, const std::string& output);
+    static bool setLinks(const std::string& links);
+    static void startClients();
+    static void addRewindReport(uint32_t host_id, unsigned rewinds,
+                                unsigned rewind_ms, unsigned corrections,
+                                float total_correction, float max_correction);
+    static void setupRace(PeerVote* vote, uint32_t* item_seed);
+    static void update();
+    static const char* getSectionName(Section section);
+    // ------------------------------------------------------------------------
+    /** Passes the time of all sections to ServerMetrics if enabled. */
+    static void setMetrics(bool enabled)                { m_metrics = enabled; }
+    // ------------------------------------------------------------------------
+    /** Returns true if this server is running a benchmark. */
+    static bool isEnabled()                              { return m_ticks > 0; }
+    // ------------------------------------------------------------------------
+    /** Returns true if the state intervals didn't follow the links. */
+    static bool hasFailed()                                 { return m_failed; }
+};   // ServerBenchmark
+
+#endif
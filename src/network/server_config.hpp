@@ -319,6 +319,66 @@ namespace ServerConfig
         "more rewind, which clients with slow device may have problem playing "
         "this server, use the default value is recommended."));
 
+    SERVER_CFG_PREFIX BoolServerConfigParam m_delta_state
+        SERVER_CFG_DEFAULT(BoolServerConfigParam(false,
+        "delta-state",
+        "Send game states relative to the latest state acknowledged by each "
+        "client, which only includes data that changed. This reduces upload "
+        "bandwidth of the server, clients not supporting it will still "
+        "receive full states."));
+
+    SERVER_CFG_PREFIX FloatServerConfigParam m_relevance_distance
+        SERVER_CFG_DEFAULT(FloatServerConfigParam(0.0f,
+        "relevance-distance",
+        "Distance (in meters) within which karts, projectiles and physical "
+        "objects are sent to a player in full in every state. Further away "
+        "from all karts of the player, physical objects are only sent every "
+        "far-state-interval states, and karts and projectiles are sent with "
+        "reduced precision in between to clients supporting delta states. "
+        "0 to disable, which sends everything in every state."));
+
+    SERVER_CFG_PREFIX IntServerConfigParam m_far_state_interval
+        SERVER_CFG_DEFAULT(IntServerConfigParam(3,
+        "far-state-interval",
+        "Send objects further away than relevance-distance from a player "
+        "in full only in every n-th state."));
+
+    SERVER_CFG_PREFIX IntServerConfigParam m_max_state_interval
+        SERVER_CFG_DEFAULT(IntServerConfigParam(1,
+        "max-state-interval",
+        "If larger than 1, send states less often to clients with a bad "
+        "connection (high ping or packet loss) or which spend too much time "
+        "rewinding, down to only every n-th state. Use it with a higher "
+        "state-frequency, so that clients with a good connection get more "
+        "states while the others are not affected."));
+
+    SERVER_CFG_PREFIX IntServerConfigParam m_send_threads
+        SERVER_CFG_DEFAULT(IntServerConfigParam(1,
+        "send-threads",
+        "Number of threads used to create (and encrypt) the packets when a "
+        "message is sent to several clients, 0 to use one thread per CPU "
+        "core. With 1 the thread sending the message creates all packets."));
+
+    SERVER_CFG_PREFIX BoolServerConfigParam m_coalesce_messages
+        SERVER_CFG_DEFAULT(BoolServerConfigParam(true,
+        "coalesce-messages",
+        "Send small reliable messages (like player lists, chat and votes) to "
+        "a client together in one packet every few milliseconds instead of "
+        "one packet for each message, which reduces the number of packets "
+        "and acknowledgements. Only used for clients supporting it."));
+
+    SERVER_CFG_PREFIX StringServerConfigParam m_metrics_file
+        SERVER_CFG_DEFAULT(StringServerConfigParam("",
+        "metrics-file",
+        "File to which the server writes its metrics (tick timings, network "
+        "traffic, peer pings and queue lengths) in Prometheus text format, "
+        "empty to disable."));
+
+    SERVER_CFG_PREFIX IntServerConfigParam m_metrics_interval
+        SERVER_CFG_DEFAULT(IntServerConfigParam(10,
+        "metrics-interval",
+        "Specified in seconds, how often the metrics file is written."));
+
     SERVER_CFG_PREFIX BoolServerConfigParam m_sql_management
         SERVER_CFG_DEFAULT(BoolServerConfigParam(false,
         "sql-management",
@@ -340,6 +400,23 @@ namespace ServerConfig
         "sqlite3_busy_handler. You may need a higher value if your database "
         "is shared by many servers or having a slow hard disk."));
 
+    SERVER_CFG_PREFIX IntServerConfigParam m_database_refresh_interval
+        SERVER_CFG_DEFAULT(IntServerConfigParam(30,
+        "database-refresh-interval",
+        "Specified in seconds, how often the ip ban, online id ban and ip "
+        "geolocation tables are checked for changes. The tables are kept in "
+        "memory, so connecting players are checked without a database query, "
+        "and changed tables are loaded again in the background. 0 to disable, "
+        "which queries the database for every connecting player instead."));
+
+    SERVER_CFG_PREFIX IntServerConfigParam m_database_write_interval
+        SERVER_CFG_DEFAULT(IntServerConfigParam(1000,
+        "database-write-interval",
+        "Specified in millisecond, for how long server stats, player reports "
+        "and ban triggers are collected before they are written to the "
+        "database in one transaction. They are written in a separate thread, "
+        "so a slow database doesn't affect the game."));
+
     SERVER_CFG_PREFIX StringServerConfigParam m_ip_ban_table
         SERVER_CFG_DEFAULT(StringServerConfigParam("ip_ban",
         "ip-ban-table",
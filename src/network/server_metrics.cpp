@@ -0,0 +1,415 @@
+//
+//  SuperTuxKart - a fun racing game with go-kart
+//  Copyright (C) 2020 SuperTuxKart-Team
+//
+//  This program is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU General Public License
+//  as published by the Free Software Foundation; either version 3
+//  of the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+#include "network/server_metrics.hpp"
+
+#include "io/file_manager.hpp"
+#include "network/protocol_manager.hpp"
+#include "network/server_config.hpp"
+#include "network/stk_host.hpp"
+#include "network/stk_peer.hpp"
+#include "utils/file_utils.hpp"
+#include "utils/log.hpp"
+#include "utils/string_utils.hpp"
+#include "utils/vs.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <cstdio>
+
+const uint64_t ServerMetrics::m_bucket_us[NUM_BUCKETS] =
+{
+    250, 500, 1000, 2000, 4000, 8000, 16000, 32000, 64000, 128000
+};
+std::array<ServerMetrics::Histogram, ServerBenchmark::SB_COUNT + 1>
+    ServerMetrics::m_histograms;
+uint64_t ServerMetrics::m_tick_us = 0;
+bool ServerMetrics::m_enabled = false;
+bool ServerMetrics::m_exit = false;
+std::mutex ServerMetrics::m_mutex;
+std::condition_variable ServerMetrics::m_cv;
+std::thread ServerMetrics::m_thread;
+int ServerMetrics::m_instance = 0;
+
+// ----------------------------------------------------------------------------
+void ServerMetrics::Histogram::reset()
+{
+    for (std::atomic<uint64_t>& bucket : m_buckets)
+        bucket.store(0);
+    m_count.store(0);
+    m_total_us.store(0);
+    m_max_us.store(0);
+}   // reset
+
+// ----------------------------------------------------------------------------
+/** Adds a time to the histogram, only called by one thread. */
+void ServerMetrics::Histogram::add(uint64_t us)
+{
+    const uint64_t* bucket =
+        std::lower_bound(m_bucket_us, m_bucket_us + NUM_BUCKETS, us);
+    if (bucket != m_bucket_us + NUM_BUCKETS)
+    {
+        m_buckets[bucket - m_bucket_us].fetch_add(1,
+            std::memory_order_relaxed);
+    }
+    m_total_us.fetch_add(us, std::memory_order_relaxed);
+    m_count.fetch_add(1, std::memory_order_relaxed);
+    // The writer thread resets the maximum
+    uint64_t max_us = m_max_us.load(std::memory_order_relaxed);
+    while (us > max_us && !m_max_us.compare_exchange_weak(max_us, us,
+        std::memory_order_relaxed))
+    {
+    }
+}   // add
+
+// ----------------------------------------------------------------------------
+/** Writes the histogram in the Prometheus text format.
+ *  \param out The stream to write to.
+ *  \param name Name of the metric, in seconds.
+ *  \param labels Labels of the metric without braces, can be empty.
+ */
+void ServerMetrics::Histogram::write(std::ostringstream* out,
+                                     const std::string& name,
+                                     const std::string& labels)
+{
+    const std::string sep = labels.empty() ? "" : ",";
+    const std::string braces = labels.empty() ? "" : "{" + labels + "}";
+    // Read the count first, so that the buckets never exceed it even if a
+    // time is added meanwhile
+    const uint64_t count = m_count.load(std::memory_order_relaxed);
+    uint64_t cumulative = 0;
+    for (unsigned i = 0; i < NUM_BUCKETS; i++)
+    {
+        cumulative += m_buckets[i].load(std::memory_order_relaxed);
+        *out << name << "_bucket{" << labels << sep << "le=\""
+             << m_bucket_us[i] / 1000000.0 << "\"} "
+             << std::min(cumulative, count) << "\n";
+    }
+    *out << name << "_bucket{" << labels << sep << "le=\"+Inf\"} " << count
+         << "\n";
+    *out << name << "_sum" << braces << " "
+         << m_total_us.load(std::memory_order_relaxed) / 1000000.0 << "\n";
+    *out << name << "_count" << braces << " " << count << "\n";
+}   // write
+
+// ----------------------------------------------------------------------------
+/** Starts the writer thread if a metrics file is set in the server config.
+ *  \param host The server host, which must exist until stop() is called.
+ */
+void ServerMetrics::start(STKHost* host)
+{
+    if (std::string(ServerConfig::m_metrics_file).empty())
+        return;
+    const std::string file =
+        getFileName(ServerConfig::m_metrics_file, m_instance);
+
+    for (Histogram& h : m_histograms)
+        h.reset();
+    m_tick_us = 0;
+    m_exit = false;
+    m_enabled = true;
+    ServerBenchmark::setMetrics(true);
+    const int interval = std::max((int)ServerConfig::m_metrics_interval, 1);
+    m_thread = std::thread([host, file, interval]()
+        {
+            writerLoop(host, file, interval);
+        });
+    Log::info("ServerMetrics", "Writing metrics to %s every %d seconds.",
+        file.c_str(), interval);
+}   // start
+
+// ----------------------------------------------------------------------------
+/** Stops the writer thread, must be called before the host is deleted. */
+void ServerMetrics::stop()
+{
+    if (!m_enabled)
+        return;
+    std::unique_lock<std::mutex> ul(m_mutex);
+    m_exit = true;
+    m_cv.notify_one();
+    ul.unlock();
+    m_thread.join();
+    ServerBenchmark::setMetrics(false);
+    m_enabled = false;
+}   // stop
+
+// ----------------------------------------------------------------------------
+/** Adds the time of a section in the current tick, called by
+ *  ServerBenchmark::Timer from the main thread. */
+void ServerMetrics::addTime(ServerBenchmark::Section section, uint64_t us)
+{
+    m_histograms[section].add(us);
+    // The protocol manager update and the world update make up a tick
+    if (section == ServerBenchmark::SB_PROTOCOL_MANAGER ||
+        section == ServerBenchmark::SB_UPDATE_WORLD)
+        m_tick_us += us;
+}   // addTime
+
+// ----------------------------------------------------------------------------
+/** Called by the main loop after each tick. */
+void ServerMetrics::endTick()
+{
+    m_histograms[ServerBenchmark::SB_COUNT].add(m_tick_us);
+    m_tick_us = 0;
+}   // endTick
+
+// ----------------------------------------------------------------------------
+/** Returns all metrics in the Prometheus text format. */
+std::string ServerMetrics::getMetrics(STKHost* host)
+{
+    std::ostringstream out;
+    out.precision(10);
+
+    out << "# HELP stk_tick_seconds Time the main thread needs for a tick.\n"
+        << "# TYPE stk_tick_seconds histogram\n";
+    Histogram& tick = m_histograms[ServerBenchmark::SB_COUNT];
+    tick.write(&out, "stk_tick_seconds", "");
+    out << "# HELP stk_tick_max_seconds Longest tick since the metrics were "
+        "last written.\n"
+        << "# TYPE stk_tick_max_seconds gauge\n"
+        << "stk_tick_max_seconds "
+        << tick.m_max_us.exchange(0, std::memory_order_relaxed) / 1000000.0
+        << "\n";
+
+    out << "# HELP stk_tick_section_seconds Time spent in each part of a "
+        "tick.\n"
+        << "# TYPE stk_tick_section_seconds histogram\n";
+    for (unsigned i = 0; i < ServerBenchmark::SB_COUNT; i++)
+    {
+        m_histograms[i].write(&out, "stk_tick_section_seconds",
+            std::string("section=\"") +
+            ServerBenchmark::getSectionName((ServerBenchmark::Section)i) +
+            "\"");
+    }
+    out << "# HELP stk_tick_section_max_seconds Longest time spent in each "
+        "part of a tick since the metrics were last written.\n"
+        << "# TYPE stk_tick_section_max_seconds gauge\n";
+    for (unsigned i = 0; i < ServerBenchmark::SB_COUNT; i++)
+    {
+        out << "stk_tick_section_max_seconds{section=\""
+            << ServerBenchmark::getSectionName((ServerBenchmark::Section)i)
+            << "\"} "
+            << m_histograms[i].m_max_us.exchange(0,
+               std::memory_order_relaxed) / 1000000.0 << "\n";
+    }
+
+    out << "# HELP stk_network_sent_bytes_total Bytes sent by enet.\n"
+        << "# TYPE stk_network_sent_bytes_total counter\n"
+        << "stk_network_sent_bytes_total " << host->getTotalSentBytes()
+        << "\n"
+        << "# HELP stk_network_received_bytes_total Bytes received by enet.\n"
+        << "# TYPE stk_network_received_bytes_total counter\n"
+        << "stk_network_received_bytes_total "
+        << host->getTotalReceivedBytes() << "\n";
+
+    out << "# HELP stk_players Number of players on the server.\n"
+        << "# TYPE stk_players gauge\n"
+        << "stk_players{state=\"in_game\"} " << host->getPlayersInGame()
+        << "\n"
+        << "stk_players{state=\"waiting\"} " << host->getWaitingPlayers()
+        << "\n";
+
+    if (auto pm = ProtocolManager::lock())
+    {
+        out << "# HELP stk_pending_events Network events waiting to be "
+            "handled.\n"
+            << "# TYPE stk_pending_events gauge\n"
+            << "stk_pending_events{queue=\"sync\"} "
+            << pm->getNumPendingEvents(/*async*/false) << "\n"
+            << "stk_pending_events{queue=\"async\"} "
+            << pm->getNumPendingEvents(/*async*/true) << "\n"
+            << "stk_pending_events{queue=\"controller\"} "
+            << pm->getNumControllerEvents() << "\n";
+    }
+
+    auto peers = host->getPeers();
+    out << "# HELP stk_peers Number of connected peers.\n"
+        << "# TYPE stk_peers gauge\n"
+        << "stk_peers " << peers.size() << "\n";
+    std::ostringstream rtt, rtt_variance, packet_loss, sent;
+    rtt.precision(10);
+    rtt_variance.precision(10);
+    packet_loss.precision(10);
+    for (auto& peer : peers)
+    {
+        const std::string label =
+            "{host_id=\"" + StringUtils::toString(peer->getHostId()) + "\"} ";
+        rtt << "stk_peer_rtt_seconds" << label
+            << peer->getAveragePing() / 1000.0 << "\n";
+        rtt_variance << "stk_peer_rtt_variance_seconds" << label
+            << peer->getENetPeer()->roundTripTimeVariance / 1000.0 << "\n";
+        packet_loss << "stk_peer_packet_loss_ratio" << label
+            << peer->getPacketLoss() << "\n";
+        sent << "stk_peer_sent_bytes_total" << label << peer->getBytesSent()
+            << "\n";
+    }
+    out << "# HELP stk_peer_rtt_seconds Average round trip time of the last "
+        "5 seconds.\n"
+        << "# TYPE stk_peer_rtt_seconds gauge\n" << rtt.str()
+        << "# HELP stk_peer_rtt_variance_seconds Round trip time variance "
+        "measured by enet.\n"
+        << "# TYPE stk_peer_rtt_variance_seconds gauge\n"
+        << rtt_variance.str()
+        << "# HELP stk_peer_packet_loss_ratio Packet loss measured by enet.\n"
+        << "# TYPE stk_peer_packet_loss_ratio gauge\n" << packet_loss.str()
+        << "# HELP stk_peer_sent_bytes_total Bytes sent to the peer.\n"
+        << "# TYPE stk_peer_sent_bytes_total counter\n" << sent.str();
+    return m_instance > 0 ? addInstanceLabel(out.str(), m_instance)
+                          : out.str();
+}   // getMetrics
+
+// ----------------------------------------------------------------------------
+/** Returns the metrics file of a server with --server-instances: the number
+ *  of the server is appended to the file name (before the extension) for
+ *  all but the first one, e.g. stk.prom, stk-2.prom, stk-3.prom.
+ */
+std::string ServerMetrics::getFileName(const std::string& file, int instance)
+{
+    if (instance <= 1)
+        return file;
+    const std::string suffix = "-" + StringUtils::toString(instance);
+    const size_t dot = file.find_last_of('.');
+    const size_t slash = file.find_last_of("/\\");
+    if (dot == std::string::npos || dot == 0 ||
+        (slash != std::string::npos && dot <= slash + 1))
+        return file + suffix;
+    return file.substr(0, dot) + suffix + file.substr(dot);
+}   // getFileName
+
+// ----------------------------------------------------------------------------
+/** Adds the label server_instance to all samples, so that the metrics of
+ *  the servers of one process are distinct when they are collected
+ *  together.
+ */
+std::string ServerMetrics::addInstanceLabel(const std::string& metrics,
+                                            int instance)
+{
+    const std::string label =
+        "server_instance=\"" + StringUtils::toString(instance) + "\"";
+    std::string result;
+    result.reserve(metrics.size() + metrics.size() / 8);
+    size_t start = 0;
+    while (start < metrics.size())
+    {
+        size_t end = metrics.find('\n', start);
+        if (end == std::string::npos)
+            end = metrics.size();
+        const std::string line = metrics.substr(start, end - start);
+        const size_t name_end = line.find_first_of("{ ");
+        if (line.empty() || line[0] == '#' || name_end == std::string::npos)
+            result += line;
+        else if (line[name_end] == '{')
+        {
+            result += line.substr(0, name_end + 1) + label +
+                (line[name_end + 1] == '}' ? "" : ",") +
+                line.substr(name_end + 1);
+        }
+        else
+        {
+            result += line.substr(0, name_end) + "{" + label + "}" +
+                line.substr(name_end);
+        }
+        if (end < metrics.size())
+            result += "\n";
+        start = end + 1;
+    }
+    return result;
+}   // addInstanceLabel
+
+// ----------------------------------------------------------------------------
+/** Writes the metrics to a temporary file every interval seconds, which then
+ *  replaces the metrics file. */
+void ServerMetrics::writerLoop(STKHost* host, std::string file, int interval)
+{
+    VS::setThreadName("ServerMetrics");
+    const std::string tmp_file = file + ".tmp";
+    std::unique_lock<std::mutex> ul(m_mutex);
+    while (true)
+    {
+        m_cv.wait_for(ul, std::chrono::seconds(interval),
+            [] { return m_exit; });
+        if (m_exit)
+            break;
+        ul.unlock();
+
+        const std::string metrics = getMetrics(host);
+        FILE* fp = FileUtils::fopenU8Path(tmp_file, "wb");
+        bool written = fp != NULL &&
+            fwrite(metrics.data(), 1, metrics.size(), fp) == metrics.size();
+        if (fp != NULL && fclose(fp) != 0)
+            written = false;
+#ifdef WIN32
+        // Windows can't rename to an existing file
+        if (written)
+            file_manager->removeFile(file);
+#endif
+        if (!written || FileUtils::renameU8Path(tmp_file, file) != 0)
+            Log::warn("ServerMetrics", "Failed to write %s.", file.c_str());
+        ul.lock();
+    }
+}   // writerLoop
+
+// ----------------------------------------------------------------------------
+void ServerMetrics::unitTesting()
+{
+    Histogram h;
+    h.reset();
+    h.add(100);
+    h.add(250);
+    h.add(3000);
+    h.add(1000000);
+    std::ostringstream out;
+    h.write(&out, "test_seconds", "a=\"b\"");
+    const std::string text = out.str();
+    assert(text.find("test_seconds_bucket{a=\"b\",le=\"0.00025\"} 2\n") !=
+        std::string::npos);
+    assert(text.find("test_seconds_bucket{a=\"b\",le=\"0.002\"} 2\n") !=
+        std::string::npos);
+    assert(text.find("test_seconds_bucket{a=\"b\",le=\"0.004\"} 3\n") !=
+        std::string::npos);
+    assert(text.find("test_seconds_bucket{a=\"b\",le=\"0.128\"} 3\n") !=
+        std::string::npos);
+    assert(text.find("test_seconds_bucket{a=\"b\",le=\"+Inf\"} 4\n") !=
+        std::string::npos);
+    assert(text.find("test_seconds_sum{a=\"b\"} 1.00335\n") !=
+        std::string::npos);
+    assert(text.find("test_seconds_count{a=\"b\"} 4\n") != std::string::npos);
+    assert(h.m_max_us.load() == 1000000);
+
+    std::ostringstream no_labels;
+    h.write(&no_labels, "test_seconds", "");
+    assert(no_labels.str().find("test_seconds_bucket{le=\"+Inf\"} 4\n") !=
+        std::string::npos);
+    assert(no_labels.str().find("test_seconds_count 4\n") !=
+        std::string::npos);
+
+    // Each server of --server-instances writes its own file and label
+    assert(getFileName("stk.prom", 0) == "stk.prom");
+    assert(getFileName("stk.prom", 1) == "stk.prom");
+    assert(getFileName("stk.prom", 2) == "stk-2.prom");
+    assert(getFileName("/var/lib/node.d/stk.prom", 12) ==
+        "/var/lib/node.d/stk-12.prom");
+    assert(getFileName("metrics", 3) == "metrics-3");
+    assert(getFileName("./metrics", 3) == "./metrics-3");
+    const std::string labeled = addInstanceLabel(
+        "# TYPE test gauge\ntest 1\ntest{a=\"b\"} 2\n", 2);
+    assert(labeled == "# TYPE test gauge\n"
+        "test{server_instance=\"2\"} 1\n"
+        "test{server_instance=\"2\",a=\"b\"} 2\n");
+}   // unitTesting
@@ -0,0 +1,119 @@
+//
+//  SuperTuxKart - a fun racing game with go-kart
+//  Copyright (C) 2020 SuperTuxKart-Team
+//
+//  This program is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU General Public License
+//  as published by the Free Software Foundation; either version 3
+//  of the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+#ifndef HEADER_SERVER_METRICS_HPP
+#define HEADER_SERVER_METRICS_HPP
+
+#include "network/server_benchmark.hpp"
+#include "utils/types.hpp"
+
+#include <array>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+
+class STKHost;
+
+/** \ingroup network
+ *  Collects metrics of a running server (enabled with metrics-file in the
+ *  server config): the time of each tick and of the sections timed with
+ *  ServerBenchmark::Timer, the bytes sent and received, the ping, ping
+ *  variance and packet loss of each peer, and the number of events waiting
+ *  in the ProtocolManager. A separate thread writes them periodically in
+ *  the Prometheus text format. The file is replaced atomically, so it can
+ *  be read at any time (e.g. by the textfile collector of node exporter).
+ *  The tick times are recorded by the main thread only, and read by the
+ *  writer thread without locking.
+ */
+class ServerMetrics
+{
+public:
+    /** Number of histogram buckets with an upper bound, the last bucket
+     *  (+Inf) is the total count. */
+    static const unsigned NUM_BUCKETS = 10;
+
+    /** A histogram of times, written in the Prometheus format. */
+    struct Histogram
+    {
+        std::array<std::atomic<uint64_t>, NUM_BUCKETS> m_buckets;
+        std::atomic<uint64_t> m_count;
+        std::atomic<uint64_t> m_total_us;
+        /** Longest time since the metrics were last written. */
+        std::atomic<uint64_t> m_max_us;
+        // --------------------------------------------------------------------
+        void reset();
+        void add(uint64_t us);
+        void write(std::ostringstream* out, const std::string& name,
+                   const std::string& labels);
+    };   // Histogram
+
+private:
+    /** Upper bounds of the histogram buckets in microseconds. */
+    static const uint64_t m_bucket_us[NUM_BUCKETS];
+
+    /** One histogram per ServerBenchmark section, the last one is for the
+     *  whole tick. */
+    static std::array<Histogram, ServerBenchmark::SB_COUNT + 1> m_histograms;
+
+    /** Time spent in the current tick so far, only used by the main
+     *  thread. */
+    static uint64_t m_tick_us;
+
+    static bool m_enabled;
+
+    static bool m_exit;
+
+    static std::mutex m_mutex;
+
+    static std::condition_variable m_cv;
+
+    static std::thread m_thread;
+
+    /** Number of this server with --server-instances (starting at 1), or 0
+     *  if it is the only server of the process. */
+    static int m_instance;
+
+    // ------------------------------------------------------------------------
+    static void writerLoop(STKHost* host, std::string file, int interval);
+    // ------------------------------------------------------------------------
+    static std::string getMetrics(STKHost* host);
+    // ------------------------------------------------------------------------
+    static std::string getFileName(const std::string& file, int instance);
+    // ------------------------------------------------------------------------
+    static std::string addInstanceLabel(const std::string& metrics,
+                                        int instance);
+
+public:
+    static void start(STKHost* host);
+    static void stop();
+    static void addTime(ServerBenchmark::Section section, uint64_t us);
+    static void endTick();
+    static void unitTesting();
+    // ------------------------------------------------------------------------
+    /** Sets the number of this server with --server-instances, so that each
+     *  server writes its own file, with its number as label. */
+    static void setInstance(int instance)           { m_instance = instance; }
+    // ------------------------------------------------------------------------
+    /** Returns true if the metrics are collected. */
+    static bool isEnabled()                                { return m_enabled; }
+};   // ServerMetrics
+
+#endif
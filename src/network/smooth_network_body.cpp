@@ -21,6 +21,10 @@
 
 #include <algorithm>
 
+unsigned SmoothNetworkBody::m_num_corrections = 0;
+float SmoothNetworkBody::m_total_correction = 0.0f;
+float SmoothNetworkBody::m_max_correction = 0.0f;
+
 // ----------------------------------------------------------------------------
 SmoothNetworkBody::SmoothNetworkBody(bool enable)
 {
@@ -64,6 +68,12 @@ void SmoothNetworkBody::checkSmoothing(const btTransform& current_transform,
 
     float adjust_length = (current_transform.getOrigin() -
         m_prev_position_data.first.getOrigin()).length();
+    if (adjust_length >= m_min_adjust_length)
+    {
+        m_num_corrections++;
+        m_total_correction += adjust_length;
+        m_max_correction = std::max(m_max_correction, adjust_length);
+    }
     if (adjust_length < m_min_adjust_length ||
         adjust_length > m_max_adjust_length)
         return;
@@ -70,6 +70,12 @@ private:
     float m_min_adjust_length, m_max_adjust_length, m_min_adjust_speed,
         m_max_adjust_time, m_adjust_length_threshold;
 
+    /** Number, total and maximum length of the position corrections of all
+     *  bodies since the last reset, reported to the server for testing. */
+    static unsigned m_num_corrections;
+
+    static float m_total_correction, m_max_correction;
+
 public:
     SmoothNetworkBody(bool enable = false);
     // ------------------------------------------------------------------------
@@ -123,6 +129,18 @@ public:
     // ------------------------------------------------------------------------
     void setAdjustLengthThreshold(float val)
                                            { m_adjust_length_threshold = val; }
+    // ------------------------------------------------------------------------
+    static unsigned getNumCorrections()           { return m_num_corrections; }
+    // ------------------------------------------------------------------------
+    static float getTotalCorrection()            { return m_total_correction; }
+    // ------------------------------------------------------------------------
+    static float getMaxCorrection()                { return m_max_correction; }
+    // ------------------------------------------------------------------------
+    static void resetCorrectionStats()
+    {
+        m_num_corrections = 0;
+        m_total_correction = m_max_correction = 0.0f;
+    }
 
 };
 
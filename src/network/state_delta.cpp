@@ -0,0 +1,851 @@
+//
+//  SuperTuxKart - a fun racing game with go-kart
+//  Copyright (C) 2020 SuperTuxKart-Team
+//
+//  This program is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU General Public License
+//  as published by the Free Software Foundation; either version 3
+//  of the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+#include "network/state_delta.hpp"
+
+#include "network/network_string.hpp"
+#include "network/rewind_info.hpp"
+#include "network/rewind_manager.hpp"
+#include "network/rewinder.hpp"
+#include "utils/log.hpp"
+
+#include <cmath>
+#include <stdexcept>
+#include <string.h>
+
+// ----------------------------------------------------------------------------
+/** Returns the index of the entry with the given name, or -1 if not found.
+ *  Rewinder are saved in the order of their unique identity, so searching
+ *  from the index of the previous match usually finds it immediately.
+ *  \param name Unique identity of the rewinder.
+ *  \param hint Index to start searching.
+ */
+int StateDelta::Snapshot::findEntry(const std::string& name,
+                                    unsigned hint) const
+{
+    const unsigned n = (unsigned)m_entries.size();
+    for (unsigned i = 0; i < n; i++)
+    {
+        const unsigned idx = (hint + i) % n;
+        if (m_entries[idx].m_name == name)
+            return (int)idx;
+    }
+    return -1;
+}   // findEntry
+
+// ----------------------------------------------------------------------------
+/** Appends the state of a rewinder to this snapshot. */
+void StateDelta::Snapshot::addEntry(const std::string& name,
+                                    const uint8_t* data, uint16_t size,
+                                    int body, bool reduced)
+{
+    Entry e;
+    e.m_name = name;
+    e.m_offset = (uint32_t)m_data.size();
+    e.m_size = size;
+    e.m_body = body;
+    e.m_reduced = reduced;
+    m_entries.push_back(e);
+    m_data.insert(m_data.end(), data, data + size);
+}   // addEntry
+
+// ============================================================================
+/** Reads a big endian 32 bit value like BareNetworkString::getUInt32. */
+static uint32_t readUInt32(const uint8_t* data)
+{
+    return ((uint32_t)data[0] << 24) | ((uint32_t)data[1] << 16) |
+           ((uint32_t)data[2] <<  8) |  (uint32_t)data[3];
+}   // readUInt32
+
+// ----------------------------------------------------------------------------
+/** Writes a big endian 32 bit value like BareNetworkString::addUInt32. */
+static void writeUInt32(uint32_t value, uint8_t* data)
+{
+    data[0] = (uint8_t)((value >> 24) & 0xff);
+    data[1] = (uint8_t)((value >> 16) & 0xff);
+    data[2] = (uint8_t)((value >>  8) & 0xff);
+    data[3] = (uint8_t)( value        & 0xff);
+}   // writeUInt32
+
+// ----------------------------------------------------------------------------
+/** Writes the state of a rewinder with reduced precision of its body, as
+ *  used for rewinders far away from all karts of a client. The position is
+ *  stored as 16 bit fixed point numbers with a resolution of 1/32, and the
+ *  angular velocity is left out. The rotation and linear velocity are
+ *  already compressed and kept as they are.
+ *  \param data The state of the rewinder.
+ *  \param size Size of the state.
+ *  \param body Offset of the body in the state, see
+ *         CompressNetworkBody::compress.
+ *  \param out The state with the reduced body.
+ *  
+eturn False if the state can't be reduced, e.g. because the body is
+ *          too far away from the origin.
+ */
+bool StateDelta::reduceBody(const uint8_t* data, uint16_t size, int body,
+                            std::vector<uint8_t>* out)
+{
+    if (body < 0 || body > 255 || body + BODY_SIZE > size)
+        return false;
+    const uint8_t* full = data + body;
+    uint8_t reduced[REDUCED_BODY_SIZE];
+    for (unsigned i = 0; i < 3; i++)
+    {
+        float value;
+        const uint32_t bits = readUInt32(full + i * 4);
+        memcpy(&value, &bits, sizeof(value));
+        const float scaled = value * 32.0f;
+        // Also false for NaN
+        if (!(fabsf(scaled) < 32767.0f))
+            return false;
+        const uint16_t fixed = (uint16_t)(int16_t)lrintf(scaled);
+        reduced[i * 2] = (uint8_t)((fixed >> 8) & 0xff);
+        reduced[i * 2 + 1] = (uint8_t)(fixed & 0xff);
+    }
+    // Compressed rotation and linear velocity
+    memcpy(reduced + 6, full + 12, 10);
+
+    out->assign(data, data + body);
+    out->insert(out->end(), reduced, reduced + REDUCED_BODY_SIZE);
+    out->insert(out->end(), full + BODY_SIZE, data + size);
+    return true;
+}   // reduceBody
+
+// ----------------------------------------------------------------------------
+/** Converts a state written by reduceBody back into the format expected by
+ *  the rewinder, with zero angular velocity.
+ *  \param data The state with reduced body.
+ *  \param size Size of the state, at least body + REDUCED_BODY_SIZE.
+ *  \param body Offset of the reduced body in the state.
+ *  \param out The state in the format written by the rewinder.
+ */
+void StateDelta::expandBody(const uint8_t* data, uint16_t size, int body,
+                            std::vector<uint8_t>* out)
+{
+    const uint8_t* reduced = data + body;
+    uint8_t full[BODY_SIZE];
+    for (unsigned i = 0; i < 3; i++)
+    {
+        const int16_t fixed = (int16_t)(((uint16_t)reduced[i * 2] << 8) |
+                                         reduced[i * 2 + 1]);
+        const float value = fixed / 32.0f;
+        uint32_t bits;
+        memcpy(&bits, &value, sizeof(bits));
+        writeUInt32(bits, full + i * 4);
+    }
+    memcpy(full + 12, reduced + 6, 10);
+    // Angular velocity, 0 is the same as a half float
+    memset(full + 22, 0, 6);
+
+    out->assign(data, data + body);
+    out->insert(out->end(), full, full + BODY_SIZE);
+    out->insert(out->end(), reduced + REDUCED_BODY_SIZE, data + size);
+}   // expandBody
+
+// ----------------------------------------------------------------------------
+/** Parses a full state as written by GameProtocol (ticks, list of rewinder
+ *  names, and for each rewinder the size and data) into a snapshot.
+ *  \param in The state, with the read offset at the ticks.
+ *  \param s The snapshot to fill, any previous content is removed.
+ */
+void StateDelta::parseState(BareNetworkString* in, Snapshot* s)
+{
+    s->m_data.clear();
+    s->m_ticks = in->getUInt32();
+    const unsigned count = in->getUInt8();
+    // Reuse the existing entries, so names keep their allocated memory
+    s->m_entries.resize(count);
+    for (unsigned i = 0; i < count; i++)
+        in->decodeString(&s->m_entries[i].m_name);
+    for (unsigned i = 0; i < count; i++)
+    {
+        const uint16_t size = in->getUInt16();
+        if (size > in->size())
+            throw std::out_of_range("parseState out of range.");
+        s->m_entries[i].m_offset = (uint32_t)s->m_data.size();
+        s->m_entries[i].m_size = size;
+        s->m_entries[i].m_body = -1;
+        s->m_entries[i].m_reduced = false;
+        const uint8_t* data = (const uint8_t*)in->getCurrentData();
+        s->m_data.insert(s->m_data.end(), data, data + size);
+        in->skip(size);
+    }
+}   // parseState
+
+// ----------------------------------------------------------------------------
+/** Writes the data of all rewinders with their size in front, which is the
+ *  format expected by RewindInfoState. Reduced bodies are expanded again.
+ */
+void StateDelta::writeState(const Snapshot& s, std::vector<uint8_t>* out)
+{
+    out->clear();
+    out->reserve(s.m_data.size() + s.m_entries.size() * 2);
+    std::vector<uint8_t> expanded;
+    for (const Entry& e : s.m_entries)
+    {
+        const uint8_t* data = s.m_data.data() + e.m_offset;
+        uint16_t size = e.m_size;
+        if (e.m_reduced)
+        {
+            expandBody(data, e.m_size, e.m_body, &expanded);
+            data = expanded.data();
+            size = (uint16_t)expanded.size();
+        }
+        out->push_back((uint8_t)((size >> 8) & 0xff));
+        out->push_back((uint8_t)(size & 0xff));
+        out->insert(out->end(), data, data + size);
+    }
+}   // writeState
+
+// ----------------------------------------------------------------------------
+/** Writes the runs of bytes which differ between base and cur. Each run is
+ *  stored as number of unchanged bytes to skip, length and the new bytes.
+ *  Runs separated by only a few unchanged bytes are merged, since the run
+ *  header would cost more than the bytes saved.
+ *  \return False if the patch is not smaller than the full data, in which
+ *          case the content written to out is undefined.
+ */
+bool StateDelta::writePatch(const uint8_t* base, const uint8_t* cur,
+                            uint16_t size, BareNetworkString* out)
+{
+    const unsigned start = out->getTotalSize();
+    std::vector<uint8_t>& buffer = out->getBuffer();
+    out->addUInt8(0);
+    unsigned runs = 0;
+    unsigned i = 0, last_end = 0;
+    while (i < size)
+    {
+        if (base[i] == cur[i])
+        {
+            i++;
+            continue;
+        }
+        unsigned skip = i - last_end;
+        while (skip > 255)
+        {
+            // Empty run to skip more than 255 bytes
+            out->addUInt8(255).addUInt8(0);
+            skip -= 255;
+            runs++;
+        }
+        unsigned end = i;
+        unsigned same = 0;
+        while (end < size && end - i < 255)
+        {
+            if (base[end] == cur[end])
+            {
+                same++;
+                if (same >= 3)
+                    break;
+            }
+            else
+                same = 0;
+            end++;
+        }
+        // Don't include trailing unchanged bytes
+        while (end > i && base[end - 1] == cur[end - 1])
+            end--;
+        out->addUInt8((uint8_t)skip).addUInt8((uint8_t)(end - i));
+        buffer.insert(buffer.end(), cur + i, cur + end);
+        runs++;
+        last_end = i = end;
+        if (runs > 255 || buffer.size() - start >= (unsigned)size + 2)
+            return false;
+    }
+    buffer[start] = (uint8_t)runs;
+    return true;
+}   // writePatch
+
+// ----------------------------------------------------------------------------
+/** Writes the data of a rewinder relative to its data in the base state:
+ *  nothing if it is unchanged, the changed bytes if this is smaller, or
+ *  the full data with its size.
+ *  \param base The data in the base state, or NULL if there is none.
+ *  
+eturn How the data was written.
+ */
+StateDelta::EntryMode StateDelta::writeEntry(const uint8_t* base,
+                                             uint16_t base_size,
+                                             const uint8_t* cur,
+                                             uint16_t size,
+                                             BareNetworkString* out)
+{
+    std::vector<uint8_t>& buffer = out->getBuffer();
+    if (base && base_size == size)
+    {
+        if (memcmp(base, cur, size) == 0)
+            return EM_SAME;
+        const unsigned patch_start = out->getTotalSize();
+        if (writePatch(base, cur, size, out))
+            return EM_PATCH;
+        buffer.resize(patch_start);
+    }
+    out->addUInt16(size);
+    buffer.insert(buffer.end(), cur, cur + size);
+    return EM_FULL;
+}   // writeEntry
+
+// ----------------------------------------------------------------------------
+/** Returns the number of entries of s to be sent according to send. */
+unsigned StateDelta::countSent(const Snapshot& s,
+                               const std::vector<uint8_t>* send)
+{
+    if (!send)
+        return (unsigned)s.m_entries.size();
+    unsigned count = 0;
+    for (unsigned i = 0; i < s.m_entries.size(); i++)
+    {
+        if ((*send)[i] != SM_SKIP)
+            count++;
+    }
+    return count;
+}   // countSent
+
+// ----------------------------------------------------------------------------
+/** Writes a full state in the format used by GP_STATE, optionally leaving
+ *  out some rewinders. This format has no reduced precision, so entries
+ *  to be sent with reduced precision are sent in full.
+ *  \param s The state to write.
+ *  \param send If not NULL, how each entry is sent. SM_REDUCED is changed
+ *         to SM_FULL.
+ *  \param out The network string to append the state to.
+ */
+void StateDelta::writeFilteredState(const Snapshot& s,
+                                    std::vector<uint8_t>* send,
+                                    BareNetworkString* out)
+{
+    out->addUInt32(s.m_ticks);
+    out->addUInt8((uint8_t)countSent(s, send));
+    for (unsigned i = 0; i < s.m_entries.size(); i++)
+    {
+        if (!send || (*send)[i] != SM_SKIP)
+            out->encodeString(s.m_entries[i].m_name);
+    }
+    std::vector<uint8_t>& buffer = out->getBuffer();
+    for (unsigned i = 0; i < s.m_entries.size(); i++)
+    {
+        if (send && (*send)[i] == SM_SKIP)
+            continue;
+        if (send)
+            (*send)[i] = SM_FULL;
+        const Entry& e = s.m_entries[i];
+        out->addUInt16(e.m_size);
+        const uint8_t* data = s.m_data.data() + e.m_offset;
+        buffer.insert(buffer.end(), data, data + e.m_size);
+    }
+}   // writeFilteredState
+
+// ----------------------------------------------------------------------------
+/** Encodes the state cur relative to base.
+ *  \param base The state acknowledged by the client, or NULL if there is
+ *         none, in which case all rewinders are sent in full.
+ *  \param cur The state to send.
+ *  \param out The network string to append the delta state to.
+ *  \param base_sent If not NULL, how each entry of base was actually sent
+ *         to the client. An entry is only used as base for an entry sent
+ *         with the same precision.
+ *  \param cur_send If not NULL, how each entry of cur is sent. Entries
+ *         which can't be reduced are changed from SM_REDUCED to SM_FULL.
+ */
+void StateDelta::encode(const Snapshot* base, const Snapshot& cur,
+                        BareNetworkString* out,
+                        const std::vector<uint8_t>* base_sent,
+                        std::vector<uint8_t>* cur_send)
+{
+    out->addUInt32(cur.m_ticks);
+    out->addUInt32(base ? (uint32_t)base->m_ticks : 0xffffffff);
+    const unsigned count = countSent(cur, cur_send);
+    out->addUInt8((uint8_t)count);
+    for (unsigned i = 0; i < cur.m_entries.size(); i++)
+    {
+        if (!cur_send || (*cur_send)[i] != SM_SKIP)
+            out->encodeString(cur.m_entries[i].m_name);
+    }
+
+    std::vector<uint8_t>& buffer = out->getBuffer();
+    const unsigned mask_pos = out->getTotalSize();
+    buffer.resize(mask_pos + (count + 3) / 4, 0);
+
+    std::vector<uint8_t> reduced_cur, reduced_base;
+    unsigned hint = 0;
+    unsigned n = 0;
+    for (unsigned i = 0; i < cur.m_entries.size(); i++)
+    {
+        uint8_t send_mode = cur_send ? (*cur_send)[i] : (uint8_t)SM_FULL;
+        if (send_mode == SM_SKIP)
+            continue;
+        const Entry& e = cur.m_entries[i];
+        const uint8_t* cur_data = cur.m_data.data() + e.m_offset;
+        uint16_t cur_size = e.m_size;
+        if (send_mode == SM_REDUCED)
+        {
+            if (reduceBody(cur_data, e.m_size, e.m_body, &reduced_cur))
+            {
+                cur_data = reduced_cur.data();
+                cur_size = (uint16_t)reduced_cur.size();
+            }
+            else
+                send_mode = (*cur_send)[i] = SM_FULL;
+        }
+
+        // The client only has the entry of the base state with the
+        // precision it was sent with
+        const uint8_t* base_data = NULL;
+        uint16_t base_size = 0;
+        int base_idx = base ? base->findEntry(e.m_name, hint) : -1;
+        if (base_idx != -1)
+        {
+            hint = base_idx + 1;
+            const Entry& b = base->m_entries[base_idx];
+            const uint8_t* data = base->m_data.data() + b.m_offset;
+            const uint8_t base_mode =
+                base_sent ? (*base_sent)[base_idx] : (uint8_t)SM_FULL;
+            if (base_mode == SM_FULL && send_mode == SM_FULL)
+            {
+                base_data = data;
+                base_size = b.m_size;
+            }
+            else if (base_mode == SM_REDUCED && send_mode == SM_REDUCED &&
+                     b.m_body == e.m_body &&
+                     reduceBody(data, b.m_size, b.m_body, &reduced_base))
+            {
+                base_data = reduced_base.data();
+                base_size = (uint16_t)reduced_base.size();
+            }
+        }
+
+        EntryMode mode;
+        if (send_mode == SM_REDUCED)
+        {
+            // Offset of the body and the mode of the reduced data
+            out->addUInt8((uint8_t)e.m_body).addUInt8(0);
+            const unsigned reduced_mode_pos = out->getTotalSize() - 1;
+            buffer[reduced_mode_pos] = (uint8_t)writeEntry(base_data,
+                base_size, cur_data, cur_size, out);
+            mode = EM_REDUCED;
+        }
+        else
+        {
+            mode = writeEntry(base_data, base_size, cur_data, cur_size,
+                out);
+        }
+        buffer[mask_pos + n / 4] |= (uint8_t)(mode << ((n % 4) * 2));
+        n++;
+    }
+}   // encode
+
+// ----------------------------------------------------------------------------
+/** Returns the ticks of the base state used by a delta state, or -1 if the
+ *  state does not depend on a previous state. It does not change the read
+ *  position of in, which must be at the start of the delta state.
+ */
+int StateDelta::getBaseTicks(BareNetworkString* in)
+{
+    const int offset = in->getCurrentOffset();
+    in->skip(4);
+    uint32_t base_ticks = in->getUInt32();
+    in->skip(offset - in->getCurrentOffset());
+    return base_ticks == 0xffffffff ? -1 : (int)base_ticks;
+}   // getBaseTicks
+
+// ----------------------------------------------------------------------------
+/** Reads the data of a rewinder written by writeEntry and adds it to out.
+ *  \param mode How the data was written.
+ *  \param name Unique identity of the rewinder.
+ *  \param body Offset of the body if it has reduced precision.
+ *  \param reduced True if the body has reduced precision.
+ *  \param base The base state, or NULL.
+ *  \param hint Index in base to start searching the rewinder.
+ *  \param in The delta state.
+ *  \param out The decoded state.
+ */
+void StateDelta::readEntry(EntryMode mode, const std::string& name,
+                           int body, bool reduced, const Snapshot* base,
+                           unsigned* hint, BareNetworkString* in,
+                           Snapshot* out)
+{
+    if (mode == EM_FULL)
+    {
+        const uint16_t size = in->getUInt16();
+        if (size > in->size())
+            throw std::out_of_range("Delta state out of range.");
+        out->addEntry(name, (const uint8_t*)in->getCurrentData(), size,
+            body, reduced);
+        in->skip(size);
+        return;
+    }
+
+    int base_idx = base ? base->findEntry(name, *hint) : -1;
+    if (base_idx == -1)
+        throw std::runtime_error("Missing rewinder in base state.");
+    *hint = base_idx + 1;
+    const Entry& b = base->m_entries[base_idx];
+    if (b.m_reduced != reduced || (reduced && b.m_body != body))
+        throw std::runtime_error("Different precision in base state.");
+    out->addEntry(name, base->m_data.data() + b.m_offset, b.m_size, body,
+        reduced);
+    if (mode == EM_SAME)
+        return;
+    if (mode != EM_PATCH)
+        throw std::runtime_error("Invalid delta state mode.");
+
+    uint8_t* data = out->m_data.data() + out->m_entries.back().m_offset;
+    const unsigned runs = in->getUInt8();
+    unsigned pos = 0;
+    for (unsigned r = 0; r < runs; r++)
+    {
+        pos += in->getUInt8();
+        const unsigned len = in->getUInt8();
+        if (pos + len > b.m_size || len > in->size())
+            throw std::out_of_range("Delta state patch out of range.");
+        memcpy(data + pos, in->getCurrentData(), len);
+        in->skip(len);
+        pos += len;
+    }
+}   // readEntry
+
+// ----------------------------------------------------------------------------
+/** Decodes a delta state written by encode.
+ *  \param base The base state with ticks getBaseTicks(in), or NULL if the
+ *         delta state does not depend on a base state.
+ *  \param in The delta state, with read offset at its start.
+ *  \param out The decoded full state.
+ *  Throws an exception if the delta state is invalid or needs the base.
+ */
+void StateDelta::decode(const Snapshot* base, BareNetworkString* in,
+                        Snapshot* out)
+{
+    out->clear();
+    out->m_ticks = in->getUInt32();
+    const uint32_t base_ticks = in->getUInt32();
+    if (base_ticks != 0xffffffff &&
+        (!base || (uint32_t)base->m_ticks != base_ticks))
+        throw std::runtime_error("Missing base state for delta state.");
+
+    const unsigned count = in->getUInt8();
+    std::vector<std::string> names(count);
+    for (unsigned i = 0; i < count; i++)
+        in->decodeString(&names[i]);
+
+    std::vector<uint8_t> mask((count + 3) / 4);
+    for (unsigned i = 0; i < mask.size(); i++)
+        mask[i] = in->getUInt8();
+
+    unsigned hint = 0;
+    for (unsigned i = 0; i < count; i++)
+    {
+        const EntryMode mode =
+            (EntryMode)((mask[i / 4] >> ((i % 4) * 2)) & 3);
+        if (mode != EM_REDUCED)
+        {
+            readEntry(mode, names[i], -1, false, base, &hint, in, out);
+            continue;
+        }
+        const int body = in->getUInt8();
+        const EntryMode reduced_mode = (EntryMode)in->getUInt8();
+        readEntry(reduced_mode, names[i], body, true, base, &hint, in, out);
+        if (body + REDUCED_BODY_SIZE > out->m_entries.back().m_size)
+            throw std::out_of_range("Reduced body out of range.");
+    }
+}   // decode
+
+// ============================================================================
+namespace StateDeltaTesting
+{
+    /** Rewinder which records the state data it restores. */
+    class RecordingRewinder : public Rewinder
+    {
+    public:
+        std::vector<uint8_t> m_restored;
+        RecordingRewinder(const std::string& name) : Rewinder(name) {}
+        virtual void saveTransform() {}
+        virtual void computeError() {}
+        virtual bool saveState(BareNetworkString* buffer,
+                               std::vector<std::string>* ru) { return false; }
+        virtual void undoEvent(BareNetworkString *buffer) {}
+        virtual void rewindToEvent(BareNetworkString *buffer) {}
+        virtual void undoState(BareNetworkString *buffer) {}
+        virtual void restoreState(BareNetworkString *buffer, int count)
+        {
+            const uint8_t* data = (const uint8_t*)buffer->getCurrentData();
+            m_restored.assign(data, data + count);
+            buffer->skip(count);
+        }
+    };   // RecordingRewinder
+
+    // ------------------------------------------------------------------------
+    /** Encodes cur against base, decodes it again and checks that the
+     *  decoded state is identical. Returns the encoded size. */
+    unsigned roundTrip(const StateDelta::Snapshot* base,
+                       const StateDelta::Snapshot& cur,
+                       StateDelta::Snapshot* decoded)
+    {
+        BareNetworkString bns;
+        StateDelta::encode(base, cur, &bns);
+        assert(StateDelta::getBaseTicks(&bns) == (base ? base->m_ticks : -1));
+        StateDelta::decode(base, &bns, decoded);
+        assert(bns.size() == 0);
+        assert(decoded->m_ticks == cur.m_ticks);
+        assert(decoded->m_data == cur.m_data);
+        assert(decoded->m_entries.size() == cur.m_entries.size());
+        for (unsigned i = 0; i < cur.m_entries.size(); i++)
+        {
+            assert(decoded->m_entries[i].m_name == cur.m_entries[i].m_name);
+            assert(decoded->m_entries[i].m_size == cur.m_entries[i].m_size);
+        }
+        return bns.getTotalSize();
+    }   // roundTrip
+}   // namespace StateDeltaTesting
+
+// ----------------------------------------------------------------------------
+/** Unit testing: encodes states with unchanged, changed, resized, new and
+ *  removed rewinders, and makes sure that the decoded states restore the
+ *  exact data to the rewinders through RewindInfoState.
+ */
+void StateDelta::unitTesting()
+{
+    using namespace StateDeltaTesting;
+    std::vector<uint8_t> kart(40), item(3), flag(8), big(600);
+    for (unsigned i = 0; i < kart.size(); i++) kart[i] = (uint8_t)i;
+    for (unsigned i = 0; i < item.size(); i++) item[i] = (uint8_t)(i * 7);
+    for (unsigned i = 0; i < flag.size(); i++) flag[i] = (uint8_t)(i + 100);
+    for (unsigned i = 0; i < big.size(); i++) big[i] = (uint8_t)(i * 13);
+
+    Snapshot base;
+    base.m_ticks = 100;
+    base.addEntry("\x01", item.data(), (uint16_t)item.size());
+    base.addEntry("\x02\x01", kart.data(), (uint16_t)kart.size());
+    base.addEntry("\x03", flag.data(), (uint16_t)flag.size());
+    base.addEntry("\x09\x02", big.data(), (uint16_t)big.size());
+
+    // Full state without base
+    Snapshot decoded;
+    unsigned full_size = roundTrip(NULL, base, &decoded);
+
+    // Identical state only costs the header
+    Snapshot same = base;
+    same.m_ticks = 110;
+    unsigned same_size = roundTrip(&base, same, &decoded);
+    if (same_size >= full_size / 4)
+        Log::fatal("StateDelta", "Unchanged state is not compressed.");
+
+    // A few changed bytes, including a change after more than 255 unchanged
+    // bytes, are sent as patch
+    Snapshot cur;
+    cur.m_ticks = 120;
+    std::vector<uint8_t> kart2 = kart, big2 = big;
+    kart2[3] = 200; kart2[4] = 201; kart2[30] = 0;
+    big2[10] = 1; big2[500] = 2; big2[599] = 3;
+    cur.addEntry("\x01", item.data(), (uint16_t)item.size());
+    cur.addEntry("\x02\x01", kart2.data(), (uint16_t)kart2.size());
+    cur.addEntry("\x03", flag.data(), (uint16_t)flag.size());
+    cur.addEntry("\x09\x02", big2.data(), (uint16_t)big2.size());
+    unsigned patch_size = roundTrip(&base, cur, &decoded);
+    if (patch_size >= full_size / 4)
+        Log::fatal("StateDelta", "Changed state is not compressed.");
+
+    // Resized, completely changed, removed and new rewinders
+    Snapshot other;
+    other.m_ticks = 130;
+    std::vector<uint8_t> item2 = item;
+    item2.push_back(9);
+    std::vector<uint8_t> flag2(flag.size());
+    for (unsigned i = 0; i < flag2.size(); i++) flag2[i] = (uint8_t)~flag[i];
+    other.addEntry("\x01", item2.data(), (uint16_t)item2.size());
+    other.addEntry("\x03", flag2.data(), (uint16_t)flag2.size());
+    other.addEntry("\x05\x03", kart.data(), (uint16_t)kart.size());
+    roundTrip(&base, other, &decoded);
+
+    // Decoding with the wrong base must fail
+    BareNetworkString bns;
+    encode(&base, cur, &bns);
+    bool failed = false;
+    try
+    {
+        decode(&other, &bns, &decoded);
+    }
+    catch (std::exception&)
+    {
+        failed = true;
+    }
+    assert(failed);
+
+    // Leave out rewinders not relevant for a client: the client only has
+    // the sent entries, so the next delta must not use the others as base
+    std::vector<uint8_t> send = { SM_FULL, SM_SKIP, SM_FULL, SM_SKIP };
+    bns.getBuffer().clear();
+    bns.reset();
+    encode(NULL, base, &bns, NULL, &send);
+    Snapshot client_base;
+    decode(NULL, &bns, &client_base);
+    assert(client_base.m_entries.size() == 2);
+    assert(client_base.findEntry("\x02\x01", 0) == -1);
+    bns.getBuffer().clear();
+    bns.reset();
+    encode(&base, cur, &bns, &send, NULL);
+    decode(&client_base, &bns, &decoded);
+    assert(decoded.m_data == cur.m_data);
+
+    // Filtered full state has the format of GP_STATE
+    bns.getBuffer().clear();
+    bns.reset();
+    writeFilteredState(cur, &send, &bns);
+    parseState(&bns, &decoded);
+    assert(decoded.m_entries.size() == 2);
+    assert(decoded.m_entries[1].m_name == "\x03");
+
+    // A far kart is sent with reduced precision of its body
+    auto kart_state = [](float x, float y, float z, std::vector<uint8_t>* out)
+    {
+        BareNetworkString bns;
+        bns.addUInt16(1234).addUInt8(5);
+        bns.addFloat(x).addFloat(y).addFloat(z).addUInt32(0x12345678);
+        for (unsigned i = 0; i < 6; i++)
+            bns.addUInt16((uint16_t)(0x3c00 + i));
+        bns.addUInt8(7).addFloat(2.5f);
+        *out = bns.getBuffer();
+    };   // kart_state
+    std::vector<uint8_t> far_kart;
+    Snapshot far_base;
+    far_base.m_ticks = 200;
+    kart_state(100.0f, 2.0f, -300.0f, &far_kart);
+    far_base.addEntry("\x01", item.data(), (uint16_t)item.size());
+    far_base.addEntry("\x02\x01", far_kart.data(), (uint16_t)far_kart.size(),
+        3);
+    std::vector<uint8_t> far_send = { SM_FULL, SM_REDUCED };
+    bns.getBuffer().clear();
+    bns.reset();
+    encode(NULL, far_base, &bns, NULL, &far_send);
+    assert(far_send[1] == SM_REDUCED);
+    const unsigned reduced_size = bns.getTotalSize();
+    Snapshot client_far;
+    decode(NULL, &bns, &client_far);
+    assert(client_far.m_entries[1].m_reduced);
+    assert(client_far.m_entries[1].m_size ==
+           far_kart.size() - BODY_SIZE + REDUCED_BODY_SIZE);
+
+    // The rewinder gets the state in its own format: only the angular
+    // velocity is lost, and the position is rounded
+    std::vector<uint8_t> expanded;
+    writeState(client_far, &expanded);
+    BareNetworkString restored((const char*)expanded.data(),
+                               (int)expanded.size());
+    restored.skip(2 + (int)item.size());
+    const uint16_t restored_size = restored.getUInt16();
+    const uint16_t prefix16 = restored.getUInt16();
+    const uint8_t prefix8 = restored.getUInt8();
+    const Vec3 xyz = restored.getVec3();
+    const uint32_t rotation = restored.getUInt32();
+    uint16_t velocities[6];
+    for (unsigned i = 0; i < 6; i++)
+        velocities[i] = restored.getUInt16();
+    const uint8_t suffix8 = restored.getUInt8();
+    const float suffix_float = restored.getFloat();
+    assert(restored_size == far_kart.size());
+    assert(prefix16 == 1234 && prefix8 == 5);
+    assert(xyz == Vec3(100.0f, 2.0f, -300.0f));
+    assert(rotation == 0x12345678);
+    for (unsigned i = 0; i < 6; i++)
+        assert(velocities[i] == (i < 3 ? 0x3c00 + i : 0));
+    assert(suffix8 == 7 && suffix_float == 2.5f);
+    assert(restored.size() == 0);
+    (void)restored_size; (void)prefix16; (void)prefix8; (void)rotation;
+    (void)suffix8; (void)suffix_float;
+
+    // Sending the body in full costs 10 more bytes
+    bns.getBuffer().clear();
+    bns.reset();
+    std::vector<uint8_t> all_full = { SM_FULL, SM_FULL };
+    encode(NULL, far_base, &bns, NULL, &all_full);
+    assert(bns.getTotalSize() == reduced_size + BODY_SIZE -
+           REDUCED_BODY_SIZE - 2);
+
+    // The next reduced state is a patch of the reduced base, a full state
+    // doesn't use the reduced base
+    Snapshot far_cur;
+    far_cur.m_ticks = 210;
+    std::vector<uint8_t> moved_kart;
+    kart_state(100.5f, 2.0f, -300.0f, &moved_kart);
+    far_cur.addEntry("\x01", item.data(), (uint16_t)item.size());
+    far_cur.addEntry("\x02\x01", moved_kart.data(),
+        (uint16_t)moved_kart.size(), 3);
+    std::vector<uint8_t> far_cur_send = { SM_FULL, SM_REDUCED };
+    bns.getBuffer().clear();
+    bns.reset();
+    encode(&far_base, far_cur, &bns, &far_send, &far_cur_send);
+    assert(bns.getTotalSize() < reduced_size - 10);
+    decode(&client_far, &bns, &decoded);
+    writeState(decoded, &expanded);
+    BareNetworkString moved((const char*)expanded.data(),
+                            (int)expanded.size());
+    moved.skip(2 + (int)item.size() + 2 + 3);
+    const float moved_x = moved.getFloat();
+    assert(moved_x == 100.5f);
+    (void)moved_x;
+    far_cur_send[1] = SM_FULL;
+    bns.getBuffer().clear();
+    bns.reset();
+    encode(&far_base, far_cur, &bns, &far_send, &far_cur_send);
+    decode(&client_far, &bns, &decoded);
+    assert(!decoded.m_entries[1].m_reduced);
+    assert(decoded.m_data == far_cur.m_data);
+
+    // A body which doesn't fit into 16 bit is sent in full
+    kart_state(5000.0f, 0.0f, 0.0f, &far_kart);
+    Snapshot far_away;
+    far_away.m_ticks = 220;
+    far_away.addEntry("\x02\x01", far_kart.data(), (uint16_t)far_kart.size(),
+        3);
+    std::vector<uint8_t> far_away_send = { SM_REDUCED };
+    bns.getBuffer().clear();
+    bns.reset();
+    encode(NULL, far_away, &bns, NULL, &far_away_send);
+    assert(far_away_send[0] == SM_FULL);
+    decode(NULL, &bns, &decoded);
+    assert(!decoded.m_entries[0].m_reduced);
+    assert(decoded.m_data == far_away.m_data);
+
+    // Restore a decoded state through RewindInfoState like
+    // GameProtocol::handleState does
+    bool enabled = RewindManager::isEnabled();
+    RewindManager::setEnable(true);
+    RewindManager::create();
+    std::vector<std::shared_ptr<RecordingRewinder> > rewinders;
+    for (const Entry& e : cur.m_entries)
+    {
+        rewinders.push_back(std::make_shared<RecordingRewinder>(e.m_name));
+        RewindManager::get()->addRewinder(rewinders.back());
+    }
+    roundTrip(&base, cur, &decoded);
+    std::vector<std::string> names;
+    for (const Entry& e : decoded.m_entries)
+        names.push_back(e.m_name);
+    std::vector<uint8_t> state;
+    writeState(decoded, &state);
+    RewindInfoState ris(decoded.m_ticks, 0, names, state);
+    ris.restore();
+    for (unsigned i = 0; i < cur.m_entries.size(); i++)
+    {
+        const Entry& e = cur.m_entries[i];
+        std::vector<uint8_t> expected(cur.m_data.begin() + e.m_offset,
+            cur.m_data.begin() + e.m_offset + e.m_size);
+        assert(rewinders[i]->m_restored == expected);
+    }
+    RewindManager::destroy();
+    RewindManager::setEnable(enabled);
+}   // unitTesting
@@ -0,0 +1,142 @@
+//
+//  SuperTuxKart - a fun racing game with go-kart
+//  Copyright (C) 2020 SuperTuxKart-Team
+//
+//  This program is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU General Public License
+//  as published by the Free Software Foundation; either version 3
+//  of the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+#ifndef HEADER_STATE_DELTA_HPP
+#define HEADER_STATE_DELTA_HPP
+
+#include "utils/types.hpp"
+
+#include <string>
+#include <vector>
+
+class BareNetworkString;
+
+/** \ingroup network
+ *  Encodes and decodes game states sent by the server relative to a state
+ *  which was previously acknowledged by a client. A state is split into
+ *  the data of each rewinder, and for each rewinder only one of these is
+ *  sent:
+ *  - Nothing if the data is identical to the one in the base state.
+ *  - A list of changed byte runs if the data has the same size as in the
+ *    base state and this is smaller than the full data.
+ *  - The full data otherwise.
+ *  The modes are stored in a bitmask with 2 bits for each rewinder. The
+ *  encoding is lossless, so a decoded state is byte identical to the full
+ *  state the server saved, which keeps client and server rounding in sync.
+ *  The only exception are rewinders far away from all karts of a client,
+ *  whose body (see CompressNetworkBody) can be sent with reduced precision
+ *  (see reduceBody). The client keeps such entries in the reduced form, so
+ *  that the server can use them as base for the next reduced entries.
+ */
+class StateDelta
+{
+public:
+    /** How the state of a rewinder is sent to a client. */
+    enum SendMode : uint8_t
+    {
+        SM_SKIP = 0,
+        SM_FULL = 1,
+        SM_REDUCED = 2
+    };
+
+    /** Location of the state of one rewinder inside Snapshot::m_data. */
+    struct Entry
+    {
+        std::string m_name;
+        uint32_t m_offset;
+        uint16_t m_size;
+        /** Offset of the compressed body in the data, or -1 if there is
+         *  none. Only known on the server, and for reduced entries. */
+        int m_body;
+        /** True if the body is stored with reduced precision. */
+        bool m_reduced;
+    };   // Entry
+
+    // ------------------------------------------------------------------------
+    /** A complete state split into the data of each rewinder. */
+    struct Snapshot
+    {
+        int m_ticks;
+        std::vector<uint8_t> m_data;
+        std::vector<Entry> m_entries;
+        // --------------------------------------------------------------------
+        Snapshot() { clear(); }
+        // --------------------------------------------------------------------
+        void clear()
+        {
+            m_ticks = -1;
+            m_data.clear();
+            m_entries.clear();
+        }   // clear
+        // --------------------------------------------------------------------
+        int findEntry(const std::string& name, unsigned hint) const;
+        // --------------------------------------------------------------------
+        void addEntry(const std::string& name, const uint8_t* data,
+                      uint16_t size, int body = -1, bool reduced = false);
+    };   // Snapshot
+
+private:
+    /** How each rewinder is stored in a delta state. */
+    enum EntryMode : uint8_t
+    {
+        EM_SAME = 0,
+        EM_FULL = 1,
+        EM_PATCH = 2,
+        EM_REDUCED = 3
+    };
+
+    /** Size of a body written by CompressNetworkBody::compress. */
+    static const unsigned BODY_SIZE = 28;
+
+    /** Size of a body with reduced precision, see reduceBody. */
+    static const unsigned REDUCED_BODY_SIZE = 16;
+
+    static bool writePatch(const uint8_t* base, const uint8_t* cur,
+                           uint16_t size, BareNetworkString* out);
+    static EntryMode writeEntry(const uint8_t* base, uint16_t base_size,
+                                const uint8_t* cur, uint16_t size,
+                                BareNetworkString* out);
+    static void readEntry(EntryMode mode, const std::string& name,
+                          int body, bool reduced, const Snapshot* base,
+                          unsigned* hint, BareNetworkString* in,
+                          Snapshot* out);
+    static unsigned countSent(const Snapshot& s,
+                              const std::vector<uint8_t>* send);
+
+public:
+    static void unitTesting();
+
+    static bool reduceBody(const uint8_t* data, uint16_t size, int body,
+                           std::vector<uint8_t>* out);
+    static void expandBody(const uint8_t* data, uint16_t size, int body,
+                           std::vector<uint8_t>* out);
+    static void parseState(BareNetworkString* in, Snapshot* s);
+    static void writeState(const Snapshot& s, std::vector<uint8_t>* out);
+    static void writeFilteredState(const Snapshot& s,
+                                   std::vector<uint8_t>* send,
+                                   BareNetworkString* out);
+    static void encode(const Snapshot* base, const Snapshot& cur,
+                       BareNetworkString* out,
+                       const std::vector<uint8_t>* base_sent = NULL,
+                       std::vector<uint8_t>* cur_send = NULL);
+    static int  getBaseTicks(BareNetworkString* in);
+    static void decode(const Snapshot* base, BareNetworkString* in,
+                       Snapshot* out);
+};   // StateDelta
+
+#endif
@@ -21,6 +21,7 @@
 #include "config/stk_config.hpp"
 #include "config/user_config.hpp"
 #include "io/file_manager.hpp"
+#include "network/crypto.hpp"
 #include "network/event.hpp"
 #include "network/game_setup.hpp"
 #include "network/network_config.hpp"
@@ -32,12 +33,14 @@
 #include "network/protocols/server_lobby.hpp"
 #include "network/protocol_manager.hpp"
 #include "network/server_config.hpp"
+#include "network/server_metrics.hpp"
 #include "network/stk_peer.hpp"
 #include "tracks/track.hpp"
 #include "tracks/track_manager.hpp"
 #include "utils/log.hpp"
 #include "utils/separate_process.hpp"
 #include "utils/string_utils.hpp"
+#include "utils/thread_pool.hpp"
 #include "utils/time.hpp"
 #include "utils/vs.hpp"
 
@@ -286,7 +289,15 @@ STKHost::STKHost(bool server)
     }
     setPrivatePort();
     if (server)
+    {
         Log::info("STKHost", "Server port is %d", m_private_port);
+        unsigned num_threads = ServerConfig::m_send_threads > 0
+                             ? (unsigned)ServerConfig::m_send_threads
+                             : ThreadPool::getDefaultNumThreads();
+        if (num_threads > 1)
+            m_send_pool.reset(new ThreadPool(num_threads));
+        ServerMetrics::start(this);
+    }
 }   // STKHost
 
 // ----------------------------------------------------------------------------
@@ -304,6 +315,10 @@ void STKHost::init()
     m_network          = NULL;
     m_exit_timeout.store(std::numeric_limits<uint64_t>::max());
     m_client_ping.store(0);
+    m_upload_speed.store(0);
+    m_download_speed.store(0);
+    m_total_sent_bytes.store(0);
+    m_total_received_bytes.store(0);
 
     // Start with initialising ENet
     // ============================
@@ -331,6 +346,7 @@ void STKHost::init()
  */
 STKHost::~STKHost()
 {
+    ServerMetrics::stop();
     NetworkConfig::get()->clearActivePlayersForClient();
     requestShutdown();
     if (m_network_console.joinable())
@@ -740,6 +756,10 @@ void STKHost::mainLoop()
             m_upload_speed.store(getNetwork()->getENetHost()->totalSentData);
             m_download_speed.store(
                 getNetwork()->getENetHost()->totalReceivedData);
+            m_total_sent_bytes.fetch_add(
+                getNetwork()->getENetHost()->totalSentData);
+            m_total_received_bytes.fetch_add(
+                getNetwork()->getENetHost()->totalReceivedData);
             getNetwork()->getENetHost()->totalSentData = 0;
             getNetwork()->getENetHost()->totalReceivedData = 0;
         }
@@ -892,6 +912,12 @@ void STKHost::mainLoop()
             peer_lock.unlock();
         }
 
+        // Send the small reliable messages collected for each peer
+        std::unique_lock<std::mutex> flush_lock(m_peers_mutex);
+        for (auto& p : m_peers)
+            p.second->flushMessages();
+        flush_lock.unlock();
+
         std::list<std::tuple<ENetPeer*, ENetPacket*, uint32_t,
             ENetCommandType> > copied_list;
         std::unique_lock<std::mutex> lock(m_enet_cmd_mutex);
@@ -1237,11 +1263,13 @@ bool STKHost::isConnectedTo(const TransportAddress& peer)
 void STKHost::sendPacketToAllPeersInServer(NetworkString *data, bool reliable)
 {
     std::lock_guard<std::mutex> lock(m_peers_mutex);
+    std::vector<STKPeer*> peers;
     for (auto p : m_peers)
     {
         if (p.second->isValidated())
-            p.second->sendPacket(data, reliable);
+            peers.push_back(p.second.get());
     }
+    sendPacketToPeers(peers, { data }, reliable);
 }   // sendPacketToAllPeersInServer
 
 //-----------------------------------------------------------------------------
@@ -1252,11 +1280,13 @@ void STKHost::sendPacketToAllPeersInServer(NetworkString *data, bool reliable)
 void STKHost::sendPacketToAllPeers(NetworkString *data, bool reliable)
 {
     std::lock_guard<std::mutex> lock(m_peers_mutex);
+    std::vector<STKPeer*> peers;
     for (auto p : m_peers)
     {
         if (p.second->isValidated() && !p.second->isWaitingForGame())
-            p.second->sendPacket(data, reliable);
+            peers.push_back(p.second.get());
     }
+    sendPacketToPeers(peers, { data }, reliable);
 }   // sendPacketToAllPeers
 
 //-----------------------------------------------------------------------------
@@ -1269,15 +1299,17 @@ void STKHost::sendPacketExcept(STKPeer* peer, NetworkString *data,
                                bool reliable)
 {
     std::lock_guard<std::mutex> lock(m_peers_mutex);
+    std::vector<STKPeer*> peers;
     for (auto p : m_peers)
     {
         STKPeer* stk_peer = p.second.get();
         if (!stk_peer->isSamePeer(peer) && p.second->isValidated() &&
             !p.second->isWaitingForGame())
         {
-            stk_peer->sendPacket(data, reliable);
+            peers.push_back(stk_peer);
         }
     }
+    sendPacketToPeers(peers, { data }, reliable);
 }   // sendPacketExcept
 
 //-----------------------------------------------------------------------------
@@ -1290,16 +1322,86 @@ void STKHost::sendPacketToAllPeersWith(std::function<bool(STKPeer*)> predicate,
                                        NetworkString* data, bool reliable)
 {
     std::lock_guard<std::mutex> lock(m_peers_mutex);
+    std::vector<STKPeer*> peers;
     for (auto p : m_peers)
     {
         STKPeer* stk_peer = p.second.get();
         if (!stk_peer->isValidated())
             continue;
         if (predicate(stk_peer))
-            stk_peer->sendPacket(data, reliable);
+            peers.push_back(stk_peer);
     }
+    sendPacketToPeers(peers, { data }, reliable);
 }   // sendPacketToAllPeersWith
 
+//-----------------------------------------------------------------------------
+/** Sends (encrypted) data to several peers. The packets for all peers are
+ *  created and encrypted in parallel on the send pool (if enabled), and then
+ *  handed to the enet thread in the order of the peers. The caller must make
+ *  sure that the peers are not deleted meanwhile.
+ *  \param peers The peers to send to.
+ *  \param data Either one message which is sent to all peers, or one
+ *         message for each peer.
+ *  \param reliable If the data should be sent reliable or now.
+ */
+void STKHost::sendPacketToPeers(const std::vector<STKPeer*>& peers,
+                                const std::vector<NetworkString*>& data,
+                                bool reliable)
+{
+    assert(data.size() == 1 || data.size() == peers.size());
+    if (peers.empty())
+        return;
+
+    std::vector<ENetPacket*> packets;
+    std::unique_lock<std::mutex> ul(m_send_pool_mutex, std::try_to_lock);
+    createPackets(ul.owns_lock() ? m_send_pool.get() : NULL, peers, data,
+                  reliable, &packets);
+    if (ul.owns_lock())
+        ul.unlock();
+
+    for (unsigned i = 0; i < peers.size(); i++)
+    {
+        if (packets[i])
+            peers[i]->sendCreatedPacket(packets[i], /*encrypted*/true);
+    }
+}   // sendPacketToPeers
+
+//-----------------------------------------------------------------------------
+/** Creates and encrypts the packets of a message sent to several peers, see
+ *  sendPacketToPeers.
+ *  \param pool The thread pool to create the packets in parallel, or NULL
+ *         to create them on this thread.
+ *  \param peers The peers to send to.
+ *  \param data Either one message which is sent to all peers, or one
+ *         message for each peer.
+ *  \param reliable If the data should be sent reliable or now.
+ *  \param[out] packets The packet for each peer, NULL if nothing is to be
+ *         sent to a peer.
+ */
+void STKHost::createPackets(ThreadPool* pool,
+                            const std::vector<STKPeer*>& peers,
+                            const std::vector<NetworkString*>& data,
+                            bool reliable, std::vector<ENetPacket*>* packets)
+{
+    packets->assign(peers.size(), NULL);
+    std::function<void(unsigned)> create =
+        [&peers, &data, packets, reliable](unsigned i)
+    {
+        NetworkString* ns = data.size() == 1 ? data[0] : data[i];
+        (*packets)[i] = peers[i]->createPacket(ns, reliable,
+                                               /*encrypted*/true);
+    };
+    if (pool)
+    {
+        pool->parallelFor((unsigned)peers.size(), create);
+    }
+    else
+    {
+        for (unsigned i = 0; i < peers.size(); i++)
+            create(i);
+    }
+}   // createPackets
+
 //-----------------------------------------------------------------------------
 /** Sends a message from a client to the server. */
 void STKHost::sendToServer(NetworkString *data, bool reliable)
@@ -1450,3 +1552,81 @@ void STKHost::updatePlayers(unsigned* ingame, unsigned* waiting,
     if (total)
         *total = total_players;
 }   // updatePlayers
+
+// ----------------------------------------------------------------------------
+/** Creates and encrypts the game state of each peer, as done by
+ *  GameProtocol::sendPeerStates, on this thread and on the send pool.
+ *  \param repeat How often the packets are created for each number of peers
+ *         and threads.
+ *  \param print If the time of each is printed.
+ */
+void STKHost::testCreatePackets(int repeat, bool print)
+{
+    const unsigned STATE_SIZE = 1000;
+    const std::vector<uint8_t> key(16, 1), iv(12, 2);
+    for (unsigned num_peers : { 8, 32 })
+    {
+        std::vector<ENetPeer> enet_peers(num_peers);
+        std::vector<std::unique_ptr<STKPeer> > stk_peers;
+        std::vector<STKPeer*> peers;
+        std::vector<NetworkString*> states;
+        for (unsigned i = 0; i < num_peers; i++)
+        {
+            memset(&enet_peers[i], 0, sizeof(ENetPeer));
+            enet_peers[i].state = ENET_PEER_STATE_CONNECTED;
+            stk_peers.emplace_back(new STKPeer(&enet_peers[i], NULL, i));
+            stk_peers.back()->setCrypto(
+                std::unique_ptr<Crypto>(new Crypto(key, iv)));
+            peers.push_back(stk_peers.back().get());
+            NetworkString* ns =
+                new NetworkString(PROTOCOL_CONTROLLER_EVENTS, STATE_SIZE);
+            for (unsigned j = 1; j < STATE_SIZE; j++)
+                ns->addUInt8((uint8_t)(i + j));
+            states.push_back(ns);
+        }
+
+        for (unsigned num_threads : { 1, 2, 4 })
+        {
+            std::unique_ptr<ThreadPool> pool;
+            if (num_threads > 1)
+                pool.reset(new ThreadPool(num_threads));
+            std::vector<ENetPacket*> packets;
+            double total = 0.0;
+            for (int r = 0; r < repeat; r++)
+            {
+                const double s = StkTime::getRealTime();
+                createPackets(pool.get(), peers, states, /*reliable*/false,
+                              &packets);
+                total += StkTime::getRealTime() - s;
+                for (unsigned i = 0; i < num_peers; i++)
+                {
+                    // 4 bytes counter and 4 bytes tag are added
+                    assert(packets[i] != NULL);
+                    assert(packets[i]->dataLength ==
+                           states[i]->getTotalSize() + 8);
+                    enet_packet_destroy(packets[i]);
+                }
+            }
+            if (print)
+            {
+                Log::info("STKHost", "Encrypted states of %u bytes for %u "
+                          "peers with %u threads in %lf ms", STATE_SIZE,
+                          num_peers, num_threads, total * 1000.0 / repeat);
+            }
+        }
+        for (NetworkString* ns : states)
+            delete ns;
+    }
+}   // testCreatePackets
+
+// ----------------------------------------------------------------------------
+void STKHost::unitTesting()
+{
+    testCreatePackets(1, /*print*/false);
+}   // unitTesting
+
+// ----------------------------------------------------------------------------
+void STKHost::benchmark()
+{
+    testCreatePackets(200, /*print*/true);
+}   // benchmark
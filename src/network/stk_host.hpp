@@ -45,6 +45,7 @@
 #include <set>
 #include <thread>
 #include <tuple>
+#include <vector>
 
 class GameSetup;
 class LobbyProtocol;
@@ -53,6 +54,7 @@ class NetworkTimerSynchronizer;
 class Server;
 class ServerLobby;
 class SeparateProcess;
+class ThreadPool;
 
 enum ENetCommandType : unsigned int
 {
@@ -99,6 +101,14 @@ private:
     /** Protect \ref m_enet_cmd from multiple threads usage. */
     std::mutex m_enet_cmd_mutex;
 
+    /** Creates the packets of a message sent to several peers in parallel
+     *  (see sendPacketToPeers), NULL if only one thread is used. */
+    std::unique_ptr<ThreadPool> m_send_pool;
+
+    /** The send pool can only run one job at a time. Messages sent by
+     *  another thread meanwhile create their packets serially. */
+    std::mutex m_send_pool_mutex;
+
     /** The list of peers connected to this instance. */
     std::map<ENetPeer*, std::shared_ptr<STKPeer> > m_peers;
 
@@ -145,6 +155,9 @@ private:
 
     std::atomic<uint32_t> m_download_speed;
 
+    /** Bytes sent and received by enet since the host was created. */
+    std::atomic<uint64_t> m_total_sent_bytes, m_total_received_bytes;
+
     std::atomic<uint32_t> m_players_in_game;
 
     std::atomic<uint32_t> m_players_waiting;
@@ -167,6 +180,14 @@ private:
                                    std::map<std::string, uint64_t>& ctp);
     // ------------------------------------------------------------------------
     void mainLoop();
+    // ------------------------------------------------------------------------
+    static void createPackets(ThreadPool* pool,
+                              const std::vector<STKPeer*>& peers,
+                              const std::vector<NetworkString*>& data,
+                              bool reliable,
+                              std::vector<ENetPacket*>* packets);
+    // ------------------------------------------------------------------------
+    static void testCreatePackets(int repeat, bool print);
 
 public:
     /** If a network console should be started. */
@@ -231,6 +252,14 @@ public:
     void sendPacketToAllPeersWith(std::function<bool(STKPeer*)> predicate,
                                   NetworkString* data, bool reliable = true);
     // ------------------------------------------------------------------------
+    void sendPacketToPeers(const std::vector<STKPeer*>& peers,
+                           const std::vector<NetworkString*>& data,
+                           bool reliable = true);
+    // ------------------------------------------------------------------------
+    static void unitTesting();
+    // ------------------------------------------------------------------------
+    static void benchmark();
+    // ------------------------------------------------------------------------
     /** Returns true if this client instance is allowed to control the server.
      *  It will auto transfer ownership if previous server owner disconnected.
      */
@@ -364,6 +393,14 @@ public:
     /* Return download speed in bytes per second. */
     unsigned getDownloadSpeed() const       { return m_download_speed.load(); }
     // ------------------------------------------------------------------------
+    /* Return bytes sent since the host was created, updated every second. */
+    uint64_t getTotalSentBytes() const    { return m_total_sent_bytes.load(); }
+    // ------------------------------------------------------------------------
+    /* Return bytes received since the host was created, updated every
+     * second. */
+    uint64_t getTotalReceivedBytes() const
+                                      { return m_total_received_bytes.load(); }
+    // ------------------------------------------------------------------------
     void updatePlayers(unsigned* ingame = NULL,
                        unsigned* waiting = NULL,
                        unsigned* total = NULL);
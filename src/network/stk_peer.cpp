@@ -21,6 +21,7 @@
 #include "config/user_config.hpp"
 #include "network/crypto.hpp"
 #include "network/event.hpp"
+#include "network/message_coalescer.hpp"
 #include "network/network_config.hpp"
 #include "network/network_string.hpp"
 #include "network/stk_host.hpp"
@@ -45,6 +46,11 @@ STKPeer::STKPeer(ENetPeer *enet_peer, STKHost* host, uint32_t host_id)
     m_disconnected.store(false);
     m_warned_for_high_ping.store(false);
     m_last_activity.store((int64_t)StkTime::getMonoTimeMs());
+    m_acked_state_ticks.store(-1);
+    m_bytes_sent.store(0);
+    m_rewind_load.store(-1);
+    m_coalesce_messages.store(false);
+    m_coalescer.reset(new MessageCoalescer());
 }   // STKPeer
 
 //-----------------------------------------------------------------------------
@@ -61,6 +67,8 @@ void STKPeer::disconnect()
     if (m_enet_peer->state != ENET_PEER_STATE_CONNECTED ||
         a != m_peer_address)
         return;
+    // Send the collected messages before the disconnection
+    flushMessages();
     m_disconnected.store(true);
     m_host->addEnetCommand(m_enet_peer, NULL, PDI_NORMAL, ECT_DISCONNECT);
 }   // disconnect
@@ -76,6 +84,7 @@ void STKPeer::kick()
     if (m_enet_peer->state != ENET_PEER_STATE_CONNECTED ||
         a != m_peer_address)
         return;
+    flushMessages();
     m_disconnected.store(true);
     m_host->addEnetCommand(m_enet_peer, NULL, PDI_KICK, ECT_DISCONNECT);
 }   // kick
@@ -91,6 +100,7 @@ void STKPeer::reset()
     if (m_enet_peer->state != ENET_PEER_STATE_CONNECTED ||
         a != m_peer_address)
         return;
+    flushMessages();
     m_disconnected.store(true);
     m_host->addEnetCommand(m_enet_peer, NULL, 0, ECT_RESET);
 }   // reset
@@ -102,43 +112,116 @@ void STKPeer::reset()
  *  \param encrypted If the data is sent encrypted or not.
  */
 void STKPeer::sendPacket(NetworkString *data, bool reliable, bool encrypted)
+{
+    ENetPacket* packet = createPacket(data, reliable, encrypted);
+    if (packet)
+        sendCreatedPacket(packet, encrypted);
+}   // sendPacket
+
+//-----------------------------------------------------------------------------
+/** Returns if packets can be sent to this peer. */
+bool STKPeer::canSend() const
 {
     if (m_disconnected.load())
-        return;
+        return false;
     TransportAddress a(m_enet_peer->address);
     // Enet will reuse a disconnected peer so we check here to avoid sending
     // to wrong peer
-    if (m_enet_peer->state != ENET_PEER_STATE_CONNECTED ||
-        a != m_peer_address)
-        return;
+    return m_enet_peer->state == ENET_PEER_STATE_CONNECTED &&
+        a == m_peer_address;
+}   // canSend
 
-    ENetPacket* packet = NULL;
-    if (m_crypto && encrypted)
+//-----------------------------------------------------------------------------
+/** Creates (and encrypts if necessary) the enet packet to send data to this
+ *  host. It does not modify data and only locks the crypto and the message
+ *  coalescer of this peer, so it can be called for different peers at the
+ *  same time (see STKHost::sendPacketToPeers). Small reliable messages are
+ *  collected if enabled, and sent together by flushMessages(). Other
+ *  reliable messages are then sent at once by the coalescer.
+ *  \param data The data to send.
+ *  \param reliable If the data is sent reliable or not.
+ *  \param encrypted If the data is sent encrypted or not.
+ *  \return The packet, or NULL if nothing (more) is to be sent to this
+ *          peer.
+ */
+ENetPacket* STKPeer::createPacket(NetworkString *data, bool reliable,
+                                  bool encrypted)
+{
+    if (!canSend())
+        return NULL;
+
+    if (reliable && encrypted && m_coalesce_messages.load())
     {
-        packet = m_crypto->encryptSend(*data, reliable);
+        // A message which is not collected is sent by the coalescer, so
+        // that it can't be overtaken by messages collected later
+        m_coalescer->add(data, [this](NetworkString* ns)
+            {
+                sendReliable(ns);
+            });
+        return NULL;
     }
-    else
+    return encodePacket(data, reliable, encrypted);
+}   // createPacket
+
+//-----------------------------------------------------------------------------
+ENetPacket* STKPeer::encodePacket(NetworkString *data, bool reliable,
+                                  bool encrypted)
+{
+    if (m_crypto && encrypted)
+        return m_crypto->encryptSend(*data, reliable);
+
+    return enet_packet_create(data->getData(),
+        data->getTotalSize(), (reliable ?
+        ENET_PACKET_FLAG_RELIABLE :
+        (ENET_PACKET_FLAG_UNSEQUENCED |
+        ENET_PACKET_FLAG_UNRELIABLE_FRAGMENT)));
+}   // encodePacket
+
+//-----------------------------------------------------------------------------
+/** Hands a packet created by createPacket to the enet thread to be sent.
+ *  \param packet The packet, which is then owned by the enet thread.
+ *  \param encrypted If the packet is encrypted or not.
+ */
+void STKPeer::sendCreatedPacket(ENetPacket* packet, bool encrypted)
+{
+    if (Network::m_connection_debug)
     {
-        packet = enet_packet_create(data->getData(),
-            data->getTotalSize(), (reliable ?
-            ENET_PACKET_FLAG_RELIABLE :
-            (ENET_PACKET_FLAG_UNSEQUENCED |
-            ENET_PACKET_FLAG_UNRELIABLE_FRAGMENT)));
+        TransportAddress a(m_enet_peer->address);
+        Log::verbose("STKPeer", "sending packet of size %d to %s at %lf",
+            packet->dataLength, a.toString().c_str(),
+            StkTime::getRealTime());
     }
+    m_bytes_sent.fetch_add(packet->dataLength, std::memory_order_relaxed);
+    m_host->addEnetCommand(m_enet_peer, packet,
+            encrypted ? EVENT_CHANNEL_NORMAL : EVENT_CHANNEL_UNENCRYPTED,
+            ECT_SEND_PACKET);
+}   // sendCreatedPacket
 
-    if (packet)
-    {
-        if (Network::m_connection_debug)
+//-----------------------------------------------------------------------------
+/** Sends the small reliable messages collected since the last call in one
+ *  packet, called regularly by the STKHost thread.
+ */
+void STKPeer::flushMessages()
+{
+    if (!m_coalesce_messages.load())
+        return;
+    m_coalescer->flush([this](NetworkString* packed)
         {
-            Log::verbose("STKPeer", "sending packet of size %d to %s at %lf",
-                packet->dataLength, a.toString().c_str(),
-                StkTime::getRealTime());
-        }
-        m_host->addEnetCommand(m_enet_peer, packet,
-                encrypted ? EVENT_CHANNEL_NORMAL : EVENT_CHANNEL_UNENCRYPTED,
-                ECT_SEND_PACKET);
-    }
-}   // sendPacket
+            if (canSend())
+                sendReliable(packed);
+        });
+}   // flushMessages
+
+//-----------------------------------------------------------------------------
+/** Encrypts and sends a reliable message, called by the message coalescer.
+ */
+void STKPeer::sendReliable(NetworkString* data)
+{
+    ENetPacket* packet = encodePacket(data, /*reliable*/true,
+                                      /*encrypted*/true);
+    if (packet)
+        sendCreatedPacket(packet, /*encrypted*/true);
+}   // sendReliable
 
 //-----------------------------------------------------------------------------
 /** Returns if the peer is connected or not.
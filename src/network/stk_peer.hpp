@@ -39,6 +39,7 @@
 #include <vector>
 
 class Crypto;
+class MessageCoalescer;
 class NetworkPlayerProfile;
 class NetworkString;
 class STKHost;
@@ -104,6 +105,31 @@ protected:
      *  features available in same version. */
     std::set<std::string> m_client_capabilities;
 
+    /** Ticks of the latest game state acknowledged by this peer, used as
+     *  base for delta compressed states. -1 if none. */
+    std::atomic<int> m_acked_state_ticks;
+
+    /** Total number of bytes of all packets sent to this peer. */
+    std::atomic<uint64_t> m_bytes_sent;
+
+    /** Per mille of time the client spent rewinding, as reported by the
+     *  client, -1 if it doesn't report it. */
+    std::atomic<int> m_rewind_load;
+
+    /** True if small reliable messages to this peer are collected and sent
+     *  together by flushMessages(). */
+    std::atomic_bool m_coalesce_messages;
+
+    std::unique_ptr<MessageCoalescer> m_coalescer;
+
+    // ------------------------------------------------------------------------
+    bool canSend() const;
+    // ------------------------------------------------------------------------
+    ENetPacket* encodePacket(NetworkString *data, bool reliable,
+                             bool encrypted);
+    // ------------------------------------------------------------------------
+    void sendReliable(NetworkString* data);
+
 public:
     STKPeer(ENetPeer *enet_peer, STKHost* host, uint32_t host_id);
     // ------------------------------------------------------------------------
@@ -112,6 +138,13 @@ public:
     void sendPacket(NetworkString *data, bool reliable = true,
                     bool encrypted = true);
     // ------------------------------------------------------------------------
+    ENetPacket* createPacket(NetworkString *data, bool reliable,
+                             bool encrypted);
+    // ------------------------------------------------------------------------
+    void sendCreatedPacket(ENetPacket* packet, bool encrypted);
+    // ------------------------------------------------------------------------
+    void flushMessages();
+    // ------------------------------------------------------------------------
     void disconnect();
     // ------------------------------------------------------------------------
     void kick();
@@ -241,6 +274,26 @@ public:
     // ------------------------------------------------------------------------
     const std::set<std::string>& getClientCapabilities() const
                                               { return m_client_capabilities; }
+    // ------------------------------------------------------------------------
+    void setAckedStateTicks(int ticks)     { m_acked_state_ticks.store(ticks); }
+    // ------------------------------------------------------------------------
+    int getAckedStateTicks() const        { return m_acked_state_ticks.load(); }
+    // ------------------------------------------------------------------------
+    uint64_t getBytesSent() const                { return m_bytes_sent.load(); }
+    // ------------------------------------------------------------------------
+    void setRewindLoad(int load)                 { m_rewind_load.store(load); }
+    // ------------------------------------------------------------------------
+    int getRewindLoad() const                   { return m_rewind_load.load(); }
+    // ------------------------------------------------------------------------
+    /** Enables sending small reliable messages together, only if the peer
+     *  can split them again. */
+    void setCoalesceMessages(bool val)      { m_coalesce_messages.store(val); }
+    // ------------------------------------------------------------------------
+    /** Returns the packet loss measured by enet, from 0 to 1. */
+    float getPacketLoss() const
+    {
+        return (float)m_enet_peer->packetLoss / ENET_PEER_PACKET_LOSS_SCALE;
+    }   // getPacketLoss
 };   // STKPeer
 
 #endif // STK_PEER_HPP
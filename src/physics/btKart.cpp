@@ -414,6 +414,27 @@ void btKart::getVisualContactPoint(const btTransform& chassis_trans,
     }
 }   // getVisualContactPoint
 
+// ----------------------------------------------------------------------------
+/** Returns the ray which rayCast(index) casts for a wheel. This is used to
+ *  cast the rays of all karts against the track together before the karts
+ *  are updated, so it must compute the ray exactly like rayCast (a ray which
+ *  differs is cast again by the raycaster).
+ *  \param index Index of the wheel.
+ *  \param from, to On return the start and end point of the ray.
+ */
+void btKart::getWheelRay(unsigned int index, btVector3 *from,
+                         btVector3 *to) const
+{
+    const btWheelInfo &wheel = m_wheelInfo[index];
+    btTransform chassis_trans = getChassisWorldTransform();
+    *from = chassis_trans(wheel.m_chassisConnectionPointCS*1.0f);
+    btVector3 direction = chassis_trans.getBasis()*wheel.m_wheelDirectionCS;
+    btScalar max_susp_len = wheel.getSuspensionRestLength()
+                          + wheel.m_maxSuspensionTravel;
+    btScalar raylen = max_susp_len + 0.5f;
+    *to = *from + direction * (raylen);
+}   // getWheelRay
+
 // ----------------------------------------------------------------------------
 const btTransform& btKart::getChassisWorldTransform() const
 {
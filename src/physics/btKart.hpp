@@ -144,6 +144,8 @@ public:
     void               debugDraw(btIDebugDraw* debugDrawer);
     const btTransform& getChassisWorldTransform() const;
     btScalar           rayCast(unsigned int index, float fraction=1.0f);
+    void               getWheelRay(unsigned int index, btVector3 *from,
+                                   btVector3 *to) const;
     virtual void       updateVehicle(btScalar step);
     void               resetSuspension();
     btScalar           getSteeringValue(int wheel) const;
@@ -189,6 +191,9 @@ public:
     /** Returns the number of wheels of this vehicle. */
     inline int getNumWheels() const { return int(m_wheelInfo.size());}
     // ------------------------------------------------------------------------
+    /** Returns the raycaster used for the wheels. */
+    btVehicleRaycaster* getRaycaster() { return m_vehicleRaycaster; }
+    // ------------------------------------------------------------------------
     /** Returns the chassis (rigid) body. */
     inline btRigidBody* getRigidBody() { return m_chassisBody; }
     // ------------------------------------------------------------------------
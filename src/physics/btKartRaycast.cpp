@@ -19,6 +19,54 @@
 #include "physics/triangle_mesh.hpp"
 #include "tracks/track.hpp"
 
+// ----------------------------------------------------------------------------
+/** Stores the rays of the wheels which were cast against an object together
+ *  with the rays of all other karts. A ray cast with castRay which is
+ *  identical to one of them only needs to be tested against other objects.
+ *  \param object The object (the track) against which the rays were cast.
+ *  \param num_rays Number of rays.
+ *  \param from, to Start and end points of the rays.
+ *  \param hits The hits of the rays against the object.
+ */
+void btKartRaycaster::setBatchedRays(const btCollisionObject *object,
+                                     int num_rays, const btVector3 *from,
+                                     const btVector3 *to,
+                                     const TriangleMesh::RayHit *hits)
+{
+    m_batched_object = object;
+    m_batched_from.resize(num_rays);
+    m_batched_to.resize(num_rays);
+    m_batched_hits.resize(num_rays);
+    for (int i = 0; i < num_rays; i++)
+    {
+        m_batched_from[i] = from[i];
+        m_batched_to[i]   = to[i];
+        m_batched_hits[i] = hits[i];
+    }
+}   // setBatchedRays
+
+// ----------------------------------------------------------------------------
+/** Returns the batched hit of a ray, or NULL if the ray was not batched.
+ *  Only the x, y, z components are compared, since w is not always set.
+ */
+const TriangleMesh::RayHit* btKartRaycaster::getBatchedHit(
+                             const btVector3 &from, const btVector3 &to) const
+{
+    if (!m_batched_object)
+        return NULL;
+    for (int i = 0; i < m_batched_hits.size(); i++)
+    {
+        const btVector3 &f = m_batched_from[i];
+        const btVector3 &t = m_batched_to[i];
+        if (f.getX() == from.getX() && f.getY() == from.getY() &&
+            f.getZ() == from.getZ() && t.getX() == to.getX() &&
+            t.getY() == to.getY() && t.getZ() == to.getZ())
+            return &m_batched_hits[i];
+    }
+    return NULL;
+}   // getBatchedHit
+
+// ----------------------------------------------------------------------------
 void* btKartRaycaster::castRay(const btVector3& from, const btVector3& to,
                                btVehicleRaycasterResult& result)
 {
@@ -27,6 +75,8 @@ void* btKartRaycaster::castRay(const btVector3& from, const btVector3& to,
     {
     private:
         int m_triangle_index;
+        /** An object which is not tested, since its hit is already known. */
+        const btCollisionObject *m_skip_object;
     public:
         /** Constructor, initialises the triangle index. */
         ClosestWithNormal(const btVector3 &from,
@@ -34,8 +84,34 @@ void* btKartRaycaster::castRay(const btVector3& from, const btVector3& to,
                           : btCollisionWorld::ClosestRayResultCallback(from,to)
         {
             m_triangle_index = -1;
+            m_skip_object    = NULL;
         }   // CloestWithNormal
         // --------------------------------------------------------------------
+        /** Sets the result of the ray against an object, which is then
+         *  skipped by the raycast, so only a closer hit replaces it. */
+        void setHit(const btCollisionObject *object,
+                    const TriangleMesh::RayHit &hit)
+        {
+            m_skip_object = object;
+            if (hit.m_triangle_index < 0)
+                return;
+            m_closestHitFraction = hit.m_fraction;
+            m_collisionObject    = const_cast<btCollisionObject*>(object);
+            m_hitNormalWorld     = hit.m_normal;
+            m_hitPointWorld.setInterpolate3(m_rayFromWorld, m_rayToWorld,
+                                            hit.m_fraction);
+            if (hit.m_shape_part > -1)
+                m_triangle_index = hit.m_triangle_index;
+        }   // setHit
+        // --------------------------------------------------------------------
+        virtual bool needsCollision(btBroadphaseProxy* proxy) const
+        {
+            if (proxy->m_clientObject == m_skip_object)
+                return false;
+            return btCollisionWorld::ClosestRayResultCallback
+                                   ::needsCollision(proxy);
+        }   // needsCollision
+        // --------------------------------------------------------------------
         /** Stores the index of the triangle hit. */
         virtual    btScalar addSingleResult(btCollisionWorld::LocalRayResult& rayResult,
                                          bool normalInWorldSpace)
@@ -58,6 +134,11 @@ void* btKartRaycaster::castRay(const btVector3& from, const btVector3& to,
     // ========================================================================
 
     ClosestWithNormal rayCallback(from,to);
+    // If the ray was already cast against the track together with the rays
+    // of all karts, only the other objects need to be tested.
+    const TriangleMesh::RayHit *hit = getBatchedHit(from, to);
+    if (hit)
+        rayCallback.setHit(m_batched_object, *hit);
 
     m_dynamicsWorld->rayTest(from, to, rayCallback);
 
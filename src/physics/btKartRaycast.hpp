@@ -18,6 +18,7 @@ class btDynamicsWorld;
 #include "LinearMath/btAlignedObjectArray.h"
 #include "BulletDynamics/Vehicle/btWheelInfo.h"
 #include "BulletDynamics/Dynamics/btActionInterface.h"
+#include "physics/triangle_mesh.hpp"
 
 
 class btKartRaycaster : public btVehicleRaycaster
@@ -27,14 +28,31 @@ private:
     /** True if the normals should be smoothed. Not all tracks support this,
     *  so this flag is set depending on track when constructing this object. */
     bool                m_smooth_normals;
+    /** The object (the track) against which the wheel rays were already
+     *  cast together with the rays of all other karts, or NULL. */
+    const btCollisionObject* m_batched_object;
+    /** The wheel rays cast against m_batched_object, and their hits. */
+    btAlignedObjectArray<btVector3> m_batched_from;
+    btAlignedObjectArray<btVector3> m_batched_to;
+    btAlignedObjectArray<TriangleMesh::RayHit> m_batched_hits;
+
+    const TriangleMesh::RayHit* getBatchedHit(const btVector3 &from,
+                                              const btVector3 &to) const;
 public:
     btKartRaycaster(btDynamicsWorld* world, bool smooth_normals=false)
-        :m_dynamicsWorld(world), m_smooth_normals(smooth_normals)
+        :m_dynamicsWorld(world), m_smooth_normals(smooth_normals),
+         m_batched_object(NULL)
     {
     }
 
     virtual void* castRay(const btVector3& from,const btVector3& to,
                           btVehicleRaycasterResult& result);
+    void setBatchedRays(const btCollisionObject *object, int num_rays,
+                        const btVector3 *from, const btVector3 *to,
+                        const TriangleMesh::RayHit *hits);
+    // ------------------------------------------------------------------------
+    /** Discards the batched rays, so all rays are cast normally again. */
+    void clearBatchedRays() { m_batched_object = NULL; }
 
 };
 
@@ -29,6 +29,7 @@
 #include "io/xml_node.hpp"
 #include "physics/physics.hpp"
 #include "physics/triangle_mesh.hpp"
+#include "scriptengine/script_engine.hpp"
 #include "network/compress_network_body.hpp"
 #include "network/network_config.hpp"
 #include "network/protocols/lobby_protocol.hpp"
@@ -167,6 +168,9 @@ PhysicalObject::PhysicalObject(bool is_dynamic,
     m_reset_height       = settings.m_reset_height;
     m_on_kart_collision  = settings.m_on_kart_collision;
     m_on_item_collision  = settings.m_on_item_collision;
+    m_on_kart_collision_function = NULL;
+    m_on_item_collision_function = NULL;
+    m_script_functions_resolved  = false;
     m_current_transform.setOrigin(Vec3());
     m_current_transform.setRotation(
         btQuaternion(0.0f, 0.0f, 0.0f, 1.0f));
@@ -743,6 +747,27 @@ void PhysicalObject::setInteraction(std::string interaction){
     }
 }   // set interaction
 
+// ----------------------------------------------------------------------------
+/** Looks up the script functions which are called on collisions with this
+ *  object, so that each collision doesn't need to find them by name.
+ */
+void PhysicalObject::resolveScriptFunctions()
+{
+    m_script_functions_resolved = true;
+    Scripting::ScriptEngine *script_engine =
+        Scripting::ScriptEngine::getInstance();
+    if (!m_on_kart_collision.empty())
+    {
+        m_on_kart_collision_function = script_engine->getFunction(true,
+            "void " + m_on_kart_collision + "(int, const string, const string)");
+    }
+    if (!m_on_item_collision.empty())
+    {
+        m_on_item_collision_function = script_engine->getFunction(true,
+            "void " + m_on_item_collision + "(int, int, const string)");
+    }
+}   // resolveScriptFunctions
+
 // ----------------------------------------------------------------------------
 /** Remove body from physics dynamic world interaction type for object*/
 void PhysicalObject::removeBody()
@@ -812,14 +837,14 @@ void PhysicalObject::computeError()
 }   // computeError
 
 // ----------------------------------------------------------------------------
-BareNetworkString* PhysicalObject::saveState(std::vector<std::string>* ru)
+bool PhysicalObject::saveState(BareNetworkString* buffer,
+                               std::vector<std::string>* ru)
 {
     bool has_live_join = false;
 
     if (auto sl = LobbyProtocol::get<LobbyProtocol>())
         has_live_join = sl->hasLiveJoiningRecently();
 
-    BareNetworkString* buffer = new BareNetworkString();
     // This will compress and round down values of body, use the rounded
     // down value to test if sending state is needed
     // If any client live-joined always send new state for this object
@@ -833,15 +858,15 @@ BareNetworkString* PhysicalObject::saveState(std::vector<std::string>* ru)
         (current_lv - m_last_lv).length() < 0.01f &&
         (current_av - m_last_av).length() < 0.01f && !has_live_join)
     {
-        delete buffer;
-        return nullptr;
+        // The compressed data written above will be discarded by the caller
+        return false;
     }
 
     ru->push_back(getUniqueIdentity());
     m_last_transform = cur_transform;
     m_last_lv = current_lv;
     m_last_av = current_av;
-    return buffer;
+    return true;
 }   // saveState
 
 // ----------------------------------------------------------------------------
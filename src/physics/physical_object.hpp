@@ -30,6 +30,7 @@
 #include "utils/leak_check.hpp"
 
 
+class asIScriptFunction;
 class Material;
 class TrackObject;
 class XMLNode;
@@ -180,6 +181,11 @@ private:
     * when a (flyable) item collides with this object
     */
     std::string           m_on_item_collision;
+    /** The script functions with these names, looked up once when they are
+     *  needed the first time (NULL if there is no such function). */
+    asIScriptFunction    *m_on_kart_collision_function;
+    asIScriptFunction    *m_on_item_collision_function;
+    bool                  m_script_functions_resolved;
     /** If this body is a bullet dynamic body, i.e. affected by physics
      *  or not (static (not moving) or kinematic (animated outside
      *  of physics). */
@@ -197,6 +203,8 @@ private:
      * when the object is not moving */
     bool                  m_no_server_state;
 
+    void resolveScriptFunctions();
+
 public:
                     PhysicalObject(bool is_dynamic, const Settings& settings,
                                    TrackObject* object);
@@ -252,6 +260,24 @@ public:
     // ------------------------------------------------------------------------
     const std::string& getOnItemCollisionFunction() const { return m_on_item_collision; }
     // ------------------------------------------------------------------------
+    /** Returns the script function to call when a kart collides with this
+     *  object, or NULL. */
+    asIScriptFunction* getOnKartCollisionScript()
+    {
+        if (!m_script_functions_resolved)
+            resolveScriptFunctions();
+        return m_on_kart_collision_function;
+    }   // getOnKartCollisionScript
+    // ------------------------------------------------------------------------
+    /** Returns the script function to call when an item collides with this
+     *  object, or NULL. */
+    asIScriptFunction* getOnItemCollisionScript()
+    {
+        if (!m_script_functions_resolved)
+            resolveScriptFunctions();
+        return m_on_item_collision_function;
+    }   // getOnItemCollisionScript
+    // ------------------------------------------------------------------------
     TrackObject* getTrackObject() { return m_object; }
 
     // Methods usable by scripts
@@ -285,7 +311,8 @@ public:
     void addForRewind();
     virtual void saveTransform();
     virtual void computeError();
-    virtual BareNetworkString* saveState(std::vector<std::string>* ru);
+    virtual bool saveState(BareNetworkString* buffer,
+                           std::vector<std::string>* ru);
     virtual void undoEvent(BareNetworkString *buffer) {}
     virtual void rewindToEvent(BareNetworkString *buffer) {}
     virtual void restoreState(BareNetworkString *buffer, int count);
@@ -44,6 +44,8 @@
 #include "tracks/track_object.hpp"
 #include "utils/profiler.hpp"
 
+#include <chrono>
+
 // ----------------------------------------------------------------------------
 /** Initialise physics.
  *  Create the bullet dynamics world.
@@ -68,6 +70,12 @@ void Physics::init(const Vec3 &world_min, const Vec3 &world_max)
                                                  this,
                                                  m_collision_conf);
     m_karts_to_delete.clear();
+    m_num_steps           = 0;
+    m_step_time_us        = 0;
+    m_all_collisions.clear();
+    m_all_collisions.reserve(32);
+    m_kart_kart_collision_function = NULL;
+    m_script_functions_resolved    = false;
     m_dynamics_world->setGravity(
         btVector3(0.0f,
                   -Track::getCurrentTrack()->getGravity(),
@@ -168,8 +176,12 @@ void Physics::update(int ticks)
     double start;
     if(UserConfigParams::m_physics_debug) start = StkTime::getRealTime();
 
+    auto step_start = std::chrono::steady_clock::now();
     m_dynamics_world->stepSimulation(stk_config->ticks2Time(1), 1,
                                      stk_config->ticks2Time(1)      );
+    m_num_steps++;
+    m_step_time_us += std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - step_start).count();
     if (UserConfigParams::m_physics_debug)
     {
         Log::verbose("Physics", "At %d physics duration %12.8f",
@@ -192,15 +204,24 @@ void Physics::update(int ticks)
                               p->getContactPointCS(0),
                               p->getUserPointer(1)->getPointerKart(),
                               p->getContactPointCS(1)                );
-            Scripting::ScriptEngine* script_engine =
-                                            Scripting::ScriptEngine::getInstance();
-            int kartid1 = p->getUserPointer(0)->getPointerKart()->getWorldKartId();
-            int kartid2 = p->getUserPointer(1)->getPointerKart()->getWorldKartId();
-            script_engine->runFunction(false, "void onKartKartCollision(int, int)",
-                [=](asIScriptContext* ctx) {
-                    ctx->SetArgDWord(0, kartid1);
-                    ctx->SetArgDWord(1, kartid2);
-                });
+            if (!m_script_functions_resolved)
+            {
+                m_script_functions_resolved = true;
+                m_kart_kart_collision_function =
+                    Scripting::ScriptEngine::getInstance()->getFunction(false,
+                                        "void onKartKartCollision(int, int)");
+            }
+            if (m_kart_kart_collision_function)
+            {
+                int kartid1 = p->getUserPointer(0)->getPointerKart()->getWorldKartId();
+                int kartid2 = p->getUserPointer(1)->getPointerKart()->getWorldKartId();
+                Scripting::ScriptEngine::getInstance()->executeFunction(
+                    m_kart_kart_collision_function,
+                    [=](asIScriptContext* ctx) {
+                        ctx->SetArgDWord(0, kartid1);
+                        ctx->SetArgDWord(1, kartid2);
+                    });
+            }
             continue;
         }  // if kart-kart collision
 
@@ -208,27 +229,21 @@ void Physics::update(int ticks)
         {
             // Kart hits physical object
             // -------------------------
-            Scripting::ScriptEngine* script_engine = Scripting::ScriptEngine::getInstance();
             AbstractKart *kart = p->getUserPointer(1)->getPointerKart();
             int kartId = kart->getWorldKartId();
             PhysicalObject* obj = p->getUserPointer(0)->getPointerPhysicalObject();
-            std::string obj_id = obj->getID();
-            std::string scripting_function = obj->getOnKartCollisionFunction();
-
-            TrackObject* to = obj->getTrackObject();
-            TrackObject* library = to->getParentLibrary();
-            std::string lib_id;
-            std::string* lib_id_ptr = NULL;
-            if (library != NULL)
-                lib_id = library->getID();
-            lib_id_ptr = &lib_id;
-
-            if (scripting_function.size() > 0)
+            asIScriptFunction* function = obj->getOnKartCollisionScript();
+            if (function)
             {
-                script_engine->runFunction(true, "void " + scripting_function + "(int, const string, const string)",
+                std::string obj_id = obj->getID();
+                TrackObject* library = obj->getTrackObject()->getParentLibrary();
+                std::string lib_id;
+                if (library != NULL)
+                    lib_id = library->getID();
+                Scripting::ScriptEngine::getInstance()->executeFunction(function,
                     [&](asIScriptContext* ctx) {
                         ctx->SetArgDWord(0, kartId);
-                        ctx->SetArgObject(1, lib_id_ptr);
+                        ctx->SetArgObject(1, &lib_id);
                         ctx->SetArgObject(2, &obj_id);
                     });
             }
@@ -311,15 +326,14 @@ void Physics::update(int ticks)
         {
             // Projectile hits physical object
             // -------------------------------
-            Scripting::ScriptEngine* script_engine = Scripting::ScriptEngine::getInstance();
             Flyable* flyable = p->getUserPointer(0)->getPointerFlyable();
             PhysicalObject* obj = p->getUserPointer(1)->getPointerPhysicalObject();
-            std::string obj_id = obj->getID();
-            std::string scripting_function = obj->getOnItemCollisionFunction();
-            if (scripting_function.size() > 0)
+            asIScriptFunction* function = obj->getOnItemCollisionScript();
+            if (function)
             {
-                script_engine->runFunction(true, "void " + scripting_function + "(int, int, const string)",
-                        [&](asIScriptContext* ctx) {
+                std::string obj_id = obj->getID();
+                Scripting::ScriptEngine::getInstance()->executeFunction(function,
+                    [&](asIScriptContext* ctx) {
                         ctx->SetArgDWord(0, (int)flyable->getType());
                         ctx->SetArgDWord(1, flyable->getOwnerId());
                         ctx->SetArgObject(2, &obj_id);
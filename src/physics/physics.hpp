@@ -35,6 +35,7 @@
 #include "utils/singleton.hpp"
 
 class AbstractKart;
+class asIScriptFunction;
 class STKDynamicsWorld;
 class Vec3;
 
@@ -105,7 +106,8 @@ private:
 
     // ========================================================================
     // This class is the list of collision objects, where each collision
-    // pair is stored as most once.
+    // pair is stored as most once. It is cleared (but keeps its memory)
+    // each step, so no memory is allocated once it is large enough.
     class CollisionList : public std::vector<CollisionPair>
     {
     private:
@@ -149,6 +151,16 @@ private:
     btDefaultCollisionConfiguration *m_collision_conf;
     CollisionList                    m_all_collisions;
 
+    /** The script function called when two karts collide, looked up once
+     *  per track when it is needed the first time (NULL if the track
+     *  script does not have it). */
+    asIScriptFunction               *m_kart_kart_collision_function;
+    bool                             m_script_functions_resolved;
+
+    /** Number of physics steps and their total duration (for profiling). */
+    unsigned                         m_num_steps;
+    uint64_t                         m_step_time_us;
+
     /** Singleton. */
     static Physics                  *m_physics;
 
@@ -177,6 +189,10 @@ public:
     /** Returns true if the debug drawer is enabled. */
     bool  isDebug() const     {return m_debug_drawer->debugEnabled(); }
     IrrDebugDrawer* getDebugDrawer() { return m_debug_drawer; }
+    /** Returns the number of physics steps done since init. */
+    unsigned getNumSteps() const { return m_num_steps; }
+    /** Returns the total duration of these steps in microseconds. */
+    uint64_t getStepTimeUs() const { return m_step_time_us; }
     virtual btScalar solveGroup(btCollisionObject** bodies, int numBodies,
                                 btPersistentManifold** manifold,int numManifolds,
                                 btTypedConstraint** constraints,int numConstraints,
@@ -0,0 +1,112 @@
+//
+//  SuperTuxKart - a fun racing game with go-kart
+//  Copyright (C) 2020 SuperTuxKart-Team
+//
+//  This program is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU General Public License
+//  as published by the Free Software Foundation; either version 3
+//  of the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+#include "physics/stk_dynamics_world.hpp"
+
+#include "config/user_config.hpp"
+#include "physics/btKart.hpp"
+#include "physics/btKartRaycast.hpp"
+#include "tracks/track.hpp"
+
+// ----------------------------------------------------------------------------
+/** Moves the bodies. Since the karts cast the rays of their wheels in
+ *  updateActions, which is called next with these transforms, the rays of
+ *  all karts are cast against the track here together.
+ */
+void STKDynamicsWorld::integrateTransforms(btScalar time_step)
+{
+    btDiscreteDynamicsWorld::integrateTransforms(time_step);
+    if (UserConfigParams::m_batched_raycasts)
+        castWheelRays();
+}   // integrateTransforms
+
+// ----------------------------------------------------------------------------
+/** Does one physics step and discards the batched rays afterwards, so that
+ *  rays cast outside of a step (e.g. after a rewind) are not affected.
+ */
+void STKDynamicsWorld::internalSingleStepSimulation(btScalar time_step)
+{
+    btDiscreteDynamicsWorld::internalSingleStepSimulation(time_step);
+    for (int i = 0; i < m_batched_raycasters.size(); i++)
+        m_batched_raycasters[i]->clearBatchedRays();
+    m_batched_raycasters.clear();
+}   // internalSingleStepSimulation
+
+// ----------------------------------------------------------------------------
+/** Casts the rays of the wheels of all karts against the track with
+ *  TriangleMesh::castRays, and gives the hits to the raycasters of the
+ *  karts. Only the first ray of each wheel is batched, the ray closer to the
+ *  chassis which is cast when the first one does not hit is cast normally.
+ */
+void STKDynamicsWorld::castWheelRays()
+{
+    Track *track = Track::getCurrentTrack();
+    if (!track || !track->getPtrTriangleMesh())
+        return;
+    const TriangleMesh *mesh = track->getPtrTriangleMesh();
+    const btCollisionObject *object = mesh->getCollisionObject();
+    if (!object || !object->getBroadphaseHandle())
+        return;
+    // The raycast of the karts must test the track
+    btCollisionWorld::ClosestRayResultCallback filter(btVector3(0, 0, 0),
+                                                      btVector3(0, 0, 0));
+    btBroadphaseProxy *proxy =
+        const_cast<btBroadphaseProxy*>(object->getBroadphaseHandle());
+    if (!filter.needsCollision(proxy))
+        return;
+
+    m_batched_num_rays.resize(0);
+    m_batched_from.resize(0);
+    m_batched_to.resize(0);
+    for (int i = 0; i < m_actions.size(); i++)
+    {
+        btKart *kart = dynamic_cast<btKart*>(m_actions[i]);
+        if (!kart)
+            continue;
+        btKartRaycaster *raycaster =
+            dynamic_cast<btKartRaycaster*>(kart->getRaycaster());
+        if (!raycaster || kart->getNumWheels() == 0)
+            continue;
+        m_batched_raycasters.push_back(raycaster);
+        m_batched_num_rays.push_back(kart->getNumWheels());
+        for (int j = 0; j < kart->getNumWheels(); j++)
+        {
+            btVector3 from, to;
+            kart->getWheelRay(j, &from, &to);
+            m_batched_from.push_back(from);
+            m_batched_to.push_back(to);
+        }
+    }
+    if (m_batched_from.size() == 0)
+        return;
+
+    m_batched_hits.resize(m_batched_from.size());
+    mesh->castRays(m_batched_from.size(), &m_batched_from[0],
+                   &m_batched_to[0], &m_batched_hits[0]);
+
+    int first = 0;
+    for (int i = 0; i < m_batched_raycasters.size(); i++)
+    {
+        const int n = m_batched_num_rays[i];
+        m_batched_raycasters[i]->setBatchedRays(object, n,
+                                                &m_batched_from[first],
+                                                &m_batched_to[first],
+                                                &m_batched_hits[first]);
+        first += n;
+    }
+}   // castWheelRays
@@ -20,13 +20,36 @@
 #define HEADER_STK_DYNAMICS_WORLD_HPP
 
 #include "btBulletDynamicsCommon.h"
+#include "physics/triangle_mesh.hpp"
+
+class btKartRaycaster;
 
 /** A thin wrapper around bullet's btDiscreteDynamicsWorld. Used to
  *  be able to query and set the 'left over' time from a previous
  *  time step, which is needed for more precise rewind/replays.
+ *  It also casts the wheel rays of all karts against the track together
+ *  in each step, before the karts are updated.
  */
 class STKDynamicsWorld : public btDiscreteDynamicsWorld
 {
+private:
+    /** The raycasters of the karts whose rays were batched in this step. */
+    btAlignedObjectArray<btKartRaycaster*> m_batched_raycasters;
+
+    /** The number of rays of each of these karts. */
+    btAlignedObjectArray<int> m_batched_num_rays;
+
+    /** The batched wheel rays of all karts and their hits. */
+    btAlignedObjectArray<btVector3> m_batched_from;
+    btAlignedObjectArray<btVector3> m_batched_to;
+    btAlignedObjectArray<TriangleMesh::RayHit> m_batched_hits;
+
+    void castWheelRays();
+
+protected:
+    virtual void integrateTransforms(btScalar time_step);
+    virtual void internalSingleStepSimulation(btScalar time_step);
+
 public:
     /** The standard constructor which just created a btDiscreteDynamicsWorld. */
     STKDynamicsWorld(btDispatcher*             dispatcher,
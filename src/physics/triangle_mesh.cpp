@@ -19,14 +19,53 @@
 #include "physics/triangle_mesh.hpp"
 
 #include "config/stk_config.hpp"
+#include "io/file_manager.hpp"
 #include "main_loop.hpp"
 #include "physics/physics.hpp"
 #include "utils/constants.hpp"
+#include "utils/file_utils.hpp"
+#include "utils/log.hpp"
 #include "utils/time.hpp"
 
 #include "btBulletDynamicsCommon.h"
+#include "BulletCollision/NarrowPhaseCollision/btRaycastCallback.h"
 
-#include <fstream>
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+// The scalar code of bullet is only compiled to SSE on x86-64, so only there
+// testing 4 rays at once with SSE gives identical results
+#if (defined(__x86_64__) || defined(_M_X64)) && \
+    !defined(BT_USE_DOUBLE_PRECISION)
+ #include <emmintrin.h>
+ #ifdef _MSC_VER
+  #include <intrin.h>
+ #endif
+ #define SIMD_RAY_PACKET (1)
+ #define SIMD_BLENDV_PS(x,y,mask) \
+     _mm_or_ps(_mm_andnot_ps(mask,x),_mm_and_ps(y,mask))
+#endif
+
+/** Version of the cached BVH files. Must be increased whenever the file
+ *  format or the bullet BVH data structures change. */
+static const uint32_t BVH_CACHE_VERSION = 2;
+
+// -----------------------------------------------------------------------------
+/** Adds data to a 64-bit FNV-1a hash. */
+static uint64_t addToHash(uint64_t hash, const void* data, size_t size)
+{
+    const unsigned char* p = (const unsigned char*)data;
+    for (size_t i = 0; i < size; i++)
+    {
+        hash ^= p[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}   // addToHash
+
+/** Initial value of a 64-bit FNV-1a hash. */
+static const uint64_t FNV_OFFSET_BASIS = 14695981039346656037ULL;
 
 // -----------------------------------------------------------------------------
 /** Constructor: Initialises all data structures with zero.
@@ -44,6 +83,7 @@ TriangleMesh::TriangleMesh(bool can_be_transformed) : m_mesh()
     // (and m_mesh->m_weldingThreshold at m_normals
     m_collision_shape  = NULL;
     m_collision_object = NULL;
+    m_bvh_memory       = NULL;
     m_user_pointer.set(this);
 }   // TriangleMesh
 
@@ -89,10 +129,13 @@ void TriangleMesh::addTriangle(const btVector3 &t1, const btVector3 &t2,
 // -----------------------------------------------------------------------------
 /** Creates a collision body only, which can be used for raycasting, but
  *  has no physical properties.
- *  @param serialized_bhv if non-null, load the serialized bhv from file instead
- *                        of builing it on the fly
+ *  \param create_collision_object If a collision object is to be created.
+ *  \param use_bvh_cache If the BVH should be loaded from (and saved to) the
+ *         cache, which avoids building it again each time a big mesh like
+ *         the track is loaded.
  */
-void TriangleMesh::createCollisionShape(bool create_collision_object, const char* serialized_bhv)
+void TriangleMesh::createCollisionShape(bool create_collision_object,
+                                        bool use_bvh_cache)
 {
     if(m_triangleIndex2Material.size()==0)
     {
@@ -103,55 +146,40 @@ void TriangleMesh::createCollisionShape(bool create_collision_object, const char
         return;
     }
     // Now convert the triangle mesh into a static rigid body
-    btBvhTriangleMeshShape* bhv_triangle_mesh;
+    btBvhTriangleMeshShape* bhv_triangle_mesh = NULL;
+    const bool quantized = stk_config->m_quantized_bvh;
+    const uint64_t start = StkTime::getMonoTimeMs();
 
-    if (serialized_bhv != NULL)
+    if (use_bvh_cache)
     {
-        FILE *f = fopen(serialized_bhv, "rb");
-        fseek(f, 0, SEEK_END);
-        long pos = ftell(f);
-        assert(pos != -1L);
-        fseek(f, 0, SEEK_SET);
-
-        void* bytes = btAlignedAlloc(pos, 16);
-        fread(bytes, pos, 1, f);
-        fclose(f);
-
-        btOptimizedBvh* bhv = btOptimizedBvh::deSerializeInPlace(bytes, pos, !IS_LITTLE_ENDIAN);
-        if (bhv == NULL)
+        const uint64_t hash = getBvhHash(quantized);
+        char hash_string[17];
+        snprintf(hash_string, sizeof(hash_string), "%016llx",
+            (unsigned long long)hash);
+        const std::string cache_file = file_manager->getCachedDataDir() +
+            "track-bvh-" + hash_string + ".bin";
+        btOptimizedBvh* bvh = loadBvh(cache_file, hash);
+        if (bvh)
         {
-            Log::warn("TriangleMesh", "Failed to load serialized BHV");
-            bhv_triangle_mesh = new btBvhTriangleMeshShape(&m_mesh, false /* useQuantizedAabbCompression */);
+            bhv_triangle_mesh = new btBvhTriangleMeshShape(&m_mesh, quantized,
+                                                           /*buildBvh*/false);
+            bhv_triangle_mesh->setOptimizedBvh(bvh);
+            Log::info("TriangleMesh", "Loaded BVH of %d triangles in %d ms.",
+                (int)m_triangleIndex2Material.size(),
+                (int)(StkTime::getMonoTimeMs() - start));
         }
         else
         {
-            bhv_triangle_mesh = new btBvhTriangleMeshShape(&m_mesh, false /* useQuantizedAabbCompression */,
-                                                           false /* buildBvh */);
-            bhv_triangle_mesh->setOptimizedBvh( bhv );
+            bhv_triangle_mesh = new btBvhTriangleMeshShape(&m_mesh, quantized);
+            Log::info("TriangleMesh", "Built BVH of %d triangles in %d ms.",
+                (int)m_triangleIndex2Material.size(),
+                (int)(StkTime::getMonoTimeMs() - start));
+            saveBvh(cache_file, hash, bhv_triangle_mesh->getOptimizedBvh());
         }
-        // Do *NOT* free the bytes, 'deSerializeInPlace' makes the btOptimizedBvh object
-        // directly at this memory location
-        //free(bytes);
-
     }
     else
     {
-        bhv_triangle_mesh = new btBvhTriangleMeshShape(&m_mesh, false /* useQuantizedAabbCompression */);
-
-        /*
-         // code to serialize triangle mesh
-        btOptimizedBvh* bvh = bhv_triangle_mesh->getOptimizedBvh();
-        unsigned int ssize = bvh->calculateSerializeBufferSize();
-        char* buffer = (char*)btAlignedAlloc(ssize, 16);
-        bool success = bvh->serialize(buffer, ssize, !IS_LITTLE_ENDIAN);
-        printf("serialization success = %i\n", success);
-
-        std::ofstream fileout("/tmp/btOptimizedBvh");
-        fileout.write(buffer, ssize);
-        fileout.close();
-
-        btAlignedFree(buffer);
-         */
+        bhv_triangle_mesh = new btBvhTriangleMeshShape(&m_mesh, quantized);
     }
 
     m_collision_shape = bhv_triangle_mesh;
@@ -167,6 +195,140 @@ void TriangleMesh::createCollisionShape(bool create_collision_object, const char
 
 }   // createCollisionShape
 
+// ----------------------------------------------------------------------------
+/** Returns a hash (64-bit FNV-1a) of the triangles of this mesh, used to
+ *  detect if a cached BVH belongs to this mesh. The BVH only depends on the
+ *  points of the triangles (and their order), and on the layout of the
+ *  bullet data structures.
+ *  \param quantized If the BVH uses quantized AABB compression.
+ */
+uint64_t TriangleMesh::getBvhHash(bool quantized) const
+{
+    uint64_t hash = FNV_OFFSET_BASIS;
+    auto add = [&hash](const void* data, size_t size)
+    {
+        hash = addToHash(hash, data, size);
+    };
+    const uint32_t layout[] = { (uint32_t)sizeof(void*),
+        (uint32_t)sizeof(btScalar), (uint32_t)sizeof(btOptimizedBvh),
+        (uint32_t)quantized, (uint32_t)m_triangleIndex2Material.size() };
+    add(layout, sizeof(layout));
+    btVector3 p[3];
+    for (unsigned i = 0; i < m_triangleIndex2Material.size(); i++)
+    {
+        getTriangle(i, &p[0], &p[1], &p[2]);
+        // Only x, y and z, the 4th component is not used
+        for (unsigned j = 0; j < 3; j++)
+            add(p[j].m_floats, 3 * sizeof(btScalar));
+    }
+    return hash;
+}   // getBvhHash
+
+// ----------------------------------------------------------------------------
+/** Loads a BVH from a file written by saveBvh. The BVH is created in place
+ *  in m_bvh_memory, which is freed in removeAll. The file is only used if
+ *  the checksum of the serialized BVH matches, so that a damaged file can't
+ *  break the collision detection.
+ *  \param file_name Name of the cache file.
+ *  \param hash Hash of the triangles, which must match the one in the file.
+ *  \return The loaded BVH, or NULL if there is no valid cache file.
+ */
+btOptimizedBvh* TriangleMesh::loadBvh(const std::string &file_name,
+                                      uint64_t hash)
+{
+    FILE* fp = FileUtils::fopenU8Path(file_name, "rb");
+    if (!fp)
+        return NULL;
+
+    uint32_t version = 0, size = 0;
+    uint64_t file_hash = 0, checksum = 0;
+    bool ok = fread(&version, sizeof(version), 1, fp) == 1 &&
+              fread(&file_hash, sizeof(file_hash), 1, fp) == 1 &&
+              fread(&size, sizeof(size), 1, fp) == 1 &&
+              fread(&checksum, sizeof(checksum), 1, fp) == 1 &&
+              version == BVH_CACHE_VERSION && file_hash == hash &&
+              size >= sizeof(btOptimizedBvh);
+    void* bytes = NULL;
+    btOptimizedBvh* bvh = NULL;
+    if (ok)
+    {
+        bytes = btAlignedAlloc(size, 16);
+        ok = fread(bytes, size, 1, fp) == 1 &&
+             fgetc(fp) == EOF &&
+             addToHash(FNV_OFFSET_BASIS, bytes, size) == checksum;
+    }
+    fclose(fp);
+    if (ok)
+    {
+        // The cache is only used on this computer, so no endian swapping
+        bvh = btOptimizedBvh::deSerializeInPlace(bytes, size,
+                                                 /*swapEndian*/false);
+        ok = bvh != NULL;
+    }
+    if (!ok)
+    {
+        if (bytes)
+            btAlignedFree(bytes);
+        Log::warn("TriangleMesh", "Ignoring outdated or invalid cache file "
+            "'%s'.", file_name.c_str());
+        return NULL;
+    }
+    assert(!m_bvh_memory);
+    m_bvh_memory = bytes;
+    return bvh;
+}   // loadBvh
+
+// ----------------------------------------------------------------------------
+/** Saves a BVH, so it can be loaded the next time this mesh is used. The
+ *  file is written under a temporary name of this process first, so that no
+ *  other process can read a partially written file, and processes saving
+ *  the same BVH at the same time don't write to the same file.
+ *  \param file_name Name of the cache file.
+ *  \param hash Hash of the triangles.
+ *  \param bvh The BVH to save.
+ */
+void TriangleMesh::saveBvh(const std::string &file_name, uint64_t hash,
+                           const btOptimizedBvh *bvh) const
+{
+    const uint32_t size = bvh->calculateSerializeBufferSize();
+    void* buffer = btAlignedAlloc(size, 16);
+    if (!bvh->serialize(buffer, size, /*swapEndian*/false))
+    {
+        btAlignedFree(buffer);
+        Log::warn("TriangleMesh", "Can not serialize BVH.");
+        return;
+    }
+
+    const uint64_t checksum = addToHash(FNV_OFFSET_BASIS, buffer, size);
+    const std::string part_name = FileUtils::getTemporaryPath(file_name);
+    FILE* fp = FileUtils::fopenU8Path(part_name, "wb");
+    if (!fp)
+    {
+        btAlignedFree(buffer);
+        Log::warn("TriangleMesh", "Can not write cache file '%s'.",
+            part_name.c_str());
+        return;
+    }
+    bool ok = fwrite(&BVH_CACHE_VERSION, sizeof(uint32_t), 1, fp) == 1 &&
+              fwrite(&hash, sizeof(hash), 1, fp) == 1 &&
+              fwrite(&size, sizeof(size), 1, fp) == 1 &&
+              fwrite(&checksum, sizeof(checksum), 1, fp) == 1 &&
+              fwrite(buffer, size, 1, fp) == 1;
+    ok = fclose(fp) == 0 && ok;
+    btAlignedFree(buffer);
+#ifdef WIN32
+    // Rename does not replace an existing (outdated) file on windows
+    if (ok && file_manager->fileExists(file_name))
+        file_manager->removeFile(file_name);
+#endif
+    if (!ok || FileUtils::renameU8Path(part_name, file_name) != 0)
+    {
+        Log::warn("TriangleMesh", "Can not write cache file '%s'.",
+            file_name.c_str());
+        file_manager->removeFile(part_name);
+    }
+}   // saveBvh
+
 // -----------------------------------------------------------------------------
 /** Creates the physics body for this triangle mesh. If the body already
  *  exists (because it was created by a previous call to createBody)
@@ -178,16 +340,16 @@ void TriangleMesh::createCollisionShape(bool create_collision_object, const char
  *  for height of terrain detection).
  *  \param friction Friction to be used for this TriangleMesh.
  *  \param flags Additional collision flags (default 0).
- *  \param serializedBhv if non-NULL, the bhv is deserialized instead of
- *                       being calculated on the fly
+ *  \param use_bvh_cache If the BVH should be loaded from (and saved to) the
+ *         cache.
  */
 void TriangleMesh::createPhysicalBody(float friction,
                                       btCollisionObject::CollisionFlags flags,
-                                      const char* serializedBhv)
+                                      bool use_bvh_cache)
 {
     // We need the collision shape, but not the collision object (since
     // this will be created when the dynamics body is anyway).
-    createCollisionShape(/*create_collision_object*/false, serializedBhv);
+    createCollisionShape(/*create_collision_object*/false, use_bvh_cache);
     main_loop->renderGUI(5583);
 
     btTransform startTransform;
@@ -232,6 +394,13 @@ void TriangleMesh::removeAll()
     }
     delete m_collision_shape;
     m_collision_shape = NULL;
+    if (m_bvh_memory)
+    {
+        // The shape does not own a BVH loaded from the cache
+        ((btOptimizedBvh*)m_bvh_memory)->~btOptimizedBvh();
+        btAlignedFree(m_bvh_memory);
+        m_bvh_memory = NULL;
+    }
 }   // removeAll
 
 // -----------------------------------------------------------------------------
@@ -407,3 +576,685 @@ bool TriangleMesh::castRay(const btVector3 &from, const btVector3 &to,
     return ray_callback.hasHit();
 
 }   // castRay
+
+// ----------------------------------------------------------------------------
+namespace
+{
+    /** Maximum number of rays which traverse the BVH together. */
+    const int MAX_PACKET_SIZE = 64;
+
+    // ========================================================================
+    /** Stores the closest hit of one ray of TriangleMesh::castRays. The hits
+     *  are reported like by the callback of btCollisionWorld::rayTestSingle
+     *  into a ClosestRayResultCallback, so that the results are identical.
+     */
+    class BatchedRayCallback : public btTriangleRaycastCallback
+    {
+    public:
+        /** Rotation of the mesh, to get the normal in world space. */
+        const btMatrix3x3    *m_basis;
+        /** Where the closest hit is stored. */
+        TriangleMesh::RayHit *m_hit;
+        // --------------------------------------------------------------------
+        BatchedRayCallback() : btTriangleRaycastCallback(btVector3(0, 0, 0),
+                                                         btVector3(0, 0, 0))
+        {
+            m_basis = NULL;
+            m_hit   = NULL;
+        }   // BatchedRayCallback
+        // --------------------------------------------------------------------
+        virtual btScalar reportHit(const btVector3 &normal, btScalar fraction,
+                                   int part, int triangle_index)
+        {
+            m_hit->m_normal         = *m_basis * normal;
+            m_hit->m_fraction       = fraction;
+            m_hit->m_shape_part     = part;
+            m_hit->m_triangle_index = triangle_index;
+            return fraction;
+        }   // reportHit
+    };   // BatchedRayCallback
+
+    // ========================================================================
+    /** The rays of TriangleMesh::castRays which traverse the BVH together.
+     *  Each ray is tested against a node exactly like in
+     *  btQuantizedBvh::walkStacklessTreeAgainstRay (or
+     *  walkStacklessQuantizedTreeAgainstRay for a quantized BVH). On x86-64
+     *  four rays are tested at once with SSE, using the same floating point
+     *  operations as the scalar code of bullet (which is compiled to SSE on
+     *  x86-64 as well), so the results are the same.
+     */
+    struct RayPacket
+    {
+        int            m_num_rays;
+        btVector3      m_from[MAX_PACKET_SIZE];
+        btVector3      m_inv_dir[MAX_PACKET_SIZE];
+        btVector3      m_aabb_min[MAX_PACKET_SIZE];
+        btVector3      m_aabb_max[MAX_PACKET_SIZE];
+        unsigned int   m_sign[MAX_PACKET_SIZE][3];
+        btScalar       m_lambda_max[MAX_PACKET_SIZE];
+        unsigned short m_quantized_min[MAX_PACKET_SIZE][3];
+        unsigned short m_quantized_max[MAX_PACKET_SIZE][3];
+#ifdef SIMD_RAY_PACKET
+        // --------------------------------------------------------------------
+        /** Returns the index of the lowest set bit, mask must not be 0. */
+        static int lowestBit(uint64_t mask)
+        {
+#ifdef _MSC_VER
+            unsigned long index;
+            _BitScanForward64(&index, mask);
+            return (int)index;
+#else
+            return __builtin_ctzll(mask);
+#endif
+        }   // lowestBit
+        // --------------------------------------------------------------------
+        /** The same data as structure of arrays, the sign is stored as a
+         *  mask with all bits set for negative directions. */
+        float m_soa_from[3][MAX_PACKET_SIZE];
+        float m_soa_inv_dir[3][MAX_PACKET_SIZE];
+        float m_soa_sign[3][MAX_PACKET_SIZE];
+        float m_soa_aabb_min[3][MAX_PACKET_SIZE];
+        float m_soa_aabb_max[3][MAX_PACKET_SIZE];
+        float m_soa_lambda_max[MAX_PACKET_SIZE];
+#endif
+        // --------------------------------------------------------------------
+        /** Sets the data of one ray, see walkStacklessTreeAgainstRay.
+         *  \param i Index of the ray in the packet.
+         *  \param from, to The ray in the space of the mesh.
+         *  \param bvh The BVH, needed to quantize the ray.
+         */
+        void setRay(int i, const btVector3 &from, const btVector3 &to,
+                    const btOptimizedBvh *bvh)
+        {
+            m_from[i]     = from;
+            m_aabb_min[i] = from;
+            m_aabb_max[i] = from;
+            m_aabb_min[i].setMin(to);
+            m_aabb_max[i].setMax(to);
+            btVector3 dir = to - from;
+            dir.normalize();
+            m_lambda_max[i] = dir.dot(to - from);
+            for (int k = 0; k < 3; k++)
+            {
+                m_inv_dir[i][k] = dir[k] == btScalar(0.0) ?
+                    btScalar(BT_LARGE_FLOAT) : btScalar(1.0) / dir[k];
+                m_sign[i][k] = m_inv_dir[i][k] < 0.0;
+            }
+            if (bvh->isQuantized())
+            {
+                bvh->quantizeWithClamp(m_quantized_min[i], m_aabb_min[i], 0);
+                bvh->quantizeWithClamp(m_quantized_max[i], m_aabb_max[i], 1);
+            }
+#ifdef SIMD_RAY_PACKET
+            for (int k = 0; k < 3; k++)
+            {
+                m_soa_from[k][i]     = m_from[i][k];
+                m_soa_inv_dir[k][i]  = m_inv_dir[i][k];
+                m_soa_aabb_min[k][i] = m_aabb_min[i][k];
+                m_soa_aabb_max[k][i] = m_aabb_max[i][k];
+                const uint32_t sign = m_sign[i][k] ? 0xffffffff : 0;
+                memcpy(&m_soa_sign[k][i], &sign, sizeof(float));
+            }
+            m_soa_lambda_max[i] = m_lambda_max[i];
+#endif
+        }   // setRay
+        // --------------------------------------------------------------------
+        /** Sets the number of rays, and fills the unused rays of the last
+         *  group of four rays with zeros. */
+        void setNumRays(int num_rays)
+        {
+            m_num_rays = num_rays;
+#ifdef SIMD_RAY_PACKET
+            for (int i = num_rays; i < MAX_PACKET_SIZE && i % 4 != 0; i++)
+            {
+                for (int k = 0; k < 3; k++)
+                {
+                    m_soa_from[k][i] = m_soa_inv_dir[k][i] = 0.0f;
+                    m_soa_sign[k][i] = 0.0f;
+                    m_soa_aabb_min[k][i] = m_soa_aabb_max[k][i] = 0.0f;
+                }
+                m_soa_lambda_max[i] = 0.0f;
+            }
+#endif
+        }   // setNumRays
+        // --------------------------------------------------------------------
+        /** Tests which rays overlap a node of the BVH.
+         *  \param mask The rays to test (which overlap the parent node).
+         *  \param bounds Minimum and maximum of the node.
+         *  \param quantized_min, quantized_max Quantized bounds of the
+         *         node, or NULL if the BVH is not quantized.
+         *  \return The subset of mask of the rays which overlap the node.
+         */
+        uint64_t testNode(uint64_t mask, const btVector3 bounds[2],
+                          const unsigned short *quantized_min,
+                          const unsigned short *quantized_max) const
+        {
+            uint64_t result = 0;
+#ifdef SIMD_RAY_PACKET
+            const __m128 min_x = _mm_set1_ps(bounds[0].getX());
+            const __m128 min_y = _mm_set1_ps(bounds[0].getY());
+            const __m128 min_z = _mm_set1_ps(bounds[0].getZ());
+            const __m128 max_x = _mm_set1_ps(bounds[1].getX());
+            const __m128 max_y = _mm_set1_ps(bounds[1].getY());
+            const __m128 max_z = _mm_set1_ps(bounds[1].getZ());
+            while (mask != 0)
+            {
+                // Only test the groups of four rays with rays in the mask
+                const int g = lowestBit(mask) & ~3;
+                unsigned int lanes = (unsigned int)(mask >> g) & 15;
+                mask &= ~((uint64_t)15 << g);
+                if (quantized_min)
+                {
+                    for (int l = 0; l < 4; l++)
+                    {
+                        if ((lanes & (1 << l)) &&
+                            !testQuantizedAabbAgainstQuantizedAabb(
+                            m_quantized_min[g + l], m_quantized_max[g + l],
+                            quantized_min, quantized_max))
+                            lanes &= ~(1 << l);
+                    }
+                }
+                else
+                {
+                    // TestAabbAgainstAabb2
+                    __m128 out = _mm_or_ps(
+                        _mm_cmpgt_ps(_mm_loadu_ps(m_soa_aabb_min[0] + g), max_x),
+                        _mm_cmplt_ps(_mm_loadu_ps(m_soa_aabb_max[0] + g), min_x));
+                    out = _mm_or_ps(out, _mm_or_ps(
+                        _mm_cmpgt_ps(_mm_loadu_ps(m_soa_aabb_min[1] + g), max_y),
+                        _mm_cmplt_ps(_mm_loadu_ps(m_soa_aabb_max[1] + g), min_y)));
+                    out = _mm_or_ps(out, _mm_or_ps(
+                        _mm_cmpgt_ps(_mm_loadu_ps(m_soa_aabb_min[2] + g), max_z),
+                        _mm_cmplt_ps(_mm_loadu_ps(m_soa_aabb_max[2] + g), min_z)));
+                    lanes &= ~_mm_movemask_ps(out);
+                }
+                if (lanes == 0)
+                    continue;
+                // btRayAabb2, bounds[sign] is the near and bounds[1-sign]
+                // the far side of the node
+                __m128 sign = _mm_loadu_ps(m_soa_sign[0] + g);
+                __m128 from = _mm_loadu_ps(m_soa_from[0] + g);
+                __m128 inv_dir = _mm_loadu_ps(m_soa_inv_dir[0] + g);
+                __m128 tmin = _mm_mul_ps(_mm_sub_ps(
+                    SIMD_BLENDV_PS(min_x, max_x, sign), from), inv_dir);
+                __m128 tmax = _mm_mul_ps(_mm_sub_ps(
+                    SIMD_BLENDV_PS(max_x, min_x, sign), from), inv_dir);
+                sign = _mm_loadu_ps(m_soa_sign[1] + g);
+                from = _mm_loadu_ps(m_soa_from[1] + g);
+                inv_dir = _mm_loadu_ps(m_soa_inv_dir[1] + g);
+                __m128 t1 = _mm_mul_ps(_mm_sub_ps(
+                    SIMD_BLENDV_PS(min_y, max_y, sign), from), inv_dir);
+                __m128 t2 = _mm_mul_ps(_mm_sub_ps(
+                    SIMD_BLENDV_PS(max_y, min_y, sign), from), inv_dir);
+                __m128 out = _mm_or_ps(_mm_cmpgt_ps(tmin, t2),
+                                       _mm_cmpgt_ps(t1, tmax));
+                tmin = SIMD_BLENDV_PS(tmin, t1, _mm_cmpgt_ps(t1, tmin));
+                tmax = SIMD_BLENDV_PS(tmax, t2, _mm_cmplt_ps(t2, tmax));
+                sign = _mm_loadu_ps(m_soa_sign[2] + g);
+                from = _mm_loadu_ps(m_soa_from[2] + g);
+                inv_dir = _mm_loadu_ps(m_soa_inv_dir[2] + g);
+                t1 = _mm_mul_ps(_mm_sub_ps(
+                    SIMD_BLENDV_PS(min_z, max_z, sign), from), inv_dir);
+                t2 = _mm_mul_ps(_mm_sub_ps(
+                    SIMD_BLENDV_PS(max_z, min_z, sign), from), inv_dir);
+                out = _mm_or_ps(out, _mm_or_ps(_mm_cmpgt_ps(tmin, t2),
+                                               _mm_cmpgt_ps(t1, tmax)));
+                tmin = SIMD_BLENDV_PS(tmin, t1, _mm_cmpgt_ps(t1, tmin));
+                tmax = SIMD_BLENDV_PS(tmax, t2, _mm_cmplt_ps(t2, tmax));
+                __m128 in = _mm_and_ps(
+                    _mm_cmplt_ps(tmin, _mm_loadu_ps(m_soa_lambda_max + g)),
+                    _mm_cmpgt_ps(tmax, _mm_setzero_ps()));
+                lanes &= _mm_movemask_ps(_mm_andnot_ps(out, in));
+                result |= (uint64_t)lanes << g;
+            }
+#else
+            for (int i = 0; i < m_num_rays; i++)
+            {
+                if ((mask & ((uint64_t)1 << i)) == 0)
+                    continue;
+                const bool overlap = quantized_min ?
+                    testQuantizedAabbAgainstQuantizedAabb(m_quantized_min[i],
+                        m_quantized_max[i], quantized_min, quantized_max) != 0:
+                    TestAabbAgainstAabb2(m_aabb_min[i], m_aabb_max[i],
+                                         bounds[0], bounds[1]);
+                btScalar param = 1.0f;
+                if (overlap && btRayAabb2(m_from[i], m_inv_dir[i], m_sign[i],
+                                          bounds, param, 0.0f,
+                                          m_lambda_max[i]))
+                    result |= (uint64_t)1 << i;
+            }
+#endif
+            return result;
+        }   // testNode
+    };   // RayPacket
+
+}   // namespace
+
+// ----------------------------------------------------------------------------
+/** Casts a batch of rays against this mesh. The rays traverse the BVH
+ *  together, so each node is only loaded once for all rays, instead of once
+ *  per ray for a raycast of each ray. The hits are identical to the ones of
+ *  btCollisionWorld::rayTestSingle with a ClosestRayResultCallback for each
+ *  ray (the tests of a ray against the nodes and triangles are done in the
+ *  same order with the same computations).
+ *  \param num_rays Number of rays.
+ *  \param from, to Start and end points of the rays in world space.
+ *  \param hits On return the closest hit of each ray.
+ */
+void TriangleMesh::castRays(int num_rays, const btVector3 *from,
+                            const btVector3 *to, RayHit *hits) const
+{
+    for (int i = 0; i < num_rays; i++)
+    {
+        hits[i].m_fraction       = 1.0f;
+        hits[i].m_normal.setValue(0, 0, 0);
+        hits[i].m_triangle_index = -1;
+        hits[i].m_shape_part     = -1;
+    }
+    if (!m_collision_shape)
+        return;
+
+    btBvhTriangleMeshShape *shape = (btBvhTriangleMeshShape*)m_collision_shape;
+    const btOptimizedBvh *bvh = shape->getOptimizedBvh();
+    const btStridingMeshInterface *mesh = shape->getMeshInterface();
+    const btVector3 &scaling = mesh->getScaling();
+    const btTransform &world_trans = getCollisionObject()->getWorldTransform();
+    const btTransform world_to_object = world_trans.inverse();
+    const bool quantized = bvh->isQuantized();
+    const int num_nodes = bvh->getNumNodes();
+    // End of the subtree and the rays which overlap its root node
+    std::vector<std::pair<int, uint64_t> > stack;
+    // The vertices and indices of the last used part of the mesh, which are
+    // only locked once instead of for each triangle
+    const unsigned char *vertex_base = NULL, *index_base = NULL;
+    int num_verts, stride = 0, index_stride = 0, num_faces;
+    PHY_ScalarType type = PHY_FLOAT, indices_type = PHY_INTEGER;
+    int locked_part = -1;
+
+    RayPacket packet;
+    BatchedRayCallback callbacks[MAX_PACKET_SIZE];
+    for (int first = 0; first < num_rays; first += MAX_PACKET_SIZE)
+    {
+        const int n = std::min(num_rays - first, MAX_PACKET_SIZE);
+        for (int i = 0; i < n; i++)
+        {
+            const btVector3 from_local = world_to_object * from[first + i];
+            const btVector3 to_local = world_to_object * to[first + i];
+            packet.setRay(i, from_local, to_local, bvh);
+            callbacks[i].m_from        = from_local;
+            callbacks[i].m_to          = to_local;
+            callbacks[i].m_flags       = 0;
+            callbacks[i].m_hitFraction = 1.0f;
+            callbacks[i].m_basis       = &world_trans.getBasis();
+            callbacks[i].m_hit         = &hits[first + i];
+        }
+        packet.setNumRays(n);
+
+        const uint64_t all = n == MAX_PACKET_SIZE ? ~(uint64_t)0
+                                                  : ((uint64_t)1 << n) - 1;
+        int cur = 0;
+        while (cur < num_nodes)
+        {
+            while (!stack.empty() && cur >= stack.back().first)
+                stack.pop_back();
+            const uint64_t mask = stack.empty() ? all : stack.back().second;
+
+            btVector3 bounds[2];
+            uint64_t overlap;
+            int escape_index, part, triangle_index;
+            if (quantized)
+            {
+                const btQuantizedBvhNode &node =
+                    bvh->getQuantizedContiguousNodes()[cur];
+                bounds[0] = bvh->unQuantize(node.m_quantizedAabbMin);
+                bounds[1] = bvh->unQuantize(node.m_quantizedAabbMax);
+                overlap = packet.testNode(mask, bounds,
+                                          node.m_quantizedAabbMin,
+                                          node.m_quantizedAabbMax);
+                escape_index = node.isLeafNode() ? -1 : node.getEscapeIndex();
+                part = node.isLeafNode() ? node.getPartId() : 0;
+                triangle_index = node.isLeafNode() ? node.getTriangleIndex()
+                                                   : 0;
+            }
+            else
+            {
+                const btOptimizedBvhNode &node =
+                    bvh->getContiguousNodes()[cur];
+                bounds[0] = node.m_aabbMinOrg;
+                bounds[1] = node.m_aabbMaxOrg;
+                overlap = packet.testNode(mask, bounds, NULL, NULL);
+                escape_index = node.m_escapeIndex;
+                part = node.m_subPart;
+                triangle_index = node.m_triangleIndex;
+            }
+
+            if (escape_index == -1)
+            {
+                // Leaf node, see btBvhTriangleMeshShape::performRaycast
+                if (overlap)
+                {
+                    if (part != locked_part)
+                    {
+                        if (locked_part != -1)
+                            mesh->unLockReadOnlyVertexBase(locked_part);
+                        mesh->getLockedReadOnlyVertexIndexBase(&vertex_base,
+                            num_verts, type, stride, &index_base,
+                            index_stride, num_faces, indices_type, part);
+                        locked_part = part;
+                    }
+                    const unsigned int *gfx_base = (const unsigned int*)
+                        (index_base + triangle_index * index_stride);
+                    btVector3 triangle[3];
+                    for (int j = 2; j >= 0; j--)
+                    {
+                        const int index = indices_type == PHY_SHORT
+                                        ? ((const unsigned short*)gfx_base)[j]
+                                        : gfx_base[j];
+                        if (type == PHY_FLOAT)
+                        {
+                            const float *v =
+                                (const float*)(vertex_base + index * stride);
+                            triangle[j] = btVector3(v[0] * scaling.getX(),
+                                                    v[1] * scaling.getY(),
+                                                    v[2] * scaling.getZ());
+                        }
+                        else
+                        {
+                            const double *v =
+                                (const double*)(vertex_base + index * stride);
+                            triangle[j] =
+                                btVector3(btScalar(v[0]) * scaling.getX(),
+                                          btScalar(v[1]) * scaling.getY(),
+                                          btScalar(v[2]) * scaling.getZ());
+                        }
+                    }
+                    for (int i = 0; i < n; i++)
+                    {
+                        if (overlap & ((uint64_t)1 << i))
+                        {
+                            callbacks[i].processTriangle(triangle, part,
+                                                         triangle_index);
+                        }
+                    }
+                }
+                cur++;
+            }
+            else if (overlap)
+            {
+                stack.push_back(std::make_pair(cur + escape_index, overlap));
+                cur++;
+            }
+            else
+                cur += escape_index;
+        }   // while cur < num_nodes
+        stack.clear();
+    }   // for first < num_rays
+    if (locked_part != -1)
+        mesh->unLockReadOnlyVertexBase(locked_part);
+}   // castRays
+
+// ----------------------------------------------------------------------------
+/** Checks that a BVH loaded from the cache, a quantized BVH and batched
+ *  raycasts give the same hits as a newly built BVH, and that a damaged
+ *  cache file is not used.
+ *  \param repeat How often the wheel rays of 20 karts are cast.
+ *  \param print If the load and raycast times are printed.
+ */
+void TriangleMesh::testBvh(int repeat, bool print)
+{
+    // A bumpy grid, big enough that building the BVH takes measurable time
+    const int size = 200;
+    auto create_mesh = [size](bool use_bvh_cache)
+    {
+        TriangleMesh* tm = new TriangleMesh(/*can_be_transformed*/false);
+        auto height = [](int x, int z)
+        {
+            return sinf(x * 0.3f) * cosf(z * 0.2f) * 3.0f;
+        };
+        const btVector3 up(0, 1, 0);
+        for (int x = 0; x < size; x++)
+        {
+            for (int z = 0; z < size; z++)
+            {
+                btVector3 p00(x,     height(x,     z    ), z    );
+                btVector3 p10(x + 1, height(x + 1, z    ), z    );
+                btVector3 p01(x,     height(x,     z + 1), z + 1);
+                btVector3 p11(x + 1, height(x + 1, z + 1), z + 1);
+                tm->addTriangle(p00, p01, p10, up, up, up, NULL);
+                tm->addTriangle(p10, p01, p11, up, up, up, NULL);
+            }
+        }
+        tm->createCollisionShape(/*create_collision_object*/true,
+                                 use_bvh_cache);
+        return tm;
+    };
+    // Raycasts must give the same result with a loaded or quantized BVH
+    auto compare = [size](const TriangleMesh* tm, const TriangleMesh* ref)
+    {
+        for (int x = 0; x < size; x += 3)
+        {
+            for (int z = 0; z < size; z += 7)
+            {
+                const btVector3 from(x + 0.37f, 10.0f, z + 0.61f);
+                const btVector3 to(x + 0.37f, -10.0f, z + 0.61f);
+                btVector3 xyz, ref_xyz, normal, ref_normal;
+                const Material* m;
+                bool hit = tm->castRay(from, to, &xyz, &m, &normal);
+                bool ref_hit = ref->castRay(from, to, &ref_xyz, &m,
+                                            &ref_normal);
+                assert(hit && ref_hit);
+                assert(xyz == ref_xyz && normal == ref_normal);
+            }
+        }
+    };
+
+    // Batched rays must give the same hits as a raycast of each ray,
+    // including rays parallel to the axes, along the edges of triangles
+    // and rays which miss the mesh
+    auto compare_batched = [size, repeat, print](const TriangleMesh* tm)
+    {
+        class ClosestWithIndex
+            : public btCollisionWorld::ClosestRayResultCallback
+        {
+        public:
+            int m_index;
+            ClosestWithIndex(const btVector3 &from, const btVector3 &to)
+                : btCollisionWorld::ClosestRayResultCallback(from, to)
+            {
+                m_index = -1;
+            }
+            virtual btScalar addSingleResult(
+                btCollisionWorld::LocalRayResult& result, bool world_space)
+            {
+                m_index = result.m_localShapeInfo->m_triangleIndex;
+                return btCollisionWorld::ClosestRayResultCallback
+                    ::addSingleResult(result, world_space);
+            }
+        };   // ClosestWithIndex
+        btAlignedObjectArray<btVector3> from, to;
+        uint32_t seed = 12345;
+        auto random = [&seed](float max)
+        {
+            seed = seed * 1103515245 + 12345;
+            return (float)((seed >> 8) & 0xffff) / 65535.0f * max;
+        };
+        for (int i = 0; i < 1000; i++)
+        {
+            const float x = random((float)size), z = random((float)size);
+            switch (i % 4)
+            {
+            case 0:   // Short ray like the one of a wheel
+                from.push_back(btVector3(x, 3.5f, z));
+                to.push_back(btVector3(x + random(0.2f), -3.5f, z));
+                break;
+            case 1:   // Vertical ray on the edges of the triangles
+                from.push_back(btVector3(floorf(x), 10.0f, floorf(z)));
+                to.push_back(btVector3(floorf(x), -10.0f, floorf(z)));
+                break;
+            case 2:   // Long ray, which might miss the mesh
+                from.push_back(btVector3(x, random(10.0f) - 5.0f, z));
+                to.push_back(btVector3(random((float)size),
+                                       random(10.0f) - 5.0f,
+                                       random((float)size)));
+                break;
+            default:  // Horizontal ray
+                from.push_back(btVector3(x, random(6.0f) - 3.0f, z));
+                to.push_back(btVector3(x + 20.0f, from[i].getY(), z));
+                break;
+            }
+        }
+        const int n = from.size();
+        btAlignedObjectArray<RayHit> hits;
+        hits.resize(n);
+        tm->castRays(n, &from[0], &to[0], &hits[0]);
+
+        btTransform identity;
+        identity.setIdentity();
+        const btCollisionObject* object = tm->getCollisionObject();
+        int num_hits = 0;
+        for (int i = 0; i < n; i++)
+        {
+            btTransform trans_from(identity), trans_to(identity);
+            trans_from.setOrigin(from[i]);
+            trans_to.setOrigin(to[i]);
+            ClosestWithIndex callback(from[i], to[i]);
+            btCollisionWorld::rayTestSingle(trans_from, trans_to,
+                (btCollisionObject*)object, tm->m_collision_shape,
+                object->getWorldTransform(), callback);
+            assert(hits[i].m_fraction == callback.m_closestHitFraction);
+            assert(hits[i].m_triangle_index == callback.m_index);
+            if (callback.hasHit())
+            {
+                assert(hits[i].m_normal == callback.m_hitNormalWorld);
+                num_hits++;
+            }
+        }
+        assert(num_hits > n / 2 && num_hits < n);
+
+        // Compare the time of casting the wheel rays of 20 karts
+        btAlignedObjectArray<btVector3> wheel_from, wheel_to;
+        for (int kart = 0; kart < 20; kart++)
+        {
+            const float x = random((float)size - 2.0f) + 1.0f;
+            const float z = random((float)size - 2.0f) + 1.0f;
+            for (int wheel = 0; wheel < 4; wheel++)
+            {
+                const float dx = wheel % 2 ? 0.4f : -0.4f;
+                const float dz = wheel / 2 ? 0.6f : -0.6f;
+                wheel_from.push_back(btVector3(x + dx, 3.5f, z + dz));
+                wheel_to.push_back(btVector3(x + dx, -3.5f, z + dz));
+            }
+        }
+        const int num_wheel_rays = wheel_from.size();
+        double s = StkTime::getRealTime();
+        for (int r = 0; r < repeat; r++)
+        {
+            for (int i = 0; i < num_wheel_rays; i++)
+            {
+                btTransform trans_from(identity), trans_to(identity);
+                trans_from.setOrigin(wheel_from[i]);
+                trans_to.setOrigin(wheel_to[i]);
+                ClosestWithIndex callback(wheel_from[i], wheel_to[i]);
+                btCollisionWorld::rayTestSingle(trans_from, trans_to,
+                    (btCollisionObject*)object, tm->m_collision_shape,
+                    object->getWorldTransform(), callback);
+            }
+        }
+        double e = StkTime::getRealTime();
+        if (print)
+        {
+            Log::info("TriangleMesh", "%d single raycasts  %lf",
+                      num_wheel_rays, (e - s) / repeat);
+        }
+        s = StkTime::getRealTime();
+        for (int r = 0; r < repeat; r++)
+        {
+            tm->castRays(num_wheel_rays, &wheel_from[0], &wheel_to[0],
+                         &hits[0]);
+        }
+        e = StkTime::getRealTime();
+        if (print)
+        {
+            Log::info("TriangleMesh", "%d batched raycasts %lf",
+                      num_wheel_rays, (e - s) / repeat);
+        }
+    };
+
+    const bool quantized = stk_config->m_quantized_bvh;
+    TriangleMesh* ref = NULL;
+    for (bool q : { false, true })
+    {
+        stk_config->m_quantized_bvh = q;
+        // Make sure the first load is a cold one
+        TriangleMesh* cold = create_mesh(/*use_bvh_cache*/false);
+        char hash_string[17];
+        snprintf(hash_string, sizeof(hash_string), "%016llx",
+            (unsigned long long)cold->getBvhHash(q));
+        const std::string cache_file = file_manager->getCachedDataDir() +
+            "track-bvh-" + hash_string + ".bin";
+        file_manager->removeFile(cache_file);
+        if (!ref)
+            ref = cold;
+        else
+            delete cold;
+
+        double s = StkTime::getRealTime();
+        cold = create_mesh(/*use_bvh_cache*/true);
+        double e = StkTime::getRealTime();
+        if (print)
+        {
+            Log::info("TriangleMesh", "Cold load%s  %lf",
+                      q ? " (quantized)" : "", e - s);
+        }
+        assert(!cold->m_bvh_memory);
+        assert(file_manager->fileExists(cache_file));
+
+        s = StkTime::getRealTime();
+        TriangleMesh* warm = create_mesh(/*use_bvh_cache*/true);
+        e = StkTime::getRealTime();
+        if (print)
+        {
+            Log::info("TriangleMesh", "Warm load%s  %lf",
+                      q ? " (quantized)" : "", e - s);
+        }
+        assert(warm->m_bvh_memory);
+        btBvhTriangleMeshShape* shape =
+            (btBvhTriangleMeshShape*)warm->m_collision_shape;
+        assert(shape->getOptimizedBvh()->isQuantized() == q);
+
+        compare(cold, ref);
+        compare(warm, ref);
+        compare_batched(warm);
+        delete cold;
+        delete warm;
+
+        // A cache file with a damaged BVH is not used
+        FILE* fp = FileUtils::fopenU8Path(cache_file, "r+b");
+        assert(fp);
+        const long last = fseek(fp, -1, SEEK_END) == 0 ? ftell(fp) : -1;
+        const int c = fgetc(fp);
+        assert(last > 0 && c != EOF);
+        fseek(fp, last, SEEK_SET);
+        fputc(c ^ 0x5a, fp);
+        fclose(fp);
+        TriangleMesh* damaged = create_mesh(/*use_bvh_cache*/true);
+        assert(!damaged->m_bvh_memory);
+        compare(damaged, ref);
+        delete damaged;
+        file_manager->removeFile(cache_file);
+    }
+    delete ref;
+    stk_config->m_quantized_bvh = quantized;
+}   // testBvh
+
+// ----------------------------------------------------------------------------
+void TriangleMesh::unitTesting()
+{
+    testBvh(1, /*print*/false);
+}   // unitTesting
+
+// ----------------------------------------------------------------------------
+void TriangleMesh::benchmark()
+{
+    testBvh(1000, /*print*/true);
+}   // benchmark
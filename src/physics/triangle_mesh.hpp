@@ -19,6 +19,7 @@
 #ifndef HEADER_TRIANGLE_MESH_HPP
 #define HEADER_TRIANGLE_MESH_HPP
 
+#include <string>
 #include <vector>
 #include "btBulletDynamicsCommon.h"
 
@@ -46,6 +47,11 @@ private:
     btDefaultMotionState        *m_motion_state;
     btCollisionShape            *m_collision_shape;
 
+    /** Memory of a BVH loaded from the cache, the btOptimizedBvh is created
+     *  in place in it and must be freed together with the collision shape.
+     *  NULL if the BVH was built (and is owned by the collision shape). */
+    void                        *m_bvh_memory;
+
     /** The three normals for each triangle. */
     AlignedArray<btVector3>      m_normals;
 
@@ -57,7 +63,26 @@ private:
      *  to the current transform of the body. */
     bool m_can_be_transformed;
 
+    uint64_t getBvhHash(bool quantized) const;
+    btOptimizedBvh* loadBvh(const std::string &file_name, uint64_t hash);
+    void saveBvh(const std::string &file_name, uint64_t hash,
+                 const btOptimizedBvh *bvh) const;
+    static void testBvh(int repeat, bool print);
+
 public:
+    /** The result of one ray cast with castRays. */
+    struct RayHit
+    {
+        /** Fraction of the ray at the closest hit, 1 if nothing was hit. */
+        btScalar  m_fraction;
+        /** Normal of the hit triangle in world space. */
+        btVector3 m_normal;
+        /** Index of the hit triangle, or -1 if nothing was hit. */
+        int       m_triangle_index;
+        /** Part of the mesh of the hit triangle. */
+        int       m_shape_part;
+    };   // RayHit
+
     class RigidBodyTriangleMesh : public btRigidBody
     {
     public:
@@ -76,15 +101,18 @@ public:
                      const btVector3 &t3, const btVector3 &n1,
                      const btVector3 &n2, const btVector3 &n3,
                      const Material* m);
-    void createCollisionShape(bool create_collision_object=true, const char* serialized_bhv=NULL);
+    void createCollisionShape(bool create_collision_object=true,
+                              bool use_bvh_cache=false);
     void createPhysicalBody(float friction,
                             btCollisionObject::CollisionFlags flags=
                                (btCollisionObject::CollisionFlags)0,
-                            const char* serializedBhv = NULL);
+                            bool use_bvh_cache=false);
     void removeAll();
     void removeCollisionObject();
     btVector3 getInterpolatedNormal(unsigned int index,
                                     const btVector3 &position) const;
+    static void unitTesting();
+    static void benchmark();
     // ------------------------------------------------------------------------
     /** In case of physical objects of shape 'exact', the physical body is
      *  created outside of the mesh. Since raycasts need the body's world
@@ -112,6 +140,14 @@ public:
     bool castRay(const btVector3 &from, const btVector3 &to,
                  btVector3 *xyz, const Material **material,
                  btVector3 *normal=NULL, bool interpolate_normal=false) const;
+    void castRays(int num_rays, const btVector3 *from, const btVector3 *to,
+                  RayHit *hits) const;
+    // ------------------------------------------------------------------------
+    /** Returns the collision object (or the rigid body) of this mesh. */
+    const btCollisionObject *getCollisionObject() const
+    {
+        return m_collision_object ? m_collision_object : m_body;
+    }   // getCollisionObject
     // ------------------------------------------------------------------------
     /** Returns the points of the 'indx' triangle.
      *  \param indx Index of the triangle to get.
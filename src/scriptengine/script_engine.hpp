@@ -73,6 +73,12 @@ namespace Scripting
         void runFunction(bool warn_if_not_found, std::string function_name,
             std::function<void(asIScriptContext*)> callback,
             std::function<void(asIScriptContext*)> get_return_value);
+        asIScriptFunction* getFunction(bool warn_if_not_found,
+                                       const std::string &function_name);
+        void executeFunction(asIScriptFunction *func,
+            const std::function<void(asIScriptContext*)> &callback,
+            const std::function<void(asIScriptContext*)> &get_return_value =
+                std::function<void(asIScriptContext*)>());
         void runDelegate(asIScriptFunction* delegate_fn);
         void evalScript(std::string script_fragment);
         void cleanupCache();
@@ -86,7 +92,11 @@ namespace Scripting
 
         asIScriptEngine* getEngine() { return m_engine; }
 
+        static void unitTesting();
+        static void benchmark();
+
     private:
+        static void testCollisionCallbacks(int repeat, bool print);
         asIScriptEngine *m_engine;
         std::map<std::string, asIScriptFunction*> m_functions_cache;
         PtrVector<PendingTimeout> m_pending_timeouts;
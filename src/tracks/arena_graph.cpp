@@ -25,20 +25,40 @@
 #include "tracks/arena_node.hpp"
 #include "tracks/track.hpp"
 #include "tracks/track_manager.hpp"
+#include "utils/file_utils.hpp"
 #include "utils/log.hpp"
+#include "utils/thread_pool.hpp"
 
 #include <algorithm>
+#include <cstdio>
 #include <queue>
 
+/** Version of the cached shortest paths files. Must be increased whenever
+ *  the file format or the computation of the shortest paths changes. */
+static const uint32_t SHORTEST_PATHS_VERSION = 1;
+
 // -----------------------------------------------------------------------------
 ArenaGraph::ArenaGraph(const std::string &navmesh, const XMLNode *node)
           : Graph()
 {
     loadNavmesh(navmesh);
+    createSpatialIndex();
     buildGraph();
-    // Compute shortest distance from all nodes
-    for (unsigned int i = 0; i < getNumNodes(); i++)
-        computeDijkstra(i);
+    // Computing the shortest paths between all nodes takes a while on big
+    // arenas, so the result is cached using a hash of the navmesh file
+    const uint64_t hash = getNavmeshHash(navmesh);
+    char hash_string[17];
+    snprintf(hash_string, sizeof(hash_string), "%016llx",
+        (unsigned long long)hash);
+    const std::string cache_file = file_manager->getCachedDataDir() +
+        "arena-graph-" + hash_string + ".bin";
+    if (!loadShortestPaths(cache_file, hash))
+    {
+        // Compute shortest distance from all nodes
+        computeAllDijkstra(std::min(ThreadPool::getDefaultNumThreads(),
+                                    getNumNodes() / 64 + 1));
+        saveShortestPaths(cache_file, hash);
+    }
 
     setNearbyNodesOfAllNodes();
     if (node && race_manager->getMinorMode() == RaceManager::MINOR_MODE_SOCCER)
@@ -179,8 +199,7 @@ void ArenaGraph::buildGraph()
 {
     const unsigned int n_nodes = getNumNodes();
 
-    m_distance_matrix = std::vector<std::vector<float>>
-        (n_nodes, std::vector<float>(n_nodes, 9999.9f));
+    m_distance_matrix.assign(n_nodes * n_nodes, 9999.9f);
     for (unsigned int i = 0; i < n_nodes; i++)
     {
         ArenaNode* cur_node = getNode(i);
@@ -188,22 +207,21 @@ void ArenaGraph::buildGraph()
         {
             Vec3 diff = getNode(adjacent)->getCenter() - cur_node->getCenter();
             float distance = diff.length();
-            m_distance_matrix[i][adjacent] = distance;
+            m_distance_matrix[i * n_nodes + adjacent] = distance;
         }
-        m_distance_matrix[i][i] = 0.0f;
+        m_distance_matrix[i * n_nodes + i] = 0.0f;
     }
 
     // Allocate and initialise the previous node data structure:
-    m_parent_node = std::vector<std::vector<int16_t>>
-        (n_nodes, std::vector<int16_t>(n_nodes, Graph::UNKNOWN_SECTOR));
+    m_parent_node.assign(n_nodes * n_nodes, Graph::UNKNOWN_SECTOR);
     for (unsigned int i = 0; i < n_nodes; i++)
     {
         for (unsigned int j = 0; j < n_nodes; j++)
         {
-            if (i == j || m_distance_matrix[i][j] >= 9899.9f)
-                m_parent_node[i][j] = -1;
+            if (i == j || m_distance_matrix[i * n_nodes + j] >= 9899.9f)
+                m_parent_node[i * n_nodes + j] = -1;
             else
-                m_parent_node[i][j] = i;
+                m_parent_node[i * n_nodes + j] = i;
         }   // for j
     }   // for i
 
@@ -216,6 +234,8 @@ void ArenaGraph::buildGraph()
  *  source to j and m_parent_node[source][j] stores the last vertex visited on
  *  the shortest path from i to j before visiting j. Suppose the shortest path
  *  from i to j is i->......->k->j  then m_parent_node[i][j] = k
+ *  Only the row of 'source' in both matrices is modified, so this can be
+ *  called for several sources at the same time.
  */
 void ArenaGraph::computeDijkstra(int source)
 {
@@ -235,6 +255,8 @@ void ArenaGraph::computeDijkstra(int source)
     IndDistPair begin(source, 0.0f);
     queue.push(begin);
     const unsigned int n = getNumNodes();
+    float* distance = &m_distance_matrix[source * n];
+    int16_t* parent = &m_parent_node[source * n];
     std::vector<bool> visited;
     visited.resize(n, false);
     while (!queue.empty())
@@ -246,17 +268,21 @@ void ArenaGraph::computeDijkstra(int source)
         if (visited[cur_index]) continue;
         visited[cur_index] = true;
 
-        for (const int& adjacent : getNode(cur_index)->getAdjacentNodes())
+        ArenaNode* cur_node = getNode(cur_index);
+        for (const int& adjacent : cur_node->getAdjacentNodes())
         {
             // Distance already computed, can be ignored
             if (visited[adjacent]) continue;
 
-            float new_dist =
-                current.second + m_distance_matrix[cur_index][adjacent];
-            if (new_dist < m_distance_matrix[source][adjacent])
+            // The length of the edge is computed the same way as in
+            // buildGraph, the row of cur_index might already contain
+            // shortest distances (or be in the middle of being computed)
+            Vec3 diff = getNode(adjacent)->getCenter() - cur_node->getCenter();
+            float new_dist = current.second + diff.length();
+            if (new_dist < distance[adjacent])
             {
-                m_distance_matrix[source][adjacent] = new_dist;
-                m_parent_node[source][adjacent] = cur_index;
+                distance[adjacent] = new_dist;
+                parent[adjacent] = cur_index;
             }
             IndDistPair pair(adjacent, new_dist);
             queue.push(pair);
@@ -264,6 +290,20 @@ void ArenaGraph::computeDijkstra(int source)
     }
 }   // computeDijkstra
 
+// ----------------------------------------------------------------------------
+/** Computes the shortest paths from all nodes, using Dijkstra for each node.
+ *  The result does not depend on the number of threads.
+ *  \param num_threads Number of threads to use.
+ */
+void ArenaGraph::computeAllDijkstra(unsigned int num_threads)
+{
+    ThreadPool pool(num_threads);
+    pool.parallelFor(getNumNodes(), [this](unsigned int i)
+        {
+            computeDijkstra(i);
+        });
+}   // computeAllDijkstra
+
 // ----------------------------------------------------------------------------
 /** THIS FUNCTION IS ONLY USED FOR UNIT-TESTING, to verify that the new
  *  Dijkstra algorithm gives the same results.
@@ -284,12 +324,12 @@ void ArenaGraph::computeFloydWarshall()
         {
             for (unsigned int j = 0; j < n; j++)
             {
-                if ((m_distance_matrix[i][k] + m_distance_matrix[k][j]) <
-                    m_distance_matrix[i][j])
+                if ((m_distance_matrix[i * n + k] + m_distance_matrix[k * n + j]) <
+                    m_distance_matrix[i * n + j])
                 {
-                    m_distance_matrix[i][j] =
-                        m_distance_matrix[i][k] + m_distance_matrix[k][j];
-                    m_parent_node[i][j] = m_parent_node[k][j];
+                    m_distance_matrix[i * n + j] =
+                        m_distance_matrix[i * n + k] + m_distance_matrix[k * n + j];
+                    m_parent_node[i * n + j] = m_parent_node[k * n + j];
                 }
             }
         }
@@ -297,6 +337,114 @@ void ArenaGraph::computeFloydWarshall()
 
 }   // computeFloydWarshall
 
+// ----------------------------------------------------------------------------
+/** Returns a hash (64-bit FNV-1a) of the content of the navmesh file, used
+ *  to detect if cached shortest paths belong to this navmesh.
+ */
+uint64_t ArenaGraph::getNavmeshHash(const std::string &navmesh)
+{
+    uint64_t hash = 14695981039346656037ULL;
+    FILE* fp = FileUtils::fopenU8Path(navmesh, "rb");
+    if (!fp)
+        return hash;
+    unsigned char buffer[4096];
+    size_t count;
+    while ((count = fread(buffer, 1, sizeof(buffer), fp)) > 0)
+    {
+        for (size_t i = 0; i < count; i++)
+        {
+            hash ^= buffer[i];
+            hash *= 1099511628211ULL;
+        }
+    }
+    fclose(fp);
+    return hash;
+}   // getNavmeshHash
+
+// ----------------------------------------------------------------------------
+/** Loads the shortest paths from a file written by saveShortestPaths.
+ *  \param file_name Name of the cache file.
+ *  \param hash Hash of the navmesh, which must match the one in the file.
+ *  \return True if the shortest paths were loaded.
+ */
+bool ArenaGraph::loadShortestPaths(const std::string &file_name,
+                                   uint64_t hash)
+{
+    FILE* fp = FileUtils::fopenU8Path(file_name, "rb");
+    if (!fp)
+        return false;
+
+    const uint32_t n = getNumNodes();
+    uint32_t version = 0, num_nodes = 0;
+    uint64_t file_hash = 0;
+    bool ok = fread(&version, sizeof(version), 1, fp) == 1 &&
+              fread(&file_hash, sizeof(file_hash), 1, fp) == 1 &&
+              fread(&num_nodes, sizeof(num_nodes), 1, fp) == 1 &&
+              version == SHORTEST_PATHS_VERSION && file_hash == hash &&
+              num_nodes == n;
+    std::vector<float> distance_matrix;
+    std::vector<int16_t> parent_node;
+    if (ok)
+    {
+        const size_t size = (size_t)n * n;
+        distance_matrix.resize(size);
+        parent_node.resize(size);
+        ok = fread(distance_matrix.data(), sizeof(float), size, fp) == size &&
+             fread(parent_node.data(), sizeof(int16_t), size, fp) == size;
+    }
+    fclose(fp);
+    if (!ok)
+    {
+        Log::warn("ArenaGraph", "Ignoring outdated or invalid cache file "
+            "'%s'.", file_name.c_str());
+        return false;
+    }
+    m_distance_matrix.swap(distance_matrix);
+    m_parent_node.swap(parent_node);
+    return true;
+}   // loadShortestPaths
+
+// ----------------------------------------------------------------------------
+/** Saves the shortest paths, so they can be loaded the next time this arena
+ *  is used. The file is written under a temporary name of this process
+ *  first, so that no other process can read a partially written file, and
+ *  processes saving the same arena at the same time don't write to the same
+ *  file.
+ *  \param file_name Name of the cache file.
+ *  \param hash Hash of the navmesh.
+ */
+void ArenaGraph::saveShortestPaths(const std::string &file_name,
+                                   uint64_t hash) const
+{
+    const std::string part_name = FileUtils::getTemporaryPath(file_name);
+    FILE* fp = FileUtils::fopenU8Path(part_name, "wb");
+    if (!fp)
+    {
+        Log::warn("ArenaGraph", "Can not write cache file '%s'.",
+            part_name.c_str());
+        return;
+    }
+    const uint32_t n = getNumNodes();
+    const size_t size = (size_t)n * n;
+    bool ok = fwrite(&SHORTEST_PATHS_VERSION, sizeof(uint32_t), 1, fp) == 1 &&
+              fwrite(&hash, sizeof(hash), 1, fp) == 1 &&
+              fwrite(&n, sizeof(n), 1, fp) == 1 &&
+              fwrite(m_distance_matrix.data(), sizeof(float), size, fp) == size &&
+              fwrite(m_parent_node.data(), sizeof(int16_t), size, fp) == size;
+    ok = fclose(fp) == 0 && ok;
+#ifdef WIN32
+    // Rename does not replace an existing (outdated) file on windows
+    if (ok && file_manager->fileExists(file_name))
+        file_manager->removeFile(file_name);
+#endif
+    if (!ok || FileUtils::renameU8Path(part_name, file_name) != 0)
+    {
+        Log::warn("ArenaGraph", "Can not write cache file '%s'.",
+            file_name.c_str());
+        file_manager->removeFile(part_name);
+    }
+}   // saveShortestPaths
+
 // -----------------------------------------------------------------------------
 void ArenaGraph::loadGoalNodes(const XMLNode *node)
 {
@@ -341,7 +489,8 @@ void ArenaGraph::setNearbyNodesOfAllNodes()
         // Get the distance to all nodes at i
         ArenaNode* cur_node = getNode(i);
         std::vector<int> nearby_nodes;
-        std::vector<float> dist = m_distance_matrix[i];
+        std::vector<float> dist(m_distance_matrix.begin() + i * getNumNodes(),
+            m_distance_matrix.begin() + (i + 1) * getNumNodes());
 
         // Skip the same node
         dist[i] = 999999.0f;
@@ -363,13 +512,13 @@ void ArenaGraph::setNearbyNodesOfAllNodes()
  *  std::vector (in reverse order). Used only for unit testing.
  */
 std::vector<int16_t> ArenaGraph::getPathFromTo(int from, int to,
-                      const std::vector< std::vector< int16_t > >& parent_node)
+                                const std::vector<int16_t>& parent_node) const
 {
     std::vector<int16_t> path;
     path.push_back(to);
     while(from!=to)
     {
-        to = parent_node[from][to];
+        to = parent_node[from * getNumNodes() + to];
         path.push_back(to);
     }
     return path;
@@ -390,11 +539,35 @@ void ArenaGraph::unitTesting()
     double s = StkTime::getRealTime();
     ArenaGraph* ag = new ArenaGraph(navmesh_file_name);
     double e = StkTime::getRealTime();
+    Log::error("Time", "Load           %lf", e-s);
+
+    // The shortest paths must not depend on the number of threads, and the
+    // cached result (which ag might have loaded) must be identical
+    std::vector<float> cached_distance_matrix = ag->m_distance_matrix;
+    std::vector<int16_t> cached_parent_node = ag->m_parent_node;
+    ag->buildGraph();
+    s = StkTime::getRealTime();
+    ag->computeAllDijkstra(1);
+    e = StkTime::getRealTime();
     Log::error("Time", "Dijkstra       %lf", e-s);
 
     // Save the Dijkstra results
-    std::vector< std::vector< float > > distance_matrix = ag->m_distance_matrix;
-    std::vector< std::vector< int16_t > > parent_node = ag->m_parent_node;
+    std::vector<float> distance_matrix = ag->m_distance_matrix;
+    std::vector<int16_t> parent_node = ag->m_parent_node;
+    ag->buildGraph();
+    ag->computeAllDijkstra(4);
+    if (ag->m_distance_matrix != distance_matrix ||
+        ag->m_parent_node != parent_node)
+    {
+        Log::fatal("ArenaGraph", "Dijkstra with 4 threads gives different "
+            "results.");
+    }
+    if (cached_distance_matrix != distance_matrix ||
+        cached_parent_node != parent_node)
+    {
+        Log::fatal("ArenaGraph", "Shortest paths of the arena graph are "
+            "different from the ones computed.");
+    }
     ag->buildGraph();
 
     // Now compute results with Floyd-Warshall
@@ -404,15 +577,16 @@ void ArenaGraph::unitTesting()
     Log::error("Time", "Floyd-Warshall %lf", e-s);
 
     int error_count = 0;
-    for(unsigned int i=0; i<ag->m_distance_matrix.size(); i++)
+    const unsigned int n = ag->getNumNodes();
+    for(unsigned int i=0; i<n; i++)
     {
-        for(unsigned int j=0; j<ag->m_distance_matrix[i].size(); j++)
+        for(unsigned int j=0; j<n; j++)
         {
-            if(ag->m_distance_matrix[i][j] - distance_matrix[i][j] > 0.001f)
+            if(ag->m_distance_matrix[i*n+j] - distance_matrix[i*n+j] > 0.001f)
             {
                 Log::error("ArenaGraph",
                            "Incorrect distance %d, %d: Dijkstra: %f F.W.: %f",
-                           i, j, distance_matrix[i][j], ag->m_distance_matrix[i][j]);
+                           i, j, distance_matrix[i*n+j], ag->m_distance_matrix[i*n+j]);
                 error_count++;
             }    // if distance is too different
 
@@ -424,16 +598,16 @@ void ArenaGraph::unitTesting()
             // debugging in the feature
 #undef TEST_PARENT_POLY_EVEN_THOUGH_MANY_FALSE_POSITIVES
 #ifdef TEST_PARENT_POLY_EVEN_THOUGH_MANY_FALSE_POSITIVES
-            if(ag->m_parent_node[i][j] != parent_node[i][j])
+            if(ag->m_parent_node[i*n+j] != parent_node[i*n+j])
             {
                 error_count++;
-                std::vector<int16_t> dijkstra_path = getPathFromTo(i, j, parent_node);
-                std::vector<int16_t> floyd_path = getPathFromTo(i, j, ag->m_parent_node);
+                std::vector<int16_t> dijkstra_path = ag->getPathFromTo(i, j, parent_node);
+                std::vector<int16_t> floyd_path = ag->getPathFromTo(i, j, ag->m_parent_node);
                 if(dijkstra_path.size()!=floyd_path.size())
                 {
                     Log::error("ArenaGraph",
                                "Incorrect path length %d, %d: Dijkstra: %d F.W.: %d",
-                               i, j, parent_node[i][j], ag->m_parent_node[i][j]);
+                               i, j, parent_node[i*n+j], ag->m_parent_node[i*n+j]);
                     continue;
                 }
                 Log::error("ArenaGraph", "Path problems from %d to %d:",
@@ -34,11 +34,14 @@ class XMLNode;
 class ArenaGraph : public Graph
 {
 private:
-    /** The actual graph data structure, it is an adjacency matrix. */
-    std::vector<std::vector<float>> m_distance_matrix;
+    /** The actual graph data structure, it is an adjacency matrix. After
+     *  the shortest paths are computed, element i*n+j (with n being the
+     *  number of nodes) is the shortest distance from i to j. */
+    std::vector<float> m_distance_matrix;
 
-    /** The matrix that is used to store computed shortest paths. */
-    std::vector<std::vector<int16_t>> m_parent_node;
+    /** The matrix that is used to store computed shortest paths, element
+     *  i*n+j is the last node before j on the shortest path from i to j. */
+    std::vector<int16_t> m_parent_node;
 
     /** Used in soccer mode to colorize the goal lines in minimap. */
     std::set<int> m_red_node;
@@ -56,10 +59,18 @@ private:
     // ------------------------------------------------------------------------
     void computeDijkstra(int n);
     // ------------------------------------------------------------------------
+    void computeAllDijkstra(unsigned int num_threads);
+    // ------------------------------------------------------------------------
     void computeFloydWarshall();
     // ------------------------------------------------------------------------
-    static std::vector<int16_t> getPathFromTo(int from, int to,
-                     const std::vector< std::vector< int16_t > >& parent_node);
+    bool loadShortestPaths(const std::string &file_name, uint64_t hash);
+    // ------------------------------------------------------------------------
+    void saveShortestPaths(const std::string &file_name, uint64_t hash) const;
+    // ------------------------------------------------------------------------
+    static uint64_t getNavmeshHash(const std::string &navmesh);
+    // ------------------------------------------------------------------------
+    std::vector<int16_t> getPathFromTo(int from, int to,
+                               const std::vector<int16_t>& parent_node) const;
     // ------------------------------------------------------------------------
     virtual bool hasLapLine() const OVERRIDE                  { return false; }
     // ------------------------------------------------------------------------
@@ -84,7 +95,7 @@ public:
     {
         if (i == Graph::UNKNOWN_SECTOR || j == Graph::UNKNOWN_SECTOR)
             return Graph::UNKNOWN_SECTOR;
-        return (int)(m_parent_node[j][i]);
+        return (int)(m_parent_node[j * m_all_nodes.size() + i]);
     }
     // ------------------------------------------------------------------------
     /** Returns the distance between any two nodes */
@@ -92,7 +103,7 @@ public:
     {
         if (from == Graph::UNKNOWN_SECTOR || to == Graph::UNKNOWN_SECTOR)
             return 99999.0f;
-        return m_distance_matrix[from][to];
+        return m_distance_matrix[from * m_all_nodes.size() + to];
     }
 
 };   // ArenaGraph
@@ -68,12 +68,16 @@ public:
     // ------------------------------------------------------------------------
     bool pointInside(const Vec3& p, bool ignore_vertical = false) const
     {
-        float side = p.sideofPlane(m_box_faces[0][0], m_box_faces[0][1],
-            m_box_faces[0][2]);
-        for (int i = 1; i < 6; i++)
+        // A point on the plane of a face can be on either side of the box,
+        // so the side is taken from the first face the point is not on.
+        float side = 0.0f;
+        for (int i = 0; i < 6; i++)
         {
-            if (side * p.sideofPlane(m_box_faces[i][0], m_box_faces[i][1],
-                m_box_faces[i][2]) < 0)
+            float s = p.sideofPlane(m_box_faces[i][0], m_box_faces[i][1],
+                m_box_faces[i][2]);
+            if (side == 0.0f)
+                side = s;
+            else if (side * s < 0)
                 return false;
         }
         return true;
@@ -26,13 +26,22 @@
 #include "graphics/sp/sp_mesh.hpp"
 #include "graphics/sp/sp_mesh_buffer.hpp"
 #include "modes/profile_world.hpp"
+#include "io/file_manager.hpp"
 #include "race/race_manager.hpp"
+#include "tracks/arena_graph.hpp"
 #include "tracks/arena_node_3d.hpp"
+#include "tracks/drive_graph.hpp"
 #include "tracks/drive_node_2d.hpp"
 #include "tracks/drive_node_3d.hpp"
 #include "tracks/track.hpp"
+#include "tracks/track_manager.hpp"
 #include "utils/log.hpp"
 
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <random>
+
 const int Graph::UNKNOWN_SECTOR = -1;
 const float Graph::MIN_HEIGHT_TESTING = -1.0f;
 const float Graph::MAX_HEIGHT_TESTING = 5.0f;
@@ -48,6 +57,11 @@ Graph::Graph()
     m_bb_min      = Vec3( 99999,  99999,  99999);
     m_bb_max      = Vec3(-99999, -99999, -99999);
     memset(m_bb_nodes, 0, 4 * sizeof(int));
+    m_grid_min_x     = 0.0f;
+    m_grid_min_z     = 0.0f;
+    m_grid_cell_size = 1.0f;
+    m_grid_size_x    = 0;
+    m_grid_size_z    = 0;
 }  // Graph
 
 // -----------------------------------------------------------------------------
@@ -603,9 +617,9 @@ void Graph::createQuad(const Vec3 &p0, const Vec3 &p1, const Vec3 &p2,
  *         selected way in case of a branch, and also to make sure that it
  *         doesn't skip e.g. a loop (see explanation below for details).
  */
-void Graph::findRoadSector(const Vec3& xyz, int *sector,
-                           std::vector<int> *all_sectors,
-                           bool ignore_vertical) const
+void Graph::findRoadSectorLinear(const Vec3& xyz, int *sector,
+                                 std::vector<int> *all_sectors,
+                                 bool ignore_vertical) const
 {
     // Most likely the kart will still be on the sector it was before,
     // so this simple case is tested first.
@@ -647,7 +661,7 @@ void Graph::findRoadSector(const Vec3& xyz, int *sector,
     }   // for i<m_all_nodes.size()
 
     return;
-}   // findRoadSector
+}   // findRoadSectorLinear
 
 //-----------------------------------------------------------------------------
 /** findOutOfRoadSector finds the sector where XYZ is, but as it name
@@ -677,9 +691,9 @@ void Graph::findRoadSector(const Vec3& xyz, int *sector,
     until the next higher overlapping line segment, and find the closest
     one to XYZ.
  */
-int Graph::findOutOfRoadSector(const Vec3& xyz, const int curr_sector,
-                               std::vector<int> *all_sectors,
-                               bool ignore_vertical) const
+int Graph::findOutOfRoadSectorLinear(const Vec3& xyz, const int curr_sector,
+                                     std::vector<int> *all_sectors,
+                                     bool ignore_vertical) const
 {
     int count = (all_sectors!=NULL) ? (int)all_sectors->size() : getNumNodes();
     int current_sector = 0;
@@ -758,8 +772,321 @@ int Graph::findOutOfRoadSector(const Vec3& xyz, const int curr_sector,
     // We can only reach this point if min_sector==UNKNOWN_SECTOR
     Log::warn("Graph", "unknown sector found.");
     return 0;
+}   // findOutOfRoadSectorLinear
+
+//-----------------------------------------------------------------------------
+/** Returns in which sector on the road the position xyz is, using the
+ *  spatial index if possible. The result is identical to the one of
+ *  findRoadSectorLinear, which describes the parameters.
+ */
+void Graph::findRoadSector(const Vec3& xyz, int *sector,
+                           std::vector<int> *all_sectors,
+                           bool ignore_vertical) const
+{
+    // The AI only tests the quads on its selected way, which is a short
+    // list already
+    if (m_grid_start.empty() || all_sectors)
+    {
+        findRoadSectorLinear(xyz, sector, all_sectors, ignore_vertical);
+        return;
+    }
+
+    // Most likely the kart will still be on the sector it was before,
+    // so this simple case is tested first.
+    if (*sector!=UNKNOWN_SECTOR &&
+        getQuad(*sector)->pointInside(xyz, ignore_vertical))
+    {
+        return;
+    }   // if still on same quad
+
+    // The linear search starts with the quad after the current one
+    const int first = (*sector + 1) % (int)m_all_nodes.size();
+    *sector = findRoadSectorInGrid(xyz, first, ignore_vertical);
+}   // findRoadSector
+
+//-----------------------------------------------------------------------------
+/** Returns the sector closest to xyz, using the spatial index if possible.
+ *  The result is identical to the one of findOutOfRoadSectorLinear, which
+ *  describes the parameters.
+ */
+int Graph::findOutOfRoadSector(const Vec3& xyz, const int curr_sector,
+                               std::vector<int> *all_sectors,
+                               bool ignore_vertical) const
+{
+    if (m_grid_start.empty() || all_sectors ||
+        std::isnan(xyz.getX()) || std::isnan(xyz.getZ()))
+    {
+        return findOutOfRoadSectorLinear(xyz, curr_sector, all_sectors,
+                                         ignore_vertical);
+    }
+
+    // The linear search starts 9 quads before the current quad, or with
+    // quad 1 if the current quad is not known
+    const int n = (int)m_all_nodes.size();
+    int first = 1 % n;
+    if (curr_sector != UNKNOWN_SECTOR)
+        first = ((curr_sector - 9) % n + n) % n;
+
+    for (int phase = 0; phase < 2; phase++)
+    {
+        int sector = findOutOfRoadSectorInGrid(xyz, first, phase == 1,
+                                               ignore_vertical);
+        // If any sector was found after a phase, return it.
+        if (sector != UNKNOWN_SECTOR)
+            return sector;
+    }
+
+    // We can only reach this point if no sector was found
+    Log::warn("Graph", "unknown sector found.");
+    return 0;
 }   // findOutOfRoadSector
 
+//-----------------------------------------------------------------------------
+/** Creates the grid used by findRoadSector and findOutOfRoadSector. Must be
+ *  called after all quads are created. The cell size is about the average
+ *  size of a quad, so a point only needs to be tested against a few quads.
+ */
+void Graph::createSpatialIndex()
+{
+    m_grid_start.clear();
+    m_grid_quads.clear();
+    m_quad_boxes.clear();
+    m_degenerate_quads.clear();
+    const unsigned int n = getNumNodes();
+    if (n == 0)
+        return;
+
+    // Enlarge the boxes a bit, so rounding errors in pointInside or
+    // getDistance2FromPoint can not result in a quad being missed
+    const float margin = 0.1f;
+    m_quad_boxes.resize(4 * n);
+    float min_x =  std::numeric_limits<float>::max(), min_z = min_x;
+    float max_x = -std::numeric_limits<float>::max(), max_z = max_x;
+    float total_size = 0.0f;
+    for (unsigned int i = 0; i < n; i++)
+    {
+        const Quad* q = m_all_nodes[i];
+        // The box used by pointInside of 3d quads extends 5 units along
+        // the normal of the quad
+        const float extra = margin + (q->is3DQuad() ? 5.0f : 0.0f);
+        float* box = &m_quad_boxes[4 * i];
+        box[0] = box[2] = (*q)[0].getX();
+        box[1] = box[3] = (*q)[0].getZ();
+        for (unsigned int j = 1; j < 4; j++)
+        {
+            box[0] = std::min(box[0], (*q)[j].getX());
+            box[1] = std::min(box[1], (*q)[j].getZ());
+            box[2] = std::max(box[2], (*q)[j].getX());
+            box[3] = std::max(box[3], (*q)[j].getZ());
+        }
+        // The two triangles tested by Quad::pointInside only describe
+        // an area inside the quad if they are not degenerated
+        if (!q->is3DQuad())
+        {
+            const Vec3 &p0 = (*q)[0], &p1 = (*q)[1], &p2 = (*q)[2],
+                       &p3 = (*q)[3];
+            const float l02 = (p2 - p0).length();
+            if (fabsf(p2.sideOfLine2D(p0, p1)) <=
+                    0.001f * l02 * (p1 - p0).length() ||
+                fabsf(p0.sideOfLine2D(p2, p3)) <=
+                    0.001f * l02 * (p3 - p2).length())
+                m_degenerate_quads.push_back(i);
+        }
+        box[0] -= extra;
+        box[1] -= extra;
+        box[2] += extra;
+        box[3] += extra;
+        total_size += std::max(box[2] - box[0], box[3] - box[1]);
+        min_x = std::min(min_x, box[0]);
+        min_z = std::min(min_z, box[1]);
+        max_x = std::max(max_x, box[2]);
+        max_z = std::max(max_z, box[3]);
+    }
+
+    // Limit the number of cells for tracks with a few big quads
+    m_grid_cell_size = std::max(total_size / n, 1.0f);
+    while (((max_x - min_x) / m_grid_cell_size + 1.0f) *
+           ((max_z - min_z) / m_grid_cell_size + 1.0f) > 4.0f * n + 64.0f)
+    {
+        m_grid_cell_size *= 1.5f;
+    }
+    m_grid_size_x = (int)((max_x - min_x) / m_grid_cell_size) + 1;
+    m_grid_size_z = (int)((max_z - min_z) / m_grid_cell_size) + 1;
+    m_grid_min_x = min_x;
+    m_grid_min_z = min_z;
+
+    // Count the quads in each cell first, then store them in the order of
+    // their index
+    auto get_cells = [this](unsigned int i, int* x0, int* z0, int* x1,
+                            int* z1)
+    {
+        const float* box = &m_quad_boxes[4 * i];
+        *x0 = (int)((box[0] - m_grid_min_x) / m_grid_cell_size);
+        *z0 = (int)((box[1] - m_grid_min_z) / m_grid_cell_size);
+        *x1 = std::min((int)((box[2] - m_grid_min_x) / m_grid_cell_size),
+                       m_grid_size_x - 1);
+        *z1 = std::min((int)((box[3] - m_grid_min_z) / m_grid_cell_size),
+                       m_grid_size_z - 1);
+    };
+    const unsigned int num_cells = m_grid_size_x * m_grid_size_z;
+    m_grid_start.resize(num_cells + 1, 0);
+    int x0, z0, x1, z1;
+    for (unsigned int i = 0; i < n; i++)
+    {
+        get_cells(i, &x0, &z0, &x1, &z1);
+        for (int z = z0; z <= z1; z++)
+        {
+            for (int x = x0; x <= x1; x++)
+                m_grid_start[z * m_grid_size_x + x + 1]++;
+        }
+    }
+    for (unsigned int c = 0; c < num_cells; c++)
+        m_grid_start[c + 1] += m_grid_start[c];
+    m_grid_quads.resize(m_grid_start[num_cells]);
+    std::vector<unsigned int> next(m_grid_start.begin(),
+                                   m_grid_start.end() - 1);
+    for (unsigned int i = 0; i < n; i++)
+    {
+        get_cells(i, &x0, &z0, &x1, &z1);
+        for (int z = z0; z <= z1; z++)
+        {
+            for (int x = x0; x <= x1; x++)
+                m_grid_quads[next[z * m_grid_size_x + x]++] = i;
+        }
+    }
+}   // createSpatialIndex
+
+//-----------------------------------------------------------------------------
+/** Returns the squared 2d distance of xyz to the bounding box of a quad,
+ *  which is never more than the distance to any point of the quad. */
+float Graph::getBoxDistance2(int quad, const Vec3& xyz) const
+{
+    const float* box = &m_quad_boxes[4 * quad];
+    const float dx = std::max(std::max(box[0] - xyz.getX(),
+                                       xyz.getX() - box[2]), 0.0f);
+    const float dz = std::max(std::max(box[1] - xyz.getZ(),
+                                       xyz.getZ() - box[3]), 0.0f);
+    return dx * dx + dz * dz;
+}   // getBoxDistance2
+
+//-----------------------------------------------------------------------------
+/** Returns the quad xyz is on, using the grid. If it is on several quads,
+ *  the one the linear search would test first is returned.
+ *  \param first The quad the linear search would test first.
+ */
+int Graph::findRoadSectorInGrid(const Vec3& xyz, int first,
+                                bool ignore_vertical) const
+{
+    int result = UNKNOWN_SECTOR;
+    int result_order = (int)m_all_nodes.size();
+    const float fx = (xyz.getX() - m_grid_min_x) / m_grid_cell_size;
+    const float fz = (xyz.getZ() - m_grid_min_z) / m_grid_cell_size;
+    // Only degenerate quads can contain a point outside of the grid (or NAN)
+    unsigned int cell = 0, end = 0;
+    if (fx >= 0.0f && fx < (float)m_grid_size_x &&
+        fz >= 0.0f && fz < (float)m_grid_size_z)
+    {
+        cell = (int)fz * m_grid_size_x + (int)fx;
+        end = m_grid_start[cell + 1];
+    }
+    for (unsigned int i = m_grid_start[cell]; i < end; i++)
+    {
+        const int q = m_grid_quads[i];
+        const int order = getSearchOrder(q, first);
+        if (order >= result_order || getBoxDistance2(q, xyz) > 0.0f)
+            continue;
+        if (m_all_nodes[q]->pointInside(xyz, ignore_vertical))
+        {
+            result = q;
+            result_order = order;
+        }
+    }
+    for (int q : m_degenerate_quads)
+    {
+        const int order = getSearchOrder(q, first);
+        if (order < result_order &&
+            m_all_nodes[q]->pointInside(xyz, ignore_vertical))
+        {
+            result = q;
+            result_order = order;
+        }
+    }
+    return result;
+}   // findRoadSectorInGrid
+
+//-----------------------------------------------------------------------------
+/** Returns the quad closest to xyz in one phase of findOutOfRoadSector, or
+ *  UNKNOWN_SECTOR if none is found. The cells are tested in rings around
+ *  the cell of xyz, until no quad in further rings can be closer than the
+ *  best quad found so far. If several quads have the same distance, the
+ *  one the linear search would test first is returned.
+ *  \param first The quad the linear search would test first.
+ *  \param phase_1 If the height of xyz should not be tested.
+ */
+int Graph::findOutOfRoadSectorInGrid(const Vec3& xyz, int first,
+                                     bool phase_1,
+                                     bool ignore_vertical) const
+{
+    // Use the closest cell if xyz is outside of the grid
+    float fx = (xyz.getX() - m_grid_min_x) / m_grid_cell_size;
+    float fz = (xyz.getZ() - m_grid_min_z) / m_grid_cell_size;
+    fx = std::min(std::max(fx, 0.0f), (float)(m_grid_size_x - 1));
+    fz = std::min(std::max(fz, 0.0f), (float)(m_grid_size_z - 1));
+    const int cx = (int)fx;
+    const int cz = (int)fz;
+    const int max_ring = std::max(std::max(cx, m_grid_size_x - 1 - cx),
+                                  std::max(cz, m_grid_size_z - 1 - cz));
+
+    int   min_sector = UNKNOWN_SECTOR;
+    int   min_order  = (int)m_all_nodes.size();
+    float min_dist_2 = 999999.0f*999999.0f;
+    for (int r = 0; r <= max_ring; r++)
+    {
+        // All cells of ring r are at least (r-1) cells away from xyz
+        const float ring_dist = (r - 1) * m_grid_cell_size - 0.1f;
+        if (ring_dist > 0.0f && ring_dist * ring_dist > min_dist_2)
+            break;
+        for (int z = cz - r; z <= cz + r; z++)
+        {
+            if (z < 0 || z >= m_grid_size_z)
+                continue;
+            // Inside the ring only the first and last cell of a row
+            const int step = (z == cz - r || z == cz + r) ? 1 : 2 * r;
+            for (int x = cx - r; x <= cx + r; x += step)
+            {
+                if (x < 0 || x >= m_grid_size_x)
+                    continue;
+                const unsigned int cell = z * m_grid_size_x + x;
+                for (unsigned int i = m_grid_start[cell];
+                     i < m_grid_start[cell + 1]; i++)
+                {
+                    const int q = m_grid_quads[i];
+                    const Quad* quad = m_all_nodes[q];
+                    if (quad->isIgnored() ||
+                        getBoxDistance2(q, xyz) > min_dist_2)
+                        continue;
+                    const int order = getSearchOrder(q, first);
+                    float dist_2 = quad->getDistance2FromPoint(xyz);
+                    if (!(dist_2 < min_dist_2 ||
+                          (dist_2 == min_dist_2 && order < min_order &&
+                           min_sector != UNKNOWN_SECTOR)))
+                        continue;
+                    // Same height test as in findOutOfRoadSectorLinear
+                    float dist = xyz.getY() - quad->getMinHeight();
+                    if (phase_1 || (dist < 5.0f && dist>-1.0f) ||
+                        quad->is3DQuad() || ignore_vertical)
+                    {
+                        min_dist_2 = dist_2;
+                        min_sector = q;
+                        min_order  = order;
+                    }
+                }   // for i
+            }   // for x
+        }   // for z
+    }   // for r
+    return min_sector;
+}   // findOutOfRoadSectorInGrid
+
 //-----------------------------------------------------------------------------
 void Graph::loadBoundingBoxNodes()
 {
@@ -772,3 +1099,135 @@ void Graph::loadBoundingBoxNodes()
     m_bb_nodes[3] = findOutOfRoadSector(Vec3(m_bb_max.x(), 0, m_bb_max.z()),
         -1/*curr_sector*/, NULL/*all_sectors*/, true/*ignore_vertical*/);
 }   // loadBoundingBoxNodes
+
+//-----------------------------------------------------------------------------
+/** Checks for all tracks that the spatial index in findRoadSector and
+ *  findOutOfRoadSector gives the same results as the linear search, for
+ *  points on, next to, above and below all quads.
+ */
+void Graph::unitTesting()
+{
+    std::minstd_rand random(1);
+    int error_count = 0;
+
+    auto test_point = [&random, &error_count](const Graph* g,
+                                              const Vec3& xyz,
+                                              bool test_out_of_road)
+    {
+        const int n = g->getNumNodes();
+        for (int ignore_vertical = 0; ignore_vertical < 2; ignore_vertical++)
+        {
+            const int prev = random() % 4 == 0 ? UNKNOWN_SECTOR
+                                               : (int)(random() % n);
+            int grid = prev, linear = prev;
+            g->findRoadSector(xyz, &grid, NULL, ignore_vertical == 1);
+            g->findRoadSectorLinear(xyz, &linear, NULL, ignore_vertical == 1);
+            if (grid != linear)
+            {
+                Log::error("Graph", "findRoadSector %f %f %f from %d: "
+                    "grid %d, linear %d.", xyz.getX(), xyz.getY(),
+                    xyz.getZ(), prev, grid, linear);
+                error_count++;
+            }
+            if (!test_out_of_road)
+                continue;
+            grid = g->findOutOfRoadSector(xyz, prev, NULL,
+                                          ignore_vertical == 1);
+            linear = g->findOutOfRoadSectorLinear(xyz, prev, NULL,
+                                                  ignore_vertical == 1);
+            if (grid != linear)
+            {
+                Log::error("Graph", "findOutOfRoadSector %f %f %f from %d: "
+                    "grid %d, linear %d.", xyz.getX(), xyz.getY(),
+                    xyz.getZ(), prev, grid, linear);
+                error_count++;
+            }
+        }
+    };   // test_point
+
+    auto test_graph = [&random, &test_point](const Graph* g)
+    {
+        const unsigned int n = g->getNumNodes();
+        if (n == 0 || g->m_grid_start.empty())
+            return;
+        // The linear out of road search tests all quads, so limit the
+        // number of points it is used for on big graphs
+        const unsigned int out_of_road_step = n / 200 + 1;
+        const float heights[] = { 0.0f, 0.5f, 3.0f, -2.0f, 10.0f };
+        for (unsigned int i = 0; i < n; i++)
+        {
+            const Quad* q = g->getQuad(i);
+            std::vector<Vec3> points;
+            points.push_back(q->getCenter());
+            for (unsigned int j = 0; j < 4; j++)
+            {
+                // Corners, middle of edges and points just outside
+                points.push_back((*q)[j]);
+                points.push_back(((*q)[j] + (*q)[(j + 1) % 4]) * 0.5f);
+                points.push_back((*q)[j] + ((*q)[j] - q->getCenter()) * 0.01f);
+            }
+            for (unsigned int j = 0; j < 4; j++)
+            {
+                float a = (random() % 1000) / 1000.0f;
+                float b = (random() % 1000) / 1000.0f;
+                points.push_back((*q)[0] + ((*q)[1] - (*q)[0]) * a +
+                                 ((*q)[3] - (*q)[0]) * b);
+            }
+            for (const Vec3& p : points)
+            {
+                for (float h : heights)
+                {
+                    test_point(g, p + Vec3(0, h, 0),
+                               i % out_of_road_step == 0);
+                }
+            }
+        }
+        // Random points in and around the whole graph
+        const float* box = g->m_quad_boxes.data();
+        float min_x = box[0], min_z = box[1], max_x = box[2], max_z = box[3];
+        for (unsigned int i = 1; i < n; i++)
+        {
+            min_x = std::min(min_x, box[4 * i    ]);
+            min_z = std::min(min_z, box[4 * i + 1]);
+            max_x = std::max(max_x, box[4 * i + 2]);
+            max_z = std::max(max_z, box[4 * i + 3]);
+        }
+        for (unsigned int i = 0; i < 200; i++)
+        {
+            const Quad* q = g->getQuad(random() % n);
+            float x = min_x - 50.0f +
+                      (max_x - min_x + 100.0f) * (random() % 10000) / 10000.0f;
+            float z = min_z - 50.0f +
+                      (max_z - min_z + 100.0f) * (random() % 10000) / 10000.0f;
+            test_point(g, Vec3(x, q->getCenter().getY(), z), true);
+        }
+    };   // test_graph
+
+    for (unsigned int i = 0; i < track_manager->getNumberOfTracks(); i++)
+    {
+        Track* track = track_manager->getTrack(i);
+        if (track->hasNavMesh())
+        {
+            Log::info("Graph", "Testing arena graph of '%s'.",
+                      track->getIdent().c_str());
+            ArenaGraph* ag = new ArenaGraph(track->getTrackFile("navmesh.xml"));
+            test_graph(ag);
+            delete ag;
+        }
+        std::string quads = track->getTrackFile("quads.xml");
+        if (track->isRaceTrack() && file_manager->fileExists(quads))
+        {
+            Log::info("Graph", "Testing drive graph of '%s'.",
+                      track->getIdent().c_str());
+            // The drive graph registers itself as graph
+            new DriveGraph(quads, track->getTrackFile("graph.xml"), false);
+            test_graph(Graph::get());
+            Graph::destroy();
+        }
+    }
+    if (error_count > 0)
+    {
+        Log::fatal("Graph", "%d differences between the spatial index and "
+                   "the linear search.", error_count);
+    }
+}   // unitTesting
@@ -66,6 +66,8 @@ protected:
     // ------------------------------------------------------------------------
     /** Map 4 bounding box points to 4 closest graph nodes. */
     void loadBoundingBoxNodes();
+    // ------------------------------------------------------------------------
+    void createSpatialIndex();
 
 private:
     /** The 2d bounding box, used for hashing. */
@@ -90,6 +92,29 @@ private:
     /** The render target used for drawing the minimap. */
     std::unique_ptr<RenderTarget> m_render_target;
 
+    /** A 2d grid over the x/z bounding box of all quads, used to only test
+     *  the quads close to a point in findRoadSector and findOutOfRoadSector.
+     *  The quads overlapping cell c are m_grid_quads[m_grid_start[c]] up to
+     *  (excluding) m_grid_quads[m_grid_start[c+1]]. Empty if not created. */
+    std::vector<unsigned int> m_grid_start;
+    std::vector<int> m_grid_quads;
+
+    /** The x/z bounding box of each quad, stored as min x, min z, max x and
+     *  max z. It contains all points for which Quad::pointInside can return
+     *  true and the line used in getDistance2FromPoint. */
+    std::vector<float> m_quad_boxes;
+
+    /** Quads with an (almost) degenerate triangle, for which pointInside
+     *  is not reliably limited to the bounding box. They are tested in
+     *  findRoadSector for every point. */
+    std::vector<int> m_degenerate_quads;
+
+    /** Minimum x and z coordinates and cell size of the grid. */
+    float m_grid_min_x, m_grid_min_z, m_grid_cell_size;
+
+    /** Number of grid cells in x and z direction. */
+    int m_grid_size_x, m_grid_size_z;
+
     // ------------------------------------------------------------------------
     void createMesh(bool show_invisible=true,
                     bool enable_transparency=false,
@@ -103,11 +128,37 @@ private:
     // ------------------------------------------------------------------------
     void cleanupDebugMesh();
     // ------------------------------------------------------------------------
+    void findRoadSectorLinear(const Vec3& xyz, int *sector,
+                              std::vector<int> *all_sectors,
+                              bool ignore_vertical) const;
+    // ------------------------------------------------------------------------
+    int findOutOfRoadSectorLinear(const Vec3& xyz, const int curr_sector,
+                                  std::vector<int> *all_sectors,
+                                  bool ignore_vertical) const;
+    // ------------------------------------------------------------------------
+    int findRoadSectorInGrid(const Vec3& xyz, int first,
+                             bool ignore_vertical) const;
+    // ------------------------------------------------------------------------
+    int findOutOfRoadSectorInGrid(const Vec3& xyz, int first, bool phase_1,
+                                  bool ignore_vertical) const;
+    // ------------------------------------------------------------------------
+    float getBoxDistance2(int quad, const Vec3& xyz) const;
+    // ------------------------------------------------------------------------
+    /** Returns the position of a quad in the order in which the linear
+     *  search tests the quads, if it starts with quad first. */
+    int getSearchOrder(int quad, int first) const
+    {
+        int n = (int)m_all_nodes.size();
+        return quad >= first ? quad - first : quad - first + n;
+    }   // getSearchOrder
+    // ------------------------------------------------------------------------
     virtual bool hasLapLine() const = 0;
     // ------------------------------------------------------------------------
     virtual void differentNodeColor(int n, video::SColor* c) const = 0;
 
 public:
+    static void unitTesting();
+
     static const int UNKNOWN_SECTOR;
     // For 2d Quad
     static const float MIN_HEIGHT_TESTING;
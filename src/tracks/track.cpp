@@ -909,7 +909,10 @@ void Track::createPhysicsModel(unsigned int main_track_count)
         uploadNodeVertexBuffer(m_all_nodes[i]);
     }
     main_loop->renderGUI(5580);
-    m_track_mesh->createPhysicalBody(m_friction);
+    // Building the BVH of a big track takes a while, so it is cached
+    m_track_mesh->createPhysicalBody(m_friction,
+        (btCollisionObject::CollisionFlags)0,
+        /*use_bvh_cache*/UserConfigParams::m_cache_track_bvh);
     main_loop->renderGUI(5585);
     m_gfx_effect_mesh->createCollisionShape();
     main_loop->renderGUI(5590);
@@ -2213,7 +2216,10 @@ void Track::loadTrackModel(bool reverse_track, unsigned int mode_id)
     main_loop->renderGUI(5800);
 
     if (auto sl = LobbyProtocol::get<ServerLobby>())
+    {
         sl->saveInitialItems();
+        sl->saveLiveJoinWorldInfo();
+    }
 
     main_loop->renderGUI(5900);
 
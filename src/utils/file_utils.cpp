@@ -22,6 +22,11 @@
 #include <stdio.h>
 #include <string>
 #include <sys/stat.h>
+#if defined(WIN32)
+#include <process.h>
+#else
+#include <unistd.h>
+#endif
 
 // ----------------------------------------------------------------------------
 #if defined(WIN32)
@@ -166,3 +171,19 @@ int FileUtils::renameU8Path(const std::string& u8_path_old,
     return rename(u8_path_old.c_str(), u8_path_new.c_str());
 #endif
 }   // renameU8Path
+
+// ----------------------------------------------------------------------------
+/** Returns the name of a temporary file to write a file to, which is then
+ *  renamed to u8_path. It contains the process id, so that several processes
+ *  writing the same file at the same time (e.g. the forked server instances)
+ *  don't write to the same temporary file.
+ */
+std::string FileUtils::getTemporaryPath(const std::string& u8_path)
+{
+#if defined(WIN32)
+    const int pid = _getpid();
+#else
+    const int pid = (int)getpid();
+#endif
+    return u8_path + "." + StringUtils::toString(pid) + ".part";
+}   // getTemporaryPath
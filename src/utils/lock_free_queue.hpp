@@ -0,0 +1,81 @@
+//
+//  SuperTuxKart - a fun racing game with go-kart
+//  Copyright (C) 2020 SuperTuxKart-Team
+//
+//  This program is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU General Public License
+//  as published by the Free Software Foundation; either version 3
+//  of the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+#ifndef HEADER_LOCK_FREE_QUEUE_HPP
+#define HEADER_LOCK_FREE_QUEUE_HPP
+
+#include "utils/no_copy.hpp"
+
+#include <atomic>
+#include <cstddef>
+
+/** A queue which any number of threads can add objects to without locking,
+ *  while one thread takes all queued objects at once. The objects are linked
+ *  with their own next pointer (the NEXT member), so no memory is allocated.
+ *  Objects are added to a linked list in reverse order with a compare and
+ *  swap, and popAll() takes the whole list with a single exchange and
+ *  reverses it. Since single objects are never removed, this does not
+ *  suffer from the ABA problem.
+ *  \ingroup utils
+ */
+template<typename T, T* T::*NEXT>
+class LockFreeQueue : public NoCopy
+{
+private:
+    /** The last added object, linked to the previously added ones. */
+    std::atomic<T*> m_last;
+
+public:
+    // ------------------------------------------------------------------------
+    LockFreeQueue()                                      { m_last.store(NULL); }
+    // ------------------------------------------------------------------------
+    /** Adds an object to the queue, can be called from any thread. */
+    void push(T* object)
+    {
+        T* last = m_last.load(std::memory_order_relaxed);
+        do
+        {
+            object->*NEXT = last;
+        } while (!m_last.compare_exchange_weak(last, object,
+                 std::memory_order_release, std::memory_order_relaxed));
+    }   // push
+    // ------------------------------------------------------------------------
+    /** Removes all objects from the queue.
+     *  \return The first added object, which is linked to the others in the
+     *          order they were added, or NULL if the queue is empty. */
+    T* popAll()
+    {
+        T* last = m_last.exchange(NULL, std::memory_order_acquire);
+        T* first = NULL;
+        while (last)
+        {
+            T* previous = last->*NEXT;
+            last->*NEXT = first;
+            first = last;
+            last = previous;
+        }
+        return first;
+    }   // popAll
+    // ------------------------------------------------------------------------
+    bool empty() const
+    {
+        return m_last.load(std::memory_order_relaxed) == NULL;
+    }   // empty
+};   // LockFreeQueue
+
+#endif
@@ -0,0 +1,95 @@
+//
+//  SuperTuxKart - a fun racing game with go-kart
+//  Copyright (C) 2020 SuperTuxKart-Team
+//
+//  This program is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU General Public License
+//  as published by the Free Software Foundation; either version 3
+//  of the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+#include "utils/memory_pool.hpp"
+
+#include <algorithm>
+#include <new>
+
+// ----------------------------------------------------------------------------
+/** Creates an empty pool.
+ *  \param block_size Size of the blocks, larger or smaller requests are
+ *         passed on to the global operator new.
+ *  \param max_free_blocks Maximum number of unused blocks kept.
+ */
+MemoryPool::MemoryPool(size_t block_size, unsigned max_free_blocks)
+          : m_block_size(std::max(block_size, sizeof(Block))),
+            m_max_free_blocks(max_free_blocks)
+{
+    m_free_blocks = NULL;
+    m_num_free_blocks.store(0);
+}   // MemoryPool
+
+// ----------------------------------------------------------------------------
+MemoryPool::~MemoryPool()
+{
+    Block* block = m_freed_blocks.popAll();
+    while (block)
+    {
+        Block* next = block->m_next;
+        ::operator delete(block);
+        block = next;
+    }
+    block = m_free_blocks;
+    while (block)
+    {
+        Block* next = block->m_next;
+        ::operator delete(block);
+        block = next;
+    }
+}   // ~MemoryPool
+
+// ----------------------------------------------------------------------------
+/** Returns a block of memory, from the pool if possible. */
+void* MemoryPool::allocate(size_t size)
+{
+    if (size != m_block_size)
+        return ::operator new(size);
+
+    std::unique_lock<std::mutex> ul(m_mutex);
+    if (!m_free_blocks)
+        m_free_blocks = m_freed_blocks.popAll();
+    Block* block = m_free_blocks;
+    if (!block)
+    {
+        ul.unlock();
+        return ::operator new(m_block_size);
+    }
+    m_free_blocks = block->m_next;
+    ul.unlock();
+    m_num_free_blocks.fetch_sub(1, std::memory_order_relaxed);
+    return block;
+}   // allocate
+
+// ----------------------------------------------------------------------------
+/** Returns a block to the pool, can be called from any thread. */
+void MemoryPool::deallocate(void* p, size_t size)
+{
+    if (!p)
+        return;
+    // The number of free blocks is only approximate if several threads free
+    // blocks at the same time, which doesn't matter for a limit
+    if (size != m_block_size ||
+        m_num_free_blocks.load(std::memory_order_relaxed) >= m_max_free_blocks)
+    {
+        ::operator delete(p);
+        return;
+    }
+    m_num_free_blocks.fetch_add(1, std::memory_order_relaxed);
+    m_freed_blocks.push(static_cast<Block*>(p));
+}   // deallocate
@@ -0,0 +1,69 @@
+//
+//  SuperTuxKart - a fun racing game with go-kart
+//  Copyright (C) 2020 SuperTuxKart-Team
+//
+//  This program is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU General Public License
+//  as published by the Free Software Foundation; either version 3
+//  of the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+#ifndef HEADER_MEMORY_POOL_HPP
+#define HEADER_MEMORY_POOL_HPP
+
+#include "utils/lock_free_queue.hpp"
+#include "utils/no_copy.hpp"
+
+#include <atomic>
+#include <cstddef>
+#include <mutex>
+
+/** A pool of memory blocks of the same size, used by classes which are
+ *  allocated and freed very often (see Event::operator new). Blocks can be
+ *  freed from any thread without locking. Allocating locks a mutex, which
+ *  is not contended as long as only one thread allocates (e.g. the network
+ *  thread, which creates all events).
+ *  \ingroup utils
+ */
+class MemoryPool : public NoCopy
+{
+private:
+    struct Block
+    {
+        Block* m_next;
+    };
+
+    /** Size of each block. */
+    const size_t m_block_size;
+
+    /** Maximum number of blocks kept in the pool, further freed blocks are
+     *  released. */
+    const unsigned m_max_free_blocks;
+
+    /** Blocks freed since they were last taken by allocate(). */
+    LockFreeQueue<Block, &Block::m_next> m_freed_blocks;
+
+    /** Blocks available for allocate(), protected by m_mutex. */
+    Block* m_free_blocks;
+
+    std::mutex m_mutex;
+
+    /** Number of blocks in m_freed_blocks and m_free_blocks. */
+    std::atomic<unsigned> m_num_free_blocks;
+
+public:
+         MemoryPool(size_t block_size, unsigned max_free_blocks);
+        ~MemoryPool();
+    void* allocate(size_t size);
+    void  deallocate(void* p, size_t size);
+};   // MemoryPool
+
+#endif
@@ -858,6 +858,38 @@ namespace StringUtils
         return output.str();
     }   // xmlEncode
 
+    // ------------------------------------------------------------------------
+    /** Escapes a UTF-8 string so that it can be written between quotes into
+     *  a JSON file: quotes, backslashes and control characters are escaped.
+     *  \param s The input string which should be encoded.
+     */
+    std::string jsonEncode(const std::string& s)
+    {
+        std::string output;
+        output.reserve(s.size());
+        for (char c : s)
+        {
+            switch (c)
+            {
+            case '"':  output += "\\\""; break;
+            case '\\': output += "\\\\"; break;
+            case '\n': output += "\\n";  break;
+            case '\r': output += "\\r";  break;
+            case '\t': output += "\\t";  break;
+            default:
+                if ((unsigned char)c < 0x20)
+                {
+                    char hex[7];
+                    snprintf(hex, sizeof(hex), "\\u%04x", (unsigned)c);
+                    output += hex;
+                }
+                else
+                    output += c;
+            }
+        }
+        return output;
+    }   // jsonEncode
+
     // ------------------------------------------------------------------------
 
     std::string wideToUtf8(const wchar_t* input)
@@ -1358,10 +1390,15 @@ namespace StringUtils
     }   // wideToUtf32
 
     // ------------------------------------------------------------------------
-    /** At the moment only versionToInt is tested. 
+    /** At the moment only versionToInt and jsonEncode are tested.
      */
     void unitTesting()
     {
+        assert(jsonEncode("abc") == "abc");
+        assert(jsonEncode("a\"b\\c") == "a\\\"b\\\\c");
+        assert(jsonEncode("a\nb\x01") == "a\\nb\\u0001");
+        assert(jsonEncode("\xc3\xa9") == "\xc3\xa9");
+
         assert(versionToInt("git"             ) == 999999999);
         assert(versionToInt("12.34.56-alpha1" ) == 123456001);   // alphaX  = 0X
         assert(versionToInt("12.34.56-beta2"  ) == 123456012);   // betaX   = 1X
@@ -0,0 +1,135 @@
+//
+//  SuperTuxKart - a fun racing game with go-kart
+//  Copyright (C) 2020 SuperTuxKart-Team
+//
+//  This program is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU General Public License
+//  as published by the Free Software Foundation; either version 3
+//  of the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+#include "utils/thread_pool.hpp"
+
+#include "utils/string_utils.hpp"
+#include "utils/vs.hpp"
+
+
+// ----------------------------------------------------------------------------
+/** Creates the pool.
+ *  \param num_threads Total number of threads to use, including the thread
+ *         calling parallelFor. If 1 (or 0), no thread is created and all
+ *         tasks are run by the caller.
+ */
+ThreadPool::ThreadPool(unsigned num_threads)
+{
+    m_function = NULL;
+    m_count = 0;
+    m_next.store(0);
+    m_generation = 0;
+    m_workers_done = 0;
+    m_exit = false;
+    for (unsigned i = 1; i < num_threads; i++)
+        m_threads.emplace_back(&ThreadPool::workerLoop, this, i);
+}   // ThreadPool
+
+// ----------------------------------------------------------------------------
+ThreadPool::~ThreadPool()
+{
+    std::unique_lock<std::mutex> ul(m_mutex);
+    m_exit = true;
+    m_work_cv.notify_all();
+    ul.unlock();
+    for (std::thread& t : m_threads)
+        t.join();
+}   // ~ThreadPool
+
+// ----------------------------------------------------------------------------
+/** Returns the number of threads to use if the user did not select one. */
+unsigned ThreadPool::getDefaultNumThreads()
+{
+    unsigned n = std::thread::hardware_concurrency();
+    return n == 0 ? 1 : n;
+}   // getDefaultNumThreads
+
+// ----------------------------------------------------------------------------
+/** Runs tasks of the current job until none is left. */
+void ThreadPool::runTasks()
+{
+    while (true)
+    {
+        unsigned i = m_next.fetch_add(1);
+        if (i >= m_count)
+            return;
+        (*m_function)(i);
+    }
+}   // runTasks
+
+// ----------------------------------------------------------------------------
+void ThreadPool::workerLoop(unsigned index)
+{
+    VS::setThreadName((StringUtils::toString(index) + "ThreadPool").c_str());
+    unsigned generation = 0;
+    while (true)
+    {
+        std::unique_lock<std::mutex> ul(m_mutex);
+        m_work_cv.wait(ul, [this, generation]
+            {
+                return m_exit || m_generation != generation;
+            });
+        if (m_exit)
+            return;
+        generation = m_generation;
+        ul.unlock();
+
+        runTasks();
+
+        ul.lock();
+        m_workers_done++;
+        if (m_workers_done == m_threads.size())
+            m_done_cv.notify_one();
+    }
+}   // workerLoop
+
+// ----------------------------------------------------------------------------
+/** Calls function(i) for each i in [0, count). The calls can happen in any
+ *  order and on any thread of the pool, and this function returns once all
+ *  of them are done.
+ */
+void ThreadPool::parallelFor(unsigned count,
+                             const std::function<void(unsigned)>& function)
+{
+    if (m_threads.empty() || count < 2)
+    {
+        for (unsigned i = 0; i < count; i++)
+            function(i);
+        return;
+    }
+
+    std::unique_lock<std::mutex> ul(m_mutex);
+    m_function = &function;
+    m_count = count;
+    m_next.store(0);
+    m_workers_done = 0;
+    m_generation++;
+    m_work_cv.notify_all();
+    ul.unlock();
+
+    runTasks();
+
+    // Wait for all workers, even if all tasks are started already, so no
+    // worker can still be using this job when the next one starts.
+    ul.lock();
+    m_done_cv.wait(ul, [this]
+        {
+            return m_workers_done == m_threads.size();
+        });
+    m_function = NULL;
+}   // parallelFor
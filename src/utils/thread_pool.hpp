@@ -0,0 +1,86 @@
+//
+//  SuperTuxKart - a fun racing game with go-kart
+//  Copyright (C) 2020 SuperTuxKart-Team
+//
+//  This program is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU General Public License
+//  as published by the Free Software Foundation; either version 3
+//  of the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+#ifndef HEADER_THREAD_POOL_HPP
+#define HEADER_THREAD_POOL_HPP
+
+#include "utils/no_copy.hpp"
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/** A small pool of worker threads to run independent tasks of one frame
+ *  in parallel. The calling thread takes part in the work, and each thread
+ *  takes the next task not yet started, so threads which finish early take
+ *  over the remaining work of slower ones. parallelFor() only returns once
+ *  all tasks are done, so the caller can merge the results in a fixed
+ *  order afterwards, independent of the number of threads.
+ *  \ingroup utils
+ */
+class ThreadPool : public NoCopy
+{
+private:
+    std::vector<std::thread> m_threads;
+
+    std::mutex m_mutex;
+
+    /** Signals the workers that a new job was started, or that they should
+     *  exit. */
+    std::condition_variable m_work_cv;
+
+    /** Signals the caller of parallelFor that all workers are done. */
+    std::condition_variable m_done_cv;
+
+    /** The function of the current job. */
+    const std::function<void(unsigned)>* m_function;
+
+    /** Number of tasks in the current job. */
+    unsigned m_count;
+
+    /** Index of the next task of the current job to be started. */
+    std::atomic<unsigned> m_next;
+
+    /** Increased for each job, so workers can detect a new one. */
+    unsigned m_generation;
+
+    /** Number of workers which finished the current job. */
+    unsigned m_workers_done;
+
+    bool m_exit;
+
+    // ------------------------------------------------------------------------
+    void runTasks();
+    // ------------------------------------------------------------------------
+    void workerLoop(unsigned index);
+
+public:
+    ThreadPool(unsigned num_threads);
+    ~ThreadPool();
+    void parallelFor(unsigned count,
+                     const std::function<void(unsigned)>& function);
+    static unsigned getDefaultNumThreads();
+    // ------------------------------------------------------------------------
+    /** Returns the number of threads used, including the calling thread. */
+    unsigned getNumThreads() const { return (unsigned)m_threads.size() + 1; }
+};   // ThreadPool
+
+#endif
@@ -0,0 +1,43 @@
+#!/bin/bash
+#
+# Compares the rewinds of the network AI clients of two STK builds over a
+# link with high latency, e.g. before and after a change to the rewind code.
+# It runs --server-benchmark with the same track, seed and link for each
+# build, and prints the rewinds and the time the clients spent rewinding,
+# as reported by each client in the benchmark result.
+#
+# Usage:
+#     rewind_benchmark.sh old/supertuxkart new/supertuxkart [track] [ai] [ticks] [link]
+#
+# Both builds must support --server-benchmark-link, and the data directory
+# must be found by both (see SUPERTUXKART_DATADIR).
+
+if [ $# -lt 2 ]; then
+    echo "Usage: $0 old/supertuxkart new/supertuxkart [track] [ai] [ticks] [link]"
+    exit 1
+fi
+
+TRACK=${3:-lighthouse}
+AI=${4:-4}
+TICKS=${5:-3600}
+LINK=${6:-latency=200}
+
+RUN=0
+for exe in "$1" "$2"; do
+    RUN=$(($RUN + 1))
+    out="$(pwd)/rewind_benchmark.$RUN.json"
+    rm -f "$out"
+    echo "Running $exe on $TRACK with $AI clients for $TICKS ticks, link $LINK"
+    "$exe" --lan-server=rewind-benchmark --no-graphics --log=0          \
+           --server-benchmark=$TICKS --network-ai=$AI --track=$TRACK     \
+           --seed=1 --server-benchmark-link="$LINK"                      \
+           --server-benchmark-output="$out" > "rewind_benchmark.$RUN.log" 2>&1
+    if [ ! -f "$out" ]; then
+        echo "  No result written, see rewind_benchmark.$RUN.log."
+        continue
+    fi
+    grep -o '"rewinds": [0-9]*, "rewind_ms": [0-9]*' "$out" |
+        sed 's/[^0-9 ]//g' |
+        awk '{ rewinds += $1; ms += $2; print "  client " NR ": " $1 " rewinds, " $2 " ms" }
+             END { if (rewinds > 0) print "  total: " rewinds " rewinds, " ms " ms, " ms / rewinds " ms per rewind" }'
+done